@@ -90,11 +90,43 @@ int main()
 
     // ======================== OPENGL PART STARTS HERE ========================
 
+    // Submit every compile and link first and only query the results afterwards.
+    // Asking for GL_COMPILE_STATUS right after glCompileShader makes the driver
+    // finish that compile before it can start on the next one.
+
     // vertex shader
     unsigned int vertex_shader = 0;
     vertex_shader = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertex_shader, 1, &vertex_shader_source, NULL);
     glCompileShader(vertex_shader);
+
+    // Fragment shader 1
+    unsigned int fragment_shader_1 = 0;
+    fragment_shader_1 = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragment_shader_1, 1, &fragment_shader_source1, NULL);
+    glCompileShader(fragment_shader_1);
+
+    // Fragment shader 2
+    unsigned int fragment_shader_2 = 0;
+    fragment_shader_2 = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragment_shader_2, 1, &fragment_shader_source2, NULL);
+    glCompileShader(fragment_shader_2);
+
+    // Shader Program 1
+    unsigned int shader_program_1 = 0;
+    shader_program_1 = glCreateProgram();
+    glAttachShader(shader_program_1, vertex_shader);
+    glAttachShader(shader_program_1, fragment_shader_1);
+    glLinkProgram(shader_program_1);
+
+    // Shader Program 2
+    unsigned int shader_program_2 = 0;
+    shader_program_2 = glCreateProgram();
+    glAttachShader(shader_program_2, vertex_shader);
+    glAttachShader(shader_program_2, fragment_shader_2);
+    glLinkProgram(shader_program_2);
+
+    // Now check the results
     int shader_compile_result = 0;
     glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &shader_compile_result);
     if (!shader_compile_result)
@@ -102,11 +134,6 @@ int main()
         std::cout << "ERROR: Failed to compile vertex shader." << std::endl;
     }
 
-    // Fragment shader 1
-    unsigned int fragment_shader_1 = 0;
-    fragment_shader_1 = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment_shader_1, 1, &fragment_shader_source1, NULL);
-    glCompileShader(fragment_shader_1);
     shader_compile_result = 0;
     glGetShaderiv(fragment_shader_1, GL_COMPILE_STATUS, &shader_compile_result);
     if (!shader_compile_result)
@@ -114,11 +141,6 @@ int main()
         std::cout << "ERROR: Failed to compile fragment shader 1." << std::endl;
     }
 
-    // Fragment shader 2
-    unsigned int fragment_shader_2 = 0;
-    fragment_shader_2 = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment_shader_2, 1, &fragment_shader_source2, NULL);
-    glCompileShader(fragment_shader_2);
     shader_compile_result = 0;
     glGetShaderiv(fragment_shader_2, GL_COMPILE_STATUS, &shader_compile_result);
     if (!shader_compile_result)
@@ -126,12 +148,6 @@ int main()
         std::cout << "ERROR: Failed to compile fragment shader 2." << std::endl;
     }
 
-    // Shader Program 1
-    unsigned int shader_program_1 = 0;
-    shader_program_1 = glCreateProgram();
-    glAttachShader(shader_program_1, vertex_shader);
-    glAttachShader(shader_program_1, fragment_shader_1);
-    glLinkProgram(shader_program_1);
     int program_link_result = 0;
     glGetProgramiv(shader_program_1, GL_LINK_STATUS, &program_link_result);
     if (!program_link_result)
@@ -139,12 +155,6 @@ int main()
         std::cout << "ERROR: Failed to link shader program 1." << std::endl;
     }
 
-    // Shader Program 2
-    unsigned int shader_program_2 = 0;
-    shader_program_2 = glCreateProgram();
-    glAttachShader(shader_program_2, vertex_shader);
-    glAttachShader(shader_program_2, fragment_shader_2);
-    glLinkProgram(shader_program_2);
     program_link_result = 0;
     glGetProgramiv(shader_program_2, GL_LINK_STATUS, &program_link_result);
     if (!program_link_result)
@@ -173,6 +173,7 @@ int main()
     shader.setInt("texture1", 0);
     shader.setInt("texture2", 1);
 
+    Uniform<glm::mat4> transform = shader.uniform<glm::mat4>("transform");
     glm::mat4 trans1(1.0f);
     glm::mat4 trans2(1.0f);
 
@@ -199,14 +200,14 @@ int main()
         glBindTexture(GL_TEXTURE_2D, textures[1]);
         glBindVertexArray(VAO); // bind the VAO to use. this is bound to the EBO we used earlier.
         
-        glUniformMatrix4fv(glGetUniformLocation(shader.getID(), "transform"), 1, GL_FALSE, glm::value_ptr(trans1));
+        transform.set(trans1);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
         
         trans2 = glm::mat4(1.0f);
         trans2 = glm::translate(trans2, glm::vec3(-0.5f, 0.5f, 1.0f));
         float scale_ratio = sinf((float)glfwGetTime());
         trans2 = glm::scale(trans2, glm::vec3(scale_ratio, scale_ratio, 1.0f));
-        glUniformMatrix4fv(glGetUniformLocation(shader.getID(), "transform"), 1, GL_FALSE, glm::value_ptr(trans2));
+        transform.set(trans2);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
         
         glfwSwapBuffers(window);
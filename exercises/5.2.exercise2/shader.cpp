@@ -1,5 +1,9 @@
 #include "shader.hpp"
 
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+
 Shader::Shader(const char *vertexPath, const char *fragmentPath)
 {
     // * 1. Retrieve the vertex/fragment source code from filepath
@@ -84,6 +88,142 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath)
     // delete shaders. no longer necessary.
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
+
+    // * 3. Enumerate the active uniforms once
+    reflectUniforms();
+}
+
+void Shader::reflectUniforms()
+{
+    uniforms.clear();
+
+    int count = 0;
+    int maxNameLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+    std::string name(maxNameLength, '\0');
+    for (int i = 0; i < count; i++)
+    {
+        int length = 0;
+        int size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(ID, (GLuint)i, maxNameLength, &length, &size, &type, name.data());
+
+        // Uniforms inside a uniform block have no location and can't be set with glUniform*.
+        int location = glGetUniformLocation(ID, name.c_str());
+        if (location < 0)
+            continue;
+
+        // Arrays are reported as "name[0]". Store the plain name.
+        std::string_view plain(name.data(), length);
+        if (plain.ends_with("[0]"))
+            plain.remove_suffix(3);
+
+        UniformSlot slot{};
+        slot.name = plain;
+        slot.location = location;
+        slot.type = type;
+        slot.count = size;
+        slot.hasValue = false;
+        uniforms.push_back(slot);
+    }
+
+    // Keep the table sorted so lookups are a binary search.
+    std::sort(uniforms.begin(), uniforms.end(), [](const UniformSlot &a, const UniformSlot &b)
+              { return a.name < b.name; });
+}
+
+int Shader::findUniform(std::string_view name) const
+{
+    auto it = std::lower_bound(uniforms.begin(), uniforms.end(), name, [](const UniformSlot &slot, std::string_view key)
+                               { return slot.name < key; });
+    if (it == uniforms.end() || it->name != name)
+        return -1;
+    return (int)(it - uniforms.begin());
+}
+
+bool Shader::accepts(GLenum type, bool)
+{
+    return type == GL_BOOL;
+}
+
+bool Shader::accepts(GLenum type, int)
+{
+    switch (type)
+    {
+    case GL_INT:
+    case GL_BOOL:
+    case GL_SAMPLER_1D:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_3D:
+    case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_2D_SHADOW:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool Shader::accepts(GLenum type, float)
+{
+    return type == GL_FLOAT;
+}
+
+bool Shader::accepts(GLenum type, const glm::vec2 &)
+{
+    return type == GL_FLOAT_VEC2;
+}
+
+bool Shader::accepts(GLenum type, const glm::vec3 &)
+{
+    return type == GL_FLOAT_VEC3;
+}
+
+bool Shader::accepts(GLenum type, const glm::vec4 &)
+{
+    return type == GL_FLOAT_VEC4;
+}
+
+bool Shader::accepts(GLenum type, const glm::mat4 &)
+{
+    return type == GL_FLOAT_MAT4;
+}
+
+void Shader::upload(int location, bool value)
+{
+    glUniform1i(location, (int)value);
+}
+
+void Shader::upload(int location, int value)
+{
+    glUniform1i(location, value);
+}
+
+void Shader::upload(int location, float value)
+{
+    glUniform1f(location, value);
+}
+
+void Shader::upload(int location, const glm::vec2 &value)
+{
+    glUniform2fv(location, 1, glm::value_ptr(value));
+}
+
+void Shader::upload(int location, const glm::vec3 &value)
+{
+    glUniform3fv(location, 1, glm::value_ptr(value));
+}
+
+void Shader::upload(int location, const glm::vec4 &value)
+{
+    glUniform4fv(location, 1, glm::value_ptr(value));
+}
+
+void Shader::upload(int location, const glm::mat4 &value)
+{
+    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
 }
 
 void Shader::use()
@@ -91,23 +231,24 @@ void Shader::use()
     glUseProgram(ID);
 }
 
-void Shader::setBool(const std::string& name, bool value) const
+void Shader::setBool(std::string_view name, bool value)
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    uniform<bool>(name).set(value);
 }
 
-void Shader::setInt(const std::string& name, int value) const
+void Shader::setInt(std::string_view name, int value)
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    uniform<int>(name).set(value);
 }
 
-void Shader::setFloat(const std::string& name, float value) const
+void Shader::setFloat(std::string_view name, float value)
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    uniform<float>(name).set(value);
 }
 
 void Shader::destroy()
 {
     glDeleteProgram(ID);
+    ID = 0;
 }
 
@@ -1,25 +1,115 @@
 #pragma once
 
 #include <glad/glad.h>
+#include <glm/glm.hpp>
 
 #include <string>
+#include <string_view>
+#include <vector>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
+class Shader;
+
+// Typed handle to one active uniform of a Shader. Handles are cheap to copy and
+// are resolved once (usually before the render loop), so setting a value never
+// calls glGetUniformLocation. Setting the value that was uploaded last is a no-op.
+// A handle to a uniform that does not exist (or was optimized out) is invalid and
+// set() does nothing, mirroring glUniform* with location -1.
+template <typename T>
+class Uniform
+{
+private:
+    Shader *shader = nullptr;
+    int index = -1;
+
+    friend class Shader;
+
+public:
+    Uniform() = default;
+
+    // The owning program must be bound (shader.use()) when calling set().
+    void set(const T &value) const;
+
+    bool valid() const
+    {
+        return shader != nullptr;
+    }
+};
+
 class Shader
 {
 private:
+    // One entry per active uniform, filled once after linking.
+    struct UniformSlot
+    {
+        std::string name;
+        int location;
+        GLenum type;
+        int count;
+
+        // Shadow copy of the last value uploaded through this slot.
+        bool hasValue;
+        alignas(16) unsigned char value[sizeof(glm::mat4)];
+    };
+
     unsigned int ID;
+    std::vector<UniformSlot> uniforms;
+
+    void reflectUniforms();
+    int findUniform(std::string_view name) const;
+
+    // Returns true if value differs from the shadowed one (and updates the shadow).
+    template <typename T>
+    bool shadow(int index, const T &value)
+    {
+        UniformSlot &slot = uniforms[index];
+        if (slot.hasValue && std::memcmp(slot.value, &value, sizeof(T)) == 0)
+            return false;
+        std::memcpy(slot.value, &value, sizeof(T));
+        slot.hasValue = true;
+        return true;
+    }
+
+    static bool accepts(GLenum type, bool);
+    static bool accepts(GLenum type, int);
+    static bool accepts(GLenum type, float);
+    static bool accepts(GLenum type, const glm::vec2 &);
+    static bool accepts(GLenum type, const glm::vec3 &);
+    static bool accepts(GLenum type, const glm::vec4 &);
+    static bool accepts(GLenum type, const glm::mat4 &);
+
+    static void upload(int location, bool value);
+    static void upload(int location, int value);
+    static void upload(int location, float value);
+    static void upload(int location, const glm::vec2 &value);
+    static void upload(int location, const glm::vec3 &value);
+    static void upload(int location, const glm::vec4 &value);
+    static void upload(int location, const glm::mat4 &value);
+
+    template <typename T>
+    friend class Uniform;
 
 public:
     Shader(const char *vertexPath, const char *fragmentPath);
 
+    // Uniform handles point at the Shader, so it stays where it is.
+    Shader(const Shader &) = delete;
+    Shader &operator=(const Shader &) = delete;
+
     void use();
 
-    void setBool(const std::string &name, bool value) const;
-    void setInt(const std::string &name, int value) const;
-    void setFloat(const std::string &name, float value) const;
+    // Resolve a uniform by name. Call this once, outside the render loop.
+    template <typename T>
+    Uniform<T> uniform(std::string_view name);
+
+    // Convenience setters. These look the name up in the reflected table on
+    // every call, so prefer a Uniform<T> handle inside the render loop.
+    void setBool(std::string_view name, bool value);
+    void setInt(std::string_view name, int value);
+    void setFloat(std::string_view name, float value);
 
     void destroy();
 
@@ -28,3 +118,29 @@ public:
         return ID;
     }
 };
+
+template <typename T>
+void Uniform<T>::set(const T &value) const
+{
+    if (shader != nullptr && shader->shadow(index, value))
+        Shader::upload(shader->uniforms[index].location, value);
+}
+
+template <typename T>
+Uniform<T> Shader::uniform(std::string_view name)
+{
+    Uniform<T> handle;
+    int index = findUniform(name);
+    if (index < 0)
+        return handle;
+
+    if (!accepts(uniforms[index].type, T{}))
+    {
+        std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH " << name << std::endl;
+        return handle;
+    }
+
+    handle.shader = this;
+    handle.index = index;
+    return handle;
+}
@@ -0,0 +1,68 @@
+#include "counted_allocation.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// The replacement operators live in their own translation unit so that they
+// are never inlined next to a std::allocator call: the compiler would then see
+// free() on a pointer from operator new and warn about the mismatch.
+namespace
+{
+    std::atomic<std::uint64_t> allocations{0};
+}
+
+void *countedMalloc(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size);
+}
+
+void *countedRealloc(void *pointer, std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::realloc(pointer, size);
+}
+
+void countedFree(void *pointer)
+{
+    std::free(pointer);
+}
+
+std::uint64_t allocationCount()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void *operator new(std::size_t size)
+{
+    void *pointer = countedMalloc(size != 0 ? size : 1);
+    if (pointer == nullptr)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    countedFree(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    countedFree(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    countedFree(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t) noexcept
+{
+    countedFree(pointer);
+}
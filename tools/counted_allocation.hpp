@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Heap allocation counting for the benchmarks. Linking counted_allocation.cpp
+// replaces the global operator new and delete, so every C++ allocation in the
+// program is counted; C code is counted only where it is pointed at these
+// hooks (stb's STBI_MALLOC and friends). Allocations made with plain malloc,
+// e.g. inside libjpeg-turbo and libspng, are not seen.
+void *countedMalloc(std::size_t size);
+void *countedRealloc(void *pointer, std::size_t size);
+void countedFree(void *pointer);
+
+// Allocations since the program started.
+std::uint64_t allocationCount();
@@ -0,0 +1,460 @@
+// Measures image decoding: MPix/s, peak resident memory and heap allocations
+// per decode for every backend that can read an input, on one thread and on
+// several at once. Inputs are the files given (resources/textures/* by
+// default) plus a generated corpus of large JPEG, PNG and baked images.
+//
+// Backends: stb_image always; libjpeg-turbo and libspng when they were found
+// at configure time (LO_HAVE_TURBOJPEG, LO_HAVE_SPNG); and the baked format,
+// which maps a .ltex file and reads its pages, as the TextureLoader does. Each
+// input is baked (uncompressed, level 0 only) to a temporary directory first.
+//
+// usage: decode_benchmark [--seconds=S] [--threads=N] [--size=N] [--csv=FILE]
+//                         [--json=FILE] [IMAGE...]
+
+#include <glad/glad.h>
+
+#include "baked_texture.hpp"
+#include "counted_allocation.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// * Allocation counting
+// counted_allocation.cpp counts every operator new; stb is pointed at the same
+// hooks so its buffers are counted too.
+#define STBI_MALLOC(size) countedMalloc(size)
+#define STBI_REALLOC(pointer, size) countedRealloc(pointer, size)
+#define STBI_FREE(pointer) countedFree(pointer)
+#define STBIW_MALLOC(size) countedMalloc(size)
+#define STBIW_REALLOC(pointer, size) countedRealloc(pointer, size)
+#define STBIW_FREE(pointer) countedFree(pointer)
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#ifdef LO_HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+#ifdef LO_HAVE_SPNG
+#include <spng.h>
+#endif
+
+namespace
+{
+    enum class Container
+    {
+        Jpeg,
+        Png,
+        Other
+    };
+
+    struct Input
+    {
+        std::string name;
+        Container container;
+        std::vector<unsigned char> bytes; // the encoded file
+        std::filesystem::path baked; // the same image as .ltex
+        int width;
+        int height;
+    };
+
+    struct Backend
+    {
+        const char *name;
+        bool (*accepts)(const Input &input);
+        // Decodes to 8-bit pixels and frees them again. Returns false on failure.
+        bool (*decode)(const Input &input);
+    };
+
+    struct Result
+    {
+        std::string input;
+        std::string backend;
+        unsigned int threads;
+        double megapixelsPerSecond;
+        double peakRssMiB;
+        double allocationsPerDecode;
+    };
+
+    // * Peak resident memory
+    // On Linux the high-water mark can be reset, so every run gets its own
+    // peak. Elsewhere it only grows, and runs after the largest one repeat it.
+    void resetPeakRss()
+    {
+#ifdef __linux__
+        std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+    }
+
+    double peakRssMiB()
+    {
+#if defined(__linux__)
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line))
+            if (line.rfind("VmHWM:", 0) == 0)
+                return std::stod(line.substr(std::strlen("VmHWM:"))) / 1024.0; // kB
+        return 0.0;
+#elif defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+        return (double)counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return (double)usage.ru_maxrss / (1024.0 * 1024.0); // bytes on macOS
+#endif
+    }
+
+    // * Backends
+    // Every input was read with stb in the first place.
+    bool stbAccepts(const Input &)
+    {
+        return true;
+    }
+
+    bool stbDecode(const Input &input)
+    {
+        int width, height, channels;
+        stbi_uc *pixels = stbi_load_from_memory(input.bytes.data(), (int)input.bytes.size(), &width, &height, &channels, 0);
+        stbi_image_free(pixels);
+        return pixels != nullptr;
+    }
+
+#ifdef LO_HAVE_TURBOJPEG
+    bool turboAccepts(const Input &input)
+    {
+        return input.container == Container::Jpeg;
+    }
+
+    bool turboDecode(const Input &input)
+    {
+        // One decompressor per thread, like a decoder owned by a worker.
+        thread_local tjhandle decompressor = tjInitDecompress();
+        int width, height, subsampling, colorspace;
+        if (tjDecompressHeader3(decompressor, input.bytes.data(), (unsigned long)input.bytes.size(), &width, &height, &subsampling,
+                                &colorspace) != 0)
+            return false;
+        std::vector<unsigned char> pixels((std::size_t)width * height * 3);
+        return tjDecompress2(decompressor, input.bytes.data(), (unsigned long)input.bytes.size(), pixels.data(), width, 0, height,
+                             TJPF_RGB, TJFLAG_FASTDCT) == 0;
+    }
+#endif
+
+#ifdef LO_HAVE_SPNG
+    bool spngAccepts(const Input &input)
+    {
+        return input.container == Container::Png;
+    }
+
+    bool spngDecode(const Input &input)
+    {
+        spng_ctx *context = spng_ctx_new(0);
+        std::size_t size = 0;
+        bool decoded = spng_set_png_buffer(context, input.bytes.data(), input.bytes.size()) == 0 &&
+                       spng_decoded_image_size(context, SPNG_FMT_RGBA8, &size) == 0;
+        if (decoded)
+        {
+            std::vector<unsigned char> pixels(size);
+            decoded = spng_decode_image(context, pixels.data(), size, SPNG_FMT_RGBA8, 0) == 0;
+        }
+        spng_ctx_free(context);
+        return decoded;
+    }
+#endif
+
+    bool bakedAccepts(const Input &input)
+    {
+        return !input.baked.empty();
+    }
+
+    bool bakedDecode(const Input &input)
+    {
+        // Nothing to decode: map, validate and fault the pages in. The page
+        // cache is warm after the first run, as it is for a game's assets.
+        BakedTexture baked;
+        if (!baked.open(input.baked.string()))
+            return false;
+        baked.touch();
+        return true;
+    }
+
+    const Backend BACKENDS[] = {
+        {"stb", stbAccepts, stbDecode},
+#ifdef LO_HAVE_TURBOJPEG
+        {"turbojpeg", turboAccepts, turboDecode},
+#endif
+#ifdef LO_HAVE_SPNG
+        {"spng", spngAccepts, spngDecode},
+#endif
+        {"baked", bakedAccepts, bakedDecode},
+    };
+
+    // * Inputs
+    Container containerOf(const std::vector<unsigned char> &bytes)
+    {
+        if (bytes.size() >= 3 && bytes[0] == 0xFF && bytes[1] == 0xD8 && bytes[2] == 0xFF)
+            return Container::Jpeg;
+        if (bytes.size() >= 8 && std::memcmp(bytes.data(), "\x89PNG\r\n\x1a\n", 8) == 0)
+            return Container::Png;
+        return Container::Other;
+    }
+
+    // Bake level 0 of the image, uncompressed, so the baked backend reads the same pixels.
+    bool bake(Input &input, const unsigned char *pixels, int channels, const std::filesystem::path &directory)
+    {
+        static const GLenum internalFormats[] = {GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+        static const GLenum formats[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+        std::vector<BakedImageLevel> levels(1);
+        levels[0] = {input.width, input.height, std::vector<unsigned char>(pixels, pixels + (std::size_t)input.width * input.height * channels)};
+
+        input.baked = directory / (std::filesystem::path(input.name).stem().string() + BAKED_TEXTURE_EXTENSION);
+        return writeBakedTexture(input.baked.string(), internalFormats[channels - 1], formats[channels - 1], GL_UNSIGNED_BYTE, channels, levels);
+    }
+
+    bool readInput(const std::filesystem::path &path, const std::filesystem::path &directory, Input &input)
+    {
+        std::ifstream file(path, std::ios::binary);
+        input = {path.filename().string(), Container::Other, {}, {}, 0, 0};
+        input.bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        input.container = containerOf(input.bytes);
+
+        int channels;
+        stbi_uc *pixels = stbi_load_from_memory(input.bytes.data(), (int)input.bytes.size(), &input.width, &input.height, &channels, 0);
+        if (pixels == nullptr)
+        {
+            std::cerr << "ERROR::DECODE_BENCHMARK::STBI_DATA_EMPTY " << path.string() << " (" << stbi_failure_reason() << ")" << std::endl;
+            return false;
+        }
+        bool baked = bake(input, pixels, channels, directory);
+        stbi_image_free(pixels);
+        return baked;
+    }
+
+    void appendBytes(void *context, void *data, int size)
+    {
+        std::vector<unsigned char> &bytes = *(std::vector<unsigned char> *)context;
+        bytes.insert(bytes.end(), (unsigned char *)data, (unsigned char *)data + size);
+    }
+
+    // Photo-like content: gradients with noise, which is what JPEG is for, and
+    // a flat-shaded cut-out with alpha, which is what PNG is for.
+    std::vector<Input> generateCorpus(int size, const std::filesystem::path &directory)
+    {
+        std::vector<unsigned char> rgb((std::size_t)size * size * 3), rgba((std::size_t)size * size * 4);
+        std::uint32_t random = 12345;
+        for (int y = 0; y < size; y++)
+        {
+            for (int x = 0; x < size; x++)
+            {
+                random = random * 1664525u + 1013904223u;
+                int noise = (int)(random >> 28) - 8;
+                std::size_t pixel = (std::size_t)y * size + x;
+                rgb[pixel * 3 + 0] = (unsigned char)std::clamp(x * 255 / size + noise, 0, 255);
+                rgb[pixel * 3 + 1] = (unsigned char)std::clamp(y * 255 / size + noise, 0, 255);
+                rgb[pixel * 3 + 2] = (unsigned char)std::clamp((int)(127.5 + 100.0 * std::sin((x + y) * 0.01)) + noise, 0, 255);
+
+                double dx = x - size / 2.0, dy = y - size / 2.0;
+                bool inside = dx * dx + dy * dy < size * size / 5.0;
+                bool stripe = (x / (size / 16)) % 2 == 0;
+                rgba[pixel * 4 + 0] = stripe ? 230 : 40;
+                rgba[pixel * 4 + 1] = 180;
+                rgba[pixel * 4 + 2] = stripe ? 20 : 200;
+                rgba[pixel * 4 + 3] = inside ? 255 : 0;
+            }
+        }
+
+        std::string suffix = std::to_string(size) + "x" + std::to_string(size);
+        std::vector<Input> corpus(2);
+        corpus[0] = {"generated_" + suffix + ".jpg", Container::Jpeg, {}, {}, size, size};
+        stbi_write_jpg_to_func(appendBytes, &corpus[0].bytes, size, size, 3, rgb.data(), 90);
+        bake(corpus[0], rgb.data(), 3, directory);
+
+        corpus[1] = {"generated_" + suffix + ".png", Container::Png, {}, {}, size, size};
+        stbi_write_png_to_func(appendBytes, &corpus[1].bytes, size, size, 4, rgba.data(), size * 4);
+        bake(corpus[1], rgba.data(), 4, directory);
+        return corpus;
+    }
+
+    // * Measuring
+    // Every thread decodes the input over and over for about `seconds`.
+    Result measure(const Input &input, const Backend &backend, unsigned int threadCount, double seconds)
+    {
+        using Clock = std::chrono::steady_clock;
+        backend.decode(input); // warm up caches and per-thread state
+
+        resetPeakRss();
+        std::uint64_t allocationsBefore = allocationCount();
+        std::atomic<std::uint64_t> decodes{0};
+        std::atomic<bool> failed{false};
+        Clock::time_point start = Clock::now();
+        Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+
+        auto work = [&]
+        {
+            std::uint64_t done = 0;
+            do
+            {
+                if (!backend.decode(input))
+                    failed = true;
+                done++;
+            } while (Clock::now() < end);
+            decodes += done;
+        };
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < threadCount; i++)
+            threads.emplace_back(work);
+        work();
+        for (std::thread &thread : threads)
+            thread.join();
+
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+        // The threads themselves allocate a few times; that's noise next to the decodes.
+        double allocationsPerDecode = (double)(allocationCount() - allocationsBefore) / (double)decodes;
+        if (failed)
+            std::cerr << "ERROR::DECODE_BENCHMARK::DECODE_FAILED " << backend.name << " " << input.name << std::endl;
+
+        double pixels = (double)input.width * input.height * (double)decodes;
+        return {input.name, backend.name, threadCount, pixels / elapsed.count() / 1e6, peakRssMiB(), allocationsPerDecode};
+    }
+
+    void writeCsv(const std::string &path, const std::vector<Result> &results)
+    {
+        std::ofstream file(path);
+        file << "input,backend,threads,mpix_per_s,peak_rss_mib,allocations_per_decode\n";
+        for (const Result &result : results)
+            file << result.input << "," << result.backend << "," << result.threads << "," << result.megapixelsPerSecond << ","
+                 << result.peakRssMiB << "," << result.allocationsPerDecode << "\n";
+        if (!file)
+            std::cerr << "ERROR::DECODE_BENCHMARK::CANNOT_WRITE " << path << std::endl;
+    }
+
+    void writeJson(const std::string &path, const std::vector<Result> &results)
+    {
+        // File names are the only strings; they don't need escaping beyond quotes and backslashes.
+        auto quoted = [](const std::string &text)
+        {
+            std::string escaped = "\"";
+            for (char c : text)
+            {
+                if (c == '"' || c == '\\')
+                    escaped += '\\';
+                escaped += c;
+            }
+            return escaped + "\"";
+        };
+
+        std::ofstream file(path);
+        file << "[\n";
+        for (std::size_t i = 0; i < results.size(); i++)
+        {
+            const Result &result = results[i];
+            file << "  {\"input\": " << quoted(result.input) << ", \"backend\": " << quoted(result.backend)
+                 << ", \"threads\": " << result.threads << ", \"mpix_per_s\": " << result.megapixelsPerSecond
+                 << ", \"peak_rss_mib\": " << result.peakRssMiB << ", \"allocations_per_decode\": " << result.allocationsPerDecode
+                 << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        file << "]\n";
+        if (!file)
+            std::cerr << "ERROR::DECODE_BENCHMARK::CANNOT_WRITE " << path << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 0.5;
+    unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    int corpusSize = 4096;
+    std::string csvPath, jsonPath;
+    std::vector<std::filesystem::path> paths;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument.rfind("--seconds=", 0) == 0)
+            seconds = std::stod(argument.substr(std::strlen("--seconds=")));
+        else if (argument.rfind("--threads=", 0) == 0)
+            threadCount = (unsigned int)std::max(1, std::stoi(argument.substr(std::strlen("--threads="))));
+        else if (argument.rfind("--size=", 0) == 0)
+            corpusSize = std::max(16, std::stoi(argument.substr(std::strlen("--size="))));
+        else if (argument.rfind("--csv=", 0) == 0)
+            csvPath = argument.substr(std::strlen("--csv="));
+        else if (argument.rfind("--json=", 0) == 0)
+            jsonPath = argument.substr(std::strlen("--json="));
+        else
+            paths.push_back(argument);
+    }
+
+    std::error_code error;
+    if (paths.empty())
+        for (const auto &entry : std::filesystem::directory_iterator("resources/textures", error))
+            paths.push_back(entry.path());
+
+    // * 1. Read the inputs and bake each one
+    std::string stamp = std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / ("decode_benchmark_" + stamp);
+    std::filesystem::create_directories(directory);
+
+    std::vector<Input> inputs;
+    for (const std::filesystem::path &path : paths)
+    {
+        Input input;
+        if (readInput(path, directory, input))
+            inputs.push_back(std::move(input));
+    }
+    for (Input &input : generateCorpus(corpusSize, directory))
+        inputs.push_back(std::move(input));
+
+    // * 2. Run every backend on every input it reads, on one thread and on all of them
+    std::vector<unsigned int> threadCounts = {1};
+    if (threadCount > 1)
+        threadCounts.push_back(threadCount);
+
+    std::vector<Result> results;
+    std::printf("%-28s %-10s %8s %12s %14s %14s\n", "input", "backend", "threads", "MPix/s", "peak RSS MiB", "allocs/decode");
+    for (const Input &input : inputs)
+    {
+        for (const Backend &backend : BACKENDS)
+        {
+            if (!backend.accepts(input))
+                continue;
+            for (unsigned int threads : threadCounts)
+            {
+                Result result = measure(input, backend, threads, seconds);
+                std::printf("%-28s %-10s %8u %12.2f %14.1f %14.1f\n", result.input.c_str(), result.backend.c_str(), result.threads,
+                            result.megapixelsPerSecond, result.peakRssMiB, result.allocationsPerDecode);
+                results.push_back(result);
+            }
+        }
+    }
+
+    // * 3. Write the results for tracking
+    if (!csvPath.empty())
+        writeCsv(csvPath, results);
+    if (!jsonPath.empty())
+        writeJson(jsonPath, results);
+
+    std::filesystem::remove_all(directory, error);
+    return 0;
+}
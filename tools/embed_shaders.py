@@ -0,0 +1,230 @@
+"""Validate shader stages with glslang and embed them into a C++ header.
+
+Every *.vs.glsl / *.fs.glsl file passed on the command line is expanded the same
+way ShaderSourceCache does it at runtime (#include "file" relative to the
+including file, each file pasted once, #line directives after each include),
+checked with glslangValidator, and written out as a constexpr byte array
+together with its FNV-1a hash. Any validation error fails the build.
+
+Stages that declare `#pragma variant KEYWORD ...` are validated in every
+combination of their keywords, with the #defines inserted after #version the
+way ShaderVariants does it, so any variant a mask can select has been checked.
+
+"""
+
+import argparse
+import itertools
+import os
+import re
+import subprocess
+import sys
+
+FNV_OFFSET = 0xCBF29CE484222325
+FNV_PRIME = 0x100000001B3
+
+STAGES = {
+    ".vs.glsl": "vert",
+    ".fs.glsl": "frag",
+}
+
+
+def fnv1a(data, value=FNV_OFFSET):
+    for byte in data:
+        value ^= byte
+        value = (value * FNV_PRIME) & 0xFFFFFFFFFFFFFFFF
+    return value
+
+
+class Expander:
+    def __init__(self):
+        self.cache = {}
+
+    def load(self, path, stack):
+        if path not in self.cache:
+            self.cache[path] = self.expand(path, stack)
+        return self.cache[path]
+
+    def expand(self, path, stack):
+        with open(path, "rb") as f:
+            text = f.read()
+
+        directory = os.path.dirname(path)
+        stack = stack + [path]
+        dependencies = [path]
+        pieces = []
+
+        chunk_start = 0
+        line_start = 0
+        line = 1
+        while line_start < len(text):
+            line_end = text.find(b"\n", line_start)
+            next_line = len(text) if line_end < 0 else line_end + 1
+            current = text[line_start:next_line]
+
+            if current.lstrip(b" \t").startswith(b"#include"):
+                match = re.search(rb'"([^"]*)"', current)
+                if not match:
+                    raise SystemExit(f"{path}:{line}: malformed #include")
+
+                include = os.path.realpath(os.path.join(directory, match.group(1).decode()))
+                pieces.append(text[chunk_start:line_start])
+                chunk_start = next_line
+
+                if include in stack:
+                    raise SystemExit(f"{path}:{line}: #include cycle through {include}")
+
+                if include not in dependencies:
+                    included, included_dependencies = self.load(include, stack)
+                    pieces.append(included)
+                    for dependency in included_dependencies:
+                        if dependency not in dependencies:
+                            dependencies.append(dependency)
+
+                pieces.append(f"\n#line {line + 1}\n".encode())
+
+            line_start = next_line
+            line += 1
+
+        pieces.append(text[chunk_start:])
+        return b"".join(pieces), dependencies
+
+
+def stage_of(path):
+    for suffix, stage in STAGES.items():
+        if path.endswith(suffix):
+            return stage
+    return None
+
+
+def symbol_of(relative):
+    return re.sub(r"[^0-9A-Za-z]", "_", relative)
+
+
+def is_directive(line, name):
+    """Returns what follows the directive name, or None if line isn't that directive."""
+    line = line.lstrip(b" \t")
+    if not line.startswith(name):
+        return None
+    rest = line[len(name):]
+    if rest and rest[:1] not in b" \t\r\n":
+        return None  # a longer word that starts with name
+    return rest
+
+
+def variant_keywords(source):
+    """Keywords declared with #pragma variant, in order of first appearance."""
+    keywords = []
+    for line in source.split(b"\n"):
+        pragma = is_directive(line, b"#pragma")
+        names = None if pragma is None else is_directive(pragma, b"variant")
+        if names is None:
+            continue
+        for name in names.split():
+            if name.decode() not in keywords:
+                keywords.append(name.decode())
+    return keywords
+
+
+def with_defines(source, keywords):
+    """Mirrors ShaderVariants::variantText."""
+    insert_at = 0
+    next_line = 1
+    offset = 0
+    for number, line in enumerate(source.split(b"\n"), 1):
+        offset += len(line) + 1
+        if is_directive(line, b"#version") is not None:
+            insert_at = min(offset, len(source))
+            next_line = number + 1
+            break
+
+    defines = "".join(f"#define {keyword}\n" for keyword in keywords)
+    defines = (defines + f"#line {next_line}\n").encode()
+    if insert_at > 0 and source[insert_at - 1:insert_at] != b"\n":
+        defines = b"\n" + defines
+    return source[:insert_at] + defines + source[insert_at:]
+
+
+def validate(validator, source, stage, name, scratch):
+    scratch_path = os.path.join(scratch, symbol_of(name) + "." + stage)
+    with open(scratch_path, "wb") as f:
+        f.write(source)
+
+    result = subprocess.run([validator, scratch_path], capture_output=True, text=True)
+    if result.returncode != 0:
+        sys.stderr.write(f"ERROR::SHADER::VALIDATION_FAILED {name}\n{result.stdout}{result.stderr}")
+        return False
+    return True
+
+
+def byte_lines(data, per_line=16):
+    values = list(data) + [0]
+    for i in range(0, len(values), per_line):
+        yield "    " + ", ".join(f"'\\x{b:02x}'" for b in values[i:i + per_line]) + ","
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--root", required=True, help="paths in the header are relative to this directory")
+    parser.add_argument("--output", required=True, help="header to write")
+    parser.add_argument("--validator", required=True, help="glslangValidator executable")
+    parser.add_argument("shaders", nargs="+")
+    args = parser.parse_args()
+
+    root = os.path.realpath(args.root)
+    output_dir = os.path.dirname(os.path.realpath(args.output))
+    scratch = os.path.join(output_dir, "validate")
+    os.makedirs(scratch, exist_ok=True)
+
+    expander = Expander()
+    entries = []
+    ok = True
+    for shader in sorted(args.shaders):
+        path = os.path.realpath(shader)
+        stage = stage_of(path)
+        if stage is None:
+            continue  # include-only file, pasted into the stages that use it
+
+        relative = os.path.relpath(path, root).replace(os.sep, "/")
+        source, _ = expander.load(path, [])
+        keywords = variant_keywords(source)
+        for count in range(len(keywords) + 1):
+            for combination in itertools.combinations(keywords, count):
+                name = "#".join((relative,) + combination)
+                if not validate(args.validator, with_defines(source, combination), stage, name, scratch):
+                    ok = False
+        entries.append((relative, source))
+
+    if not ok:
+        return 1
+
+    out = [
+        "// Generated by tools/embed_shaders.py. Do not edit.",
+        "#pragma once",
+        "",
+        '#include "embedded_shader.hpp"',
+        "",
+        "namespace embedded_shaders",
+        "{",
+    ]
+    for relative, source in entries:
+        symbol = symbol_of(relative)
+        out.append(f"    // {relative}")
+        out.append(f"    inline constexpr char {symbol}_source[] = {{")
+        out.extend("    " + line for line in byte_lines(source))
+        out.append("    };")
+        out.append(f"    inline constexpr EmbeddedShader {symbol} = {{")
+        out.append(f'        "{relative}", {symbol}_source, {len(source)}, 0x{fnv1a(source):016x}ull}};')
+        out.append("")
+    out.append("    inline constexpr const EmbeddedShader *ALL[] = {")
+    for relative, _ in entries:
+        out.append(f"        &{symbol_of(relative)},")
+    out.append("    };")
+    out.append("}")
+
+    with open(args.output, "w") as f:
+        f.write("\n".join(out) + "\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
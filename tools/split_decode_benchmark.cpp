@@ -0,0 +1,234 @@
+// Measures how decoding one large image scales with cores: decodeImage (see
+// parallel_decode.hpp) on 1, 2, 4, ... threads, against stb_image on one, in
+// milliseconds per decode and speedup. Inputs are the files given plus a
+// generated JPEG and PNG. stb writes JPEGs without restart markers, so the
+// generated one gets one per MCU row from addJpegRestartMarkers; the files
+// given are used as they are, and show whether they split at all.
+//
+// Inflating can't be split, so PNG speedups level off at the share of the
+// time that goes to unfiltering.
+//
+// usage: split_decode_benchmark [--seconds=S] [--threads=N] [--size=N] [--csv=FILE] [IMAGE...]
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include "parallel_decode.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct Input
+    {
+        std::string name;
+        std::vector<unsigned char> bytes;
+    };
+
+    struct Result
+    {
+        std::string input;
+        std::string decoder;
+        unsigned int threads;
+        double milliseconds;
+        double megapixelsPerSecond;
+        double speedup; // over the same decoder on one thread
+    };
+
+    void appendBytes(void *context, void *data, int size)
+    {
+        std::vector<unsigned char> &bytes = *(std::vector<unsigned char> *)context;
+        bytes.insert(bytes.end(), (unsigned char *)data, (unsigned char *)data + size);
+    }
+
+    // Gradients with noise, like a photo.
+    std::vector<Input> generateCorpus(int size)
+    {
+        std::vector<unsigned char> rgb((std::size_t)size * size * 3);
+        std::uint32_t random = 12345;
+        for (int y = 0; y < size; y++)
+        {
+            for (int x = 0; x < size; x++)
+            {
+                random = random * 1664525u + 1013904223u;
+                int noise = (int)(random >> 28) - 8;
+                unsigned char *pixel = &rgb[((std::size_t)y * size + x) * 3];
+                pixel[0] = (unsigned char)std::clamp(x * 255 / size + noise, 0, 255);
+                pixel[1] = (unsigned char)std::clamp(y * 255 / size + noise, 0, 255);
+                pixel[2] = (unsigned char)std::clamp((int)(127.5 + 100.0 * std::sin((x + y) * 0.01)) + noise, 0, 255);
+            }
+        }
+
+        std::string suffix = std::to_string(size) + "x" + std::to_string(size);
+        std::vector<Input> corpus(2);
+        std::vector<unsigned char> jpeg;
+        stbi_write_jpg_to_func(appendBytes, &jpeg, size, size, 3, rgb.data(), 90);
+        corpus[0] = {"generated_" + suffix + "_rst.jpg", addJpegRestartMarkers(jpeg.data(), jpeg.size())};
+        if (corpus[0].bytes.empty())
+            std::cerr << "ERROR::SPLIT_DECODE_BENCHMARK::RESTART_MARKERS_FAILED " << corpus[0].name << std::endl;
+
+        corpus[1] = {"generated_" + suffix + ".png", {}};
+        stbi_write_png_to_func(appendBytes, &corpus[1].bytes, size, size, 3, rgb.data(), size * 3);
+        return corpus;
+    }
+
+    // Decodes over and over for about `seconds`; returns milliseconds per decode.
+    double measure(const std::function<unsigned char *()> &decode, double seconds)
+    {
+        using Clock = std::chrono::steady_clock;
+        stbi_image_free(decode()); // warm up caches and the pool
+
+        int decodes = 0;
+        Clock::time_point start = Clock::now();
+        std::chrono::duration<double> elapsed;
+        do
+        {
+            stbi_image_free(decode());
+            decodes++;
+            elapsed = Clock::now() - start;
+        } while (elapsed.count() < seconds);
+        return elapsed.count() * 1000.0 / decodes;
+    }
+
+    void writeCsv(const std::string &path, const std::vector<Result> &results)
+    {
+        std::ofstream file(path);
+        file << "input,decoder,threads,ms_per_decode,mpix_per_s,speedup\n";
+        for (const Result &result : results)
+            file << result.input << "," << result.decoder << "," << result.threads << "," << result.milliseconds << ","
+                 << result.megapixelsPerSecond << "," << result.speedup << "\n";
+        if (!file)
+            std::cerr << "ERROR::SPLIT_DECODE_BENCHMARK::CANNOT_WRITE " << path << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 1.0;
+    unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    int corpusSize = 8192;
+    std::string csvPath;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument.rfind("--seconds=", 0) == 0)
+            seconds = std::stod(argument.substr(std::strlen("--seconds=")));
+        else if (argument.rfind("--threads=", 0) == 0)
+            threadCount = (unsigned int)std::max(1, std::stoi(argument.substr(std::strlen("--threads="))));
+        else if (argument.rfind("--size=", 0) == 0)
+            corpusSize = std::max(16, std::stoi(argument.substr(std::strlen("--size="))));
+        else if (argument.rfind("--csv=", 0) == 0)
+            csvPath = argument.substr(std::strlen("--csv="));
+        else
+            paths.push_back(argument);
+    }
+
+    // * 1. Inputs
+    std::vector<Input> inputs;
+    for (const std::string &path : paths)
+    {
+        std::ifstream file(path, std::ios::binary);
+        Input input{path, {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()}};
+        if (input.bytes.empty())
+            std::cerr << "ERROR::SPLIT_DECODE_BENCHMARK::CANNOT_READ " << path << std::endl;
+        else
+            inputs.push_back(std::move(input));
+    }
+    for (Input &input : generateCorpus(corpusSize))
+        inputs.push_back(std::move(input));
+
+    // 1, 2, 4, ... threads, and all of them.
+    std::vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < threadCount; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(threadCount);
+
+    // * 2. stb on one thread, then the split decoder on more and more
+    std::vector<Result> results;
+    std::printf("%-32s %-13s %8s %12s %10s %9s %9s\n", "input", "decoder", "threads", "ms/decode", "MPix/s", "speedup", "vs stb");
+    for (const Input &input : inputs)
+    {
+        const unsigned char *bytes = input.bytes.data();
+        int width = 0, height = 0, channels = 0;
+        unsigned char *reference = stbi_load_from_memory(bytes, (int)input.bytes.size(), &width, &height, &channels, 0);
+        if (reference == nullptr)
+        {
+            std::cerr << "ERROR::SPLIT_DECODE_BENCHMARK::STBI_DATA_EMPTY " << input.name << " (" << stbi_failure_reason() << ")" << std::endl;
+            continue;
+        }
+        double megapixels = (double)width * height / 1e6;
+
+        double stbMilliseconds = measure([&]
+                                         {
+            int w, h, c;
+            return stbi_load_from_memory(bytes, (int)input.bytes.size(), &w, &h, &c, 0); }, seconds);
+        results.push_back({input.name, "stb", 1, stbMilliseconds, megapixels * 1000.0 / stbMilliseconds, 1.0});
+        std::printf("%-32s %-13s %8u %12.1f %10.1f %9.2f %9.2f\n", input.name.c_str(), "stb", 1u, stbMilliseconds,
+                    megapixels * 1000.0 / stbMilliseconds, 1.0, 1.0);
+
+        // Which decoder takes the image, and how far its pixels are from stb's.
+        DecodePath path;
+        int w, h, c;
+        unsigned char *pixels = decodeImage(bytes, input.bytes.size(), &w, &h, &c, nullptr, &path);
+        if (path == DecodePath::Stb)
+        {
+            std::printf("%-32s not split (too small, or no restart markers, interlaced, ...)\n", input.name.c_str());
+            stbi_image_free(pixels);
+            stbi_image_free(reference);
+            continue;
+        }
+        int difference = 0;
+        if (pixels != nullptr && w == width && h == height && c == channels)
+        {
+            for (std::size_t i = 0; i < (std::size_t)width * height * channels; i++)
+                difference = std::max(difference, std::abs(pixels[i] - reference[i]));
+        }
+        else
+        {
+            difference = 255;
+        }
+        stbi_image_free(pixels);
+        stbi_image_free(reference);
+
+        double single = 0.0;
+        for (unsigned int threads : threadCounts)
+        {
+            // The decoding thread takes part, so the pool has one worker fewer.
+            std::unique_ptr<ThreadPool> pool = threads > 1 ? std::make_unique<ThreadPool>(threads - 1) : nullptr;
+            double milliseconds = measure([&]
+                                          {
+                int w, h, c;
+                return decodeImage(bytes, input.bytes.size(), &w, &h, &c, pool.get()); }, seconds);
+            if (threads == 1)
+                single = milliseconds;
+            results.push_back({input.name, decodePathName(path), threads, milliseconds, megapixels * 1000.0 / milliseconds, single / milliseconds});
+            std::printf("%-32s %-13s %8u %12.1f %10.1f %9.2f %9.2f\n", input.name.c_str(), decodePathName(path), threads, milliseconds,
+                        megapixels * 1000.0 / milliseconds, single / milliseconds, stbMilliseconds / milliseconds);
+        }
+        std::printf("%-32s largest difference from stb: %d\n", input.name.c_str(), difference);
+    }
+
+    // * 3. Write the results for tracking
+    if (!csvPath.empty())
+        writeCsv(csvPath, results);
+    return 0;
+}
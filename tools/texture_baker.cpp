@@ -0,0 +1,313 @@
+// Bakes images (anything stb_image reads) into .ltex containers: flipped so the
+// first row is at the bottom, expanded to a format GL stores natively (RGB
+// becomes RGBA) and with the full mip chain, so the app only maps and uploads.
+//
+// Mips are filtered with --mip-filter (Kaiser by default) in linear light;
+// pass --linear for data that isn't sRGB color (normal maps, masks).
+// --alpha-cutoff=F keeps the alpha-tested coverage of cut-outs constant
+// across the levels.
+//
+// Every level is block-compressed unless --no-compress is given: BC4 for one
+// channel, BC5 for two, BC1 for opaque color and BC3 for color with alpha.
+//
+// --atlas=NAME packs all images into one RGBA texture, NAME.ltex, and writes
+// where each one went to NAME.atlas (see texture_atlas.hpp) instead.
+//
+// usage: texture_baker [--no-flip] [--no-compress] [--quality=fast|normal|high]
+//                      [--mip-filter=box|kaiser|lanczos|mitchell] [--linear] [--alpha-cutoff=F]
+//                      [--atlas=NAME [--atlas-mip-levels=N]]
+//                      --output-dir=DIR IMAGE...
+
+#include <glad/glad.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "atlas_packer.hpp"
+#include "baked_texture.hpp"
+#include "block_compression.hpp"
+#include "mipmap.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Format
+    {
+        GLenum internalFormat;
+        GLenum format;
+    };
+
+    Format formatFor(int channels)
+    {
+        switch (channels)
+        {
+        case 1:
+            return {GL_R8, GL_RED};
+        case 2:
+            return {GL_RG8, GL_RG};
+        default:
+            return {GL_RGBA8, GL_RGBA};
+        }
+    }
+
+    struct Settings
+    {
+        bool flip = true;
+        bool compress = true;
+        CompressionQuality quality = CompressionQuality::High;
+        MipOptions mips;
+        std::string atlas; // empty: one texture per image
+        int atlasMipLevels = 5;
+    };
+
+    // Widely supported, and well past what GL 3.3 guarantees (1024).
+    constexpr int MAX_ATLAS_SIZE = 4096;
+
+    BlockFormat blockFormatFor(const BakedImageLevel &level, int channels)
+    {
+        switch (channels)
+        {
+        case 1:
+            return BlockFormat::BC4;
+        case 2:
+            return BlockFormat::BC5;
+        default:
+            // BC1 has no alpha worth keeping, so only images that use it pay for BC3.
+            for (std::size_t i = 3; i < level.pixels.size(); i += 4)
+                if (level.pixels[i] != 255)
+                    return BlockFormat::BC3;
+            return BlockFormat::BC1;
+        }
+    }
+
+    bool compressAndWrite(const std::filesystem::path &output, std::vector<BakedImageLevel> &levels, int stored, const Settings &settings, ThreadPool &pool)
+    {
+        Format format = formatFor(stored);
+        GLenum internalFormat = format.internalFormat;
+        GLenum pixelFormat = format.format;
+        GLenum type = GL_UNSIGNED_BYTE;
+
+        // * 1. Compress every level, rows of blocks spread over the pool
+        if (settings.compress)
+        {
+            BlockFormat blockFormat = blockFormatFor(levels[0], stored);
+            for (BakedImageLevel &level : levels)
+            {
+                std::vector<unsigned char> blocks(compressedSize(blockFormat, level.width, level.height));
+                compressImage(level.pixels.data(), level.width, level.height, stored, blockFormat, settings.quality, blocks.data(), &pool);
+                level.pixels = std::move(blocks);
+            }
+            internalFormat = blockFormatGLEnum(blockFormat);
+            pixelFormat = 0;
+            type = 0;
+        }
+
+        // * 2. Write the container
+        return writeBakedTexture(output.string(), internalFormat, pixelFormat, type, stored, levels);
+    }
+
+    bool bake(const std::filesystem::path &input, const std::filesystem::path &output, const Settings &settings, ThreadPool &pool)
+    {
+        int width, height, channels;
+        if (!stbi_info(input.string().c_str(), &width, &height, &channels))
+        {
+            std::cerr << "ERROR::TEXTURE_BAKER::UNSUPPORTED_IMAGE " << input.string() << " (" << stbi_failure_reason() << ")" << std::endl;
+            return false;
+        }
+
+        // * 1. Decode in the final channel count
+        int stored = channels == 3 ? 4 : channels;
+        stbi_set_flip_vertically_on_load(settings.flip);
+        unsigned char *data = stbi_load(input.string().c_str(), &width, &height, &channels, stored);
+        if (data == nullptr)
+        {
+            std::cerr << "ERROR::TEXTURE_BAKER::STBI_DATA_EMPTY " << input.string() << " (" << stbi_failure_reason() << ")" << std::endl;
+            return false;
+        }
+
+        // * 2. Build the mip chain
+        std::vector<BakedImageLevel> levels;
+        levels.push_back({width, height, std::vector<unsigned char>(data, data + (std::size_t)width * height * stored)});
+        stbi_image_free(data);
+
+        for (MipLevel &mip : generateMips(levels[0].pixels.data(), width, height, stored, settings.mips, &pool))
+            levels.push_back({mip.width, mip.height, std::move(mip.pixels)});
+
+        return compressAndWrite(output, levels, stored, settings, pool);
+    }
+
+    bool bakeAtlas(const std::vector<std::filesystem::path> &inputs, const std::filesystem::path &outputDir, const Settings &settings, ThreadPool &pool)
+    {
+        // Images are placed on a grid of `alignment` texels, and the chain stops
+        // at the level where a grid cell is one texel. Box-filtered, a texel of
+        // any level then only averages texels of its own image, and the gutter
+        // of repeated edge texels around each image keeps bilinear filtering
+        // from reaching into the next one.
+        int alignment = 1 << (settings.atlasMipLevels - 1);
+        int gutter = alignment;
+
+        struct Sprite
+        {
+            std::string name;
+            int width;
+            int height;
+            std::vector<unsigned char> rgba;
+        };
+        std::vector<Sprite> sprites;
+        std::vector<AtlasRect> cells; // in grid units
+
+        // * 1. Decode every image as RGBA
+        stbi_set_flip_vertically_on_load(settings.flip);
+        for (const std::filesystem::path &input : inputs)
+        {
+            int width, height, channels;
+            unsigned char *data = stbi_load(input.string().c_str(), &width, &height, &channels, 4);
+            if (data == nullptr)
+            {
+                std::cerr << "ERROR::TEXTURE_BAKER::STBI_DATA_EMPTY " << input.string() << " (" << stbi_failure_reason() << ")" << std::endl;
+                return false;
+            }
+            sprites.push_back({input.stem().string(), width, height, std::vector<unsigned char>(data, data + (std::size_t)width * height * 4)});
+            stbi_image_free(data);
+
+            cells.push_back({0, 0, (width + 2 * gutter + alignment - 1) / alignment, (height + 2 * gutter + alignment - 1) / alignment});
+        }
+
+        // * 2. Pack the cells
+        int gridWidth, gridHeight;
+        std::vector<AtlasRect> placed;
+        if (!packRects(cells, MAX_ATLAS_SIZE / alignment, gridWidth, gridHeight, placed))
+        {
+            std::cerr << "ERROR::TEXTURE_BAKER::ATLAS_TOO_LARGE the images don't fit into " << MAX_ATLAS_SIZE << "x" << MAX_ATLAS_SIZE << std::endl;
+            return false;
+        }
+        int width = gridWidth * alignment;
+        int height = gridHeight * alignment;
+
+        // * 3. Copy each image in, surrounded by its gutter
+        std::vector<BakedImageLevel> levels;
+        levels.push_back({width, height, std::vector<unsigned char>((std::size_t)width * height * 4, 0)});
+        std::vector<unsigned char> &atlas = levels[0].pixels;
+        std::string table = "atlas " + std::to_string(width) + " " + std::to_string(height) + "\n";
+
+        for (std::size_t i = 0; i < sprites.size(); i++)
+        {
+            const Sprite &sprite = sprites[i];
+            int left = placed[i].x * alignment + gutter;
+            int bottom = placed[i].y * alignment + gutter;
+            for (int y = -gutter; y < sprite.height + gutter; y++)
+            {
+                int row = std::clamp(y, 0, sprite.height - 1);
+                for (int x = -gutter; x < sprite.width + gutter; x++)
+                {
+                    int column = std::clamp(x, 0, sprite.width - 1);
+                    std::memcpy(&atlas[((std::size_t)(bottom + y) * width + left + x) * 4],
+                                &sprite.rgba[((std::size_t)row * sprite.width + column) * 4], 4);
+                }
+            }
+            table += sprite.name + " " + std::to_string(left) + " " + std::to_string(bottom) + " " +
+                     std::to_string(sprite.width) + " " + std::to_string(sprite.height) + "\n";
+        }
+
+        // * 4. Build the mip levels the grid keeps apart. Coverage is per image,
+        // so an alpha cutoff would need per-image scales; it doesn't apply here.
+        MipOptions mips = settings.mips;
+        mips.filter = MipFilter::Box;
+        mips.alphaCutoff = 0.0f;
+        std::vector<MipLevel> chain = generateMips(atlas.data(), width, height, 4, mips, &pool);
+        for (int level = 1; level < settings.atlasMipLevels && level - 1 < (int)chain.size(); level++)
+            levels.push_back({chain[level - 1].width, chain[level - 1].height, std::move(chain[level - 1].pixels)});
+
+        // * 5. Write the texture and the table
+        std::filesystem::path output = outputDir / settings.atlas;
+        if (!compressAndWrite(output.string() + BAKED_TEXTURE_EXTENSION, levels, 4, settings, pool))
+            return false;
+
+        std::ofstream file(output.string() + ".atlas", std::ios::trunc);
+        file << "# name x y width height, in texels of level 0 (generated by texture_baker)\n" << table;
+        if (!file)
+        {
+            std::cerr << "ERROR::TEXTURE_BAKER::CANNOT_WRITE " << output.string() << ".atlas" << std::endl;
+            return false;
+        }
+        std::cout << "Atlas " << settings.atlas << ": " << sprites.size() << " images in " << width << "x" << height
+                  << ", " << levels.size() << " levels" << std::endl;
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Settings settings;
+    std::filesystem::path outputDir;
+    std::vector<std::filesystem::path> inputs;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--no-flip")
+            settings.flip = false;
+        else if (argument == "--no-compress")
+            settings.compress = false;
+        else if (argument == "--quality=fast")
+            settings.quality = CompressionQuality::Fast;
+        else if (argument == "--quality=normal")
+            settings.quality = CompressionQuality::Normal;
+        else if (argument == "--quality=high")
+            settings.quality = CompressionQuality::High;
+        else if (argument == "--mip-filter=box")
+            settings.mips.filter = MipFilter::Box;
+        else if (argument == "--mip-filter=kaiser")
+            settings.mips.filter = MipFilter::Kaiser;
+        else if (argument == "--mip-filter=lanczos")
+            settings.mips.filter = MipFilter::Lanczos;
+        else if (argument == "--mip-filter=mitchell")
+            settings.mips.filter = MipFilter::Mitchell;
+        else if (argument == "--linear")
+            settings.mips.srgb = false;
+        else if (argument.rfind("--alpha-cutoff=", 0) == 0)
+            settings.mips.alphaCutoff = std::stof(argument.substr(std::strlen("--alpha-cutoff=")));
+        else if (argument.rfind("--atlas=", 0) == 0)
+            settings.atlas = argument.substr(std::strlen("--atlas="));
+        else if (argument.rfind("--atlas-mip-levels=", 0) == 0)
+            settings.atlasMipLevels = std::clamp(std::stoi(argument.substr(std::strlen("--atlas-mip-levels="))), 1, 8);
+        else if (argument.rfind("--output-dir=", 0) == 0)
+            outputDir = argument.substr(std::strlen("--output-dir="));
+        else
+            inputs.push_back(argument);
+    }
+
+    if (outputDir.empty() || inputs.empty())
+    {
+        std::cerr << "usage: texture_baker [--no-flip] [--no-compress] [--quality=fast|normal|high]" << std::endl
+                  << "                     [--mip-filter=box|kaiser|lanczos|mitchell] [--linear] [--alpha-cutoff=F]" << std::endl
+                  << "                     [--atlas=NAME [--atlas-mip-levels=N]]" << std::endl
+                  << "                     --output-dir=DIR IMAGE..." << std::endl;
+        return 2;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(outputDir, error);
+
+    ThreadPool pool;
+    if (!settings.atlas.empty())
+        return bakeAtlas(inputs, outputDir, settings, pool) ? 0 : 1;
+
+    int failed = 0;
+    for (const std::filesystem::path &input : inputs)
+    {
+        std::filesystem::path output = outputDir / input.stem();
+        output += BAKED_TEXTURE_EXTENSION;
+        if (!bake(input, output, settings, pool))
+            failed++;
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+#include "atlas_packer.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <numeric>
+
+namespace
+{
+    bool contains(const AtlasRect &outer, const AtlasRect &inner)
+    {
+        return inner.x >= outer.x && inner.y >= outer.y && inner.x + inner.width <= outer.x + outer.width &&
+               inner.y + inner.height <= outer.y + outer.height;
+    }
+
+    bool overlaps(const AtlasRect &a, const AtlasRect &b)
+    {
+        return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+    }
+}
+
+MaxRectsPacker::MaxRectsPacker(int width, int height)
+{
+    freeRects.push_back({0, 0, width, height});
+}
+
+bool MaxRectsPacker::insert(int width, int height, AtlasRect &placed)
+{
+    int bestShort = INT_MAX, bestLong = INT_MAX;
+    const AtlasRect *best = nullptr;
+    for (const AtlasRect &free : freeRects)
+    {
+        if (width > free.width || height > free.height)
+            continue;
+
+        int leftoverX = free.width - width;
+        int leftoverY = free.height - height;
+        int shortSide = std::min(leftoverX, leftoverY);
+        int longSide = std::max(leftoverX, leftoverY);
+        if (shortSide < bestShort || (shortSide == bestShort && longSide < bestLong))
+        {
+            bestShort = shortSide;
+            bestLong = longSide;
+            best = &free;
+        }
+    }
+    if (best == nullptr)
+        return false;
+
+    placed = {best->x, best->y, width, height};
+    split(placed);
+    prune();
+    return true;
+}
+
+void MaxRectsPacker::split(const AtlasRect &used)
+{
+    // Every free rectangle the new one overlaps is replaced by the (up to four)
+    // maximal rectangles left around it.
+    std::vector<AtlasRect> next;
+    for (const AtlasRect &free : freeRects)
+    {
+        if (!overlaps(free, used))
+        {
+            next.push_back(free);
+            continue;
+        }
+
+        if (used.x > free.x)
+            next.push_back({free.x, free.y, used.x - free.x, free.height});
+        if (used.x + used.width < free.x + free.width)
+            next.push_back({used.x + used.width, free.y, free.x + free.width - (used.x + used.width), free.height});
+        if (used.y > free.y)
+            next.push_back({free.x, free.y, free.width, used.y - free.y});
+        if (used.y + used.height < free.y + free.height)
+            next.push_back({free.x, used.y + used.height, free.width, free.y + free.height - (used.y + used.height)});
+    }
+    freeRects = std::move(next);
+}
+
+void MaxRectsPacker::prune()
+{
+    // Drop free rectangles that lie inside another one.
+    for (std::size_t i = 0; i < freeRects.size(); i++)
+    {
+        for (std::size_t j = i + 1; j < freeRects.size(); j++)
+        {
+            if (contains(freeRects[j], freeRects[i]))
+            {
+                freeRects.erase(freeRects.begin() + (std::ptrdiff_t)i);
+                i--;
+                break;
+            }
+            if (contains(freeRects[i], freeRects[j]))
+            {
+                freeRects.erase(freeRects.begin() + (std::ptrdiff_t)j);
+                j--;
+            }
+        }
+    }
+}
+
+bool packRects(const std::vector<AtlasRect> &sizes, int maxSize, int &binWidth, int &binHeight, std::vector<AtlasRect> &placed)
+{
+    // Largest first packs tightest: small rectangles fill the gaps left between big ones.
+    std::vector<std::size_t> order(sizes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&sizes](std::size_t a, std::size_t b)
+                     {
+        int sideA = std::max(sizes[a].width, sizes[a].height), sideB = std::max(sizes[b].width, sizes[b].height);
+        if (sideA != sideB)
+            return sideA > sideB;
+        return sizes[a].width * sizes[a].height > sizes[b].width * sizes[b].height; });
+
+    // * 1. Start at the smallest square that could hold the total area
+    long long area = 0;
+    int widest = 1, tallest = 1;
+    for (const AtlasRect &size : sizes)
+    {
+        area += (long long)size.width * size.height;
+        widest = std::max(widest, size.width);
+        tallest = std::max(tallest, size.height);
+    }
+    int width = 1, height = 1;
+    while (width < widest || (long long)width * width < area)
+        width *= 2;
+    while (height < tallest || (long long)width * height < area)
+        height *= 2;
+
+    // * 2. Grow the shorter side until everything fits
+    placed.assign(sizes.size(), AtlasRect{});
+    while (width <= maxSize && height <= maxSize)
+    {
+        MaxRectsPacker packer(width, height);
+        bool fits = true;
+        for (std::size_t i = 0; fits && i < order.size(); i++)
+            fits = packer.insert(sizes[order[i]].width, sizes[order[i]].height, placed[order[i]]);
+
+        if (fits)
+        {
+            // * 3. Crop to the used area
+            binWidth = 0;
+            binHeight = 0;
+            for (const AtlasRect &rect : placed)
+            {
+                binWidth = std::max(binWidth, rect.x + rect.width);
+                binHeight = std::max(binHeight, rect.y + rect.height);
+            }
+            return true;
+        }
+
+        if (height < width)
+            height *= 2;
+        else
+            width *= 2;
+    }
+    return false;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+struct AtlasRect
+{
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// MaxRects bin packer: keeps every maximal free rectangle of the bin and puts
+// each new rectangle where it leaves the shortest leftover side (best short
+// side fit). Rectangles are never rotated, since UVs would have to rotate too.
+class MaxRectsPacker
+{
+private:
+    std::vector<AtlasRect> freeRects;
+
+    void split(const AtlasRect &used);
+    void prune();
+
+public:
+    MaxRectsPacker(int width, int height);
+
+    // Returns false if the rectangle fits nowhere.
+    bool insert(int width, int height, AtlasRect &placed);
+};
+
+// Pack rectangles of the given sizes (x and y are ignored), largest first,
+// into the smallest power-of-two bin up to maxSize that takes all of them, and
+// crop the bin to what was used. `placed` is in the order of `sizes`.
+bool packRects(const std::vector<AtlasRect> &sizes, int maxSize, int &binWidth, int &binHeight, std::vector<AtlasRect> &placed);
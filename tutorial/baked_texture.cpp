@@ -0,0 +1,206 @@
+#include "baked_texture.hpp"
+#include "hash.hpp"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+    std::uint64_t alignUp(std::uint64_t value, std::uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // Bytes per 4x4 block of the formats the baker and the loader write, or 0.
+    std::uint64_t blockBytes(std::uint32_t internalFormat)
+    {
+        switch (internalFormat)
+        {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RED_RGTC1:
+            return 8;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_RG_RGTC2:
+            return 16;
+        default:
+            return 0;
+        }
+    }
+
+    // Bytes per pixel of tightly packed format/type data, or 0 if unknown.
+    std::uint64_t pixelBytes(std::uint32_t format, std::uint32_t type)
+    {
+        switch (type)
+        {
+        case GL_UNSIGNED_SHORT_5_6_5:
+        case GL_UNSIGNED_SHORT_4_4_4_4:
+        case GL_UNSIGNED_SHORT_5_5_5_1:
+            return 2; // the whole pixel in one short
+        case GL_UNSIGNED_BYTE:
+            break;
+        default:
+            return 0;
+        }
+
+        switch (format)
+        {
+        case GL_RED:
+            return 1;
+        case GL_RG:
+            return 2;
+        case GL_RGB:
+            return 3;
+        case GL_RGBA:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
+    // What a level of this size has to hold. GL reads exactly this much from the
+    // mapping (with GL_UNPACK_ALIGNMENT 1), so any other size is a broken file.
+    std::uint64_t levelBytes(const BakedTextureHeader &header, const BakedLevel &level)
+    {
+        if (header.format == 0)
+            return (std::uint64_t)((level.width + 3) / 4) * ((level.height + 3) / 4) * blockBytes(header.internalFormat);
+        return (std::uint64_t)level.width * level.height * pixelBytes(header.format, header.type);
+    }
+}
+
+bool BakedTexture::open(const std::string &path)
+{
+    file = MappedFile(path);
+    if (!file.valid())
+    {
+        std::cerr << "ERROR::TEXTURE::FILE_NOT_SUCCESSFULLY_READ " << path << std::endl;
+        return false;
+    }
+
+    std::string_view bytes = file.view();
+    header = (const BakedTextureHeader *)bytes.data();
+    index = (const BakedLevel *)(bytes.data() + sizeof(BakedTextureHeader));
+
+    if (bytes.size() < sizeof(BakedTextureHeader) || std::memcmp(header->magic, BAKED_TEXTURE_MAGIC, sizeof(header->magic)) != 0)
+    {
+        std::cerr << "ERROR::TEXTURE::NOT_A_BAKED_TEXTURE " << path << std::endl;
+        return false;
+    }
+    if (header->version != BAKED_TEXTURE_VERSION)
+    {
+        std::cerr << "ERROR::TEXTURE::BAKED_VERSION_MISMATCH " << path << " is version " << header->version
+                  << ", expected " << BAKED_TEXTURE_VERSION << ". Rebuild the bake_textures target." << std::endl;
+        return false;
+    }
+
+    // Every level has to lie inside the file.
+    bool valid = header->levels > 0 && header->levels <= 32 &&
+                 sizeof(BakedTextureHeader) + (std::uint64_t)header->levels * sizeof(BakedLevel) <= bytes.size();
+    for (std::uint32_t i = 0; valid && i < header->levels; i++)
+        valid = index[i].offset <= bytes.size() && index[i].size <= bytes.size() - index[i].offset;
+    if (!valid)
+    {
+        std::cerr << "ERROR::TEXTURE::BAKED_TEXTURE_TRUNCATED " << path << std::endl;
+        return false;
+    }
+
+    // The levels have to form a mip chain: no more than the dimensions allow...
+    std::uint32_t largest = std::max(header->width, header->height);
+    std::uint32_t chainLength = 1;
+    while (largest >> chainLength > 0)
+        chainLength++;
+    bool sized = header->width > 0 && header->height > 0 && header->width <= 65536 && header->height <= 65536;
+    if (!sized || header->levels > chainLength)
+    {
+        std::cerr << "ERROR::TEXTURE::BAKED_LEVEL_COUNT_MISMATCH " << path << " (" << header->width << "x" << header->height
+                  << ", " << header->levels << " levels)" << std::endl;
+        return false;
+    }
+
+    // ...each half the size of the one above (at least 1), and be exactly as
+    // large as its dimensions and format say.
+    for (std::uint32_t i = 0; i < header->levels; i++)
+    {
+        const BakedLevel &level = index[i];
+        bool chained = level.width == std::max(header->width >> i, 1u) && level.height == std::max(header->height >> i, 1u);
+        if (!chained || levelBytes(*header, level) == 0 || levelBytes(*header, level) != level.size)
+        {
+            std::cerr << "ERROR::TEXTURE::BAKED_LEVEL_SIZE_MISMATCH " << path << " level " << i << " (" << level.width << "x"
+                      << level.height << ", " << level.size << " bytes)" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool writeBakedTexture(const std::string &path, std::uint32_t internalFormat, std::uint32_t format, std::uint32_t type,
+                       int channels, const std::vector<BakedImageLevel> &levels)
+{
+    BakedTextureHeader header{};
+    std::memcpy(header.magic, BAKED_TEXTURE_MAGIC, sizeof(header.magic));
+    header.version = BAKED_TEXTURE_VERSION;
+    header.internalFormat = internalFormat;
+    header.format = format;
+    header.type = type;
+    header.width = (std::uint32_t)levels[0].width;
+    header.height = (std::uint32_t)levels[0].height;
+    header.levels = (std::uint32_t)levels.size();
+    header.channels = (std::uint32_t)channels;
+
+    // * 1. Lay the levels out, smallest first
+    std::vector<BakedLevel> index(levels.size());
+    std::uint64_t offset = sizeof(BakedTextureHeader) + index.size() * sizeof(BakedLevel);
+    for (std::size_t i = levels.size(); i-- > 0;)
+    {
+        offset = alignUp(offset, 16);
+        index[i] = BakedLevel{offset, levels[i].pixels.size(), (std::uint32_t)levels[i].width, (std::uint32_t)levels[i].height};
+        offset += levels[i].pixels.size();
+    }
+
+    std::uint64_t hash = fnv1a("");
+    for (const BakedImageLevel &level : levels)
+        hash = fnv1a(std::string_view((const char *)level.pixels.data(), level.pixels.size()), hash);
+    header.contentHash = hash;
+
+    // * 2. Write to a temporary file and rename it, so a reader never sees half a file.
+    // Loader workers may write the same path at once, so each write gets its own.
+    static std::atomic<unsigned int> writes{0};
+    std::string temporary = path + "." + std::to_string(writes++) + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write((const char *)&header, sizeof(header));
+        out.write((const char *)index.data(), (std::streamsize)(index.size() * sizeof(BakedLevel)));
+
+        std::uint64_t written = sizeof(header) + index.size() * sizeof(BakedLevel);
+        const char padding[16] = {};
+        for (std::size_t i = levels.size(); i-- > 0;)
+        {
+            out.write(padding, (std::streamsize)(index[i].offset - written));
+            out.write((const char *)levels[i].pixels.data(), (std::streamsize)levels[i].pixels.size());
+            written = index[i].offset + index[i].size;
+        }
+
+        if (!out)
+        {
+            std::cerr << "ERROR::TEXTURE::CANNOT_WRITE " << temporary << std::endl;
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+    {
+        std::cerr << "ERROR::TEXTURE::CANNOT_WRITE " << path << " (" << error.message() << ")" << std::endl;
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
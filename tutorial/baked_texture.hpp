@@ -0,0 +1,99 @@
+#pragma once
+
+#include "mapped_file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk layout of a baked texture (.ltex), written by tools/texture_baker and
+// read straight from a memory mapping. Modelled on KTX2: a header, an index
+// with one entry per mip level, then the level data, smallest level first so
+// the small levels can be read before the large ones. Level data is 16-byte
+// aligned and already in the final GL format and orientation (first row at
+// the bottom), so it goes to glTexImage2D unchanged. Block-compressed levels
+// (see block_compression.hpp) have format and type 0 and go to
+// glCompressedTexImage2D instead. All fields are little-endian.
+struct BakedTextureHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t internalFormat; // GL enums
+    std::uint32_t format; // 0 if compressed
+    std::uint32_t type;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t levels;
+    std::uint32_t channels; // of the source, after expanding RGB to RGBA
+    std::uint64_t contentHash; // FNV-1a of every level, for deduplication
+};
+
+struct BakedLevel
+{
+    std::uint64_t offset; // from the start of the file
+    std::uint64_t size;
+    std::uint32_t width;
+    std::uint32_t height;
+};
+
+static_assert(sizeof(BakedTextureHeader) == 48 && sizeof(BakedLevel) == 24, "the file layout must not depend on padding");
+
+constexpr char BAKED_TEXTURE_MAGIC[8] = {'L', 'O', 'T', 'E', 'X', '\r', '\n', '\x1a'};
+constexpr std::uint32_t BAKED_TEXTURE_VERSION = 2;
+constexpr const char *BAKED_TEXTURE_EXTENSION = ".ltex";
+
+// A mapped .ltex file. Reading a level only touches its pages.
+class BakedTexture
+{
+private:
+    MappedFile file;
+    const BakedTextureHeader *header = nullptr;
+    const BakedLevel *index = nullptr;
+
+public:
+    // Map and validate. Prints the reason and returns false if the file is unusable.
+    bool open(const std::string &path);
+
+    bool compressed() const
+    {
+        return header->format == 0;
+    }
+
+    const BakedTextureHeader &info() const
+    {
+        return *header;
+    }
+
+    const BakedLevel &level(unsigned int level) const
+    {
+        return index[level];
+    }
+
+    const unsigned char *levelData(unsigned int level) const
+    {
+        return (const unsigned char *)file.view().data() + index[level].offset;
+    }
+
+    // See MappedFile::touch.
+    void touch() const
+    {
+        file.touch();
+    }
+
+    void touch(unsigned int level) const
+    {
+        file.touch(index[level].offset, index[level].size);
+    }
+};
+
+// One level for writeBakedTexture, largest first.
+struct BakedImageLevel
+{
+    int width;
+    int height;
+    std::vector<unsigned char> pixels; // or blocks, for compressed formats
+};
+
+bool writeBakedTexture(const std::string &path, std::uint32_t internalFormat, std::uint32_t format, std::uint32_t type,
+                       int channels, const std::vector<BakedImageLevel> &levels);
@@ -0,0 +1,786 @@
+#include "block_compression.hpp"
+#include "cpu_features.hpp"
+#include "thread_pool.hpp"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#ifdef LO_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    // One 4x4 block with the channels split out, so the SIMD paths load 4 or 8 pixels at once.
+    struct ColorBlock
+    {
+        float r[16];
+        float g[16];
+        float b[16];
+    };
+
+    using ColorPalette = float[4][3];
+    using ValuePalette = std::uint8_t[8];
+
+    // Pick the nearest palette entry for every pixel of a block and return the
+    // summed squared error. These are where encoding spends its time, so they
+    // have a path per instruction set.
+    using ColorIndicesFn = float (*)(const ColorBlock &block, const ColorPalette &palette, std::uint8_t indices[16]);
+    using ValueIndicesFn = int (*)(const std::uint8_t values[16], const ValuePalette &palette, std::uint8_t indices[16]);
+
+    struct Kernels
+    {
+        ColorIndicesFn colorIndices;
+        ValueIndicesFn valueIndices;
+    };
+
+    float colorIndicesScalar(const ColorBlock &block, const ColorPalette &palette, std::uint8_t indices[16])
+    {
+        float total = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            float best = std::numeric_limits<float>::max();
+            for (int p = 0; p < 4; p++)
+            {
+                float dr = block.r[i] - palette[p][0];
+                float dg = block.g[i] - palette[p][1];
+                float db = block.b[i] - palette[p][2];
+                float distance = dr * dr + dg * dg + db * db;
+                if (distance < best)
+                {
+                    best = distance;
+                    indices[i] = (std::uint8_t)p;
+                }
+            }
+            total += best;
+        }
+        return total;
+    }
+
+    int valueIndicesScalar(const std::uint8_t values[16], const ValuePalette &palette, std::uint8_t indices[16])
+    {
+        int total = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = std::numeric_limits<int>::max();
+            for (int p = 0; p < 8; p++)
+            {
+                int distance = std::abs((int)values[i] - (int)palette[p]);
+                if (distance < best)
+                {
+                    best = distance;
+                    indices[i] = (std::uint8_t)p;
+                }
+            }
+            total += best * best;
+        }
+        return total;
+    }
+
+#ifdef LO_X86
+    LO_TARGET_SSE2 float colorIndicesSSE2(const ColorBlock &block, const ColorPalette &palette, std::uint8_t indices[16])
+    {
+        __m128 total = _mm_setzero_ps();
+        for (int i = 0; i < 16; i += 4)
+        {
+            __m128 r = _mm_loadu_ps(block.r + i);
+            __m128 g = _mm_loadu_ps(block.g + i);
+            __m128 b = _mm_loadu_ps(block.b + i);
+
+            __m128 best = _mm_set1_ps(std::numeric_limits<float>::max());
+            __m128i bestIndex = _mm_setzero_si128();
+            for (int p = 0; p < 4; p++)
+            {
+                __m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[p][0]));
+                __m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[p][1]));
+                __m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[p][2]));
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+
+                // No blend before SSE4.1: select with and/andnot.
+                __m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+                best = _mm_min_ps(distance, best);
+                bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(p)), _mm_andnot_si128(closer, bestIndex));
+            }
+
+            alignas(16) std::int32_t lanes[4];
+            _mm_store_si128((__m128i *)lanes, bestIndex);
+            for (int lane = 0; lane < 4; lane++)
+                indices[i + lane] = (std::uint8_t)lanes[lane];
+            total = _mm_add_ps(total, best);
+        }
+
+        alignas(16) float sums[4];
+        _mm_store_ps(sums, total);
+        return sums[0] + sums[1] + sums[2] + sums[3];
+    }
+
+    LO_TARGET_SSE2 int valueIndicesSSE2(const std::uint8_t values[16], const ValuePalette &palette, std::uint8_t indices[16])
+    {
+        // 16 values as two vectors of eight 16-bit lanes, so differences don't wrap.
+        __m128i bytes = _mm_loadu_si128((const __m128i *)values);
+        __m128i zero = _mm_setzero_si128();
+        __m128i value[2] = {_mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero)};
+        __m128i best[2] = {_mm_set1_epi16(0x7FFF), _mm_set1_epi16(0x7FFF)};
+        __m128i bestIndex[2] = {zero, zero};
+
+        for (int p = 0; p < 8; p++)
+        {
+            __m128i entry = _mm_set1_epi16(palette[p]);
+            __m128i index = _mm_set1_epi16((short)p);
+            for (int half = 0; half < 2; half++)
+            {
+                __m128i distance = _mm_max_epi16(_mm_sub_epi16(value[half], entry), _mm_sub_epi16(entry, value[half]));
+                __m128i closer = _mm_cmplt_epi16(distance, best[half]);
+                best[half] = _mm_min_epi16(distance, best[half]);
+                bestIndex[half] = _mm_or_si128(_mm_and_si128(closer, index), _mm_andnot_si128(closer, bestIndex[half]));
+            }
+        }
+        _mm_storeu_si128((__m128i *)indices, _mm_packus_epi16(bestIndex[0], bestIndex[1]));
+
+        __m128i squares = _mm_add_epi32(_mm_madd_epi16(best[0], best[0]), _mm_madd_epi16(best[1], best[1]));
+        alignas(16) std::int32_t sums[4];
+        _mm_store_si128((__m128i *)sums, squares);
+        return sums[0] + sums[1] + sums[2] + sums[3];
+    }
+
+    LO_TARGET_AVX2 float colorIndicesAVX2(const ColorBlock &block, const ColorPalette &palette, std::uint8_t indices[16])
+    {
+        __m256 total = _mm256_setzero_ps();
+        for (int i = 0; i < 16; i += 8)
+        {
+            __m256 r = _mm256_loadu_ps(block.r + i);
+            __m256 g = _mm256_loadu_ps(block.g + i);
+            __m256 b = _mm256_loadu_ps(block.b + i);
+
+            __m256 best = _mm256_set1_ps(std::numeric_limits<float>::max());
+            __m256i bestIndex = _mm256_setzero_si256();
+            for (int p = 0; p < 4; p++)
+            {
+                __m256 dr = _mm256_sub_ps(r, _mm256_set1_ps(palette[p][0]));
+                __m256 dg = _mm256_sub_ps(g, _mm256_set1_ps(palette[p][1]));
+                __m256 db = _mm256_sub_ps(b, _mm256_set1_ps(palette[p][2]));
+                __m256 distance = _mm256_fmadd_ps(db, db, _mm256_fmadd_ps(dg, dg, _mm256_mul_ps(dr, dr)));
+
+                __m256 closer = _mm256_cmp_ps(distance, best, _CMP_LT_OQ);
+                best = _mm256_min_ps(distance, best);
+                bestIndex = _mm256_blendv_epi8(bestIndex, _mm256_set1_epi32(p), _mm256_castps_si256(closer));
+            }
+
+            alignas(32) std::int32_t lanes[8];
+            _mm256_store_si256((__m256i *)lanes, bestIndex);
+            for (int lane = 0; lane < 8; lane++)
+                indices[i + lane] = (std::uint8_t)lanes[lane];
+            total = _mm256_add_ps(total, best);
+        }
+
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(total), _mm256_extractf128_ps(total, 1));
+        alignas(16) float sums[4];
+        _mm_store_ps(sums, sum);
+        return sums[0] + sums[1] + sums[2] + sums[3];
+    }
+
+    LO_TARGET_AVX2 int valueIndicesAVX2(const std::uint8_t values[16], const ValuePalette &palette, std::uint8_t indices[16])
+    {
+        __m256i value = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)values));
+        __m256i best = _mm256_set1_epi16(0x7FFF);
+        __m256i bestIndex = _mm256_setzero_si256();
+
+        for (int p = 0; p < 8; p++)
+        {
+            __m256i distance = _mm256_abs_epi16(_mm256_sub_epi16(value, _mm256_set1_epi16(palette[p])));
+            __m256i closer = _mm256_cmpgt_epi16(best, distance);
+            best = _mm256_min_epi16(distance, best);
+            bestIndex = _mm256_blendv_epi8(bestIndex, _mm256_set1_epi16((short)p), closer);
+        }
+        // packus works within 128-bit lanes, so pack the two halves by hand.
+        __m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(bestIndex), _mm256_extracti128_si256(bestIndex, 1));
+        _mm_storeu_si128((__m128i *)indices, packed);
+
+        __m256i squares = _mm256_madd_epi16(best, best);
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(squares), _mm256_extracti128_si256(squares, 1));
+        alignas(16) std::int32_t sums[4];
+        _mm_store_si128((__m128i *)sums, sum);
+        return sums[0] + sums[1] + sums[2] + sums[3];
+    }
+#endif
+
+    Kernels selectKernels()
+    {
+        switch (simdLevel())
+        {
+#ifdef LO_X86
+        case SimdLevel::AVX2:
+            return {colorIndicesAVX2, valueIndicesAVX2};
+        case SimdLevel::SSE41:
+        case SimdLevel::SSE2:
+            return {colorIndicesSSE2, valueIndicesSSE2};
+#endif
+        default:
+            return {colorIndicesScalar, valueIndicesScalar};
+        }
+    }
+
+    // --- BC1 ---------------------------------------------------------------
+
+    std::uint16_t to565(const float color[3])
+    {
+        auto quantize = [](float value, int maximum)
+        {
+            return (int)std::lround(std::clamp(value, 0.0f, 255.0f) * (float)maximum / 255.0f);
+        };
+        return (std::uint16_t)((quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) | quantize(color[2], 31));
+    }
+
+    void from565(std::uint16_t color, int rgb[3])
+    {
+        int r = (color >> 11) & 31;
+        int g = (color >> 5) & 63;
+        int b = color & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    // Four colors when c0 > c1 (always in BC3), otherwise three and black.
+    void bc1Palette(std::uint16_t c0, std::uint16_t c1, bool fourColors, int palette[4][3])
+    {
+        from565(c0, palette[0]);
+        from565(c1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            if (fourColors)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            else
+            {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+    }
+
+    struct BC1Candidate
+    {
+        std::uint16_t c0;
+        std::uint16_t c1;
+        std::uint8_t indices[16];
+        float error;
+    };
+
+    // Quantize the endpoints and pick the indices for them. `high` becomes c0.
+    BC1Candidate fitBC1(const ColorBlock &block, const float low[3], const float high[3], const Kernels &kernels)
+    {
+        BC1Candidate candidate;
+        candidate.c0 = to565(high);
+        candidate.c1 = to565(low);
+        // Four-color mode needs c0 > c1. Equal endpoints make every entry the same
+        // color, which index 0 decodes to in either mode.
+        if (candidate.c0 < candidate.c1)
+            std::swap(candidate.c0, candidate.c1);
+
+        int palette[4][3];
+        bc1Palette(candidate.c0, candidate.c1, true, palette);
+        ColorPalette entries;
+        for (int p = 0; p < 4; p++)
+            for (int c = 0; c < 3; c++)
+                entries[p][c] = (float)palette[p][c];
+
+        candidate.error = kernels.colorIndices(block, entries, candidate.indices);
+        return candidate;
+    }
+
+    // Bounding box, inset a little so the extremes don't waste precision on outliers.
+    void boxEndpoints(const ColorBlock &block, float low[3], float high[3])
+    {
+        const float *channels[3] = {block.r, block.g, block.b};
+        for (int c = 0; c < 3; c++)
+        {
+            auto [minimum, maximum] = std::minmax_element(channels[c], channels[c] + 16);
+            float inset = (*maximum - *minimum) / 16.0f;
+            low[c] = *minimum + inset;
+            high[c] = *maximum - inset;
+        }
+    }
+
+    // The extremes of the block's colors along their principal axis.
+    void principalEndpoints(const ColorBlock &block, float low[3], float high[3])
+    {
+        float mean[3] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            mean[0] += block.r[i];
+            mean[1] += block.g[i];
+            mean[2] += block.b[i];
+        }
+        for (float &m : mean)
+            m /= 16.0f;
+
+        float covariance[3][3] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            float d[3] = {block.r[i] - mean[0], block.g[i] - mean[1], block.b[i] - mean[2]};
+            for (int row = 0; row < 3; row++)
+                for (int column = 0; column < 3; column++)
+                    covariance[row][column] += d[row] * d[column];
+        }
+
+        // Power iteration, starting from the channel that varies most.
+        int widest = 0;
+        for (int c = 1; c < 3; c++)
+            if (covariance[c][c] > covariance[widest][widest])
+                widest = c;
+        float axis[3] = {covariance[0][widest], covariance[1][widest], covariance[2][widest]};
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[3];
+            for (int row = 0; row < 3; row++)
+                next[row] = covariance[row][0] * axis[0] + covariance[row][1] * axis[1] + covariance[row][2] * axis[2];
+            float scale = std::max({std::fabs(next[0]), std::fabs(next[1]), std::fabs(next[2])});
+            if (scale <= 0.0f)
+                break;
+            for (int c = 0; c < 3; c++)
+                axis[c] = next[c] / scale;
+        }
+        float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        if (length > 0.0f)
+            for (float &a : axis)
+                a /= length;
+
+        float lowest = 0.0f, highest = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            float t = (block.r[i] - mean[0]) * axis[0] + (block.g[i] - mean[1]) * axis[1] + (block.b[i] - mean[2]) * axis[2];
+            lowest = std::min(lowest, t);
+            highest = std::max(highest, t);
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            low[c] = mean[c] + axis[c] * lowest;
+            high[c] = mean[c] + axis[c] * highest;
+        }
+    }
+
+    // Least-squares endpoints for the chosen indices. Index 0..3 weighs c0 with 1, 0, 2/3, 1/3.
+    bool refineEndpoints(const ColorBlock &block, const std::uint8_t indices[16], float low[3], float high[3])
+    {
+        static constexpr float WEIGHTS[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[3] = {}, bx[3] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            float a = WEIGHTS[indices[i]];
+            float b = 1.0f - a;
+            float color[3] = {block.r[i], block.g[i], block.b[i]};
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (int c = 0; c < 3; c++)
+            {
+                ax[c] += a * color[c];
+                bx[c] += b * color[c];
+            }
+        }
+
+        float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-4f)
+            return false;
+        for (int c = 0; c < 3; c++)
+        {
+            high[c] = std::clamp((bb * ax[c] - ab * bx[c]) / determinant, 0.0f, 255.0f);
+            low[c] = std::clamp((aa * bx[c] - ab * ax[c]) / determinant, 0.0f, 255.0f);
+        }
+        return true;
+    }
+
+    void encodeBC1(const ColorBlock &block, CompressionQuality quality, const Kernels &kernels, unsigned char out[8])
+    {
+        float low[3], high[3];
+        BC1Candidate best;
+
+        if (quality == CompressionQuality::Fast)
+        {
+            boxEndpoints(block, low, high);
+            best = fitBC1(block, low, high, kernels);
+        }
+        else
+        {
+            principalEndpoints(block, low, high);
+            best = fitBC1(block, low, high, kernels);
+
+            if (quality == CompressionQuality::High)
+            {
+                boxEndpoints(block, low, high);
+                BC1Candidate box = fitBC1(block, low, high, kernels);
+                if (box.error < best.error)
+                    best = box;
+            }
+
+            int iterations = quality == CompressionQuality::High ? 4 : 1;
+            for (int iteration = 0; iteration < iterations && best.error > 0.0f; iteration++)
+            {
+                if (!refineEndpoints(block, best.indices, low, high))
+                    break;
+                BC1Candidate refined = fitBC1(block, low, high, kernels);
+                if (refined.error >= best.error)
+                    break;
+                best = refined;
+            }
+        }
+
+        std::uint32_t bits = 0;
+        for (int i = 0; i < 16; i++)
+            bits |= (std::uint32_t)best.indices[i] << (2 * i);
+
+        out[0] = (unsigned char)(best.c0 & 0xFF);
+        out[1] = (unsigned char)(best.c0 >> 8);
+        out[2] = (unsigned char)(best.c1 & 0xFF);
+        out[3] = (unsigned char)(best.c1 >> 8);
+        for (int i = 0; i < 4; i++)
+            out[4 + i] = (unsigned char)(bits >> (8 * i));
+    }
+
+    void decodeBC1(const unsigned char in[8], bool fourColors, unsigned char rgba[16][4])
+    {
+        std::uint16_t c0 = (std::uint16_t)(in[0] | (in[1] << 8));
+        std::uint16_t c1 = (std::uint16_t)(in[2] | (in[3] << 8));
+        std::uint32_t bits = (std::uint32_t)in[4] | ((std::uint32_t)in[5] << 8) | ((std::uint32_t)in[6] << 16) | ((std::uint32_t)in[7] << 24);
+
+        int palette[4][3];
+        bc1Palette(c0, c1, fourColors || c0 > c1, palette);
+        for (int i = 0; i < 16; i++)
+        {
+            const int *color = palette[(bits >> (2 * i)) & 3];
+            rgba[i][0] = (unsigned char)color[0];
+            rgba[i][1] = (unsigned char)color[1];
+            rgba[i][2] = (unsigned char)color[2];
+            rgba[i][3] = 255;
+        }
+    }
+
+    // --- BC4 ---------------------------------------------------------------
+
+    // Eight values when e0 > e1, otherwise six plus exact 0 and 255.
+    void bc4Palette(int e0, int e1, ValuePalette &palette)
+    {
+        palette[0] = (std::uint8_t)e0;
+        palette[1] = (std::uint8_t)e1;
+        if (e0 > e1)
+        {
+            for (int i = 2; i < 8; i++)
+                palette[i] = (std::uint8_t)(((8 - i) * e0 + (i - 1) * e1 + 3) / 7);
+        }
+        else
+        {
+            for (int i = 2; i < 6; i++)
+                palette[i] = (std::uint8_t)(((6 - i) * e0 + (i - 1) * e1 + 2) / 5);
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    struct BC4Candidate
+    {
+        std::uint8_t e0;
+        std::uint8_t e1;
+        std::uint8_t indices[16];
+        int error;
+    };
+
+    BC4Candidate fitBC4(const std::uint8_t values[16], int e0, int e1, const Kernels &kernels)
+    {
+        BC4Candidate candidate;
+        candidate.e0 = (std::uint8_t)e0;
+        candidate.e1 = (std::uint8_t)e1;
+        ValuePalette palette;
+        bc4Palette(e0, e1, palette);
+        candidate.error = kernels.valueIndices(values, palette, candidate.indices);
+        return candidate;
+    }
+
+    void encodeBC4(const std::uint8_t values[16], CompressionQuality quality, const Kernels &kernels, unsigned char out[8])
+    {
+        auto [minimum, maximum] = std::minmax_element(values, values + 16);
+        int low = *minimum, high = *maximum;
+        BC4Candidate best = fitBC4(values, high, low, kernels);
+
+        if (quality != CompressionQuality::Fast && best.error > 0)
+        {
+            // Six-value mode spends its interpolated values on the range between
+            // the extremes when the block also holds exact 0 or 255.
+            int innerLow = 255, innerHigh = 0;
+            for (int i = 0; i < 16; i++)
+            {
+                if (values[i] != 0 && values[i] != 255)
+                {
+                    innerLow = std::min(innerLow, (int)values[i]);
+                    innerHigh = std::max(innerHigh, (int)values[i]);
+                }
+            }
+            if (innerLow <= innerHigh && (low == 0 || high == 255))
+            {
+                BC4Candidate sixValues = fitBC4(values, innerLow, innerHigh, kernels);
+                if (sixValues.error < best.error)
+                    best = sixValues;
+            }
+        }
+
+        if (quality == CompressionQuality::High && best.error > 0)
+        {
+            // Pulling the endpoints in a little often fits the values in between better.
+            for (int e0 = high; e0 >= std::max(high - 3, low + 1); e0--)
+            {
+                for (int e1 = low; e1 <= std::min(low + 3, e0 - 1); e1++)
+                {
+                    BC4Candidate candidate = fitBC4(values, e0, e1, kernels);
+                    if (candidate.error < best.error)
+                        best = candidate;
+                }
+            }
+        }
+
+        std::uint64_t bits = 0;
+        for (int i = 0; i < 16; i++)
+            bits |= (std::uint64_t)best.indices[i] << (3 * i);
+
+        out[0] = best.e0;
+        out[1] = best.e1;
+        for (int i = 0; i < 6; i++)
+            out[2 + i] = (unsigned char)(bits >> (8 * i));
+    }
+
+    void decodeBC4(const unsigned char in[8], std::uint8_t values[16])
+    {
+        std::uint64_t bits = 0;
+        for (int i = 0; i < 6; i++)
+            bits |= (std::uint64_t)in[2 + i] << (8 * i);
+
+        ValuePalette palette;
+        bc4Palette(in[0], in[1], palette);
+        for (int i = 0; i < 16; i++)
+            values[i] = palette[(bits >> (3 * i)) & 7];
+    }
+
+    // --- Blocks ------------------------------------------------------------
+
+    void fetchBlock(const unsigned char *pixels, int width, int height, int channels, int blockX, int blockY, unsigned char rgba[16][4])
+    {
+        for (int y = 0; y < 4; y++)
+        {
+            int row = std::min(blockY * 4 + y, height - 1);
+            for (int x = 0; x < 4; x++)
+            {
+                int column = std::min(blockX * 4 + x, width - 1);
+                const unsigned char *source = pixels + ((std::size_t)row * width + column) * channels;
+                unsigned char *texel = rgba[y * 4 + x];
+                texel[0] = source[0];
+                texel[1] = channels > 1 ? source[1] : 0;
+                texel[2] = channels > 2 ? source[2] : 0;
+                texel[3] = channels > 3 ? source[3] : 255;
+            }
+        }
+    }
+
+    void splitColors(const unsigned char rgba[16][4], ColorBlock &block)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            block.r[i] = rgba[i][0];
+            block.g[i] = rgba[i][1];
+            block.b[i] = rgba[i][2];
+        }
+    }
+
+    void splitChannel(const unsigned char rgba[16][4], int channel, std::uint8_t values[16])
+    {
+        for (int i = 0; i < 16; i++)
+            values[i] = rgba[i][channel];
+    }
+}
+
+std::size_t blockBytes(BlockFormat format)
+{
+    return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+std::size_t compressedSize(BlockFormat format, int width, int height)
+{
+    return (std::size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+int blockFormatChannels(BlockFormat format)
+{
+    switch (format)
+    {
+    case BlockFormat::BC4:
+        return 1;
+    case BlockFormat::BC5:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+const char *blockFormatName(BlockFormat format)
+{
+    switch (format)
+    {
+    case BlockFormat::BC1:
+        return "BC1";
+    case BlockFormat::BC3:
+        return "BC3";
+    case BlockFormat::BC4:
+        return "BC4";
+    default:
+        return "BC5";
+    }
+}
+
+std::uint32_t blockFormatGLEnum(BlockFormat format)
+{
+    switch (format)
+    {
+    case BlockFormat::BC1:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BlockFormat::BC3:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BlockFormat::BC4:
+        return GL_COMPRESSED_RED_RGTC1;
+    default:
+        return GL_COMPRESSED_RG_RGTC2;
+    }
+}
+
+bool blockFormatFromGLEnum(std::uint32_t internalFormat, BlockFormat &format)
+{
+    switch (internalFormat)
+    {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        format = BlockFormat::BC1;
+        return true;
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        format = BlockFormat::BC3;
+        return true;
+    case GL_COMPRESSED_RED_RGTC1:
+        format = BlockFormat::BC4;
+        return true;
+    case GL_COMPRESSED_RG_RGTC2:
+        format = BlockFormat::BC5;
+        return true;
+    default:
+        return false;
+    }
+}
+
+void compressImage(const unsigned char *pixels, int width, int height, int channels, BlockFormat format,
+                   CompressionQuality quality, unsigned char *blocks, ThreadPool *pool)
+{
+    const Kernels kernels = selectKernels();
+    const int blocksWide = (width + 3) / 4;
+    const int blocksHigh = (height + 3) / 4;
+    const std::size_t stride = blockBytes(format);
+
+    auto compressRows = [&](std::size_t begin, std::size_t end)
+    {
+        unsigned char rgba[16][4];
+        ColorBlock colors;
+        std::uint8_t values[16];
+
+        for (std::size_t blockY = begin; blockY < end; blockY++)
+        {
+            for (int blockX = 0; blockX < blocksWide; blockX++)
+            {
+                unsigned char *out = blocks + (blockY * blocksWide + blockX) * stride;
+                fetchBlock(pixels, width, height, channels, blockX, (int)blockY, rgba);
+
+                switch (format)
+                {
+                case BlockFormat::BC1:
+                    splitColors(rgba, colors);
+                    encodeBC1(colors, quality, kernels, out);
+                    break;
+                case BlockFormat::BC3:
+                    splitChannel(rgba, 3, values);
+                    encodeBC4(values, quality, kernels, out);
+                    splitColors(rgba, colors);
+                    encodeBC1(colors, quality, kernels, out + 8);
+                    break;
+                case BlockFormat::BC4:
+                    splitChannel(rgba, 0, values);
+                    encodeBC4(values, quality, kernels, out);
+                    break;
+                case BlockFormat::BC5:
+                    splitChannel(rgba, 0, values);
+                    encodeBC4(values, quality, kernels, out);
+                    splitChannel(rgba, 1, values);
+                    encodeBC4(values, quality, kernels, out + 8);
+                    break;
+                }
+            }
+        }
+    };
+
+    if (pool != nullptr)
+        pool->parallelFor((std::size_t)blocksHigh, 1, compressRows);
+    else
+        compressRows(0, (std::size_t)blocksHigh);
+}
+
+void decompressImage(const unsigned char *blocks, int width, int height, BlockFormat format, unsigned char *pixels)
+{
+    const int blocksWide = (width + 3) / 4;
+    const int blocksHigh = (height + 3) / 4;
+    const std::size_t stride = blockBytes(format);
+    const int channels = blockFormatChannels(format);
+
+    unsigned char rgba[16][4];
+    std::uint8_t values[16];
+    for (int blockY = 0; blockY < blocksHigh; blockY++)
+    {
+        for (int blockX = 0; blockX < blocksWide; blockX++)
+        {
+            const unsigned char *in = blocks + ((std::size_t)blockY * blocksWide + blockX) * stride;
+            switch (format)
+            {
+            case BlockFormat::BC1:
+                decodeBC1(in, false, rgba);
+                break;
+            case BlockFormat::BC3:
+                decodeBC1(in + 8, true, rgba);
+                decodeBC4(in, values);
+                for (int i = 0; i < 16; i++)
+                    rgba[i][3] = values[i];
+                break;
+            case BlockFormat::BC4:
+                decodeBC4(in, values);
+                for (int i = 0; i < 16; i++)
+                    rgba[i][0] = values[i];
+                break;
+            case BlockFormat::BC5:
+                decodeBC4(in, values);
+                for (int i = 0; i < 16; i++)
+                    rgba[i][0] = values[i];
+                decodeBC4(in + 8, values);
+                for (int i = 0; i < 16; i++)
+                    rgba[i][1] = values[i];
+                break;
+            }
+
+            // Blocks hang over the right and bottom edges of odd sizes.
+            for (int y = 0; y < 4 && blockY * 4 + y < height; y++)
+            {
+                for (int x = 0; x < 4 && blockX * 4 + x < width; x++)
+                {
+                    unsigned char *target = pixels + ((std::size_t)(blockY * 4 + y) * width + blockX * 4 + x) * channels;
+                    for (int c = 0; c < channels; c++)
+                        target[c] = rgba[y * 4 + x][c];
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class ThreadPool;
+
+// S3TC and RGTC block formats. Each stores a 4x4 block of pixels in a fixed
+// number of bytes, and the GPU samples them without decompressing.
+enum class BlockFormat
+{
+    BC1, // RGB, 8 bytes per block (DXT1)
+    BC3, // RGBA, 16 bytes: BC1 color + BC4 alpha (DXT5)
+    BC4, // one channel, 8 bytes (RGTC1)
+    BC5  // two channels, 16 bytes (RGTC2)
+};
+
+// Fast fits the endpoints to the bounding box of a block's colors. Normal uses
+// the extremes along their principal axis, refined once by least squares, and
+// tries both BC4 modes. High also tries the bounding box, refines until that
+// stops helping and searches around the BC4 endpoints.
+enum class CompressionQuality
+{
+    Fast,
+    Normal,
+    High
+};
+
+std::size_t blockBytes(BlockFormat format);
+std::size_t compressedSize(BlockFormat format, int width, int height);
+
+// Channels that decompressImage writes: 4 for BC1 and BC3, 1 for BC4, 2 for BC5.
+int blockFormatChannels(BlockFormat format);
+
+const char *blockFormatName(BlockFormat format);
+
+// GL internal format, and back. RGTC is core since GL 3.0, S3TC needs
+// EXT_texture_compression_s3tc.
+std::uint32_t blockFormatGLEnum(BlockFormat format);
+bool blockFormatFromGLEnum(std::uint32_t internalFormat, BlockFormat &format);
+
+// Compress 8-bit pixels with `channels` interleaved channels into
+// compressedSize() bytes. BC1 reads RGB, BC3 RGBA, BC4 the first channel and
+// BC5 the first two; missing channels read as 0 (alpha as 255). Blocks past the
+// right or bottom edge repeat the last column or row. With a pool, rows of
+// blocks are spread over its threads. Uses the best SIMD path of simdLevel().
+void compressImage(const unsigned char *pixels, int width, int height, int channels, BlockFormat format,
+                   CompressionQuality quality, unsigned char *blocks, ThreadPool *pool = nullptr);
+
+// The inverse, into blockFormatChannels() channels per pixel.
+void decompressImage(const unsigned char *blocks, int width, int height, BlockFormat format, unsigned char *pixels);
@@ -0,0 +1,182 @@
+#include "compile_queue.hpp"
+
+#include <iostream>
+
+namespace
+{
+    void printCompileLog(unsigned int shader, const char *stage, const std::string &path)
+    {
+        int success = 0;
+        char infoLog[512];
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            glGetShaderInfoLog(shader, 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER::" << stage << "_SHADER_COMPILATION_FAILED " << path << "\n"
+                      << infoLog << std::endl;
+        }
+    }
+}
+
+CompileQueue::CompileQueue(ProgramCache *cache)
+    : cache(cache)
+{
+    parallel = GLAD_GL_KHR_parallel_shader_compile || GLAD_GL_ARB_parallel_shader_compile;
+
+    // Let the driver pick how many compiler threads to use.
+    if (GLAD_GL_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    else if (GLAD_GL_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+}
+
+void CompileQueue::add(Shader &target, const char *vertexPath, const char *fragmentPath)
+{
+    Job job{};
+    job.target = &target;
+    target.buildFailed = false;
+    job.vertexPath = vertexPath;
+    job.fragmentPath = fragmentPath;
+    queued.push_back(std::move(job));
+}
+
+void CompileQueue::add(Shader &target, const EmbeddedShader &vertex, const EmbeddedShader &fragment)
+{
+    Job job{};
+    job.target = &target;
+    target.buildFailed = false;
+    job.vertexPath = vertex.path;
+    job.fragmentPath = fragment.path;
+    job.vertexEmbedded = &vertex;
+    job.fragmentEmbedded = &fragment;
+    queued.push_back(std::move(job));
+}
+
+void CompileQueue::submit()
+{
+    // Kick off every stage first...
+    for (Job &job : queued)
+    {
+        ShaderSource vertexEmbedded, fragmentEmbedded;
+        if (job.vertexEmbedded != nullptr)
+        {
+            vertexEmbedded = ShaderSource::fromMemory(job.vertexEmbedded->source, job.vertexEmbedded->size, job.vertexEmbedded->hash);
+            fragmentEmbedded = ShaderSource::fromMemory(job.fragmentEmbedded->source, job.fragmentEmbedded->size, job.fragmentEmbedded->hash);
+        }
+
+        const ShaderSource &vertexSource = job.vertexEmbedded ? vertexEmbedded : shaderSources().load(job.vertexPath.c_str());
+        const ShaderSource &fragmentSource = job.fragmentEmbedded ? fragmentEmbedded : shaderSources().load(job.fragmentPath.c_str());
+        if (!vertexSource.valid || !fragmentSource.valid)
+        {
+            std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ " << (vertexSource.valid ? job.fragmentPath : job.vertexPath)
+                      << std::endl;
+            job.target->buildFailed = true;
+            continue;
+        }
+
+        if (cache != nullptr && cache->enabled())
+        {
+            job.cacheKey = cache->key(vertexSource.hash, fragmentSource.hash);
+            job.program = cache->load(job.cacheKey);
+            if (job.program != 0)
+                continue;
+        }
+
+        job.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        vertexSource.upload(job.vertexShader);
+        glCompileShader(job.vertexShader);
+        job.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        fragmentSource.upload(job.fragmentShader);
+        glCompileShader(job.fragmentShader);
+    }
+
+    // ...then every link. Linking doesn't wait for the compile result; a failed
+    // stage just makes the link fail, which finalize() reports.
+    for (Job &job : queued)
+    {
+        if (job.program == 0 && job.vertexShader == 0)
+            continue; // sources couldn't be read
+
+        if (job.program == 0)
+        {
+            job.program = glCreateProgram();
+            if (cache != nullptr)
+                cache->markRetrievable(job.program);
+            glAttachShader(job.program, job.vertexShader);
+            glAttachShader(job.program, job.fragmentShader);
+            glLinkProgram(job.program);
+        }
+        compiling.push_back(std::move(job));
+    }
+    queued.clear();
+}
+
+bool CompileQueue::isComplete(const Job &job) const
+{
+    // Restored binaries have no stages and are already linked.
+    if (!parallel || job.vertexShader == 0)
+        return true;
+
+    int done = 0;
+    glGetProgramiv(job.program, GL_COMPLETION_STATUS_KHR, &done);
+    return done != 0;
+}
+
+void CompileQueue::finalize(Job &job)
+{
+    bool fromSource = job.vertexShader != 0;
+    int success = 1;
+    if (fromSource)
+        glGetProgramiv(job.program, GL_LINK_STATUS, &success);
+
+    if (!success)
+    {
+        char infoLog[512];
+        printCompileLog(job.vertexShader, "VERTEX", job.vertexPath);
+        printCompileLog(job.fragmentShader, "FRAGMENT", job.fragmentPath);
+        glGetProgramInfoLog(job.program, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::SHADER_PROGRAM_LINKING_FAILED\n"
+                  << infoLog << std::endl;
+        glDeleteProgram(job.program);
+        job.target->buildFailed = true;
+    }
+    else
+    {
+        if (fromSource && cache != nullptr)
+            cache->store(job.cacheKey, job.program);
+        job.target->adopt(job.program);
+    }
+
+    if (fromSource)
+    {
+        glDeleteShader(job.vertexShader);
+        glDeleteShader(job.fragmentShader);
+    }
+}
+
+bool CompileQueue::poll()
+{
+    submit();
+
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < compiling.size(); i++)
+    {
+        if (isComplete(compiling[i]))
+            finalize(compiling[i]);
+        else if (kept++ != i)
+            compiling[kept - 1] = std::move(compiling[i]);
+    }
+    compiling.resize(kept);
+
+    return compiling.empty();
+}
+
+void CompileQueue::finish()
+{
+    submit();
+
+    // Querying the link status waits for the compiler anyway.
+    for (Job &job : compiling)
+        finalize(job);
+    compiling.clear();
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "shader.hpp"
+#include "program_cache.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Batches shader compilation so the driver never has to sync after each stage.
+//
+// add() only records the paths. submit() loads the sources and issues
+// glCompileShader/glLinkProgram for everything queued without asking for any
+// status, and poll() picks up the programs that are done. With KHR_parallel_shader_compile (or the ARB variant)
+// poll() never blocks: it checks GL_COMPLETION_STATUS and leaves unfinished
+// programs for a later frame. Without it, poll() finishes the whole batch at
+// once, which still keeps every status query after the last submission.
+//
+// Until a program is finished its Shader is not ready() and should not be drawn.
+// A program whose sources can't be read or that fails to build leaves its
+// Shader failed() instead.
+class CompileQueue
+{
+private:
+    struct Job
+    {
+        Shader *target;
+        std::string vertexPath;
+        std::string fragmentPath;
+        const EmbeddedShader *vertexEmbedded;
+        const EmbeddedShader *fragmentEmbedded;
+        std::uint64_t cacheKey;
+        unsigned int vertexShader;
+        unsigned int fragmentShader;
+        unsigned int program;
+    };
+
+    ProgramCache *cache;
+    bool parallel;
+
+    std::vector<Job> queued;
+    std::vector<Job> compiling;
+
+    bool isComplete(const Job &job) const;
+    void finalize(Job &job);
+
+public:
+    // Needs a current GL context.
+    explicit CompileQueue(ProgramCache *cache = nullptr);
+
+    // Queue a program. target must stay alive until it is ready().
+    void add(Shader &target, const char *vertexPath, const char *fragmentPath);
+    void add(Shader &target, const EmbeddedShader &vertex, const EmbeddedShader &fragment);
+
+    // Start compiling everything that was added since the last submit.
+    void submit();
+
+    // Finish the programs that are done. Returns true once nothing is pending.
+    bool poll();
+
+    // Block until every queued program is finished.
+    void finish();
+
+    bool parallelCompile() const
+    {
+        return parallel;
+    }
+
+    std::size_t pending() const
+    {
+        return queued.size() + compiling.size();
+    }
+};
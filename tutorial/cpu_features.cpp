@@ -0,0 +1,79 @@
+#include "cpu_features.hpp"
+
+#include <atomic>
+
+#if defined(LO_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+    SimdLevel detect()
+    {
+#if defined(LO_X86) && (defined(__GNUC__) || defined(__clang__))
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return SimdLevel::AVX2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return SimdLevel::SSE41;
+        return SimdLevel::SSE2;
+#elif defined(LO_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+
+        __cpuid(info, 1);
+        bool sse41 = (info[2] & (1 << 19)) != 0;
+        bool fma = (info[2] & (1 << 12)) != 0;
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+
+        // AVX state has to be enabled by the OS, not just supported by the CPU.
+        bool avxState = osxsave && (_xgetbv(0) & 0x6) == 0x6;
+        bool avx2 = false;
+        if (maxLeaf >= 7)
+        {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+
+        if (avx2 && fma && avxState)
+            return SimdLevel::AVX2;
+        return sse41 ? SimdLevel::SSE41 : SimdLevel::SSE2;
+#elif defined(LO_NEON)
+        return SimdLevel::NEON;
+#else
+        return SimdLevel::Scalar;
+#endif
+    }
+
+    std::atomic<SimdLevel> limit{SimdLevel::NEON};
+}
+
+SimdLevel simdLevel()
+{
+    static const SimdLevel supported = detect();
+    SimdLevel cap = limit.load(std::memory_order_relaxed);
+    return supported < cap ? supported : cap;
+}
+
+void setSimdLevelLimit(SimdLevel level)
+{
+    limit.store(level, std::memory_order_relaxed);
+}
+
+const char *simdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::SSE2:
+        return "SSE2";
+    case SimdLevel::SSE41:
+        return "SSE4.1";
+    case SimdLevel::AVX2:
+        return "AVX2";
+    case SimdLevel::NEON:
+        return "NEON";
+    default:
+        return "scalar";
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+// SIMD code in this directory is compiled for every instruction set it has a
+// path for (with per-function target attributes, no global -m flags) and picks
+// one at runtime with simdLevel().
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define LO_X86 1
+#endif
+// NEON is part of every AArch64 CPU (and ARMv7 builds with -mfpu=neon), so it
+// needs no detection or target attributes.
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define LO_NEON 1
+#endif
+
+#if defined(LO_X86) && (defined(__GNUC__) || defined(__clang__))
+#define LO_TARGET_SSE2 __attribute__((target("sse2")))
+#define LO_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define LO_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define LO_TARGET_SSE2
+#define LO_TARGET_SSE41
+#define LO_TARGET_AVX2
+#endif
+
+enum class SimdLevel
+{
+    Scalar,
+    SSE2,
+    SSE41,
+    AVX2,
+    NEON // ARM only; no x86 level is below or above it
+};
+
+// The best level this CPU supports, capped by setSimdLevelLimit().
+SimdLevel simdLevel();
+
+// Cap the level for everything that dispatches on simdLevel(), e.g. to compare
+// the paths in a benchmark.
+void setSimdLevelLimit(SimdLevel limit);
+
+const char *simdLevelName(SimdLevel level);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// A shader stage compiled into the executable by the embed_shaders build step.
+// source is the #include-expanded text and hash matches ShaderSource::hash for
+// the same file, so embedded and on-disk shaders share program cache entries.
+struct EmbeddedShader
+{
+    const char *path; // relative to the repository root
+    const char *source;
+    std::size_t size;
+    std::uint64_t hash;
+};
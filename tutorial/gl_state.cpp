@@ -0,0 +1,395 @@
+#include "gl_state.hpp"
+#include "gpu_memory.hpp"
+
+GLState &glState()
+{
+    static GLState state;
+    return state;
+}
+
+GLState::GLState()
+{
+    invalidate();
+}
+
+void GLState::invalidate()
+{
+    program = UNKNOWN;
+    programPipeline = UNKNOWN;
+    vertexArray = UNKNOWN;
+    activeUnit = UNKNOWN;
+    for (auto &unit : textures)
+        unit.fill(UNKNOWN);
+    samplers.fill(UNKNOWN);
+    buffers.fill(UNKNOWN);
+    capabilities.fill(UNKNOWN);
+    blendFuncs.fill(UNKNOWN);
+    blendEquationMode = UNKNOWN;
+    depthFuncMode = UNKNOWN;
+    depthWrite = UNKNOWN;
+    cullFaceMode = UNKNOWN;
+    frontFaceMode = UNKNOWN;
+    polygonModeValue = UNKNOWN;
+    viewportKnown = false;
+    clearColorKnown = false;
+}
+
+void GLState::beginFrame()
+{
+    previous = frame;
+    frame = Stats{};
+}
+
+int GLState::textureTarget(GLenum target)
+{
+    switch (target)
+    {
+    case GL_TEXTURE_2D:
+        return TEXTURE_2D;
+    case GL_TEXTURE_2D_ARRAY:
+        return TEXTURE_2D_ARRAY;
+    case GL_TEXTURE_3D:
+        return TEXTURE_3D;
+    case GL_TEXTURE_CUBE_MAP:
+        return TEXTURE_CUBE_MAP;
+    default:
+        return -1;
+    }
+}
+
+int GLState::bufferTarget(GLenum target)
+{
+    switch (target)
+    {
+    case GL_ARRAY_BUFFER:
+        return ARRAY_BUFFER;
+    case GL_ELEMENT_ARRAY_BUFFER:
+        return ELEMENT_ARRAY_BUFFER;
+    case GL_UNIFORM_BUFFER:
+        return UNIFORM_BUFFER;
+    case GL_PIXEL_UNPACK_BUFFER:
+        return PIXEL_UNPACK_BUFFER;
+    case GL_PIXEL_PACK_BUFFER:
+        return PIXEL_PACK_BUFFER;
+    case GL_COPY_READ_BUFFER:
+        return COPY_READ_BUFFER;
+    case GL_COPY_WRITE_BUFFER:
+        return COPY_WRITE_BUFFER;
+    default:
+        return -1;
+    }
+}
+
+int GLState::capability(GLenum cap)
+{
+    switch (cap)
+    {
+    case GL_BLEND:
+        return BLEND;
+    case GL_DEPTH_TEST:
+        return DEPTH_TEST;
+    case GL_CULL_FACE:
+        return CULL_FACE;
+    case GL_SCISSOR_TEST:
+        return SCISSOR_TEST;
+    case GL_STENCIL_TEST:
+        return STENCIL_TEST;
+    case GL_POLYGON_OFFSET_FILL:
+        return POLYGON_OFFSET_FILL;
+    case GL_FRAMEBUFFER_SRGB:
+        return FRAMEBUFFER_SRGB;
+    case GL_MULTISAMPLE:
+        return MULTISAMPLE;
+    default:
+        return -1;
+    }
+}
+
+bool GLState::change(unsigned int &shadowed, unsigned int value)
+{
+    if (shadowed == value)
+    {
+        frame.dropped++;
+        return false;
+    }
+    shadowed = value;
+    frame.issued++;
+    return true;
+}
+
+void GLState::useProgram(unsigned int id)
+{
+    if (change(program, id))
+        glUseProgram(id);
+}
+
+void GLState::bindProgramPipeline(unsigned int id)
+{
+    if (change(programPipeline, id))
+        glBindProgramPipeline(id);
+}
+
+void GLState::bindVertexArray(unsigned int id)
+{
+    if (change(vertexArray, id))
+    {
+        glBindVertexArray(id);
+        // The element array binding belongs to the VAO.
+        buffers[ELEMENT_ARRAY_BUFFER] = UNKNOWN;
+    }
+}
+
+void GLState::bindBuffer(GLenum target, unsigned int id)
+{
+    int index = bufferTarget(target);
+    if (index < 0)
+    {
+        frame.issued++;
+        glBindBuffer(target, id);
+        return;
+    }
+
+    if (change(buffers[index], id))
+        glBindBuffer(target, id);
+}
+
+void GLState::bindBufferBase(GLenum target, unsigned int index, unsigned int id)
+{
+    // Indexed bindings are rarely redundant. Issue it, but remember that it also
+    // changes the generic binding point.
+    frame.issued++;
+    glBindBufferBase(target, index, id);
+
+    int generic = bufferTarget(target);
+    if (generic >= 0)
+        buffers[generic] = id;
+}
+
+void GLState::activeTexture(GLenum unit)
+{
+    if (change(activeUnit, unit - GL_TEXTURE0))
+        glActiveTexture(unit);
+}
+
+void GLState::bindTexture(GLenum target, unsigned int id)
+{
+    int index = textureTarget(target);
+    if (index < 0 || activeUnit >= MAX_TEXTURE_UNITS)
+    {
+        frame.issued++;
+        glBindTexture(target, id);
+        return;
+    }
+
+    if (change(textures[activeUnit][index], id))
+        glBindTexture(target, id);
+}
+
+void GLState::bindTextureUnit(unsigned int unit, GLenum target, unsigned int id)
+{
+    int index = textureTarget(target);
+    if (index >= 0 && unit < MAX_TEXTURE_UNITS && textures[unit][index] == id)
+    {
+        frame.dropped++;
+        return;
+    }
+
+    activeTexture(GL_TEXTURE0 + unit);
+    bindTexture(target, id);
+}
+
+void GLState::bindSampler(unsigned int unit, unsigned int id)
+{
+    if (unit >= MAX_TEXTURE_UNITS)
+    {
+        frame.issued++;
+        glBindSampler(unit, id);
+        return;
+    }
+
+    if (change(samplers[unit], id))
+        glBindSampler(unit, id);
+}
+
+void GLState::deleteProgram(unsigned int id)
+{
+    glDeleteProgram(id);
+    if (program == id)
+        program = UNKNOWN;
+}
+
+void GLState::deleteProgramPipelines(int count, const unsigned int *ids)
+{
+    glDeleteProgramPipelines(count, ids);
+    for (int i = 0; i < count; i++)
+    {
+        if (programPipeline == ids[i])
+            programPipeline = 0;
+    }
+}
+
+void GLState::deleteVertexArrays(int count, const unsigned int *ids)
+{
+    glDeleteVertexArrays(count, ids);
+    for (int i = 0; i < count; i++)
+    {
+        if (vertexArray == ids[i])
+            vertexArray = 0;
+    }
+}
+
+void GLState::deleteBuffers(int count, const unsigned int *ids)
+{
+    glDeleteBuffers(count, ids);
+    gpuMemory().released(GL_BUFFER, count, ids);
+    for (int i = 0; i < count; i++)
+    {
+        for (unsigned int &buffer : buffers)
+        {
+            if (buffer == ids[i])
+                buffer = 0;
+        }
+    }
+}
+
+void GLState::deleteTextures(int count, const unsigned int *ids)
+{
+    glDeleteTextures(count, ids);
+    gpuMemory().released(GL_TEXTURE, count, ids);
+    for (int i = 0; i < count; i++)
+    {
+        for (auto &unit : textures)
+        {
+            for (unsigned int &texture : unit)
+            {
+                if (texture == ids[i])
+                    texture = 0;
+            }
+        }
+    }
+}
+
+void GLState::deleteSamplers(int count, const unsigned int *ids)
+{
+    glDeleteSamplers(count, ids);
+    for (int i = 0; i < count; i++)
+    {
+        for (unsigned int &sampler : samplers)
+        {
+            if (sampler == ids[i])
+                sampler = 0;
+        }
+    }
+}
+
+void GLState::deleteRenderbuffers(int count, const unsigned int *ids)
+{
+    // Renderbuffer bindings aren't shadowed.
+    glDeleteRenderbuffers(count, ids);
+    gpuMemory().released(GL_RENDERBUFFER, count, ids);
+}
+
+void GLState::enable(GLenum cap)
+{
+    int index = capability(cap);
+    if (index < 0)
+    {
+        frame.issued++;
+        glEnable(cap);
+        return;
+    }
+
+    if (change(capabilities[index], GL_TRUE))
+        glEnable(cap);
+}
+
+void GLState::disable(GLenum cap)
+{
+    int index = capability(cap);
+    if (index < 0)
+    {
+        frame.issued++;
+        glDisable(cap);
+        return;
+    }
+
+    if (change(capabilities[index], GL_FALSE))
+        glDisable(cap);
+}
+
+void GLState::blendFunc(GLenum src, GLenum dst)
+{
+    if (blendFuncs[0] == src && blendFuncs[1] == dst)
+    {
+        frame.dropped++;
+        return;
+    }
+    blendFuncs = {src, dst};
+    frame.issued++;
+    glBlendFunc(src, dst);
+}
+
+void GLState::blendEquation(GLenum mode)
+{
+    if (change(blendEquationMode, mode))
+        glBlendEquation(mode);
+}
+
+void GLState::depthFunc(GLenum func)
+{
+    if (change(depthFuncMode, func))
+        glDepthFunc(func);
+}
+
+void GLState::depthMask(bool write)
+{
+    if (change(depthWrite, write ? GL_TRUE : GL_FALSE))
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+}
+
+void GLState::cullFace(GLenum mode)
+{
+    if (change(cullFaceMode, mode))
+        glCullFace(mode);
+}
+
+void GLState::frontFace(GLenum mode)
+{
+    if (change(frontFaceMode, mode))
+        glFrontFace(mode);
+}
+
+void GLState::polygonMode(GLenum mode)
+{
+    // Core profile only has GL_FRONT_AND_BACK.
+    if (change(polygonModeValue, mode))
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+}
+
+void GLState::viewport(int x, int y, int width, int height)
+{
+    std::array<int, 4> rect = {x, y, width, height};
+    if (viewportKnown && viewportRect == rect)
+    {
+        frame.dropped++;
+        return;
+    }
+    viewportRect = rect;
+    viewportKnown = true;
+    frame.issued++;
+    glViewport(x, y, width, height);
+}
+
+void GLState::clearColor(float r, float g, float b, float a)
+{
+    std::array<float, 4> color = {r, g, b, a};
+    if (clearColorKnown && clearColorValue == color)
+    {
+        frame.dropped++;
+        return;
+    }
+    clearColorValue = color;
+    clearColorKnown = true;
+    frame.issued++;
+    glClearColor(r, g, b, a);
+}
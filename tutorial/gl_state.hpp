@@ -0,0 +1,149 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <array>
+
+// Shadows the GL binding and fixed-function state and drops calls that would
+// set what is already set. All code in this directory goes through glState()
+// instead of calling glUseProgram/glBindTexture/... directly, so the shadow
+// stays in sync. Code that changes state behind its back must call invalidate().
+//
+// A shadowed value of UNKNOWN means "not known yet"; the next call is always issued.
+class GLState
+{
+public:
+    static constexpr unsigned int UNKNOWN = 0xFFFFFFFF;
+    static constexpr unsigned int MAX_TEXTURE_UNITS = 32;
+
+    struct Stats
+    {
+        unsigned int issued = 0;
+        unsigned int dropped = 0;
+    };
+
+private:
+    enum TextureTarget
+    {
+        TEXTURE_2D,
+        TEXTURE_2D_ARRAY,
+        TEXTURE_3D,
+        TEXTURE_CUBE_MAP,
+        TEXTURE_TARGET_COUNT
+    };
+
+    enum BufferTarget
+    {
+        ARRAY_BUFFER,
+        ELEMENT_ARRAY_BUFFER,
+        UNIFORM_BUFFER,
+        PIXEL_UNPACK_BUFFER,
+        PIXEL_PACK_BUFFER,
+        COPY_READ_BUFFER,
+        COPY_WRITE_BUFFER,
+        BUFFER_TARGET_COUNT
+    };
+
+    enum Capability
+    {
+        BLEND,
+        DEPTH_TEST,
+        CULL_FACE,
+        SCISSOR_TEST,
+        STENCIL_TEST,
+        POLYGON_OFFSET_FILL,
+        FRAMEBUFFER_SRGB,
+        MULTISAMPLE,
+        CAPABILITY_COUNT
+    };
+
+    unsigned int program;
+    unsigned int programPipeline;
+    unsigned int vertexArray;
+    unsigned int activeUnit;
+    std::array<std::array<unsigned int, TEXTURE_TARGET_COUNT>, MAX_TEXTURE_UNITS> textures;
+    std::array<unsigned int, MAX_TEXTURE_UNITS> samplers;
+    std::array<unsigned int, BUFFER_TARGET_COUNT> buffers;
+    std::array<unsigned int, CAPABILITY_COUNT> capabilities;
+    std::array<unsigned int, 2> blendFuncs;
+    unsigned int blendEquationMode;
+    unsigned int depthFuncMode;
+    unsigned int depthWrite;
+    unsigned int cullFaceMode;
+    unsigned int frontFaceMode;
+    unsigned int polygonModeValue;
+    std::array<int, 4> viewportRect;
+    bool viewportKnown;
+    std::array<float, 4> clearColorValue;
+    bool clearColorKnown;
+
+    Stats frame;
+    Stats previous;
+
+    static int textureTarget(GLenum target);
+    static int bufferTarget(GLenum target);
+    static int capability(GLenum cap);
+
+    // Returns true if the call has to be issued, and counts it either way.
+    bool change(unsigned int &shadowed, unsigned int value);
+
+public:
+    GLState();
+
+    // Forget everything. The next call of every kind is issued.
+    void invalidate();
+
+    // Start a new frame. Stats for the finished frame move to lastFrame().
+    void beginFrame();
+    const Stats &lastFrame() const
+    {
+        return previous;
+    }
+    const Stats &currentFrame() const
+    {
+        return frame;
+    }
+
+    // * Bindings
+    void useProgram(unsigned int id);
+    // Only takes effect while no program is in use (useProgram(0)).
+    void bindProgramPipeline(unsigned int id);
+    void bindVertexArray(unsigned int id);
+    void bindBuffer(GLenum target, unsigned int id);
+    void bindBufferBase(GLenum target, unsigned int index, unsigned int id);
+    void activeTexture(GLenum unit);
+    void bindTexture(GLenum target, unsigned int id);
+    // Binds to the given unit index (0, 1, ...) and only touches the active unit if needed.
+    void bindTextureUnit(unsigned int unit, GLenum target, unsigned int id);
+    void bindSampler(unsigned int unit, unsigned int id);
+
+    unsigned int currentProgram() const
+    {
+        return program;
+    }
+
+    // * Deletion. Forwards to GL and forgets the deleted names, also in gpuMemory().
+    void deleteProgram(unsigned int id);
+    void deleteProgramPipelines(int count, const unsigned int *ids);
+    void deleteVertexArrays(int count, const unsigned int *ids);
+    void deleteBuffers(int count, const unsigned int *ids);
+    void deleteTextures(int count, const unsigned int *ids);
+    void deleteSamplers(int count, const unsigned int *ids);
+    void deleteRenderbuffers(int count, const unsigned int *ids);
+
+    // * Fixed-function state
+    void enable(GLenum cap);
+    void disable(GLenum cap);
+    void blendFunc(GLenum src, GLenum dst);
+    void blendEquation(GLenum mode);
+    void depthFunc(GLenum func);
+    void depthMask(bool write);
+    void cullFace(GLenum mode);
+    void frontFace(GLenum mode);
+    void polygonMode(GLenum mode);
+    void viewport(int x, int y, int width, int height);
+    void clearColor(float r, float g, float b, float a);
+};
+
+// The state of the current context.
+GLState &glState();
@@ -0,0 +1,382 @@
+#include "gpu_memory.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+GpuMemory &gpuMemory()
+{
+    static GpuMemory memory;
+    return memory;
+}
+
+const char *gpuMemoryCategoryName(GpuMemoryCategory category)
+{
+    switch (category)
+    {
+    case GpuMemoryCategory::Texture:
+        return "textures";
+    case GpuMemoryCategory::VertexBuffer:
+        return "vertex buffers";
+    case GpuMemoryCategory::IndexBuffer:
+        return "index buffers";
+    case GpuMemoryCategory::UniformBuffer:
+        return "uniform buffers";
+    case GpuMemoryCategory::PixelBuffer:
+        return "pixel buffers";
+    case GpuMemoryCategory::OtherBuffer:
+        return "other buffers";
+    case GpuMemoryCategory::Renderbuffer:
+        return "renderbuffers";
+    default:
+        return "?";
+    }
+}
+
+namespace
+{
+    // Bytes per 4x4 block, or 0 if the format isn't block compressed.
+    std::size_t compressedBlockBytes(GLenum internalFormat)
+    {
+        switch (internalFormat)
+        {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RED_RGTC1:
+        case GL_COMPRESSED_SIGNED_RED_RGTC1:
+            return 8;
+        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_RG_RGTC2:
+        case GL_COMPRESSED_SIGNED_RG_RGTC2:
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+        case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+        case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+            return 16;
+        default:
+            return 0;
+        }
+    }
+
+    std::size_t texelBytes(GLenum internalFormat)
+    {
+        switch (internalFormat)
+        {
+        case GL_RED:
+        case GL_R8:
+        case GL_R8_SNORM:
+        case GL_R8I:
+        case GL_R8UI:
+        case GL_STENCIL_INDEX8:
+            return 1;
+        case GL_RG:
+        case GL_RG8:
+        case GL_RG8_SNORM:
+        case GL_RG8I:
+        case GL_RG8UI:
+        case GL_R16:
+        case GL_R16_SNORM:
+        case GL_R16F:
+        case GL_R16I:
+        case GL_R16UI:
+        case GL_RGB565:
+        case GL_RGBA4:
+        case GL_RGB5_A1:
+        case GL_DEPTH_COMPONENT16:
+            return 2;
+        case GL_RGB16:
+        case GL_RGB16_SNORM:
+        case GL_RGB16F:
+        case GL_RGB16I:
+        case GL_RGB16UI:
+        case GL_RGBA16:
+        case GL_RGBA16_SNORM:
+        case GL_RGBA16F:
+        case GL_RGBA16I:
+        case GL_RGBA16UI:
+        case GL_RG32F:
+        case GL_RG32I:
+        case GL_RG32UI:
+        case GL_DEPTH32F_STENCIL8:
+            return 8;
+        case GL_RGB32F:
+        case GL_RGB32I:
+        case GL_RGB32UI:
+        case GL_RGBA32F:
+        case GL_RGBA32I:
+        case GL_RGBA32UI:
+            return 16;
+        default:
+            // GL_RGB(8), GL_RGBA(8), their sRGB, signed and integer forms, RG16,
+            // R32, the packed 32-bit formats and the depth formats.
+            return 4;
+        }
+    }
+
+    // Face of a cube map image target, 0 for every other target.
+    int cubeFace(GLenum target)
+    {
+        if (target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z)
+            return (int)(target - GL_TEXTURE_CUBE_MAP_POSITIVE_X);
+        return 0;
+    }
+
+    double mebibytes(std::size_t bytes)
+    {
+        return (double)bytes / (1024.0 * 1024.0);
+    }
+}
+
+std::size_t textureImageBytes(GLenum internalFormat, int width, int height, int depth)
+{
+    std::size_t blockBytes = compressedBlockBytes(internalFormat);
+    if (blockBytes != 0)
+        return (std::size_t)((width + 3) / 4) * (std::size_t)((height + 3) / 4) * blockBytes * (std::size_t)depth;
+    return (std::size_t)width * (std::size_t)height * (std::size_t)depth * texelBytes(internalFormat);
+}
+
+GpuMemory::Resource &GpuMemory::resource(GLenum identifier, unsigned int name, GpuMemoryCategory category)
+{
+    Resource &resource = resources[key(identifier, name)];
+    if (resource.category != category)
+    {
+        categories[(std::size_t)resource.category] -= resource.bytes;
+        categories[(std::size_t)category] += resource.bytes;
+        resource.category = category;
+    }
+    return resource;
+}
+
+void GpuMemory::resize(Resource &resource, std::size_t bytes)
+{
+    categories[(std::size_t)resource.category] += bytes - resource.bytes;
+    current += bytes - resource.bytes;
+    resource.bytes = bytes;
+    highest = std::max(highest, current);
+    checkBudget();
+}
+
+void GpuMemory::checkBudget()
+{
+    if (budgetBytes == 0 || current <= budgetBytes)
+    {
+        overBudget = false;
+    }
+    else if (!overBudget)
+    {
+        overBudget = true;
+        std::cerr << "ERROR::GPU_MEMORY::OVER_BUDGET " << std::fixed << std::setprecision(1) << mebibytes(current)
+                  << " MiB in use, budget " << mebibytes(budgetBytes) << " MiB" << std::defaultfloat << std::endl;
+    }
+}
+
+void GpuMemory::setImage(unsigned int texture, GLenum target, int level, std::size_t bytes)
+{
+    Resource &entry = resource(GL_TEXTURE, texture, GpuMemoryCategory::Texture);
+    std::size_t image = (std::size_t)level * 6 + (std::size_t)cubeFace(target);
+    if (entry.images.size() <= image)
+        entry.images.resize(image + 1, 0);
+    resize(entry, entry.bytes - entry.images[image] + bytes);
+    entry.images[image] = bytes;
+}
+
+void GpuMemory::setStorage(unsigned int texture, GLenum target, int levels, GLenum internalFormat, int width, int height, int depth)
+{
+    Resource &entry = resource(GL_TEXTURE, texture, GpuMemoryCategory::Texture);
+    int faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+    entry.images.assign((std::size_t)levels * 6, 0);
+
+    std::size_t bytes = 0;
+    for (int level = 0; level < levels; level++)
+    {
+        for (int face = 0; face < faces; face++)
+        {
+            std::size_t image = textureImageBytes(internalFormat, width, height, depth);
+            entry.images[(std::size_t)level * 6 + (std::size_t)face] = image;
+            bytes += image;
+        }
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+        // Array layers don't shrink, 3D slices do.
+        if (target == GL_TEXTURE_3D)
+            depth = std::max(depth / 2, 1);
+    }
+    resize(entry, bytes);
+}
+
+void GpuMemory::texImage2D(unsigned int texture, GLenum target, int level, GLenum internalFormat, int width, int height,
+                           GLenum format, GLenum type, const void *pixels)
+{
+    glTexImage2D(target, level, (GLint)internalFormat, width, height, 0, format, type, pixels);
+    setImage(texture, target, level, textureImageBytes(internalFormat, width, height));
+}
+
+void GpuMemory::texImage3D(unsigned int texture, GLenum target, int level, GLenum internalFormat, int width, int height, int depth,
+                           GLenum format, GLenum type, const void *pixels)
+{
+    glTexImage3D(target, level, (GLint)internalFormat, width, height, depth, 0, format, type, pixels);
+    setImage(texture, target, level, textureImageBytes(internalFormat, width, height, depth));
+}
+
+void GpuMemory::compressedTexImage2D(unsigned int texture, GLenum target, int level, GLenum internalFormat, int width, int height,
+                                     GLsizei size, const void *data)
+{
+    glCompressedTexImage2D(target, level, internalFormat, width, height, 0, size, data);
+    setImage(texture, target, level, (std::size_t)size);
+}
+
+void GpuMemory::compressedTexImage3D(unsigned int texture, GLenum target, int level, GLenum internalFormat, int width, int height,
+                                     int depth, GLsizei size, const void *data)
+{
+    glCompressedTexImage3D(target, level, internalFormat, width, height, depth, 0, size, data);
+    setImage(texture, target, level, (std::size_t)size);
+}
+
+void GpuMemory::generateMipmap(unsigned int texture, GLenum target, GLenum internalFormat, int width, int height)
+{
+    glGenerateMipmap(target);
+    // Levels that immutable storage already holds just get the same size again.
+    for (int level = 1; width > 1 || height > 1; level++)
+    {
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+        setImage(texture, target, level, textureImageBytes(internalFormat, width, height));
+    }
+}
+
+void GpuMemory::texStorage2D(unsigned int texture, GLenum target, int levels, GLenum internalFormat, int width, int height)
+{
+    glTexStorage2D(target, levels, internalFormat, width, height);
+    setStorage(texture, target, levels, internalFormat, width, height, 1);
+}
+
+void GpuMemory::texStorage3D(unsigned int texture, GLenum target, int levels, GLenum internalFormat, int width, int height, int depth)
+{
+    glTexStorage3D(target, levels, internalFormat, width, height, depth);
+    setStorage(texture, target, levels, internalFormat, width, height, depth);
+}
+
+void GpuMemory::bufferData(unsigned int buffer, GLenum target, GLsizeiptr size, const void *data, GLenum usage)
+{
+    glBufferData(target, size, data, usage);
+
+    GpuMemoryCategory category;
+    switch (target)
+    {
+    case GL_ARRAY_BUFFER:
+        category = GpuMemoryCategory::VertexBuffer;
+        break;
+    case GL_ELEMENT_ARRAY_BUFFER:
+        category = GpuMemoryCategory::IndexBuffer;
+        break;
+    case GL_UNIFORM_BUFFER:
+        category = GpuMemoryCategory::UniformBuffer;
+        break;
+    case GL_PIXEL_UNPACK_BUFFER:
+    case GL_PIXEL_PACK_BUFFER:
+        category = GpuMemoryCategory::PixelBuffer;
+        break;
+    default:
+        category = GpuMemoryCategory::OtherBuffer;
+        break;
+    }
+    resize(resource(GL_BUFFER, buffer, category), (std::size_t)size);
+}
+
+void GpuMemory::renderbufferStorage(unsigned int renderbuffer, GLenum internalFormat, int width, int height, int samples)
+{
+    if (samples > 0)
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, internalFormat, width, height);
+    else
+        glRenderbufferStorage(GL_RENDERBUFFER, internalFormat, width, height);
+
+    // The driver may pick more samples than asked for; this counts the request.
+    std::size_t bytes = textureImageBytes(internalFormat, width, height) * (std::size_t)std::max(samples, 1);
+    resize(resource(GL_RENDERBUFFER, renderbuffer, GpuMemoryCategory::Renderbuffer), bytes);
+}
+
+void GpuMemory::label(GLenum identifier, unsigned int name, const std::string &label)
+{
+    auto found = resources.find(key(identifier, name));
+    if (found != resources.end())
+    {
+        found->second.label = label;
+        return;
+    }
+
+    // Not allocated yet; the category is set when it is.
+    Resource &added = resources[key(identifier, name)];
+    added.category = identifier == GL_TEXTURE        ? GpuMemoryCategory::Texture
+                     : identifier == GL_RENDERBUFFER ? GpuMemoryCategory::Renderbuffer
+                                                     : GpuMemoryCategory::OtherBuffer;
+    added.label = label;
+}
+
+void GpuMemory::released(GLenum identifier, int count, const unsigned int *names)
+{
+    for (int i = 0; i < count; i++)
+    {
+        auto found = resources.find(key(identifier, names[i]));
+        if (found == resources.end())
+            continue;
+        resize(found->second, 0);
+        resources.erase(found);
+    }
+}
+
+std::vector<GpuAllocation> GpuMemory::largest(std::size_t count) const
+{
+    std::vector<GpuAllocation> allocations;
+    allocations.reserve(resources.size());
+    for (const auto &entry : resources)
+    {
+        if (entry.second.bytes == 0)
+            continue;
+        allocations.push_back({entry.second.category, (GLenum)(entry.first >> 32), (unsigned int)entry.first, entry.second.label,
+                               entry.second.bytes});
+    }
+
+    count = std::min(count, allocations.size());
+    std::partial_sort(allocations.begin(), allocations.begin() + (std::ptrdiff_t)count, allocations.end(),
+                      [](const GpuAllocation &a, const GpuAllocation &b) { return a.bytes > b.bytes; });
+    allocations.resize(count);
+    return allocations;
+}
+
+void GpuMemory::setBudget(std::size_t bytes)
+{
+    budgetBytes = bytes;
+    overBudget = false;
+    checkBudget();
+}
+
+void GpuMemory::printReport(std::size_t count) const
+{
+    std::cout << std::fixed << std::setprecision(2) << "GPU memory: " << mebibytes(current) << " MiB in use, peak "
+              << mebibytes(highest) << " MiB";
+    if (budgetBytes != 0)
+        std::cout << ", budget " << mebibytes(budgetBytes) << " MiB";
+    std::cout << "\n";
+
+    for (std::size_t category = 0; category < categories.size(); category++)
+    {
+        if (categories[category] != 0)
+            std::cout << "  " << std::left << std::setw(16) << gpuMemoryCategoryName((GpuMemoryCategory)category) << std::right
+                      << std::setw(10) << mebibytes(categories[category]) << " MiB\n";
+    }
+
+    for (const GpuAllocation &allocation : largest(count))
+    {
+        const char *kind = allocation.identifier == GL_TEXTURE  ? "texture"
+                           : allocation.identifier == GL_BUFFER ? "buffer"
+                                                                : "renderbuffer";
+        std::cout << "  " << std::setw(10) << mebibytes(allocation.bytes) << " MiB  " << kind << " " << allocation.name << " "
+                  << allocation.label << "\n";
+    }
+    std::cout << std::defaultfloat << std::flush;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class GpuMemoryCategory
+{
+    Texture,
+    VertexBuffer,  // GL_ARRAY_BUFFER
+    IndexBuffer,   // GL_ELEMENT_ARRAY_BUFFER
+    UniformBuffer,
+    PixelBuffer,   // GL_PIXEL_UNPACK_BUFFER and GL_PIXEL_PACK_BUFFER
+    OtherBuffer,
+    Renderbuffer,
+    Count
+};
+
+const char *gpuMemoryCategoryName(GpuMemoryCategory category);
+
+// Bytes one image of `internalFormat` takes as drivers store it: three-channel
+// formats are padded to four, unsized formats count as their 8-bit sized
+// ones and compressed formats take whole 4x4 blocks. `depth` is the number of
+// layers (or slices) of the level.
+std::size_t textureImageBytes(GLenum internalFormat, int width, int height, int depth = 1);
+
+// One GL object, for reports.
+struct GpuAllocation
+{
+    GpuMemoryCategory category;
+    GLenum identifier; // GL_TEXTURE, GL_BUFFER or GL_RENDERBUFFER
+    unsigned int name;
+    std::string label; // empty if never labelled
+    std::size_t bytes;
+};
+
+// Accounts for the video memory of textures, buffers and renderbuffers. All
+// code in this directory allocates them through gpuMemory() instead of calling
+// glTexImage2D/glBufferData/... directly; each call forwards to GL and records
+// the footprint of the named object, which must be the one bound to the
+// target. glState()'s delete functions hand the names back.
+//
+// The footprint is what the driver has to keep at least, per mip level and
+// cube face: padding and alignment beyond the format are the driver's and
+// aren't seen. Reallocating a level or a buffer replaces its old size.
+class GpuMemory
+{
+private:
+    struct Resource
+    {
+        GpuMemoryCategory category = GpuMemoryCategory::Texture;
+        std::string label;
+        std::vector<std::size_t> images; // textures: per level and face (level * 6 + face)
+        std::size_t bytes = 0;
+    };
+
+    std::unordered_map<std::uint64_t, Resource> resources;
+    std::array<std::size_t, (std::size_t)GpuMemoryCategory::Count> categories{};
+    std::size_t current = 0;
+    std::size_t highest = 0;
+    std::size_t budgetBytes = 0;
+    bool overBudget = false;
+
+    static std::uint64_t key(GLenum identifier, unsigned int name)
+    {
+        return (std::uint64_t)identifier << 32 | name;
+    }
+
+    Resource &resource(GLenum identifier, unsigned int name, GpuMemoryCategory category);
+    void resize(Resource &resource, std::size_t bytes);
+    void checkBudget();
+    void setImage(unsigned int texture, GLenum target, int level, std::size_t bytes);
+    void setStorage(unsigned int texture, GLenum target, int levels, GLenum internalFormat, int width, int height, int depth);
+
+public:
+    // * Textures
+    void texImage2D(unsigned int texture, GLenum target, int level, GLenum internalFormat, int width, int height, GLenum format,
+                    GLenum type, const void *pixels);
+    void texImage3D(unsigned int texture, GLenum target, int level, GLenum internalFormat, int width, int height, int depth,
+                    GLenum format, GLenum type, const void *pixels);
+    void compressedTexImage2D(unsigned int texture, GLenum target, int level, GLenum internalFormat, int width, int height,
+                              GLsizei size, const void *data);
+    void compressedTexImage3D(unsigned int texture, GLenum target, int level, GLenum internalFormat, int width, int height, int depth,
+                              GLsizei size, const void *data);
+    // Fills (and without texture storage, allocates) every level below the base
+    // level of `width` x `height`.
+    void generateMipmap(unsigned int texture, GLenum target, GLenum internalFormat, int width, int height);
+    // Needs ARB_texture_storage.
+    void texStorage2D(unsigned int texture, GLenum target, int levels, GLenum internalFormat, int width, int height);
+    void texStorage3D(unsigned int texture, GLenum target, int levels, GLenum internalFormat, int width, int height, int depth);
+
+    // * Buffers and renderbuffers. The category follows the target.
+    void bufferData(unsigned int buffer, GLenum target, GLsizeiptr size, const void *data, GLenum usage);
+    void renderbufferStorage(unsigned int renderbuffer, GLenum internalFormat, int width, int height, int samples = 0);
+
+    // Name shown in reports, like glObjectLabel. Kept until the object is deleted.
+    void label(GLenum identifier, unsigned int name, const std::string &label);
+
+    // The objects were deleted; their memory no longer counts.
+    void released(GLenum identifier, int count, const unsigned int *names);
+
+    // * Reporting
+    std::size_t total() const
+    {
+        return current;
+    }
+
+    // The highest total so far.
+    std::size_t peak() const
+    {
+        return highest;
+    }
+
+    std::size_t categoryBytes(GpuMemoryCategory category) const
+    {
+        return categories[(std::size_t)category];
+    }
+
+    // The `count` largest objects, largest first.
+    std::vector<GpuAllocation> largest(std::size_t count) const;
+
+    // Print an error each time the total goes over the budget. 0 turns it off.
+    void setBudget(std::size_t bytes);
+
+    std::size_t budget() const
+    {
+        return budgetBytes;
+    }
+
+    // Total, peak, the categories in use and the `count` largest objects.
+    void printReport(std::size_t count = 5) const;
+};
+
+// The accounting of the current context.
+GpuMemory &gpuMemory();
@@ -0,0 +1,11 @@
+#include "hash.hpp"
+
+std::uint64_t fnv1a(std::string_view data, std::uint64_t hash)
+{
+    for (unsigned char c : data)
+    {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
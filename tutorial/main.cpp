@@ -1,14 +1,26 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "shader.hpp"
-
+#include "compile_queue.hpp"
+#include "shader_reloader.hpp"
+#include "shader_variants.hpp"
+#include "shader_pipeline.hpp"
+#include "uniform_blocks.hpp"
+#include "gl_state.hpp"
+#include "gpu_memory.hpp"
+#include "texture_array.hpp"
+#include "texture_atlas.hpp"
+#include "texture_cache.hpp"
+#include "texture_streamer.hpp"
+#include "embedded_shaders.hpp"
+
+#include <algorithm>
 #include <iostream>
+#include <vector>
 
 // #define LO_VERBOSE
 
@@ -29,7 +41,7 @@ unsigned int indices[] = {
 
 void glfw_frame_buffer_size_callback(GLFWwindow *window, int width, int height)
 {
-    glViewport(0, 0, width, height);
+    glState().viewport(0, 0, width, height);
 #ifdef LO_VERBOSE
     std::cout << "Window resized to (" << width << ", " << height << ")" << std::endl;
 #endif
@@ -46,6 +58,17 @@ void process_input(GLFWwindow *window)
     }
 }
 
+// Position, color and texture coordinates of the bound VBO, in the layout of vertices.
+void set_vertex_attributes()
+{
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+}
+
 int main()
 {
     glfwInit();
@@ -68,63 +91,96 @@ int main()
         return -1;
     }
 
-    glViewport(0, 0, 800, 600);
+    glState().viewport(0, 0, 800, 600);
     glfwSetFramebufferSizeCallback(window, glfw_frame_buffer_size_callback);
 
-    // * Set shader texture parameters
-
-    // Mirror Repeat Texture
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-
-    // Set texture border color
-    float borderColor[] = {1.0f, 1.0f, 0.0f, 1.0f}; // Yellow, maybe??
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-    // Set texture filtering algos
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    stbi_set_flip_vertically_on_load(true);
-    int width, height, nrChannels;
-    unsigned char *data = stbi_load("resources/textures/container.jpg", &width, &height, &nrChannels, 0);
-
-    unsigned int textures[2];
-    glGenTextures(2, textures);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, textures[0]);
-
-    if (data)
-    {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    }
-    else
-    {
-        std::cerr << "ERROR::TEXTURE::STBI_DATA_EMPTY for texture 1" << std::endl;
-    }
-    stbi_image_free(data);
-    data = nullptr;
-
-    width = height = nrChannels = 0;
-    data = stbi_load("resources/textures/awesomeface.png", &width, &height, &nrChannels, 0);
-
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, textures[1]);
-    if (data)
-    {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    }
-    else
+    // Everything allocated below is accounted for; say so if it outgrows this.
+    gpuMemory().setBudget(128 * 1024 * 1024);
+
+    // * Load the textures
+    // They stream in on a worker thread while the rest is set up: the small mip
+    // levels first, then the larger ones as far as the quad's size on screen
+    // and the video memory budget call for.
+    SamplerCache samplerCache;
+    TextureStreamer textureStreamer(samplerCache, 64 * 1024 * 1024);
+
+    SamplerState sampler;
+    sampler.wrapS = GL_MIRRORED_REPEAT; // Mirror Repeat Texture
+    sampler.wrapT = GL_MIRRORED_REPEAT;
+    sampler.minFilter = GL_LINEAR_MIPMAP_LINEAR;
+    sampler.magFilter = GL_LINEAR;
+
+    // The bake_textures target packs resources/textures into one atlas, flipped
+    // and with its mip chain, so loading is a map and an upload, and drawing
+    // binds one texture. Each sampler reads its image's region of it.
+    StreamedTexture atlasTexture = textureStreamer.add("resources/baked/tutorial_atlas.ltex", sampler);
+    TextureAtlas atlas;
+    atlas.load("resources/baked/tutorial_atlas.atlas");
+
+    auto regionOf = [&atlas](const char *name)
     {
-        std::cerr << "ERROR::TEXTURE::STBI_DATA_EMPTY for texture 2" << std::endl;
-    }
-    stbi_image_free(data);
-    data = nullptr;
-
-    // Create the shader object
-    Shader shader("tutorial/shader.vs.glsl", "tutorial/shader.fs.glsl");
+        const AtlasRegion *region = atlas.find(name);
+        if (region == nullptr)
+            return glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+        return glm::vec4(region->offset[0], region->offset[1], region->scale[0], region->scale[1]);
+    };
+    glm::vec4 containerRegion = regionOf("container");
+    glm::vec4 faceRegion = regionOf("awesomeface");
+    // The quad shows a region of the atlas; the whole atlas would be this much larger on screen.
+    float atlasScale = 1.0f / std::min({containerRegion.z, containerRegion.w, faceRegion.z, faceRegion.w});
+
+    // Holding T shows the source images instead, decoded on worker threads and
+    // uploaded in the smallest format that holds them. The quad never covers
+    // more than 512 pixels, so larger images are shrunk on the worker, and the
+    // shrunk ones are kept on disk so the next run skips decoding them.
+    TextureLoader textureLoader;
+    textureLoader.setTextureLimits(TextureLimits{512, 0});
+    textureLoader.setDownscaleCache("texture_cache");
+    TextureCache textureCache(textureLoader, 32 * 1024 * 1024);
+
+    TextureOptions textureOptions;
+    textureOptions.sampler = sampler;
+    // The framebuffer isn't sRGB and the baked textures are UNORM, so sample
+    // the encoded values as they are, like the atlas does.
+    textureOptions.usage = TextureUsage::Data;
+    TextureRef sourceTextures[2] = {textureCache.acquire("resources/textures/container.jpg", textureOptions),
+                                    textureCache.acquire("resources/textures/awesomeface.png", textureOptions)};
+
+    // Queue the shader object. It compiles in the background while the buffers are
+    // set up, and linked programs are cached on disk between runs.
+    ProgramCache programCache("shader_cache");
+    CompileQueue compileQueue(&programCache);
+    Shader shader;
+#ifdef LO_EMBED_SHADERS
+    compileQueue.add(shader, embedded_shaders::tutorial_shader_vs_glsl, embedded_shaders::tutorial_shader_fs_glsl);
+    compileQueue.submit();
+
+    ShaderVariants shaderVariants(embedded_shaders::tutorial_shader_vs_glsl, embedded_shaders::tutorial_shader_fs_glsl, &programCache);
+
+    // Pipelines combine stage files; embedded builds have none, so P does nothing there.
+    ShaderPipelines shaderPipelines(&programCache);
+    ShaderPipeline *solid = nullptr;
+#else
+    compileQueue.add(shader, "tutorial/shader.vs.glsl", "tutorial/shader.fs.glsl");
+    compileQueue.submit();
+
+    // Edits to the shader files are picked up while the app runs. Embedded
+    // shaders have no files to watch, so there is no reloader then.
+    ShaderReloader shaderReloader;
+    shaderReloader.watch(shader, "tutorial/shader.vs.glsl", "tutorial/shader.fs.glsl");
+
+    // The variants and pipelines are not reloaded: edits show in them after a restart.
+    ShaderVariants shaderVariants("tutorial/shader.vs.glsl", "tutorial/shader.fs.glsl", &programCache);
+
+    // Holding P draws the quad in plain vertex colors. The vertex stage is the
+    // textured shader's, combined with another fragment stage instead of linked again.
+    ShaderPipelines shaderPipelines(&programCache);
+    ShaderPipeline *solid = &shaderPipelines.get("tutorial/shader.vs.glsl", "tutorial/solid.fs.glsl");
+    shaderPipelines.printStats();
+#endif
+    PipelineUniform<glm::mat4> solidTransform;
+    if (solid != nullptr)
+        solidTransform = solid->uniform<glm::mat4>("transform");
 
     // Create vertex buffer array
     unsigned int VBO = 0;  // buffer id
@@ -139,46 +195,106 @@ int main()
     glGenVertexArrays(1, &VAO);
 
     // First bind VAO. This is like the master state for our object.
-    glBindVertexArray(VAO);
+    glState().bindVertexArray(VAO);
 
     // Bind and populate EBO
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    gpuMemory().bufferData(EBO, GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
     // Bind the VBO (which binds it to VAO) and populate vertex data.
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+    gpuMemory().bufferData(VBO, GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
     // Set the vertex attribute pointers.
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    set_vertex_attributes();
 
     // Unbind the VBO. This is allowed since call the glVertexAttribPointer registered this VBO as the VBO for active VAO.
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glState().bindBuffer(GL_ARRAY_BUFFER, 0);
 
     // Unbind the VAO so that any call to some other VAO doesnt mistakenly modify this one.
-    glBindVertexArray(0);
+    glState().bindVertexArray(0);
 
     // Unbind the EBO
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    // * A row of small quads along the bottom, textured from texture arrays
+    // Images of one size and format share an array, so all quads using it take
+    // one bind and one instanced draw, each picking its layer per instance.
+    TextureArrayPool texturePool(samplerCache, sampler);
+    TextureLayer layers[2] = {texturePool.add("resources/baked/container.ltex"), texturePool.add("resources/baked/awesomeface.ltex")};
+
+    struct InstanceBatch
+    {
+        unsigned int array;
+        int first;
+        int count;
+    };
+    std::vector<float> instances; // x, y offset and layer per quad, grouped by array
+    std::vector<InstanceBatch> batches;
+    for (unsigned int array = 0; array < texturePool.arrayCount(); array++)
+    {
+        InstanceBatch batch{array, (int)instances.size() / 3, 0};
+        for (int quad = 0; quad < 8; quad++)
+        {
+            const TextureLayer &layer = layers[quad % 2];
+            if (layer.valid() && layer.array == array)
+            {
+                instances.insert(instances.end(), {-0.875f + quad * 0.25f, -0.85f, (float)layer.layer});
+                batch.count++;
+            }
+        }
+        batches.push_back(batch);
+    }
+
+    // Same quad, plus the per-instance attribute.
+    unsigned int instanceVBO = 0;
+    glGenBuffers(1, &instanceVBO);
+    unsigned int instancedVAO;
+    glGenVertexArrays(1, &instancedVAO);
+    glState().bindVertexArray(instancedVAO);
+    glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+    set_vertex_attributes();
+    glState().bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    gpuMemory().bufferData(instanceVBO, GL_ARRAY_BUFFER, (GLsizeiptr)(instances.size() * sizeof(float)), instances.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1); // advance once per instance, not per vertex
+    glState().bindVertexArray(0);
+    glState().bindBuffer(GL_ARRAY_BUFFER, 0);
+    glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
     // Uncomment this for wireframe mode.
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-    shader.use();
-    shader.setInt("texture1", 0);
-    shader.setInt("texture2", 1);
-
+    // Shared per-frame and per-camera data, uploaded once per frame for every program.
+    UniformBlock<FrameBlock> frameBlock;
+    UniformBlock<CameraBlock> cameraBlock;
+    frameBlock.data.textureMix = 0.2f;
+    cameraBlock.data.view = glm::mat4(1.0f);
+    cameraBlock.data.projection = glm::mat4(1.0f);
+
+    // Holding C draws with the vertex colored variant instead.
+    Shader *tinted = nullptr;
+    Uniform<glm::mat4> tintedTransform;
+    Shader *layered = nullptr;
+
+    Uniform<glm::mat4> transform;
+    Uniform<glm::vec4> region1, region2;
+    Uniform<int> texture2;
+    bool shader_configured = false;
     glm::mat4 trans(1.0f);
 
     float prev_time = 0.0f;
 
     while (!glfwWindowShouldClose(window))
     {
+        glState().beginFrame();
+#ifdef LO_VERBOSE
+        std::cout << "GL state calls last frame: " << glState().lastFrame().issued << " issued, "
+                  << glState().lastFrame().dropped << " dropped" << std::endl;
+        gpuMemory().printReport();
+#endif
+
         float now_time = (float)glfwGetTime();
         float time_elapsed = prev_time - now_time;
         prev_time = now_time;
@@ -186,34 +302,157 @@ int main()
         float rot_speed = 10.0f;
         trans = glm::rotate(trans, glm::radians(time_elapsed*rot_speed), glm::vec3(0.0f, 0.0f, 1.0f));
 
-        int trans_loc = glGetUniformLocation(shader.getID(), "transform");
-        glUniformMatrix4fv(trans_loc, 1, GL_FALSE, glm::value_ptr(trans));
+        // Pick up finished programs. Until then only the clear color is shown.
+        if (compileQueue.pending() > 0 && compileQueue.poll())
+            programCache.printStats();
+
+        // After a failed build the program arrives later, from the reloader once
+        // the source is fixed, so this waits for ready() rather than the queue.
+        if (!shader_configured && shader.ready())
+        {
+            shader.use();
+            shader.setInt("texture1", 0);
+            texture2 = shader.uniform<int>("texture2");
+            region1 = shader.uniform<glm::vec4>("region1");
+            region2 = shader.uniform<glm::vec4>("region2");
+            transform = shader.uniform<glm::mat4>("transform");
+            shader_configured = true;
+
+            // Build the variants this scene uses in one batch, before they are needed.
+            std::uint32_t vertexColor = shaderVariants.mask({"VERTEX_COLOR"});
+            std::uint32_t textureArray = shaderVariants.mask({"TEXTURE_ARRAY"});
+            shaderVariants.precompile({vertexColor, textureArray});
+            shaderVariants.printStats();
+
+            tinted = &shaderVariants.get(vertexColor);
+            tinted->use();
+            tinted->setInt("texture1", 0);
+            tinted->setInt("texture2", 0);
+            tinted->uniform<glm::vec4>("region1").set(containerRegion);
+            tinted->uniform<glm::vec4>("region2").set(faceRegion);
+            tintedTransform = tinted->uniform<glm::mat4>("transform");
+
+            layered = &shaderVariants.get(textureArray);
+            layered->use();
+            layered->setInt("layers", 0);
+            layered->uniform<glm::mat4>("transform").set(glm::scale(glm::mat4(1.0f), glm::vec3(0.2f)));
+        }
+
+        // Stream the atlas in as far as the quad's size on screen asks for.
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        glm::mat4 clipFromQuad = cameraBlock.data.projection * cameraBlock.data.view * trans;
+        float quadPixels = screenExtent(clipFromQuad, glm::vec2(-0.5f), glm::vec2(0.5f), framebufferWidth, framebufferHeight);
+        textureStreamer.setScreenSize(atlasTexture, quadPixels * atlasScale);
+        textureStreamer.update();
+
+        // Upload the source images that finished decoding, within the frame budget.
+        textureLoader.update();
+        textureCache.update();
+
+#ifndef LO_EMBED_SHADERS
+        // Swap in edited shaders at the frame boundary.
+        shaderReloader.update();
+#endif
+
+        frameBlock.data.time = now_time;
+        frameBlock.upload();
+        cameraBlock.upload();
 
         // Process Input
         process_input(window);
 
         // Rendering commands
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        glState().clearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
+        if (!shader_configured)
+        {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+            continue;
+        }
+
         // Use shader program and draw triangles
-        shader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, textures[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, textures[1]);
-        glBindVertexArray(VAO); // bind the VAO to use. this is bound to the EBO we used earlier.
+        // The atlas holds both images; the source textures take a unit each.
+        bool plain = solid != nullptr && solid->ready() && glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+        bool tint = !plain && tinted->ready() && glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+        bool sources = !plain && !tint && glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+        if (plain)
+        {
+            solid->use();
+            solidTransform.set(trans);
+        }
+        else if (tint)
+        {
+            tinted->use();
+            tintedTransform.set(trans);
+        }
+        else
+        {
+            shader.use();
+            transform.set(trans);
+            // The handles shadow their values, so these only upload on a switch.
+            region1.set(sources ? glm::vec4(0.0f, 0.0f, 1.0f, 1.0f) : containerRegion);
+            region2.set(sources ? glm::vec4(0.0f, 0.0f, 1.0f, 1.0f) : faceRegion);
+            texture2.set(sources ? 1 : 0);
+        }
+
+        if (sources)
+        {
+            textureCache.bind(0, sourceTextures[0]);
+            textureCache.bind(1, sourceTextures[1]);
+        }
+        else
+        {
+            textureStreamer.bind(0, atlasTexture);
+        }
+        glState().bindVertexArray(VAO); // bind the VAO to use. this is bound to the EBO we used earlier.
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
+        // One draw per texture array. Without glDrawElementsInstancedBaseInstance
+        // (GL 4.2) each batch points the instance attribute at its own range.
+        if (layered != nullptr && layered->ready())
+        {
+            layered->use();
+            glState().bindVertexArray(instancedVAO);
+            glState().bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            for (const InstanceBatch &batch : batches)
+            {
+                texturePool.bind(0, batch.array);
+                glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)(batch.first * 3 * sizeof(float)));
+                glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, batch.count);
+            }
+        }
+
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
     // Free up resource
-    glDeleteTextures(2, textures);
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    gpuMemory().printReport();
+    textureCache.printStats();
+    sourceTextures[0].reset();
+    sourceTextures[1].reset();
+    textureCache.destroy();
+    textureLoader.destroy();
+    textureStreamer.remove(atlasTexture);
+    textureStreamer.destroy();
+    texturePool.destroy();
+    samplerCache.destroy();
+    glState().deleteVertexArrays(1, &VAO);
+    glState().deleteBuffers(1, &VBO);
+    glState().deleteBuffers(1, &EBO);
+    glState().deleteVertexArrays(1, &instancedVAO);
+    glState().deleteBuffers(1, &instanceVBO);
     shader.destroy();
+    shaderVariants.destroy();
+    shaderPipelines.destroy();
+#ifndef LO_EMBED_SHADERS
+    shaderReloader.destroy();
+#endif
+    frameBlock.destroy();
+    cameraBlock.destroy();
 
     glfwTerminate();
     return 0;
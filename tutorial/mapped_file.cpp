@@ -0,0 +1,136 @@
+#include "mapped_file.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string &path)
+{
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+        return;
+    file = handle;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(handle, &fileSize))
+    {
+        unmap();
+        return;
+    }
+    if (fileSize.QuadPart == 0)
+    {
+        // Nothing to map, which CreateFileMapping refuses.
+        unmap();
+        opened = true;
+        return;
+    }
+
+    mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        unmap();
+        return;
+    }
+
+    data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    size = data ? (std::size_t)fileSize.QuadPart : 0;
+    opened = data != nullptr;
+    if (data == nullptr)
+        unmap();
+#else
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct stat info{};
+    if (fstat(fd, &info) == 0 && info.st_size == 0)
+    {
+        opened = true; // nothing to map, which mmap refuses
+    }
+    else if (info.st_size > 0)
+    {
+        void *address = mmap(NULL, (std::size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED)
+        {
+            data = (const char *)address;
+            size = (std::size_t)info.st_size;
+            opened = true;
+        }
+    }
+
+    // The mapping keeps the file alive.
+    close(fd);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other)
+    {
+        unmap();
+        std::swap(data, other.data);
+        std::swap(size, other.size);
+        std::swap(opened, other.opened);
+#ifdef _WIN32
+        std::swap(file, other.file);
+        std::swap(mapping, other.mapping);
+#endif
+    }
+    return *this;
+}
+
+void MappedFile::unmap()
+{
+#ifdef _WIN32
+    if (data != nullptr)
+        UnmapViewOfFile(data);
+    if (mapping != nullptr)
+        CloseHandle(mapping);
+    if (file != nullptr)
+        CloseHandle(file);
+    file = nullptr;
+    mapping = nullptr;
+#else
+    if (data != nullptr)
+        munmap((void *)data, size);
+#endif
+    data = nullptr;
+    size = 0;
+    opened = false;
+}
+
+void MappedFile::touch() const
+{
+    touch(0, size);
+}
+
+void MappedFile::touch(std::size_t offset, std::size_t length) const
+{
+    // Pages are 4 KiB or larger everywhere we run. The mapping starts on a page.
+    std::size_t end = offset + length < size ? offset + length : size;
+    volatile char sink = 0;
+    for (offset -= offset % 4096; offset < end; offset += 4096)
+        sink = sink + data[offset];
+    (void)sink;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+private:
+    const char *data = nullptr;
+    std::size_t size = 0;
+    bool opened = false; // an empty file is valid but has no mapping
+#ifdef _WIN32
+    void *file = nullptr;
+    void *mapping = nullptr;
+#endif
+
+    void unmap();
+
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool valid() const
+    {
+        return opened;
+    }
+
+    std::string_view view() const
+    {
+        return std::string_view(data, size);
+    }
+
+    // Read every page once, so whoever uses the mapping next (e.g. the GL thread)
+    // doesn't stall on page faults. Meant for worker threads.
+    void touch() const;
+    // The same for the pages of one range.
+    void touch(std::size_t offset, std::size_t length) const;
+};
@@ -0,0 +1,563 @@
+#include "mipmap.hpp"
+#include "cpu_features.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+
+#ifdef LO_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    // A level while it is being filtered: linear values, interleaved channels.
+    struct FloatImage
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<float> data;
+    };
+
+    // Source texels and weights of every target texel along one axis. Each has
+    // the same number of taps (unused ones weigh 0), indices clamped to the edge.
+    struct Kernel
+    {
+        int taps = 0;
+        std::vector<int> index;
+        std::vector<float> weight;
+    };
+
+    constexpr double PI = 3.14159265358979323846;
+
+    double sinc(double x)
+    {
+        if (std::fabs(x) < 1e-6)
+            return 1.0;
+        x *= PI;
+        return std::sin(x) / x;
+    }
+
+    // Modified Bessel function of the first kind, order 0 (series expansion).
+    double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 50 && term > sum * 1e-12; k++)
+        {
+            double factor = x / (2.0 * k);
+            term *= factor * factor;
+            sum += term;
+        }
+        return sum;
+    }
+
+    constexpr double FILTER_RADIUS = 3.0;
+
+    double kaiser(double t)
+    {
+        constexpr double ALPHA = 4.0;
+        if (std::fabs(t) >= FILTER_RADIUS)
+            return 0.0;
+        double r = t / FILTER_RADIUS;
+        return sinc(t) * besselI0(ALPHA * std::sqrt(1.0 - r * r)) / besselI0(ALPHA);
+    }
+
+    double lanczos(double t)
+    {
+        if (std::fabs(t) >= FILTER_RADIUS)
+            return 0.0;
+        return sinc(t) * sinc(t / FILTER_RADIUS);
+    }
+
+    // Mitchell-Netravali with B = C = 1/3, in the polynomial form of their paper.
+    double mitchell(double t)
+    {
+        constexpr double B = 1.0 / 3.0, C = 1.0 / 3.0;
+        t = std::fabs(t);
+        if (t < 1.0)
+            return ((12.0 - 9.0 * B - 6.0 * C) * t * t * t + (-18.0 + 12.0 * B + 6.0 * C) * t * t + (6.0 - 2.0 * B)) / 6.0;
+        if (t < 2.0)
+            return ((-B - 6.0 * C) * t * t * t + (6.0 * B + 30.0 * C) * t * t + (-12.0 * B - 48.0 * C) * t + (8.0 * B + 24.0 * C)) / 6.0;
+        return 0.0;
+    }
+
+    Kernel buildKernel(int sourceSize, int targetSize, MipFilter filter)
+    {
+        // Texel i covers [i, i + 1]; the filter is stretched to the target's texel
+        // size, but never narrower than a source texel.
+        double scale = (double)sourceSize / targetSize;
+        double stretch = std::max(scale, 1.0);
+        double radius = filter == MipFilter::Box ? 0.5 : filter == MipFilter::Mitchell ? 2.0 : FILTER_RADIUS;
+        double support = radius * stretch;
+
+        Kernel kernel;
+        kernel.taps = (int)std::ceil(2.0 * support) + 1;
+        kernel.index.resize((std::size_t)targetSize * kernel.taps);
+        kernel.weight.resize((std::size_t)targetSize * kernel.taps);
+
+        for (int target = 0; target < targetSize; target++)
+        {
+            double center = (target + 0.5) * scale;
+            int first = (int)std::floor(center - support);
+            int *index = &kernel.index[(std::size_t)target * kernel.taps];
+            float *weight = &kernel.weight[(std::size_t)target * kernel.taps];
+
+            std::vector<double> weights(kernel.taps);
+            double total = 0.0;
+            for (int tap = 0; tap < kernel.taps; tap++)
+            {
+                int texel = first + tap;
+                double w;
+                if (filter == MipFilter::Box)
+                    w = std::max(0.0, std::min<double>(texel + 1, center + support) - std::max<double>(texel, center - support));
+                else if (filter == MipFilter::Kaiser)
+                    w = kaiser((texel + 0.5 - center) / stretch);
+                else if (filter == MipFilter::Mitchell)
+                    w = mitchell((texel + 0.5 - center) / stretch);
+                else
+                    w = lanczos((texel + 0.5 - center) / stretch);
+
+                index[tap] = std::clamp(texel, 0, sourceSize - 1);
+                weights[tap] = w;
+                total += w;
+            }
+            for (int tap = 0; tap < kernel.taps; tap++)
+                weight[tap] = (float)(weights[tap] / total);
+        }
+        return kernel;
+    }
+
+    // Filter passes. A horizontal pass writes one row of targetWidth texels from
+    // a source row; a vertical pass sums weighted rows of `count` floats.
+    using HorizontalFn = void (*)(const float *source, int channels, const Kernel &kernel, int targetWidth, float *target);
+    using VerticalFn = void (*)(const float *const *rows, const float *weights, int taps, std::size_t count, float *target);
+
+    void horizontalTexels(const float *source, int channels, const Kernel &kernel, int begin, int end, float *target)
+    {
+        for (int x = begin; x < end; x++)
+        {
+            const int *index = &kernel.index[(std::size_t)x * kernel.taps];
+            const float *weight = &kernel.weight[(std::size_t)x * kernel.taps];
+            for (int c = 0; c < channels; c++)
+            {
+                float sum = 0.0f;
+                for (int tap = 0; tap < kernel.taps; tap++)
+                    sum += weight[tap] * source[(std::size_t)index[tap] * channels + c];
+                target[(std::size_t)x * channels + c] = sum;
+            }
+        }
+    }
+
+    void horizontalScalar(const float *source, int channels, const Kernel &kernel, int targetWidth, float *target)
+    {
+        horizontalTexels(source, channels, kernel, 0, targetWidth, target);
+    }
+
+    void verticalScalar(const float *const *rows, const float *weights, int taps, std::size_t count, float *target)
+    {
+        for (std::size_t i = 0; i < count; i++)
+        {
+            float sum = 0.0f;
+            for (int tap = 0; tap < taps; tap++)
+                sum += weights[tap] * rows[tap][i];
+            target[i] = sum;
+        }
+    }
+
+#ifdef LO_X86
+    // Four channels are one vector per texel; other counts take the scalar path.
+    LO_TARGET_SSE2 void horizontalSSE2(const float *source, int channels, const Kernel &kernel, int targetWidth, float *target)
+    {
+        if (channels != 4)
+        {
+            horizontalScalar(source, channels, kernel, targetWidth, target);
+            return;
+        }
+
+        for (int x = 0; x < targetWidth; x++)
+        {
+            const int *index = &kernel.index[(std::size_t)x * kernel.taps];
+            const float *weight = &kernel.weight[(std::size_t)x * kernel.taps];
+            __m128 sum = _mm_setzero_ps();
+            for (int tap = 0; tap < kernel.taps; tap++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weight[tap]), _mm_loadu_ps(source + (std::size_t)index[tap] * 4)));
+            _mm_storeu_ps(target + (std::size_t)x * 4, sum);
+        }
+    }
+
+    LO_TARGET_SSE2 void verticalSSE2(const float *const *rows, const float *weights, int taps, std::size_t count, float *target)
+    {
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 sum = _mm_setzero_ps();
+            for (int tap = 0; tap < taps; tap++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[tap]), _mm_loadu_ps(rows[tap] + i)));
+            _mm_storeu_ps(target + i, sum);
+        }
+        for (; i < count; i++)
+        {
+            float sum = 0.0f;
+            for (int tap = 0; tap < taps; tap++)
+                sum += weights[tap] * rows[tap][i];
+            target[i] = sum;
+        }
+    }
+
+    // Two four-channel texels per vector, one in each half.
+    LO_TARGET_AVX2 void horizontalAVX2(const float *source, int channels, const Kernel &kernel, int targetWidth, float *target)
+    {
+        if (channels != 4)
+        {
+            horizontalScalar(source, channels, kernel, targetWidth, target);
+            return;
+        }
+
+        int x = 0;
+        for (; x + 2 <= targetWidth; x += 2)
+        {
+            const int *index0 = &kernel.index[(std::size_t)x * kernel.taps];
+            const int *index1 = index0 + kernel.taps;
+            const float *weight0 = &kernel.weight[(std::size_t)x * kernel.taps];
+            const float *weight1 = weight0 + kernel.taps;
+
+            __m256 sum = _mm256_setzero_ps();
+            for (int tap = 0; tap < kernel.taps; tap++)
+            {
+                __m256 texels = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(source + (std::size_t)index0[tap] * 4)),
+                                                     _mm_loadu_ps(source + (std::size_t)index1[tap] * 4), 1);
+                __m256 weight = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(weight0[tap])), _mm_set1_ps(weight1[tap]), 1);
+                sum = _mm256_fmadd_ps(weight, texels, sum);
+            }
+            _mm256_storeu_ps(target + (std::size_t)x * 4, sum);
+        }
+        horizontalTexels(source, channels, kernel, x, targetWidth, target);
+    }
+
+    LO_TARGET_AVX2 void verticalAVX2(const float *const *rows, const float *weights, int taps, std::size_t count, float *target)
+    {
+        std::size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 sum = _mm256_setzero_ps();
+            for (int tap = 0; tap < taps; tap++)
+                sum = _mm256_fmadd_ps(_mm256_set1_ps(weights[tap]), _mm256_loadu_ps(rows[tap] + i), sum);
+            _mm256_storeu_ps(target + i, sum);
+        }
+        for (; i < count; i++)
+        {
+            float sum = 0.0f;
+            for (int tap = 0; tap < taps; tap++)
+                sum += weights[tap] * rows[tap][i];
+            target[i] = sum;
+        }
+    }
+#endif
+
+    struct Kernels
+    {
+        HorizontalFn horizontal;
+        VerticalFn vertical;
+    };
+
+    Kernels selectKernels()
+    {
+        switch (simdLevel())
+        {
+#ifdef LO_X86
+        case SimdLevel::AVX2:
+            return {horizontalAVX2, verticalAVX2};
+        case SimdLevel::SSE41:
+        case SimdLevel::SSE2:
+            return {horizontalSSE2, verticalSSE2};
+#endif
+        default:
+            return {horizontalScalar, verticalScalar};
+        }
+    }
+
+    void forRows(ThreadPool *pool, std::size_t rows, std::size_t grain, const std::function<void(std::size_t, std::size_t)> &body)
+    {
+        if (pool != nullptr)
+            pool->parallelFor(rows, grain, body);
+        else
+            body(0, rows);
+    }
+
+    // * sRGB
+
+    float srgbToLinear(float value)
+    {
+        return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+
+    float linearToSrgb(float value)
+    {
+        return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    }
+
+    const std::array<float, 256> &decodeTable()
+    {
+        static const std::array<float, 256> table = []
+        {
+            std::array<float, 256> values;
+            for (int i = 0; i < 256; i++)
+                values[i] = srgbToLinear(i / 255.0f);
+            return values;
+        }();
+        return table;
+    }
+
+    // Linear values in steps of 1/ENCODE_STEPS to 8-bit sRGB. Fine enough that
+    // even the steep part near black rounds like the exact formula.
+    constexpr int ENCODE_STEPS = 16383;
+
+    const std::vector<unsigned char> &encodeTable()
+    {
+        static const std::vector<unsigned char> table = []
+        {
+            std::vector<unsigned char> values(ENCODE_STEPS + 1);
+            for (int i = 0; i <= ENCODE_STEPS; i++)
+                values[i] = (unsigned char)std::lround(linearToSrgb((float)i / ENCODE_STEPS) * 255.0f);
+            return values;
+        }();
+        return table;
+    }
+
+    // A filtered value back to 8 bits. Negative lobes can overshoot, hence the clamp.
+    unsigned char encode(float value, bool srgb, const std::vector<unsigned char> &toSrgb)
+    {
+        value = std::clamp(value, 0.0f, 1.0f);
+        return srgb ? toSrgb[(std::size_t)(value * ENCODE_STEPS + 0.5f)] : (unsigned char)(value * 255.0f + 0.5f);
+    }
+
+    // * Alpha coverage
+
+    int alphaChannel(int channels)
+    {
+        return channels == 2 || channels == 4 ? channels - 1 : -1;
+    }
+
+    float coverage(const FloatImage &image, int channels, int alpha, float cutoff, float scale)
+    {
+        std::size_t pixels = (std::size_t)image.width * image.height;
+        std::size_t passing = 0;
+        for (std::size_t i = 0; i < pixels; i++)
+            passing += image.data[i * channels + alpha] * scale > cutoff;
+        return (float)passing / (float)pixels;
+    }
+
+    // The alpha scale that gives `image` the coverage of the base image.
+    float coverageScale(const FloatImage &image, int channels, int alpha, float cutoff, float target)
+    {
+        float low = 0.0f, high = 16.0f;
+        for (int iteration = 0; iteration < 20; iteration++)
+        {
+            float middle = 0.5f * (low + high);
+            if (coverage(image, channels, alpha, cutoff, middle) > target)
+                high = middle;
+            else
+                low = middle;
+        }
+        return 0.5f * (low + high);
+    }
+
+    // * Filtering
+
+    void downsample(const FloatImage &source, int channels, MipFilter filter, const Kernels &kernels, ThreadPool *pool, FloatImage &target)
+    {
+        target.width = mipSize(source.width);
+        target.height = mipSize(source.height);
+        target.data.resize((std::size_t)target.width * target.height * channels);
+
+        Kernel horizontal = buildKernel(source.width, target.width, filter);
+        Kernel vertical = buildKernel(source.height, target.height, filter);
+
+        // * 1. Every source row to the target width
+        std::size_t rowFloats = (std::size_t)target.width * channels;
+        std::vector<float> narrow(rowFloats * source.height);
+        forRows(pool, (std::size_t)source.height, 8, [&](std::size_t begin, std::size_t end)
+                {
+            for (std::size_t y = begin; y < end; y++)
+                kernels.horizontal(&source.data[y * source.width * channels], channels, horizontal, target.width, &narrow[y * rowFloats]); });
+
+        // * 2. Then the rows down to the target height
+        forRows(pool, (std::size_t)target.height, 8, [&](std::size_t begin, std::size_t end)
+                {
+            std::vector<const float *> rows(vertical.taps);
+            for (std::size_t y = begin; y < end; y++)
+            {
+                for (int tap = 0; tap < vertical.taps; tap++)
+                    rows[tap] = &narrow[(std::size_t)vertical.index[y * vertical.taps + tap] * rowFloats];
+                kernels.vertical(rows.data(), &vertical.weight[y * vertical.taps], vertical.taps, rowFloats, &target.data[y * rowFloats]);
+            } });
+    }
+}
+
+int mipLevelCount(int width, int height)
+{
+    int levels = 1;
+    while (width > 1 || height > 1)
+    {
+        width = mipSize(width);
+        height = mipSize(height);
+        levels++;
+    }
+    return levels;
+}
+
+std::vector<MipLevel> generateMips(const unsigned char *pixels, int width, int height, int channels,
+                                   const MipOptions &options, ThreadPool *pool)
+{
+    int count = mipLevelCount(width, height) - 1;
+    if (count == 0)
+        return {};
+
+    const Kernels kernels = selectKernels();
+    const int alpha = alphaChannel(channels);
+    const bool preserveCoverage = alpha >= 0 && options.alphaCutoff > 0.0f;
+    auto isSrgb = [&](int channel)
+    {
+        return options.srgb && channel != alpha;
+    };
+
+    // * 1. The base image to linear floats
+    FloatImage base{width, height, std::vector<float>((std::size_t)width * height * channels)};
+    const std::array<float, 256> &toLinear = decodeTable();
+    forRows(pool, (std::size_t)height, 8, [&](std::size_t begin, std::size_t end)
+            {
+        for (std::size_t i = begin * width * channels; i < end * width * channels; i += channels)
+            for (int channel = 0; channel < channels; channel++)
+                base.data[i + channel] = isSrgb(channel) ? toLinear[pixels[i + channel]] : pixels[i + channel] / 255.0f; });
+
+    float baseCoverage = preserveCoverage ? coverage(base, channels, alpha, options.alphaCutoff, 1.0f) : 0.0f;
+
+    // * 2. Each level from the one above
+    std::vector<FloatImage> filtered(count);
+    for (int level = 0; level < count; level++)
+    {
+        downsample(level == 0 ? base : filtered[level - 1], channels, options.filter, kernels, pool, filtered[level]);
+        if (level == 0)
+            base = FloatImage();
+    }
+
+    // * 3. Back to 8 bits, rows of every level at once
+    std::vector<float> alphaScale(count, 1.0f);
+    if (preserveCoverage)
+    {
+        forRows(pool, (std::size_t)count, 1, [&](std::size_t begin, std::size_t end)
+                {
+            for (std::size_t level = begin; level < end; level++)
+                alphaScale[level] = coverageScale(filtered[level], channels, alpha, options.alphaCutoff, baseCoverage); });
+    }
+
+    std::vector<MipLevel> levels(count);
+    std::vector<std::size_t> firstRow(count + 1, 0);
+    for (int level = 0; level < count; level++)
+    {
+        levels[level].width = filtered[level].width;
+        levels[level].height = filtered[level].height;
+        levels[level].pixels.resize(filtered[level].data.size());
+        firstRow[level + 1] = firstRow[level] + filtered[level].height;
+    }
+
+    const std::vector<unsigned char> &toSrgb = encodeTable();
+    forRows(pool, firstRow[count], 8, [&](std::size_t begin, std::size_t end)
+            {
+        int level = (int)(std::upper_bound(firstRow.begin(), firstRow.end(), begin) - firstRow.begin()) - 1;
+        for (std::size_t row = begin; row < end; row++)
+        {
+            while (row >= firstRow[level + 1])
+                level++;
+
+            const FloatImage &image = filtered[level];
+            std::size_t rowFloats = (std::size_t)image.width * channels;
+            std::size_t offset = (row - firstRow[level]) * rowFloats;
+            for (std::size_t i = offset; i < offset + rowFloats; i += channels)
+            {
+                for (int channel = 0; channel < channels; channel++)
+                {
+                    float value = image.data[i + channel];
+                    if (channel == alpha)
+                        value *= alphaScale[level];
+                    levels[level].pixels[i + channel] = encode(value, isSrgb(channel), toSrgb);
+                }
+            }
+        } });
+
+    return levels;
+}
+
+void resizeImage(const unsigned char *pixels, int width, int height, int channels, unsigned char *target, int targetWidth,
+                 int targetHeight, const MipOptions &options, ThreadPool *pool)
+{
+    // Target rows per band. Neighbouring bands share the source rows under the
+    // filter's overlap and filter them twice; larger bands waste less on that
+    // but hold more rows.
+    constexpr std::size_t BAND_ROWS = 32;
+
+    const Kernels kernels = selectKernels();
+    const int alpha = alphaChannel(channels);
+    // The SIMD horizontal passes want four channels; an unused fourth costs less than the scalar path.
+    const int stride = channels == 3 ? 4 : channels;
+    // Bytes to floats by table per channel, sRGB or not, so the loop has no branches.
+    static const std::array<float, 256> linear = []
+    {
+        std::array<float, 256> values;
+        for (int i = 0; i < 256; i++)
+            values[i] = i / 255.0f;
+        return values;
+    }();
+    bool isSrgb[4];
+    const float *toFloat[4];
+    for (int channel = 0; channel < 4; channel++)
+    {
+        isSrgb[channel] = options.srgb && channel != alpha;
+        toFloat[channel] = isSrgb[channel] ? decodeTable().data() : linear.data();
+    }
+
+    Kernel horizontal = buildKernel(width, targetWidth, options.filter);
+    Kernel vertical = buildKernel(height, targetHeight, options.filter);
+    const std::vector<unsigned char> &toSrgb = encodeTable();
+    std::size_t rowFloats = (std::size_t)targetWidth * stride;
+
+    forRows(pool, (std::size_t)targetHeight, BAND_ROWS, [&](std::size_t begin, std::size_t end)
+            {
+        // * 1. The source rows under the band
+        int first = height, last = 0;
+        for (std::size_t i = begin * vertical.taps; i < end * vertical.taps; i++)
+        {
+            first = std::min(first, vertical.index[i]);
+            last = std::max(last, vertical.index[i]);
+        }
+
+        // * 2. Each of them to linear floats and the target width
+        std::vector<float> source((std::size_t)width * stride, 0.0f);
+        std::vector<float> narrow((std::size_t)(last - first + 1) * rowFloats);
+        for (int y = first; y <= last; y++)
+        {
+            const unsigned char *row = pixels + (std::size_t)y * width * channels;
+            for (int x = 0; x < width; x++)
+                for (int channel = 0; channel < channels; channel++)
+                    source[(std::size_t)x * stride + channel] = toFloat[channel][row[(std::size_t)x * channels + channel]];
+            kernels.horizontal(source.data(), stride, horizontal, targetWidth, &narrow[(std::size_t)(y - first) * rowFloats]);
+        }
+
+        // * 3. Down to the band's rows and back to 8 bits
+        std::vector<const float *> rows(vertical.taps);
+        std::vector<float> filtered(rowFloats);
+        for (std::size_t y = begin; y < end; y++)
+        {
+            for (int tap = 0; tap < vertical.taps; tap++)
+                rows[tap] = &narrow[(std::size_t)(vertical.index[y * vertical.taps + tap] - first) * rowFloats];
+            kernels.vertical(rows.data(), &vertical.weight[y * vertical.taps], vertical.taps, rowFloats, filtered.data());
+
+            unsigned char *out = target + y * targetWidth * channels;
+            for (int x = 0; x < targetWidth; x++)
+                for (int channel = 0; channel < channels; channel++)
+                    out[(std::size_t)x * channels + channel] = encode(filtered[(std::size_t)x * stride + channel], isSrgb[channel], toSrgb);
+        } });
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+
+class ThreadPool;
+
+// Number of levels in a full mip chain down to 1x1.
+int mipLevelCount(int width, int height);
+
+// Size of the next smaller level: half, rounded down, but at least 1.
+inline int mipSize(int size)
+{
+    return size > 1 ? size / 2 : 1;
+}
+
+enum class MipFilter
+{
+    Box,     // average of the covered texels; softest aliasing, blurriest
+    Kaiser,  // Kaiser-windowed sinc, 3 texels wide; sharp with little ringing
+    Lanczos, // Lanczos-3; sharpest, rings a little at hard edges
+    Mitchell // Mitchell-Netravali cubic (B = C = 1/3), 2 texels wide; softer than Lanczos, hardly rings
+};
+
+struct MipOptions
+{
+    MipFilter filter = MipFilter::Kaiser;
+    // The color channels hold sRGB-encoded values: filter in linear light and
+    // encode the result again, so averages don't darken. Alpha (the last
+    // channel of 2 and 4 channel images) is always linear.
+    bool srgb = true;
+    // Above 0: scale each level's alpha so the share of texels that pass an
+    // alpha test against this cutoff stays that of the base image, so cut-outs
+    // don't thin out or disappear in the distance.
+    float alphaCutoff = 0.0f;
+
+    bool operator==(const MipOptions &) const = default;
+};
+
+struct MipLevel
+{
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;
+};
+
+// Every level below an 8-bit image with interleaved channels, largest first
+// (mipLevelCount() - 1 of them). Each level is filtered from the one above in
+// 32-bit float, so rounding doesn't add up down the chain, and the filter
+// follows the actual scale, so odd sizes (5 texels to 2) are weighted right.
+// With a pool, the rows of each filter pass and the conversion back to 8 bits
+// of all levels at once are spread over its threads. The filter passes use the
+// best SIMD path of simdLevel().
+std::vector<MipLevel> generateMips(const unsigned char *pixels, int width, int height, int channels,
+                                   const MipOptions &options, ThreadPool *pool = nullptr);
+
+// Shrink an 8-bit image with interleaved channels to targetWidth x
+// targetHeight (each no larger than the source), filtered like the mips:
+// in linear light for options.srgb, with the filter stretched to the actual
+// scale. alphaCutoff doesn't apply. Source rows are converted to float and
+// filtered horizontally a band at a time, so no float copy of the whole source
+// is made; the bands are spread over `pool`. Both passes use the best SIMD path
+// of simdLevel(); three-channel images are padded to four on the way for it.
+void resizeImage(const unsigned char *pixels, int width, int height, int channels, unsigned char *target, int targetWidth,
+                 int targetHeight, const MipOptions &options, ThreadPool *pool = nullptr);
@@ -0,0 +1,1092 @@
+#include "parallel_decode.hpp"
+#include "thread_pool.hpp"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <utility>
+
+namespace
+{
+    unsigned int read16(const unsigned char *bytes)
+    {
+        return (unsigned int)bytes[0] << 8 | bytes[1];
+    }
+
+    std::uint32_t read32(const unsigned char *bytes)
+    {
+        return (std::uint32_t)bytes[0] << 24 | (std::uint32_t)bytes[1] << 16 | (std::uint32_t)bytes[2] << 8 | bytes[3];
+    }
+
+    unsigned char clampSample(int value)
+    {
+        return (unsigned char)(value < 0 ? 0 : value > 255 ? 255 : value);
+    }
+
+    void forRange(ThreadPool *pool, std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)> &body)
+    {
+        if (pool != nullptr)
+            pool->parallelFor(count, grain, body);
+        else
+            body(0, count);
+    }
+
+    // About eight chunks per thread, so a slow one doesn't hold up the rest.
+    std::size_t balancedGrain(ThreadPool *pool, std::size_t count)
+    {
+        std::size_t threads = pool != nullptr ? pool->size() + 1 : 1;
+        return std::max<std::size_t>(1, count / (threads * 8));
+    }
+
+    // * JPEG
+
+    // Natural (row by row) index of each coefficient in zigzag order.
+    constexpr unsigned char ZIGZAG[64] = {0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+                                          12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+                                          35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+                                          58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+    constexpr int FAST_BITS = 9;
+
+    struct HuffmanTable
+    {
+        bool defined = false;
+        // length << 8 | symbol of the code the next FAST_BITS bits start with;
+        // 0 if that code is longer.
+        std::array<std::uint16_t, 1 << FAST_BITS> fast{};
+        std::array<std::uint8_t, 256> symbols{};
+        std::array<int, 17> maxCode{}; // largest code of each length, -1 if none
+        std::array<int, 17> offset{};  // index in symbols minus code, per length
+        // For encoding: the code of each symbol, length 0 if it has none.
+        std::array<std::uint16_t, 256> codes{};
+        std::array<std::uint8_t, 256> lengths{};
+    };
+
+    // Canonical codes from the counts per length, as in a DHT segment.
+    bool buildHuffman(const unsigned char *counts, const unsigned char *symbols, HuffmanTable &table)
+    {
+        table = HuffmanTable();
+        int index = 0;
+        unsigned int code = 0;
+        for (int length = 1; length <= 16; length++)
+        {
+            table.offset[length] = index - (int)code;
+            for (int i = 0; i < counts[length - 1]; i++, index++, code++)
+            {
+                if (code >= 1u << length)
+                    return false;
+                unsigned char symbol = symbols[index];
+                table.symbols[index] = symbol;
+                table.codes[symbol] = (std::uint16_t)code;
+                table.lengths[symbol] = (std::uint8_t)length;
+                if (length <= FAST_BITS)
+                {
+                    unsigned int first = code << (FAST_BITS - length);
+                    for (unsigned int j = 0; j < 1u << (FAST_BITS - length); j++)
+                        table.fast[first + j] = (std::uint16_t)(length << 8 | symbol);
+                }
+            }
+            table.maxCode[length] = counts[length - 1] != 0 ? (int)code - 1 : -1;
+            code <<= 1;
+        }
+        table.defined = true;
+        return true;
+    }
+
+    // The entropy-coded bytes of one restart interval, with the stuffed zero
+    // after each 0xFF dropped. Intervals end before their marker, so past the
+    // end there are only zeros.
+    struct BitReader
+    {
+        const unsigned char *position;
+        const unsigned char *end;
+        std::uint64_t bits = 0; // next bit at the top
+        int count = 0;
+
+        void fill()
+        {
+            while (count <= 56)
+            {
+                std::uint64_t byte = 0;
+                if (position < end)
+                {
+                    byte = *position++;
+                    if (byte == 0xFF && position < end)
+                        position++;
+                }
+                bits |= byte << (56 - count);
+                count += 8;
+            }
+        }
+
+        unsigned int peek(int length) const
+        {
+            return (unsigned int)(bits >> (64 - length));
+        }
+
+        void skip(int length)
+        {
+            bits <<= length;
+            count -= length;
+        }
+    };
+
+    int decodeSymbol(BitReader &reader, const HuffmanTable &table)
+    {
+        if (reader.count < 16)
+            reader.fill();
+        std::uint16_t entry = table.fast[reader.peek(FAST_BITS)];
+        if (entry != 0)
+        {
+            reader.skip(entry >> 8);
+            return entry & 0xFF;
+        }
+        unsigned int code = reader.peek(16);
+        for (int length = FAST_BITS + 1; length <= 16; length++)
+        {
+            int prefix = (int)(code >> (16 - length));
+            if (prefix <= table.maxCode[length])
+            {
+                reader.skip(length);
+                return table.symbols[prefix + table.offset[length]];
+            }
+        }
+        return -1;
+    }
+
+    // `size` bits that hold a signed value the way JPEG stores them.
+    int receiveExtend(BitReader &reader, int size)
+    {
+        if (size == 0)
+            return 0;
+        if (reader.count < size)
+            reader.fill();
+        int value = (int)reader.peek(size);
+        reader.skip(size);
+        return value < 1 << (size - 1) ? value - (1 << size) + 1 : value;
+    }
+
+    // The quantized coefficients of one block, in natural order.
+    bool decodeBlock(BitReader &reader, const HuffmanTable &dc, const HuffmanTable &ac, int &predictor, int *coefficients)
+    {
+        std::fill(coefficients, coefficients + 64, 0);
+        // 8-bit samples give DC differences of up to 11 bits and AC values of
+        // up to 10; anything larger is a corrupt stream.
+        int size = decodeSymbol(reader, dc);
+        if (size < 0 || size > 11)
+            return false;
+        predictor += receiveExtend(reader, size);
+        if (predictor < -2048 || predictor > 2047)
+            return false;
+        coefficients[0] = predictor;
+
+        for (int k = 1; k < 64;)
+        {
+            int symbol = decodeSymbol(reader, ac);
+            if (symbol < 0)
+                return false;
+            int run = symbol >> 4;
+            size = symbol & 15;
+            if (size == 0)
+            {
+                if (run != 15)
+                    break; // end of block
+                k += 16;
+                continue;
+            }
+            k += run;
+            if (k > 63 || size > 10)
+                return false;
+            coefficients[ZIGZAG[k++]] = receiveExtend(reader, size);
+        }
+        return true;
+    }
+
+    // * libjpeg's accurate integer IDCT (jidctint.c), so the samples match libjpeg's.
+    // 64-bit, so that extreme (if valid) coefficients and quantizers can't overflow.
+    constexpr int CONST_BITS = 13;
+    constexpr int PASS1_BITS = 2;
+
+    std::int64_t descale(std::int64_t value, int bits)
+    {
+        return (value + ((std::int64_t)1 << (bits - 1))) >> bits;
+    }
+
+    // One 1-D pass over in[0], in[stride], ..., in[7 * stride]. The results are
+    // scaled by 2^CONST_BITS.
+    void idctPass(const std::int64_t *in, int stride, std::int64_t *out)
+    {
+        std::int64_t z2 = in[2 * stride], z3 = in[6 * stride];
+        std::int64_t z1 = (z2 + z3) * 4433;  // 0.541196100
+        std::int64_t tmp2 = z1 - z3 * 15137; // 1.847759065
+        std::int64_t tmp3 = z1 + z2 * 6270;  // 0.765366865
+        std::int64_t tmp0 = (in[0] + in[4 * stride]) * (1 << CONST_BITS);
+        std::int64_t tmp1 = (in[0] - in[4 * stride]) * (1 << CONST_BITS);
+        std::int64_t tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3, tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+
+        tmp0 = in[7 * stride];
+        tmp1 = in[5 * stride];
+        tmp2 = in[3 * stride];
+        tmp3 = in[stride];
+        z1 = tmp0 + tmp3;
+        z2 = tmp1 + tmp2;
+        z3 = tmp0 + tmp2;
+        std::int64_t z4 = tmp1 + tmp3;
+        std::int64_t z5 = (z3 + z4) * 9633; // 1.175875602
+        tmp0 *= 2446;                       // 0.298631336
+        tmp1 *= 16819;                      // 2.053119869
+        tmp2 *= 25172;                      // 3.072711026
+        tmp3 *= 12299;                      // 1.501321110
+        z1 *= -7373;                        // 0.899976223
+        z2 *= -20995;                       // 2.562915447
+        z3 = z3 * -16069 + z5;              // 1.961570560
+        z4 = z4 * -3196 + z5;               // 0.390180644
+        tmp0 += z1 + z3;
+        tmp1 += z2 + z4;
+        tmp2 += z2 + z3;
+        tmp3 += z1 + z4;
+
+        out[0] = tmp10 + tmp3;
+        out[7] = tmp10 - tmp3;
+        out[1] = tmp11 + tmp2;
+        out[6] = tmp11 - tmp2;
+        out[2] = tmp12 + tmp1;
+        out[5] = tmp12 - tmp1;
+        out[3] = tmp13 + tmp0;
+        out[4] = tmp13 - tmp0;
+    }
+
+    void inverseDct(const int *coefficients, const std::uint16_t *quant, unsigned char *target, std::size_t stride)
+    {
+        std::int64_t dequantized[64];
+        for (int i = 0; i < 64; i++)
+            dequantized[i] = coefficients[i] * quant[i];
+
+        // * 1. Columns. Most have no AC coefficients left after quantization.
+        std::int64_t workspace[64];
+        for (int column = 0; column < 8; column++)
+        {
+            const std::int64_t *in = dequantized + column;
+            bool dcOnly = true;
+            for (int row = 1; row < 8 && dcOnly; row++)
+                dcOnly = in[row * 8] == 0;
+            if (dcOnly)
+            {
+                for (int row = 0; row < 8; row++)
+                    workspace[row * 8 + column] = in[0] * (1 << PASS1_BITS);
+                continue;
+            }
+            std::int64_t out[8];
+            idctPass(in, 8, out);
+            for (int row = 0; row < 8; row++)
+                workspace[row * 8 + column] = descale(out[row], CONST_BITS - PASS1_BITS);
+        }
+
+        // * 2. Rows, to samples around 128.
+        for (int row = 0; row < 8; row++)
+        {
+            std::int64_t out[8];
+            idctPass(workspace + row * 8, 1, out);
+            unsigned char *samples = target + row * stride;
+            for (int x = 0; x < 8; x++)
+                samples[x] = (unsigned char)std::clamp<std::int64_t>(descale(out[x], CONST_BITS + PASS1_BITS + 3) + 128, 0, 255);
+        }
+    }
+
+    struct JpegComponent
+    {
+        int id;
+        int h, v; // sampling factors
+        int quant;
+        int dcTable = 0, acTable = 0;
+        int width, height; // samples that cover the image
+        int stride, rows;  // of the plane, whole blocks
+        std::vector<unsigned char> plane;
+    };
+
+    struct Jpeg
+    {
+        int width = 0, height = 0;
+        std::array<std::array<std::uint16_t, 64>, 4> quant{}; // natural order
+        std::array<HuffmanTable, 4> dc, ac;
+        std::vector<JpegComponent> components;
+        int hMax = 1, vMax = 1;
+        int mcusX = 0, mcusY = 0;
+        int restartInterval = 0;
+        std::vector<std::size_t> restartSegments; // offsets of DRI markers
+        std::size_t scanHeader = 0;               // offset of the SOS marker
+        std::size_t scanData = 0;                 // first entropy-coded byte
+        // Entropy-coded bytes of each restart interval, markers excluded.
+        std::vector<std::pair<std::size_t, std::size_t>> intervals;
+
+        int mcuCount() const
+        {
+            return mcusX * mcusY;
+        }
+
+        int mcusPerInterval() const
+        {
+            return restartInterval > 0 ? restartInterval : mcuCount();
+        }
+    };
+
+    bool parseFrame(const unsigned char *segment, std::size_t length, Jpeg &jpeg)
+    {
+        if (length < 6 || segment[0] != 8 || !jpeg.components.empty())
+            return false;
+        jpeg.height = (int)read16(segment + 1);
+        jpeg.width = (int)read16(segment + 3);
+        int count = segment[5];
+        // Height 0 means a DNL marker brings it later; 4 components are CMYK.
+        if (jpeg.width == 0 || jpeg.height == 0 || (count != 1 && count != 3) || length < 6 + 3 * (std::size_t)count)
+            return false;
+
+        for (int i = 0; i < count; i++)
+        {
+            const unsigned char *entry = segment + 6 + 3 * i;
+            JpegComponent component{};
+            component.id = entry[0];
+            component.h = entry[1] >> 4;
+            component.v = entry[1] & 15;
+            component.quant = entry[2];
+            if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4 || component.quant > 3)
+                return false;
+            jpeg.components.push_back(component);
+        }
+        // stb_image reads components named R, G and B as RGB.
+        if (count == 3 && jpeg.components[0].id == 'R' && jpeg.components[1].id == 'G' && jpeg.components[2].id == 'B')
+            return false;
+        return true;
+    }
+
+    bool parseHuffmanTables(const unsigned char *segment, std::size_t length, Jpeg &jpeg)
+    {
+        while (length > 0)
+        {
+            if (length < 17)
+                return false;
+            int tableClass = segment[0] >> 4, id = segment[0] & 15;
+            int total = 0;
+            for (int i = 1; i <= 16; i++)
+                total += segment[i];
+            if (tableClass > 1 || id > 3 || total > 256 || length < 17 + (std::size_t)total)
+                return false;
+            if (!buildHuffman(segment + 1, segment + 17, tableClass == 0 ? jpeg.dc[id] : jpeg.ac[id]))
+                return false;
+            segment += 17 + total;
+            length -= 17 + total;
+        }
+        return true;
+    }
+
+    bool parseQuantTables(const unsigned char *segment, std::size_t length, Jpeg &jpeg)
+    {
+        while (length > 0)
+        {
+            int precision = segment[0] >> 4, id = segment[0] & 15;
+            std::size_t size = 1 + 64 * (precision + 1);
+            if (precision > 1 || id > 3 || length < size)
+                return false;
+            for (int k = 0; k < 64; k++)
+                jpeg.quant[id][ZIGZAG[k]] = (std::uint16_t)(precision == 0 ? segment[1 + k] : read16(segment + 1 + 2 * k));
+            segment += size;
+            length -= size;
+        }
+        return true;
+    }
+
+    bool parseScan(const unsigned char *segment, std::size_t length, Jpeg &jpeg)
+    {
+        std::size_t count = jpeg.components.size();
+        // Every component in one interleaved scan, in frame order.
+        if (count == 0 || length < 4 + 2 * count || segment[0] != count)
+            return false;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            JpegComponent &component = jpeg.components[i];
+            const unsigned char *entry = segment + 1 + 2 * i;
+            component.dcTable = entry[1] >> 4;
+            component.acTable = entry[1] & 15;
+            if (entry[0] != component.id || component.dcTable > 3 || component.acTable > 3 || !jpeg.dc[component.dcTable].defined ||
+                !jpeg.ac[component.acTable].defined)
+                return false;
+        }
+        // Spectral selection and successive approximation are for progressive files.
+        const unsigned char *selection = segment + 1 + 2 * count;
+        if (selection[0] != 0 || selection[1] != 63 || selection[2] != 0)
+            return false;
+
+        // A single component scan codes one block at a time, whatever its sampling.
+        if (count == 1)
+            jpeg.components[0].h = jpeg.components[0].v = 1;
+        for (const JpegComponent &component : jpeg.components)
+        {
+            jpeg.hMax = std::max(jpeg.hMax, component.h);
+            jpeg.vMax = std::max(jpeg.vMax, component.v);
+        }
+        jpeg.mcusX = (jpeg.width + 8 * jpeg.hMax - 1) / (8 * jpeg.hMax);
+        jpeg.mcusY = (jpeg.height + 8 * jpeg.vMax - 1) / (8 * jpeg.vMax);
+        for (JpegComponent &component : jpeg.components)
+        {
+            if (jpeg.hMax % component.h != 0 || jpeg.vMax % component.v != 0)
+                return false;
+            component.width = (jpeg.width * component.h + jpeg.hMax - 1) / jpeg.hMax;
+            component.height = (jpeg.height * component.v + jpeg.vMax - 1) / jpeg.vMax;
+            component.stride = jpeg.mcusX * component.h * 8;
+            component.rows = jpeg.mcusY * component.v * 8;
+        }
+        return true;
+    }
+
+    // Split the entropy-coded data at its restart markers. The scan has to be
+    // the last thing before EOI.
+    bool findIntervals(const unsigned char *data, std::size_t size, Jpeg &jpeg)
+    {
+        std::size_t begin = jpeg.scanData;
+        std::size_t position = begin;
+        while (true)
+        {
+            const void *found = position < size ? std::memchr(data + position, 0xFF, size - position) : nullptr;
+            if (found == nullptr)
+                return false;
+            position = (std::size_t)((const unsigned char *)found - data);
+            if (position + 1 >= size)
+                return false;
+            if (data[position + 1] == 0x00)
+            {
+                position += 2;
+                continue;
+            }
+
+            // A marker, perhaps after fill bytes.
+            std::size_t end = position;
+            while (position < size && data[position] == 0xFF)
+                position++;
+            if (position >= size)
+                return false;
+            unsigned char marker = data[position++];
+            jpeg.intervals.emplace_back(begin, end);
+            if (marker >= 0xD0 && marker <= 0xD7)
+            {
+                begin = position;
+                continue;
+            }
+            if (marker != 0xD9)
+                return false; // another scan, or DNL
+            break;
+        }
+
+        std::size_t expected = ((std::size_t)jpeg.mcuCount() + jpeg.mcusPerInterval() - 1) / jpeg.mcusPerInterval();
+        return jpeg.intervals.size() == expected;
+    }
+
+    // Everything up to the entropy-coded data of a baseline JPEG with one scan.
+    // False for anything else, which goes to stb_image.
+    bool parseJpeg(const unsigned char *data, std::size_t size, Jpeg &jpeg)
+    {
+        if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+            return false;
+
+        std::size_t position = 2;
+        while (true)
+        {
+            if (position >= size || data[position] != 0xFF)
+                return false;
+            std::size_t start = position;
+            while (position < size && data[position] == 0xFF)
+                position++;
+            if (position + 2 >= size)
+                return false;
+            unsigned char marker = data[position++];
+            if (marker == 0xD8 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+                continue;
+
+            std::size_t length = read16(data + position);
+            if (length < 2 || position + length > size)
+                return false;
+            const unsigned char *segment = data + position + 2;
+            length -= 2;
+            switch (marker)
+            {
+            case 0xC0: // baseline
+            case 0xC1: // extended sequential, 8-bit here
+                if (!parseFrame(segment, length, jpeg))
+                    return false;
+                break;
+            case 0xC4:
+                if (!parseHuffmanTables(segment, length, jpeg))
+                    return false;
+                break;
+            case 0xDB:
+                if (!parseQuantTables(segment, length, jpeg))
+                    return false;
+                break;
+            case 0xDD:
+                if (length < 2)
+                    return false;
+                jpeg.restartInterval = (int)read16(segment);
+                jpeg.restartSegments.push_back(start);
+                break;
+            case 0xEE:
+                // Adobe's transform 0 means the three components are RGB.
+                if (length >= 12 && std::memcmp(segment, "Adobe", 5) == 0 && segment[11] == 0)
+                    return false;
+                break;
+            case 0xDA:
+                jpeg.scanHeader = start;
+                jpeg.scanData = position + 2 + length;
+                return parseScan(segment, length, jpeg) && findIntervals(data, size, jpeg);
+            default:
+                // Progressive, lossless, hierarchical and arithmetic frames, and DNL.
+                if ((marker >= 0xC2 && marker <= 0xCF) || marker == 0xDC || marker == 0xD9)
+                    return false;
+                break; // APPn, COM and the like
+            }
+            position += 2 + length;
+        }
+    }
+
+    // Decode one restart interval into the component planes.
+    bool decodeInterval(const unsigned char *data, std::size_t index, Jpeg &jpeg)
+    {
+        BitReader reader{data + jpeg.intervals[index].first, data + jpeg.intervals[index].second};
+        int predictors[3] = {};
+        int coefficients[64];
+
+        int first = (int)index * jpeg.mcusPerInterval();
+        int last = std::min(first + jpeg.mcusPerInterval(), jpeg.mcuCount());
+        for (int mcu = first; mcu < last; mcu++)
+        {
+            int mcuX = mcu % jpeg.mcusX, mcuY = mcu / jpeg.mcusX;
+            for (std::size_t c = 0; c < jpeg.components.size(); c++)
+            {
+                JpegComponent &component = jpeg.components[c];
+                const HuffmanTable &dc = jpeg.dc[component.dcTable];
+                const HuffmanTable &ac = jpeg.ac[component.acTable];
+                for (int blockY = 0; blockY < component.v; blockY++)
+                {
+                    for (int blockX = 0; blockX < component.h; blockX++)
+                    {
+                        if (!decodeBlock(reader, dc, ac, predictors[c], coefficients))
+                            return false;
+                        std::size_t x = (std::size_t)(mcuX * component.h + blockX) * 8;
+                        std::size_t y = (std::size_t)(mcuY * component.v + blockY) * 8;
+                        inverseDct(coefficients, jpeg.quant[component.quant].data(), component.plane.data() + y * component.stride + x,
+                                   (std::size_t)component.stride);
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // Doubles a row: each output is 3/4 of its nearest input and 1/4 of the
+    // next nearest, (3 * near + far + bias) >> shift with libjpeg's biases.
+    template <typename T>
+    void fancyUpsample(const T *in, int count, int shift, int evenBias, int oddBias, unsigned char *target)
+    {
+        target[0] = (unsigned char)((in[0] * 4 + evenBias) >> shift);
+        for (int i = 1; i < count; i++)
+        {
+            target[2 * i - 1] = (unsigned char)((in[i - 1] * 3 + in[i] + oddBias) >> shift);
+            target[2 * i] = (unsigned char)((in[i] * 3 + in[i - 1] + evenBias) >> shift);
+        }
+        target[2 * count - 1] = (unsigned char)((in[count - 1] * 4 + oddBias) >> shift);
+    }
+
+    // Row y of a component at full resolution, with libjpeg's fancy (triangle)
+    // upsampling for factors of 2, and replication for the rest. `target` holds
+    // jpeg.mcusX * jpeg.hMax * 8 samples, `sums` a row of the component.
+    const unsigned char *upsampleRow(const Jpeg &jpeg, const JpegComponent &component, int y, unsigned char *target, int *sums)
+    {
+        int factorX = jpeg.hMax / component.h, factorY = jpeg.vMax / component.v;
+        int sourceY = y / factorY;
+        const unsigned char *near = component.plane.data() + (std::size_t)sourceY * component.stride;
+        if (factorX == 1 && factorY == 1)
+            return near;
+
+        if (factorY == 2 && factorX <= 2)
+        {
+            // The nearer row counts three times, the farther one (above for even rows) once.
+            bool upper = y % 2 == 0;
+            int farY = upper ? std::max(sourceY - 1, 0) : std::min(sourceY + 1, component.height - 1);
+            const unsigned char *far = component.plane.data() + (std::size_t)farY * component.stride;
+            if (factorX == 1)
+            {
+                int bias = upper ? 1 : 2;
+                for (int x = 0; x < jpeg.width; x++)
+                    target[x] = (unsigned char)((near[x] * 3 + far[x] + bias) >> 2);
+                return target;
+            }
+            for (int x = 0; x < component.width; x++)
+                sums[x] = near[x] * 3 + far[x];
+            fancyUpsample(sums, component.width, 4, 8, 7, target);
+            return target;
+        }
+        if (factorY == 1 && factorX == 2)
+        {
+            fancyUpsample(near, component.width, 2, 1, 2, target);
+            return target;
+        }
+        for (int x = 0; x < jpeg.width; x++)
+            target[x] = near[x / factorX];
+        return target;
+    }
+
+    unsigned char *decodeJpeg(const unsigned char *data, Jpeg &jpeg, ThreadPool *pool)
+    {
+        for (JpegComponent &component : jpeg.components)
+            component.plane.resize((std::size_t)component.stride * component.rows);
+
+        // * 1. Every restart interval on its own, into the planes.
+        std::atomic<bool> failed{false};
+        forRange(pool, jpeg.intervals.size(), balancedGrain(pool, jpeg.intervals.size()), [&](std::size_t begin, std::size_t end)
+                 {
+            for (std::size_t i = begin; i < end && !failed; i++)
+            {
+                if (!decodeInterval(data, i, jpeg))
+                    failed = true;
+            } });
+        if (failed)
+            return nullptr;
+
+        // * 2. Upsampling and color conversion, over the rows.
+        int channels = (int)jpeg.components.size();
+        auto *pixels = (unsigned char *)std::malloc((std::size_t)jpeg.width * jpeg.height * channels);
+        if (pixels == nullptr)
+            return nullptr;
+        forRange(pool, (std::size_t)jpeg.height, balancedGrain(pool, (std::size_t)jpeg.height), [&](std::size_t begin, std::size_t end)
+                 {
+            std::size_t rowLength = (std::size_t)jpeg.mcusX * jpeg.hMax * 8;
+            std::vector<unsigned char> rows(rowLength * channels);
+            std::vector<int> sums(rowLength);
+            for (std::size_t y = begin; y < end; y++)
+            {
+                unsigned char *target = pixels + y * jpeg.width * channels;
+                if (channels == 1)
+                {
+                    std::memcpy(target, jpeg.components[0].plane.data() + y * jpeg.components[0].stride, (std::size_t)jpeg.width);
+                    continue;
+                }
+
+                const unsigned char *luma = upsampleRow(jpeg, jpeg.components[0], (int)y, rows.data(), sums.data());
+                const unsigned char *blue = upsampleRow(jpeg, jpeg.components[1], (int)y, rows.data() + rowLength, sums.data());
+                const unsigned char *red = upsampleRow(jpeg, jpeg.components[2], (int)y, rows.data() + 2 * rowLength, sums.data());
+                // YCbCr to RGB in 16.16 fixed point, rounded like libjpeg.
+                for (int x = 0; x < jpeg.width; x++)
+                {
+                    int l = luma[x], cb = blue[x] - 128, cr = red[x] - 128;
+                    int r = l + ((91881 * cr + 32768) >> 16);
+                    int g = l + ((-22554 * cb - 46802 * cr + 32768) >> 16);
+                    int b = l + ((116130 * cb + 32768) >> 16);
+                    target[x * 3 + 0] = clampSample(r);
+                    target[x * 3 + 1] = clampSample(g);
+                    target[x * 3 + 2] = clampSample(b);
+                }
+            } });
+        return pixels;
+    }
+
+    // Writes entropy-coded bits, stuffing a zero after each 0xFF.
+    struct BitWriter
+    {
+        std::vector<unsigned char> &bytes;
+        std::uint32_t bits = 0;
+        int count = 0;
+
+        void put(unsigned int value, int length)
+        {
+            bits = bits << length | (value & ((1u << length) - 1));
+            count += length;
+            while (count >= 8)
+            {
+                unsigned char byte = (unsigned char)(bits >> (count - 8));
+                bytes.push_back(byte);
+                if (byte == 0xFF)
+                    bytes.push_back(0x00);
+                count -= 8;
+            }
+        }
+
+        // Pad the last byte with ones.
+        void flush()
+        {
+            if (count > 0)
+                put(0xFF, 8 - count);
+        }
+    };
+
+    bool putSymbol(BitWriter &writer, const HuffmanTable &table, int symbol)
+    {
+        if (table.lengths[symbol] == 0)
+            return false;
+        writer.put(table.codes[symbol], table.lengths[symbol]);
+        return true;
+    }
+
+    // A coefficient as its size category (ORed into `symbol`) and its bits.
+    bool putValue(BitWriter &writer, const HuffmanTable &table, int symbol, int value)
+    {
+        int size = 0;
+        for (int magnitude = std::abs(value); magnitude != 0; magnitude >>= 1)
+            size++;
+        if (!putSymbol(writer, table, symbol | size))
+            return false;
+        if (size > 0)
+            writer.put((unsigned int)(value < 0 ? value - 1 : value), size);
+        return true;
+    }
+
+    bool encodeBlock(BitWriter &writer, const HuffmanTable &dc, const HuffmanTable &ac, int &predictor, const int *coefficients)
+    {
+        if (!putValue(writer, dc, 0, coefficients[0] - predictor))
+            return false;
+        predictor = coefficients[0];
+
+        int run = 0;
+        for (int k = 1; k < 64; k++)
+        {
+            int value = coefficients[ZIGZAG[k]];
+            if (value == 0)
+            {
+                run++;
+                continue;
+            }
+            for (; run > 15; run -= 16)
+            {
+                if (!putSymbol(writer, ac, 0xF0))
+                    return false;
+            }
+            if (!putValue(writer, ac, run << 4, value))
+                return false;
+            run = 0;
+        }
+        return run == 0 || putSymbol(writer, ac, 0x00);
+    }
+
+    // * PNG
+
+    struct Png
+    {
+        int width = 0, height = 0;
+        int colorType = 0;
+        int sourceChannels = 0; // bytes per pixel in the filtered rows
+        int channels = 0;       // of the decoded pixels
+        std::vector<unsigned char> compressed;
+        std::array<unsigned char, 256 * 4> palette{};
+        int paletteSize = 0;
+        bool paletteAlpha = false;
+    };
+
+    // The chunks of a non-interlaced 8-bit PNG. False for anything else, which
+    // goes to stb_image.
+    bool parsePng(const unsigned char *data, std::size_t size, Png &png)
+    {
+        if (size < 8 || std::memcmp(data, "\x89PNG\r\n\x1a\n", 8) != 0)
+            return false;
+
+        bool header = false;
+        for (std::size_t position = 8; position + 12 <= size;)
+        {
+            std::size_t length = read32(data + position);
+            const unsigned char *type = data + position + 4;
+            const unsigned char *chunk = data + position + 8;
+            if (length > size - position - 12)
+                return false;
+
+            if (std::memcmp(type, "IHDR", 4) == 0)
+            {
+                if (length != 13)
+                    return false;
+                png.width = (int)read32(chunk);
+                png.height = (int)read32(chunk + 4);
+                png.colorType = chunk[9];
+                // 8 bits, deflate, adaptive filtering, not interlaced.
+                if (png.width <= 0 || png.height <= 0 || chunk[8] != 8 || chunk[10] != 0 || chunk[11] != 0 || chunk[12] != 0)
+                    return false;
+                static const int channelsOf[7] = {1, 0, 3, 1, 2, 0, 4};
+                if (png.colorType > 6 || channelsOf[png.colorType] == 0)
+                    return false;
+                png.sourceChannels = channelsOf[png.colorType];
+                header = true;
+            }
+            else if (std::memcmp(type, "PLTE", 4) == 0)
+            {
+                png.paletteSize = (int)std::min<std::size_t>(length / 3, 256);
+                for (int i = 0; i < png.paletteSize; i++)
+                {
+                    std::memcpy(&png.palette[i * 4], chunk + i * 3, 3);
+                    png.palette[i * 4 + 3] = 255;
+                }
+            }
+            else if (std::memcmp(type, "tRNS", 4) == 0)
+            {
+                // stb_image adds an alpha channel for color keys; left to it.
+                if (png.colorType != 3 || (int)length > png.paletteSize)
+                    return false;
+                for (std::size_t i = 0; i < length; i++)
+                    png.palette[i * 4 + 3] = chunk[i];
+                png.paletteAlpha = true;
+            }
+            else if (std::memcmp(type, "IDAT", 4) == 0)
+            {
+                png.compressed.insert(png.compressed.end(), chunk, chunk + length);
+            }
+            else if (std::memcmp(type, "CgBI", 4) == 0)
+            {
+                return false; // Apple's variant
+            }
+            else if (std::memcmp(type, "IEND", 4) == 0)
+            {
+                break;
+            }
+            position += 12 + length;
+        }
+
+        if (!header || png.compressed.empty() || (png.colorType == 3 && png.paletteSize == 0))
+            return false;
+        png.channels = png.colorType == 3 ? (png.paletteAlpha ? 4 : 3) : png.sourceChannels;
+        return true;
+    }
+
+    unsigned char paeth(int left, int above, int aboveLeft)
+    {
+        int estimate = left + above - aboveLeft;
+        int toLeft = std::abs(estimate - left), toAbove = std::abs(estimate - above), toAboveLeft = std::abs(estimate - aboveLeft);
+        if (toLeft <= toAbove && toLeft <= toAboveLeft)
+            return (unsigned char)left;
+        return (unsigned char)(toAbove <= toAboveLeft ? above : aboveLeft);
+    }
+
+    // Undo one row's filter. `target` may be `source`; `previous` is the
+    // unfiltered row above.
+    void unfilterRow(int filter, const unsigned char *source, const unsigned char *previous, unsigned char *target, std::size_t length,
+                     int stride)
+    {
+        std::size_t first = std::min<std::size_t>((std::size_t)stride, length);
+        switch (filter)
+        {
+        case 0: // None
+            if (target != source)
+                std::memcpy(target, source, length);
+            break;
+        case 1: // Sub
+            std::memmove(target, source, first);
+            for (std::size_t i = first; i < length; i++)
+                target[i] = (unsigned char)(source[i] + target[i - stride]);
+            break;
+        case 2: // Up
+            for (std::size_t i = 0; i < length; i++)
+                target[i] = (unsigned char)(source[i] + previous[i]);
+            break;
+        case 3: // Average
+            for (std::size_t i = 0; i < first; i++)
+                target[i] = (unsigned char)(source[i] + (previous[i] >> 1));
+            for (std::size_t i = first; i < length; i++)
+                target[i] = (unsigned char)(source[i] + ((target[i - stride] + previous[i]) >> 1));
+            break;
+        default: // Paeth
+            for (std::size_t i = 0; i < first; i++)
+                target[i] = (unsigned char)(source[i] + previous[i]);
+            for (std::size_t i = first; i < length; i++)
+                target[i] = (unsigned char)(source[i] + paeth(target[i - stride], previous[i], previous[i - stride]));
+            break;
+        }
+    }
+
+    unsigned char *decodePng(Png &png, ThreadPool *pool)
+    {
+        std::size_t rowBytes = (std::size_t)png.width * png.sourceChannels;
+        std::size_t filteredBytes = (rowBytes + 1) * png.height;
+        if (png.compressed.size() > INT_MAX || filteredBytes > INT_MAX)
+            return nullptr;
+
+        // * 1. Inflate, on this thread.
+        int inflatedBytes = 0;
+        auto *filtered = (unsigned char *)stbi_zlib_decode_malloc_guesssize_headerflag(
+            (const char *)png.compressed.data(), (int)png.compressed.size(), (int)filteredBytes, &inflatedBytes, 1);
+        png.compressed = std::vector<unsigned char>();
+        if (filtered == nullptr || (std::size_t)inflatedBytes < filteredBytes)
+        {
+            stbi_image_free(filtered);
+            return nullptr;
+        }
+
+        // * 2. Find the rows that don't need the one above: each starts a run.
+        std::vector<int> runs;
+        for (int y = 0; y < png.height; y++)
+        {
+            unsigned char filter = filtered[y * (rowBytes + 1)];
+            if (filter > 4)
+            {
+                stbi_image_free(filtered);
+                return nullptr;
+            }
+            if (y == 0 || filter <= 1)
+                runs.push_back(y);
+        }
+
+        // * 3. Unfilter the runs in parallel. Palette images are unfiltered in
+        // place and expanded row by row; the rest go straight to the pixels.
+        bool indexed = png.colorType == 3;
+        auto *pixels = (unsigned char *)std::malloc((std::size_t)png.width * png.height * png.channels);
+        if (pixels != nullptr)
+        {
+            forRange(pool, runs.size(), balancedGrain(pool, runs.size()), [&](std::size_t begin, std::size_t end)
+                     {
+                std::vector<unsigned char> zeros;
+                for (std::size_t run = begin; run < end; run++)
+                {
+                    int last = run + 1 < runs.size() ? runs[run + 1] : png.height;
+                    for (int y = runs[run]; y < last; y++)
+                    {
+                        unsigned char *line = filtered + y * (rowBytes + 1);
+                        unsigned char *target = indexed ? line + 1 : pixels + y * rowBytes;
+                        const unsigned char *previous;
+                        if (y == 0)
+                        {
+                            zeros.assign(rowBytes, 0);
+                            previous = zeros.data();
+                        }
+                        else
+                        {
+                            previous = indexed ? line + 1 - (rowBytes + 1) : target - rowBytes;
+                        }
+                        unfilterRow(line[0], line + 1, previous, target, rowBytes, png.sourceChannels);
+
+                        if (indexed)
+                        {
+                            unsigned char *expanded = pixels + (std::size_t)y * png.width * png.channels;
+                            for (int x = 0; x < png.width; x++)
+                                std::memcpy(expanded + x * png.channels, &png.palette[target[x] * 4], png.channels);
+                        }
+                    }
+                } });
+        }
+        stbi_image_free(filtered);
+        return pixels;
+    }
+}
+
+const char *decodePathName(DecodePath path)
+{
+    switch (path)
+    {
+    case DecodePath::JpegRestart:
+        return "jpeg-restart";
+    case DecodePath::PngRows:
+        return "png-rows";
+    default:
+        return "stb";
+    }
+}
+
+unsigned char *decodeImage(const unsigned char *data, std::size_t size, int *width, int *height, int *channels, ThreadPool *pool,
+                           DecodePath *path)
+{
+    unsigned char *pixels = nullptr;
+    DecodePath used = DecodePath::Stb;
+
+    Jpeg jpeg;
+    Png png;
+    if (parseJpeg(data, size, jpeg) && jpeg.intervals.size() > 1 && (std::size_t)jpeg.width * jpeg.height >= SPLIT_DECODE_MIN_PIXELS)
+    {
+        pixels = decodeJpeg(data, jpeg, pool);
+        if (pixels != nullptr)
+        {
+            *width = jpeg.width;
+            *height = jpeg.height;
+            *channels = (int)jpeg.components.size();
+            used = DecodePath::JpegRestart;
+        }
+    }
+    else if (parsePng(data, size, png) && (std::size_t)png.width * png.height >= SPLIT_DECODE_MIN_PIXELS)
+    {
+        pixels = decodePng(png, pool);
+        if (pixels != nullptr)
+        {
+            *width = png.width;
+            *height = png.height;
+            *channels = png.channels;
+            used = DecodePath::PngRows;
+        }
+    }
+
+    // Also for files the split decoders gave up on, so stb reports what is wrong.
+    if (pixels == nullptr && size <= INT_MAX)
+        pixels = stbi_load_from_memory(data, (int)size, width, height, channels, 0);
+    if (path != nullptr)
+        *path = used;
+    return pixels;
+}
+
+std::vector<unsigned char> addJpegRestartMarkers(const unsigned char *data, std::size_t size, int interval)
+{
+    Jpeg jpeg;
+    if (!parseJpeg(data, size, jpeg))
+        return {};
+    if (interval <= 0)
+        interval = jpeg.mcusX;
+    interval = std::min(interval, 0xFFFF);
+
+    // * 1. The segments before the scan, without the old DRI, then the new one.
+    std::vector<unsigned char> result;
+    result.reserve(size + size / 64);
+    std::size_t copied = 0;
+    for (std::size_t restart : jpeg.restartSegments)
+    {
+        result.insert(result.end(), data + copied, data + restart);
+        copied = restart + 2 + read16(data + restart + 2);
+    }
+    result.insert(result.end(), data + copied, data + jpeg.scanHeader);
+    const unsigned char restartSegment[6] = {0xFF, 0xDD, 0x00, 0x04, (unsigned char)(interval >> 8), (unsigned char)(interval & 0xFF)};
+    result.insert(result.end(), restartSegment, restartSegment + 6);
+    result.insert(result.end(), data + jpeg.scanHeader, data + jpeg.scanData);
+
+    // * 2. The coefficients, coded again with the same tables. Only the DC
+    // differences change, as the predictors now reset at the new markers.
+    BitWriter writer{result};
+    BitReader reader{nullptr, nullptr};
+    int readPredictors[3] = {}, writePredictors[3] = {};
+    int coefficients[64];
+    for (int mcu = 0; mcu < jpeg.mcuCount(); mcu++)
+    {
+        if (mcu % jpeg.mcusPerInterval() == 0)
+        {
+            const std::pair<std::size_t, std::size_t> &source = jpeg.intervals[mcu / jpeg.mcusPerInterval()];
+            reader = BitReader{data + source.first, data + source.second};
+            std::fill(std::begin(readPredictors), std::end(readPredictors), 0);
+        }
+        if (mcu > 0 && mcu % interval == 0)
+        {
+            writer.flush();
+            result.push_back(0xFF);
+            result.push_back((unsigned char)(0xD0 + (mcu / interval - 1) % 8));
+            std::fill(std::begin(writePredictors), std::end(writePredictors), 0);
+        }
+
+        for (std::size_t c = 0; c < jpeg.components.size(); c++)
+        {
+            const JpegComponent &component = jpeg.components[c];
+            const HuffmanTable &dc = jpeg.dc[component.dcTable];
+            const HuffmanTable &ac = jpeg.ac[component.acTable];
+            for (int block = 0; block < component.h * component.v; block++)
+            {
+                if (!decodeBlock(reader, dc, ac, readPredictors[c], coefficients) ||
+                    !encodeBlock(writer, dc, ac, writePredictors[c], coefficients))
+                    return {};
+            }
+        }
+    }
+    writer.flush();
+    result.push_back(0xFF);
+    result.push_back(0xD9);
+    return result;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+// Decoding of one large JPEG or PNG on several threads.
+//
+// JPEG: baseline (sequential Huffman, 8-bit) images with restart markers are
+// cut at the markers. Every restart interval decodes into the component
+// planes on its own task, then upsampling and color conversion run over the
+// rows. stb_image decodes everything else: progressive and arithmetic-coded
+// files, files without restart markers (see addJpegRestartMarkers), CMYK and
+// Adobe RGB.
+//
+// PNG: the IDAT stream is inflated once (zlib can't be split), then the rows
+// are unfiltered in parallel. A row can only start a run of its own if it
+// doesn't depend on the row above, i.e. its filter is None or Sub (or it is
+// the first row), so how far an image splits depends on its encoder's filter
+// choices; one whose rows all depend on the row above decodes on one thread.
+// stb_image decodes interlaced, 16-bit, sub-byte and color-keyed images.
+//
+// Both decoders give the same channels as stbi_load with req_comp = 0. PNG
+// pixels are identical to stb's; JPEG pixels use libjpeg's integer IDCT and
+// fancy upsampling and may differ from stb's by a step or two.
+
+enum class DecodePath
+{
+    Stb,        // too small to split, or a variant the split decoders don't read
+    JpegRestart,
+    PngRows
+};
+
+const char *decodePathName(DecodePath path);
+
+// Images with fewer pixels aren't worth splitting.
+constexpr std::size_t SPLIT_DECODE_MIN_PIXELS = 1024 * 1024;
+
+// Decode an encoded image in memory to 8-bit pixels, first row at the top,
+// spreading it over `pool`, whose caller takes part (without a pool the split
+// decoders run on the calling thread alone). Returns nullptr on failure, with
+// the reason in stbi_failure_reason(); free with stbi_image_free. `path`, if
+// given, receives the decoder that was used.
+unsigned char *decodeImage(const unsigned char *data, std::size_t size, int *width, int *height, int *channels, ThreadPool *pool,
+                           DecodePath *path = nullptr);
+
+// A copy of a baseline JPEG with a restart marker every `interval` MCUs (0:
+// one per MCU row), so decodeImage can split it. The coefficients are copied
+// as they are, so the image doesn't change. Empty if the file isn't a
+// baseline JPEG or its Huffman tables lack a code the new intervals need.
+std::vector<unsigned char> addJpegRestartMarkers(const unsigned char *data, std::size_t size, int interval = 0);
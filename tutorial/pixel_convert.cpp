@@ -0,0 +1,643 @@
+#include "pixel_convert.hpp"
+#include "cpu_features.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#ifdef LO_X86
+#include <immintrin.h>
+#endif
+#ifdef LO_NEON
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    // x / 255 rounded to nearest, for x up to 255 * 255. The SIMD paths take
+    // the same steps, so they match exactly.
+    inline unsigned int div255(unsigned int x)
+    {
+        x += 128;
+        return (x + (x >> 8)) >> 8;
+    }
+
+    // * Tables
+
+    float srgbToLinear(float value)
+    {
+        return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+
+    float linearToSrgb(float value)
+    {
+        return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    }
+
+    // Linear light in steps of 1/LINEAR_STEPS, fine enough that encoding it
+    // again rounds like the exact formula even near black.
+    constexpr int LINEAR_STEPS = 16383;
+
+    struct TransferTables
+    {
+        std::array<unsigned char, 256> toLinear;
+        std::array<unsigned char, 256> toSrgb;
+        std::array<std::uint16_t, 256> decode; // sRGB to LINEAR_STEPS
+        std::vector<unsigned char> encode;     // LINEAR_STEPS to sRGB
+    };
+
+    const TransferTables &transferTables()
+    {
+        static const TransferTables tables = []
+        {
+            TransferTables built;
+            for (int i = 0; i < 256; i++)
+            {
+                built.toLinear[i] = (unsigned char)std::lround(srgbToLinear(i / 255.0f) * 255.0f);
+                built.toSrgb[i] = (unsigned char)std::lround(linearToSrgb(i / 255.0f) * 255.0f);
+                built.decode[i] = (std::uint16_t)std::lround(srgbToLinear(i / 255.0f) * LINEAR_STEPS);
+            }
+            built.encode.resize(LINEAR_STEPS + 1);
+            for (int i = 0; i <= LINEAR_STEPS; i++)
+                built.encode[i] = (unsigned char)std::lround(linearToSrgb((float)i / LINEAR_STEPS) * 255.0f);
+            return built;
+        }();
+        return tables;
+    }
+
+    // * Scalar reference versions
+
+    void expandScalar(const unsigned char *source, std::size_t count, unsigned char *target)
+    {
+        for (std::size_t i = 0; i < count; i++)
+        {
+            target[i * 4 + 0] = source[i * 3 + 0];
+            target[i * 4 + 1] = source[i * 3 + 1];
+            target[i * 4 + 2] = source[i * 3 + 2];
+            target[i * 4 + 3] = 255;
+        }
+    }
+
+    void swizzleScalar(const unsigned char *source, std::size_t count, const std::array<std::uint8_t, 4> &order, unsigned char *target)
+    {
+        for (std::size_t i = 0; i < count; i++)
+        {
+            unsigned char pixel[4];
+            std::memcpy(pixel, source + i * 4, 4);
+            for (int c = 0; c < 4; c++)
+                target[i * 4 + c] = pixel[order[c]];
+        }
+    }
+
+    void premultiplyScalar(unsigned char *pixels, std::size_t count, int channels)
+    {
+        int alpha = channels - 1;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            unsigned char *pixel = pixels + i * channels;
+            for (int c = 0; c < alpha; c++)
+                pixel[c] = (unsigned char)div255(pixel[c] * pixel[alpha]);
+        }
+    }
+
+    // Table lookups on every level.
+    void premultiplySrgb(unsigned char *pixels, std::size_t count, int channels)
+    {
+        const TransferTables &tables = transferTables();
+        int alpha = channels - 1;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            unsigned char *pixel = pixels + i * channels;
+            for (int c = 0; c < alpha; c++)
+                pixel[c] = tables.encode[(tables.decode[pixel[c]] * (unsigned int)pixel[alpha] + 127) / 255];
+        }
+    }
+
+#ifdef LO_X86
+    // * SSE2
+
+    LO_TARGET_SSE2 void swizzleSSE2(const unsigned char *source, std::size_t count, const std::array<std::uint8_t, 4> &order,
+                                    unsigned char *target)
+    {
+        // Each output byte of a 32-bit pixel is an input byte shifted into place.
+        __m128i byteMask = _mm_set1_epi32(0xFF);
+        __m128i right[4], left[4];
+        for (int c = 0; c < 4; c++)
+        {
+            right[c] = _mm_cvtsi32_si128(8 * order[c]);
+            left[c] = _mm_cvtsi32_si128(8 * c);
+        }
+
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i pixels = _mm_loadu_si128((const __m128i *)(source + i * 4));
+            __m128i swizzled = _mm_setzero_si128();
+            for (int c = 0; c < 4; c++)
+                swizzled = _mm_or_si128(swizzled, _mm_sll_epi32(_mm_and_si128(_mm_srl_epi32(pixels, right[c]), byteMask), left[c]));
+            _mm_storeu_si128((__m128i *)(target + i * 4), swizzled);
+        }
+        swizzleScalar(source + i * 4, count - i, order, target + i * 4);
+    }
+
+    // Eight 16-bit values times the alpha of their pixel; alpha itself times 255.
+    template <int CHANNELS>
+    LO_TARGET_SSE2 __m128i premultiplyLanesSSE2(__m128i values, __m128i colorLanes, __m128i alphaLanes)
+    {
+        constexpr int broadcast = CHANNELS == 4 ? _MM_SHUFFLE(3, 3, 3, 3) : _MM_SHUFFLE(3, 3, 1, 1);
+        __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(values, broadcast), broadcast);
+        __m128i factor = _mm_or_si128(_mm_and_si128(alpha, colorLanes), alphaLanes);
+        __m128i product = _mm_add_epi16(_mm_mullo_epi16(values, factor), _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+    }
+
+    template <int CHANNELS>
+    LO_TARGET_SSE2 void premultiplySSE2(unsigned char *pixels, std::size_t count)
+    {
+        __m128i colorLanes = CHANNELS == 4 ? _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1) : _mm_set_epi16(0, -1, 0, -1, 0, -1, 0, -1);
+        __m128i alphaLanes = _mm_andnot_si128(colorLanes, _mm_set1_epi16(255));
+        __m128i zero = _mm_setzero_si128();
+
+        std::size_t bytes = count * CHANNELS;
+        std::size_t i = 0;
+        for (; i + 16 <= bytes; i += 16)
+        {
+            __m128i values = _mm_loadu_si128((const __m128i *)(pixels + i));
+            __m128i low = premultiplyLanesSSE2<CHANNELS>(_mm_unpacklo_epi8(values, zero), colorLanes, alphaLanes);
+            __m128i high = premultiplyLanesSSE2<CHANNELS>(_mm_unpackhi_epi8(values, zero), colorLanes, alphaLanes);
+            _mm_storeu_si128((__m128i *)(pixels + i), _mm_packus_epi16(low, high));
+        }
+        premultiplyScalar(pixels + i, count - i / CHANNELS, CHANNELS);
+    }
+
+    // * SSE4.1 (for SSSE3's byte shuffle)
+
+    LO_TARGET_SSE41 void expandSSE41(const unsigned char *source, std::size_t count, unsigned char *target)
+    {
+        const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+
+        // Each load reads 16 bytes for the 12 of four pixels, so stop early enough
+        // not to read past the end.
+        std::size_t i = 0;
+        for (; i + 6 <= count; i += 4)
+        {
+            __m128i rgb = _mm_loadu_si128((const __m128i *)(source + i * 3));
+            _mm_storeu_si128((__m128i *)(target + i * 4), _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha));
+        }
+        expandScalar(source + i * 3, count - i, target + i * 4);
+    }
+
+    // Byte indices that gather four pixels in `order`, for _mm_shuffle_epi8.
+    void swizzleMask(const std::array<std::uint8_t, 4> &order, char *mask)
+    {
+        for (int pixel = 0; pixel < 4; pixel++)
+        {
+            for (int c = 0; c < 4; c++)
+                mask[pixel * 4 + c] = (char)(pixel * 4 + order[c]);
+        }
+    }
+
+    LO_TARGET_SSE41 void swizzleSSE41(const unsigned char *source, std::size_t count, const std::array<std::uint8_t, 4> &order,
+                                      unsigned char *target)
+    {
+        char mask[16];
+        swizzleMask(order, mask);
+        __m128i shuffle = _mm_loadu_si128((const __m128i *)mask);
+
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i pixels = _mm_loadu_si128((const __m128i *)(source + i * 4));
+            _mm_storeu_si128((__m128i *)(target + i * 4), _mm_shuffle_epi8(pixels, shuffle));
+        }
+        swizzleScalar(source + i * 4, count - i, order, target + i * 4);
+    }
+
+    // * AVX2. Shuffles, unpacks and packs work per 128-bit lane, so each lane
+    // is handled like the SSE version.
+
+    LO_TARGET_AVX2 void expandAVX2(const unsigned char *source, std::size_t count, unsigned char *target)
+    {
+        const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                                 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+
+        // The second load reads 16 bytes from pixel 4 on.
+        std::size_t i = 0;
+        for (; i + 10 <= count; i += 8)
+        {
+            const unsigned char *rgb = source + i * 3;
+            __m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)rgb)),
+                                                     _mm_loadu_si128((const __m128i *)(rgb + 12)), 1);
+            _mm256_storeu_si256((__m256i *)(target + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha));
+        }
+        expandScalar(source + i * 3, count - i, target + i * 4);
+    }
+
+    LO_TARGET_AVX2 void swizzleAVX2(const unsigned char *source, std::size_t count, const std::array<std::uint8_t, 4> &order,
+                                    unsigned char *target)
+    {
+        char mask[16];
+        swizzleMask(order, mask);
+        __m256i shuffle = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)mask));
+
+        std::size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i pixels = _mm256_loadu_si256((const __m256i *)(source + i * 4));
+            _mm256_storeu_si256((__m256i *)(target + i * 4), _mm256_shuffle_epi8(pixels, shuffle));
+        }
+        swizzleScalar(source + i * 4, count - i, order, target + i * 4);
+    }
+
+    template <int CHANNELS>
+    LO_TARGET_AVX2 __m256i premultiplyLanesAVX2(__m256i values, __m256i colorLanes, __m256i alphaLanes)
+    {
+        constexpr int broadcast = CHANNELS == 4 ? _MM_SHUFFLE(3, 3, 3, 3) : _MM_SHUFFLE(3, 3, 1, 1);
+        __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(values, broadcast), broadcast);
+        __m256i factor = _mm256_or_si256(_mm256_and_si256(alpha, colorLanes), alphaLanes);
+        __m256i product = _mm256_add_epi16(_mm256_mullo_epi16(values, factor), _mm256_set1_epi16(128));
+        return _mm256_srli_epi16(_mm256_add_epi16(product, _mm256_srli_epi16(product, 8)), 8);
+    }
+
+    template <int CHANNELS>
+    LO_TARGET_AVX2 void premultiplyAVX2(unsigned char *pixels, std::size_t count)
+    {
+        __m256i colorLanes = CHANNELS == 4 ? _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1)
+                                           : _mm256_set_epi16(0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1);
+        __m256i alphaLanes = _mm256_andnot_si256(colorLanes, _mm256_set1_epi16(255));
+        __m256i zero = _mm256_setzero_si256();
+
+        std::size_t bytes = count * CHANNELS;
+        std::size_t i = 0;
+        for (; i + 32 <= bytes; i += 32)
+        {
+            __m256i values = _mm256_loadu_si256((const __m256i *)(pixels + i));
+            __m256i low = premultiplyLanesAVX2<CHANNELS>(_mm256_unpacklo_epi8(values, zero), colorLanes, alphaLanes);
+            __m256i high = premultiplyLanesAVX2<CHANNELS>(_mm256_unpackhi_epi8(values, zero), colorLanes, alphaLanes);
+            _mm256_storeu_si256((__m256i *)(pixels + i), _mm256_packus_epi16(low, high));
+        }
+        premultiplyScalar(pixels + i, count - i / CHANNELS, CHANNELS);
+    }
+#endif
+
+#ifdef LO_NEON
+    // * NEON. Structured loads split the channels into registers of their own.
+
+    void expandNEON(const unsigned char *source, std::size_t count, unsigned char *target)
+    {
+        std::size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            uint8x16x3_t rgb = vld3q_u8(source + i * 3);
+            uint8x16x4_t rgba;
+            rgba.val[0] = rgb.val[0];
+            rgba.val[1] = rgb.val[1];
+            rgba.val[2] = rgb.val[2];
+            rgba.val[3] = vdupq_n_u8(255);
+            vst4q_u8(target + i * 4, rgba);
+        }
+        expandScalar(source + i * 3, count - i, target + i * 4);
+    }
+
+    void swizzleNEON(const unsigned char *source, std::size_t count, const std::array<std::uint8_t, 4> &order, unsigned char *target)
+    {
+        std::size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            uint8x16x4_t pixels = vld4q_u8(source + i * 4);
+            uint8x16x4_t swizzled;
+            for (int c = 0; c < 4; c++)
+                swizzled.val[c] = pixels.val[order[c]];
+            vst4q_u8(target + i * 4, swizzled);
+        }
+        swizzleScalar(source + i * 4, count - i, order, target + i * 4);
+    }
+
+    // vraddhn(x, (x + 128) >> 8) is div255's (x + 128 + ((x + 128) >> 8)) >> 8.
+    uint8x16_t multiplyNEON(uint8x16_t color, uint8x16_t alpha)
+    {
+        uint16x8_t low = vmull_u8(vget_low_u8(color), vget_low_u8(alpha));
+        uint16x8_t high = vmull_u8(vget_high_u8(color), vget_high_u8(alpha));
+        return vcombine_u8(vraddhn_u16(low, vrshrq_n_u16(low, 8)), vraddhn_u16(high, vrshrq_n_u16(high, 8)));
+    }
+
+    void premultiplyNEON(unsigned char *pixels, std::size_t count, int channels)
+    {
+        std::size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            unsigned char *block = pixels + i * channels;
+            if (channels == 4)
+            {
+                uint8x16x4_t rgba = vld4q_u8(block);
+                for (int c = 0; c < 3; c++)
+                    rgba.val[c] = multiplyNEON(rgba.val[c], rgba.val[3]);
+                vst4q_u8(block, rgba);
+            }
+            else
+            {
+                uint8x16x2_t greyAlpha = vld2q_u8(block);
+                greyAlpha.val[0] = multiplyNEON(greyAlpha.val[0], greyAlpha.val[1]);
+                vst2q_u8(block, greyAlpha);
+            }
+        }
+        premultiplyScalar(pixels + i * channels, count - i, channels);
+    }
+#endif
+
+    // * Conversion of whole images
+
+    // The steps a conversion takes for an image of some channel count.
+    struct Plan
+    {
+        bool expand;
+        bool swizzle;
+        bool reduce;
+        bool premultiply;
+        bool transfer;
+        bool pack;
+        int steps;
+    };
+
+    Plan makePlan(int channels, const PixelConversion &conversion)
+    {
+        Plan plan{};
+        plan.expand = conversion.expandToRgba && channels == 3;
+        if (plan.expand)
+            channels = 4;
+        plan.swizzle = channels == 4 && conversion.swizzle != std::array<std::uint8_t, 4>{0, 1, 2, 3};
+        plan.reduce = conversion.reduceToMask && channels >= 3;
+        if (plan.reduce)
+            channels -= 2;
+        plan.premultiply = conversion.premultiplyAlpha && (channels == 2 || channels == 4);
+        plan.transfer = conversion.transfer != TransferFunction::None;
+        plan.pack = conversion.packing != PixelPacking::None;
+        plan.steps = plan.expand + plan.swizzle + plan.reduce + plan.premultiply + plan.transfer + plan.pack;
+        return plan;
+    }
+
+    // One row through every step. The first reads the source row, the last
+    // writes the target row, and the ones between work in `scratch`, which
+    // holds a row of 4 channel pixels.
+    void convertRow(const unsigned char *source, std::size_t width, int channels, const PixelConversion &conversion, const Plan &plan,
+                    unsigned char *scratch, unsigned char *target)
+    {
+        if (plan.steps == 0)
+        {
+            if (source != target)
+                std::memcpy(target, source, width * channels);
+            return;
+        }
+
+        int remaining = plan.steps;
+        const unsigned char *in = source;
+        auto nextOutput = [&]
+        {
+            return --remaining == 0 ? target : scratch;
+        };
+        // For the steps that only work in place.
+        auto inPlace = [&]
+        {
+            unsigned char *out = nextOutput();
+            if (out != in)
+                std::memcpy(out, in, width * channels);
+            return out;
+        };
+
+        if (plan.expand)
+        {
+            unsigned char *out = nextOutput();
+            expandRgbToRgba(in, width, out);
+            in = out;
+            channels = 4;
+        }
+        if (plan.swizzle)
+        {
+            unsigned char *out = nextOutput();
+            swizzleRgba(in, width, conversion.swizzle, out);
+            in = out;
+        }
+        if (plan.reduce)
+        {
+            unsigned char *out = nextOutput();
+            reduceToMask(in, width, channels, out);
+            in = out;
+            channels -= 2;
+        }
+        if (plan.premultiply)
+        {
+            unsigned char *out = inPlace();
+            premultiplyAlpha(out, width, channels, conversion.srgb);
+            in = out;
+        }
+        if (plan.transfer)
+        {
+            unsigned char *out = inPlace();
+            applyTransfer(out, width, channels, conversion.transfer);
+            in = out;
+        }
+        if (plan.pack)
+            packPixels(in, width, conversion.packing, nextOutput());
+    }
+
+    void forRows(ThreadPool *pool, std::size_t rows, std::size_t grain, const std::function<void(std::size_t, std::size_t)> &body)
+    {
+        if (pool != nullptr)
+            pool->parallelFor(rows, grain, body);
+        else
+            body(0, rows);
+    }
+}
+
+void expandRgbToRgba(const unsigned char *source, std::size_t count, unsigned char *target)
+{
+    switch (simdLevel())
+    {
+#ifdef LO_X86
+    case SimdLevel::AVX2:
+        expandAVX2(source, count, target);
+        return;
+    case SimdLevel::SSE41:
+        expandSSE41(source, count, target);
+        return;
+#endif
+#ifdef LO_NEON
+    case SimdLevel::NEON:
+        expandNEON(source, count, target);
+        return;
+#endif
+    default:
+        expandScalar(source, count, target);
+    }
+}
+
+void swizzleRgba(const unsigned char *source, std::size_t count, const std::array<std::uint8_t, 4> &order, unsigned char *target)
+{
+    switch (simdLevel())
+    {
+#ifdef LO_X86
+    case SimdLevel::AVX2:
+        swizzleAVX2(source, count, order, target);
+        return;
+    case SimdLevel::SSE41:
+        swizzleSSE41(source, count, order, target);
+        return;
+    case SimdLevel::SSE2:
+        swizzleSSE2(source, count, order, target);
+        return;
+#endif
+#ifdef LO_NEON
+    case SimdLevel::NEON:
+        swizzleNEON(source, count, order, target);
+        return;
+#endif
+    default:
+        swizzleScalar(source, count, order, target);
+    }
+}
+
+void premultiplyAlpha(unsigned char *pixels, std::size_t count, int channels, bool srgb)
+{
+    if (channels != 2 && channels != 4)
+        return;
+    if (srgb)
+    {
+        premultiplySrgb(pixels, count, channels);
+        return;
+    }
+
+    switch (simdLevel())
+    {
+#ifdef LO_X86
+    case SimdLevel::AVX2:
+        channels == 4 ? premultiplyAVX2<4>(pixels, count) : premultiplyAVX2<2>(pixels, count);
+        return;
+    case SimdLevel::SSE41:
+    case SimdLevel::SSE2:
+        channels == 4 ? premultiplySSE2<4>(pixels, count) : premultiplySSE2<2>(pixels, count);
+        return;
+#endif
+#ifdef LO_NEON
+    case SimdLevel::NEON:
+        premultiplyNEON(pixels, count, channels);
+        return;
+#endif
+    default:
+        premultiplyScalar(pixels, count, channels);
+    }
+}
+
+void applyTransfer(unsigned char *pixels, std::size_t count, int channels, TransferFunction transfer)
+{
+    if (transfer == TransferFunction::None)
+        return;
+
+    const TransferTables &tables = transferTables();
+    const std::array<unsigned char, 256> &table = transfer == TransferFunction::SrgbToLinear ? tables.toLinear : tables.toSrgb;
+    int colors = channels == 2 || channels == 4 ? channels - 1 : channels;
+    for (std::size_t i = 0; i < count; i++)
+    {
+        unsigned char *pixel = pixels + i * channels;
+        for (int c = 0; c < colors; c++)
+            pixel[c] = table[pixel[c]];
+    }
+}
+
+void reduceToMask(const unsigned char *source, std::size_t count, int channels, unsigned char *target)
+{
+    // Front to back, each pixel read before it is written, so target may be source.
+    int reduced = channels == 4 ? 2 : 1;
+    for (std::size_t i = 0; i < count; i++)
+    {
+        const unsigned char *pixel = source + i * channels;
+        unsigned char luminance = (unsigned char)((pixel[0] * 77 + pixel[1] * 150 + pixel[2] * 29) >> 8);
+        unsigned char alpha = channels == 4 ? pixel[3] : 255;
+        target[i * reduced] = luminance;
+        if (reduced == 2)
+            target[i * reduced + 1] = alpha;
+    }
+}
+
+void packPixels(const unsigned char *source, std::size_t count, PixelPacking packing, unsigned char *target)
+{
+    int channels = packing == PixelPacking::RGB565 ? 3 : 4;
+    for (std::size_t i = 0; i < count; i++)
+    {
+        const unsigned char *pixel = source + i * channels;
+        std::uint16_t packed;
+        if (packing == PixelPacking::RGB565)
+            packed = (std::uint16_t)(div255(pixel[0] * 31) << 11 | div255(pixel[1] * 63) << 5 | div255(pixel[2] * 31));
+        else
+            packed = (std::uint16_t)(div255(pixel[0] * 15) << 12 | div255(pixel[1] * 15) << 8 | div255(pixel[2] * 15) << 4 |
+                                     div255(pixel[3] * 15));
+        std::memcpy(target + i * 2, &packed, sizeof(packed));
+    }
+}
+
+bool PixelConversion::identity() const
+{
+    return !flipVertically && makePlan(4, *this).steps == 0 && !expandToRgba;
+}
+
+int convertedChannels(int channels, const PixelConversion &conversion)
+{
+    if (conversion.expandToRgba && channels == 3)
+        channels = 4;
+    if (conversion.reduceToMask && channels >= 3)
+        channels -= 2;
+    return channels;
+}
+
+int convertedPixelBytes(int channels, const PixelConversion &conversion)
+{
+    return conversion.packing != PixelPacking::None ? 2 : convertedChannels(channels, conversion);
+}
+
+void convertPixels(const unsigned char *source, int width, int height, int channels, const PixelConversion &conversion,
+                   unsigned char *target, ThreadPool *pool)
+{
+    Plan plan = makePlan(channels, conversion);
+    std::size_t sourceRow = (std::size_t)width * channels;
+    std::size_t targetRow = (std::size_t)width * convertedPixelBytes(channels, conversion);
+    std::size_t grain = std::max<std::size_t>(1, 64 * 1024 / std::max<std::size_t>(sourceRow, 1));
+
+    if (!conversion.flipVertically || source != target)
+    {
+        forRows(pool, (std::size_t)height, grain, [&](std::size_t begin, std::size_t end)
+                {
+            std::vector<unsigned char> scratch((std::size_t)width * 4);
+            for (std::size_t y = begin; y < end; y++)
+            {
+                std::size_t from = conversion.flipVertically ? height - 1 - y : y;
+                convertRow(source + from * sourceRow, (std::size_t)width, channels, conversion, plan, scratch.data(), target + y * targetRow);
+            } });
+        return;
+    }
+
+    // Flipping in place (the pixel size stays): rows trade places in pairs,
+    // the upper one through a copy.
+    unsigned char *pixels = target;
+    forRows(pool, (std::size_t)height / 2, grain, [&](std::size_t begin, std::size_t end)
+            {
+        std::vector<unsigned char> scratch((std::size_t)width * 4);
+        std::vector<unsigned char> upper(sourceRow);
+        for (std::size_t y = begin; y < end; y++)
+        {
+            unsigned char *top = pixels + y * sourceRow;
+            unsigned char *bottom = pixels + (height - 1 - y) * sourceRow;
+            std::memcpy(upper.data(), top, sourceRow);
+            convertRow(bottom, (std::size_t)width, channels, conversion, plan, scratch.data(), top);
+            convertRow(upper.data(), (std::size_t)width, channels, conversion, plan, scratch.data(), bottom);
+        } });
+    if (height % 2 != 0)
+    {
+        std::vector<unsigned char> scratch((std::size_t)width * 4);
+        unsigned char *middle = pixels + (std::size_t)(height / 2) * sourceRow;
+        convertRow(middle, (std::size_t)width, channels, conversion, plan, scratch.data(), middle);
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+class ThreadPool;
+
+// Conversions between decoding an 8-bit image and uploading it. Each kernel
+// works on `count` interleaved pixels and uses the best SIMD path of
+// simdLevel(); setSimdLevelLimit(SimdLevel::Scalar) selects the scalar
+// reference versions, which every SIMD path matches bit for bit.
+//
+// SIMD paths: expandRgbToRgba (SSE4.1, AVX2, NEON), swizzleRgba (SSE2, SSE4.1,
+// AVX2, NEON) and linear premultiplyAlpha (SSE2, AVX2, NEON). The sRGB
+// conversions are byte table lookups, which no SIMD path here beats, and the
+// mask and packing kernels stay scalar.
+
+enum class TransferFunction
+{
+    None,
+    SrgbToLinear, // 8-bit results lose most of the steps near black
+    LinearToSrgb
+};
+
+enum class PixelPacking
+{
+    None,
+    RGB565,  // 3 channels to GL_UNSIGNED_SHORT_5_6_5, native byte order
+    RGBA4444 // 4 channels to GL_UNSIGNED_SHORT_4_4_4_4
+};
+
+// Three channels in, four out, alpha 255.
+void expandRgbToRgba(const unsigned char *source, std::size_t count, unsigned char *target);
+
+// Output channel i takes input channel order[i] (0 to 3). May work in place.
+void swizzleRgba(const unsigned char *source, std::size_t count, const std::array<std::uint8_t, 4> &order, unsigned char *target);
+
+// Multiply the color of 2 or 4 channel pixels by their alpha, in place. With
+// `srgb` the color is sRGB-encoded and multiplied in linear light.
+void premultiplyAlpha(unsigned char *pixels, std::size_t count, int channels, bool srgb);
+
+// Apply a transfer function to the color channels, in place. Alpha (the last
+// channel of 2 and 4 channel pixels) is left alone.
+void applyTransfer(unsigned char *pixels, std::size_t count, int channels, TransferFunction transfer);
+
+// 3 and 4 channel pixels to their luminance (Rec. 601 weights, as stb_image
+// uses), keeping alpha: 1 or 2 channels out. May work in place.
+void reduceToMask(const unsigned char *source, std::size_t count, int channels, unsigned char *target);
+
+// 2 bytes per pixel out, rounded to the nearest value. May work in place.
+void packPixels(const unsigned char *source, std::size_t count, PixelPacking packing, unsigned char *target);
+
+// Everything an image may need on its way to the GPU, done row by row in one
+// pass: each row is read once, goes through the steps below in this order
+// while it is in cache, and is written once.
+struct PixelConversion
+{
+    bool flipVertically = false;
+    bool expandToRgba = false; // 3 channel images only
+    std::array<std::uint8_t, 4> swizzle{0, 1, 2, 3}; // 4 channel images only
+    bool reduceToMask = false;
+    bool premultiplyAlpha = false;
+    bool srgb = false; // for premultiplyAlpha: the color is sRGB-encoded
+    TransferFunction transfer = TransferFunction::None;
+    PixelPacking packing = PixelPacking::None; // last; needs 3 or 4 channels by then
+
+    // Nothing to do but copy.
+    bool identity() const;
+};
+
+// Channels of a converted image (before packing).
+int convertedChannels(int channels, const PixelConversion &conversion);
+
+// Bytes per pixel of a converted image.
+int convertedPixelBytes(int channels, const PixelConversion &conversion);
+
+// Convert a tightly packed image into `target`, which holds width * height *
+// convertedPixelBytes() bytes. `target` may be `source` if the pixel size
+// doesn't change. With a pool, rows are spread over its threads.
+void convertPixels(const unsigned char *source, int width, int height, int channels, const PixelConversion &conversion,
+                   unsigned char *target, ThreadPool *pool = nullptr);
@@ -0,0 +1,192 @@
+#include "program_cache.hpp"
+#include "hash.hpp"
+
+#include <climits>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+    constexpr std::uint32_t CACHE_MAGIC = 0x4e42474c; // "LGBN"
+
+    struct EntryHeader
+    {
+        std::uint32_t magic;
+        std::uint32_t format;
+        std::uint64_t key;
+        std::uint64_t length;
+    };
+
+    std::string glString(GLenum name)
+    {
+        const GLubyte *value = glGetString(name);
+        return value ? (const char *)value : "";
+    }
+}
+
+ProgramCache::ProgramCache(const char *directory)
+    : directory(directory)
+{
+    int formats = 0;
+    supported = GLAD_GL_ARB_get_program_binary;
+    if (!supported)
+    {
+        disabledReason = "driver lacks ARB_get_program_binary";
+    }
+    else
+    {
+        // Some drivers expose the extension but no binary formats.
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        supported = formats > 0;
+        if (!supported)
+            disabledReason = "driver has no program binary formats";
+    }
+
+    if (!supported)
+    {
+        std::cout << "Program binary cache disabled: " << disabledReason << "." << std::endl;
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(this->directory, error);
+    if (error)
+    {
+        std::cerr << "ERROR::PROGRAM_CACHE::CANNOT_CREATE_DIRECTORY " << this->directory << std::endl;
+        supported = false;
+        disabledReason = "cache directory can't be created";
+        return;
+    }
+
+    driver = glString(GL_VENDOR) + '\n' + glString(GL_RENDERER) + '\n' + glString(GL_VERSION);
+}
+
+std::filesystem::path ProgramCache::entryPath(std::uint64_t key) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+    return directory / name;
+}
+
+std::uint64_t ProgramCache::key(std::uint64_t vertexHash, std::uint64_t fragmentHash) const
+{
+    std::uint64_t hash = fnv1a(driver);
+    hash = fnv1a(std::string_view((const char *)&vertexHash, sizeof(vertexHash)), hash);
+    return fnv1a(std::string_view((const char *)&fragmentHash, sizeof(fragmentHash)), hash);
+}
+
+std::uint64_t ProgramCache::stageKey(GLenum type, std::uint64_t hash) const
+{
+    // The "separable" tag keeps it apart from any key(vertexHash, fragmentHash).
+    std::uint64_t result = fnv1a("separable", fnv1a(driver));
+    result = fnv1a(std::string_view((const char *)&type, sizeof(type)), result);
+    return fnv1a(std::string_view((const char *)&hash, sizeof(hash)), result);
+}
+
+unsigned int ProgramCache::load(std::uint64_t key, bool separable)
+{
+    if (!supported)
+        return 0;
+
+    std::filesystem::path path = entryPath(key);
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        missCount++;
+        return 0;
+    }
+
+    // A corrupt length must not size the buffer: it has to fit in what's left of the file.
+    std::error_code error;
+    std::uintmax_t fileSize = std::filesystem::file_size(path, error);
+    EntryHeader header{};
+    file.read((char *)&header, sizeof(header));
+    std::vector<char> binary;
+    if (file && !error && header.magic == CACHE_MAGIC && header.key == key && header.length <= fileSize - sizeof(header) &&
+        header.length <= (std::uint64_t)INT_MAX)
+    {
+        binary.resize(header.length);
+        file.read(binary.data(), (std::streamsize)binary.size());
+    }
+    file.close();
+
+    if (binary.empty() || !file)
+    {
+        std::filesystem::remove(path, error);
+        rejectCount++;
+        return 0;
+    }
+
+    unsigned int program = glCreateProgram();
+    if (separable)
+        glProgramParameteri(program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+    glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+
+    int success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        // Stale or corrupt binary. Drop it so the next launch stores a fresh one.
+        glDeleteProgram(program);
+        std::filesystem::remove(path, error);
+        rejectCount++;
+        return 0;
+    }
+
+    hitCount++;
+    return program;
+}
+
+void ProgramCache::markRetrievable(unsigned int program) const
+{
+    if (supported)
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ProgramCache::store(std::uint64_t key, unsigned int program)
+{
+    if (!supported)
+        return;
+
+    int length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, NULL, &format, binary.data());
+
+    // Write to a temporary file first so a crash never leaves a truncated entry behind.
+    std::filesystem::path path = entryPath(key);
+    std::filesystem::path temp = path;
+    temp += ".tmp";
+
+    std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+    EntryHeader header{CACHE_MAGIC, format, key, (std::uint64_t)length};
+    file.write((const char *)&header, sizeof(header));
+    file.write(binary.data(), length);
+    file.close();
+
+    std::error_code error;
+    if (file)
+        std::filesystem::rename(temp, path, error);
+    if (!file || error)
+    {
+        std::cerr << "ERROR::PROGRAM_CACHE::WRITE_FAILED " << path << std::endl;
+        std::filesystem::remove(temp, error);
+    }
+}
+
+void ProgramCache::printStats() const
+{
+    if (!supported)
+    {
+        std::cout << "Program cache: disabled (" << disabledReason << ")" << std::endl;
+        return;
+    }
+    std::cout << "Program cache: " << hitCount << " hits, " << missCount << " misses, "
+              << rejectCount << " rejected" << std::endl;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Persistent cache of linked program binaries (ARB_get_program_binary).
+//
+// Entries are keyed by a hash of the vertex/fragment sources and the GL
+// vendor/renderer/version strings, so a driver update or a different GPU
+// simply misses instead of feeding the driver a binary it can't use.
+// A binary the driver rejects anyway is deleted and the program is
+// compiled from source as usual.
+class ProgramCache
+{
+private:
+    std::filesystem::path directory;
+    std::string driver; // vendor + renderer + version, filled on first use
+    bool supported;
+    const char *disabledReason = nullptr; // why supported is false
+
+    unsigned int hitCount = 0;
+    unsigned int missCount = 0;
+    unsigned int rejectCount = 0;
+
+    std::filesystem::path entryPath(std::uint64_t key) const;
+
+public:
+    // Needs a current GL context.
+    explicit ProgramCache(const char *directory);
+
+    bool enabled() const
+    {
+        return supported;
+    }
+
+    // Takes the hashes of the expanded vertex/fragment sources (ShaderSource::hash).
+    std::uint64_t key(std::uint64_t vertexHash, std::uint64_t fragmentHash) const;
+
+    // Key of a separable program holding the single stage of that type and source hash.
+    std::uint64_t stageKey(GLenum type, std::uint64_t hash) const;
+
+    // Returns a linked program restored from disk, or 0 on a miss or a rejected binary.
+    // Separable stage programs (stageKey) are loaded with separable = true.
+    unsigned int load(std::uint64_t key, bool separable = false);
+
+    // Must be called on a new program before glLinkProgram so the driver keeps the binary around.
+    void markRetrievable(unsigned int program) const;
+
+    // Stores the binary of a successfully linked program.
+    void store(std::uint64_t key, unsigned int program);
+
+    unsigned int hits() const
+    {
+        return hitCount;
+    }
+
+    unsigned int misses() const
+    {
+        return missCount;
+    }
+
+    unsigned int rejected() const
+    {
+        return rejectCount;
+    }
+
+    void printStats() const;
+};
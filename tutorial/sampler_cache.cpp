@@ -0,0 +1,82 @@
+#include "sampler_cache.hpp"
+#include "gl_state.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+std::size_t SamplerStateHash::operator()(const SamplerState &state) const
+{
+    // Field by field: padding and -0.0f (== 0.0f) must not change the hash.
+    unsigned char bytes[sizeof(SamplerState)];
+    std::size_t size = 0;
+    auto add = [&](auto value)
+    {
+        if constexpr (std::is_floating_point_v<decltype(value)>)
+            value += 0.0f;
+        std::memcpy(bytes + size, &value, sizeof(value));
+        size += sizeof(value);
+    };
+
+    add(state.wrapS);
+    add(state.wrapT);
+    add(state.wrapR);
+    add(state.minFilter);
+    add(state.magFilter);
+    for (float channel : state.borderColor)
+        add(channel);
+    add(state.minLod);
+    add(state.maxLod);
+    add(state.lodBias);
+    add(state.maxAnisotropy);
+    add(state.compareMode);
+    add(state.compareFunc);
+    return (std::size_t)fnv1a(std::string_view((const char *)bytes, size));
+}
+
+SamplerCache::SamplerCache()
+    : anisotropyLimit(0.0f)
+{
+    if (GLAD_GL_EXT_texture_filter_anisotropic)
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &anisotropyLimit);
+}
+
+unsigned int SamplerCache::get(const SamplerState &state)
+{
+    auto found = samplers.find(state);
+    if (found != samplers.end())
+        return found->second;
+
+    unsigned int sampler;
+    glGenSamplers(1, &sampler);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, state.wrapS);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, state.wrapT);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_R, state.wrapR);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, state.minFilter);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, state.magFilter);
+    glSamplerParameterfv(sampler, GL_TEXTURE_BORDER_COLOR, state.borderColor.data());
+    glSamplerParameterf(sampler, GL_TEXTURE_MIN_LOD, state.minLod);
+    glSamplerParameterf(sampler, GL_TEXTURE_MAX_LOD, state.maxLod);
+    glSamplerParameterf(sampler, GL_TEXTURE_LOD_BIAS, state.lodBias);
+    glSamplerParameteri(sampler, GL_TEXTURE_COMPARE_MODE, state.compareMode);
+    glSamplerParameteri(sampler, GL_TEXTURE_COMPARE_FUNC, state.compareFunc);
+    if (anisotropyLimit > 0.0f)
+        glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::clamp(state.maxAnisotropy, 1.0f, anisotropyLimit));
+
+    samplers.emplace(state, sampler);
+    return sampler;
+}
+
+void SamplerCache::bind(unsigned int unit, const SamplerState &state)
+{
+    glState().bindSampler(unit, get(state));
+}
+
+void SamplerCache::destroy()
+{
+    for (auto &entry : samplers)
+        glState().deleteSamplers(1, &entry.second);
+    samplers.clear();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <array>
+#include <cstddef>
+#include <unordered_map>
+
+// How a texture is sampled, kept apart from the texture itself. Two equal
+// states share one GL sampler object.
+struct SamplerState
+{
+    GLint wrapS = GL_REPEAT;
+    GLint wrapT = GL_REPEAT;
+    GLint wrapR = GL_REPEAT;
+    GLint minFilter = GL_LINEAR_MIPMAP_LINEAR;
+    GLint magFilter = GL_LINEAR;
+    std::array<float, 4> borderColor{0.0f, 0.0f, 0.0f, 0.0f}; // for GL_CLAMP_TO_BORDER
+    float minLod = -1000.0f;
+    float maxLod = 1000.0f;
+    float lodBias = 0.0f;
+    float maxAnisotropy = 1.0f; // ignored without EXT_texture_filter_anisotropic
+    GLint compareMode = GL_NONE; // GL_COMPARE_REF_TO_TEXTURE for shadow maps
+    GLint compareFunc = GL_LEQUAL;
+
+    bool operator==(const SamplerState &) const = default;
+};
+
+struct SamplerStateHash
+{
+    std::size_t operator()(const SamplerState &state) const;
+};
+
+// Deduplicated sampler objects, created on first use and kept until destroy().
+// Binding one to a unit overrides the sampling parameters of whatever texture
+// is bound there, so textures never need glTexParameter for them, and
+// switching how a texture is sampled never touches the texture object.
+class SamplerCache
+{
+private:
+    std::unordered_map<SamplerState, unsigned int, SamplerStateHash> samplers;
+    float anisotropyLimit; // 0 without the extension
+
+public:
+    // Needs a current GL context.
+    SamplerCache();
+
+    SamplerCache(const SamplerCache &) = delete;
+    SamplerCache &operator=(const SamplerCache &) = delete;
+
+    // The sampler object for the state, created if there is none yet.
+    unsigned int get(const SamplerState &state);
+    void bind(unsigned int unit, const SamplerState &state);
+
+    std::size_t size() const
+    {
+        return samplers.size();
+    }
+
+    void destroy();
+};
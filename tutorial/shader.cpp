@@ -1,52 +1,57 @@
 #include "shader.hpp"
+#include "uniform_buffer.hpp"
+#include "gl_state.hpp"
 
-Shader::Shader(const char *vertexPath, const char *fragmentPath)
-{
-    // * 1. Retrieve the vertex/fragment source code from filepath
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
+#include <glm/gtc/type_ptr.hpp>
 
-    // Ensure the ifstreams can throw errors
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+#include <algorithm>
 
-    try
-    {
-        // open files
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        std::stringstream vShaderStream, fShaderStream;
-
-        // read file's buffer contents into streams
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-
-        // close file handlers
-        vShaderFile.close();
-        fShaderFile.close();
-
-        // convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
-    }
-    catch (const std::exception &e)
+Shader::Shader(const char *vertexPath, const char *fragmentPath, ProgramCache *cache)
+{
+    // * 1. Retrieve the vertex/fragment source code from filepath. The files are
+    // read and #includes expanded once; later Shaders reuse the expansion.
+    const ShaderSource &vertexSource = shaderSources().load(vertexPath);
+    const ShaderSource &fragmentSource = shaderSources().load(fragmentPath);
+    if (!vertexSource.valid || !fragmentSource.valid)
     {
         std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
     }
 
-    const char *vShaderCode = vertexCode.c_str();
-    const char *fShaderCode = fragmentCode.c_str();
+    build(vertexSource, fragmentSource, cache);
+}
+
+Shader::Shader(const EmbeddedShader &vertex, const EmbeddedShader &fragment, ProgramCache *cache)
+{
+    // * 1. The sources were validated and #includes expanded at build time.
+    ShaderSource vertexSource = ShaderSource::fromMemory(vertex.source, vertex.size, vertex.hash);
+    ShaderSource fragmentSource = ShaderSource::fromMemory(fragment.source, fragment.size, fragment.hash);
+
+    build(vertexSource, fragmentSource, cache);
+}
 
-    // * 2. Compile Shaders
+void Shader::build(const ShaderSource &vertexSource, const ShaderSource &fragmentSource, ProgramCache *cache)
+{
+    // * 2. Try to restore a previously linked binary
+    std::uint64_t cacheKey = 0;
+    if (cache != nullptr && cache->enabled())
+    {
+        cacheKey = cache->key(vertexSource.hash, fragmentSource.hash);
+        ID = cache->load(cacheKey);
+        if (ID != 0)
+        {
+            reflectUniforms();
+            return;
+        }
+    }
+
+    // * 3. Compile Shaders
     unsigned int vertexShader, fragmentShader;
     int success;
     char infoLog[512];
 
     // vertex shader
     vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vShaderCode, NULL);
+    vertexSource.upload(vertexShader);
     glCompileShader(vertexShader);
     glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
     if (!success)
@@ -58,7 +63,7 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath)
 
     // fragment shader
     fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fShaderCode, NULL);
+    fragmentSource.upload(fragmentShader);
     glCompileShader(fragmentShader);
     glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
     if (!success)
@@ -70,6 +75,8 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath)
 
     // shader program
     ID = glCreateProgram();
+    if (cache != nullptr)
+        cache->markRetrievable(ID);
     glAttachShader(ID, vertexShader);
     glAttachShader(ID, fragmentShader);
     glLinkProgram(ID);
@@ -79,35 +86,229 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath)
         glGetProgramInfoLog(ID, 512, NULL, infoLog);
         std::cout << "ERROR::SHADER::SHADER_PROGRAM_LINKING_FAILED\n"
                   << infoLog << std::endl;
+        // Not ready(), like a Shader whose CompileQueue job failed.
+        glDeleteProgram(ID);
+        ID = 0;
+        buildFailed = true;
+    }
+    else if (cache != nullptr)
+    {
+        cache->store(cacheKey, ID);
     }
 
     // delete shaders. no longer necessary.
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
+
+    // * 4. Enumerate the active uniforms once
+    if (ID != 0)
+        reflectUniforms();
+}
+
+void Shader::adopt(unsigned int program)
+{
+    unsigned int previous = ID;
+    ID = program;
+    buildFailed = false;
+    reflectUniforms();
+
+    if (previous != 0)
+    {
+        replayUniforms(previous);
+        glState().deleteProgram(previous);
+    }
+}
+
+void Shader::reflectUniforms()
+{
+    // Shared uniform blocks always live at the same binding points.
+    bindUniformBlocks(ID);
+
+    // Existing slots keep their index. Anything the new program lacks ends up with location -1.
+    for (UniformSlot &slot : uniforms)
+        slot.location = -1;
+
+    int count = 0;
+    int maxNameLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+    std::string name(maxNameLength, '\0');
+    for (int i = 0; i < count; i++)
+    {
+        int length = 0;
+        int size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(ID, (GLuint)i, maxNameLength, &length, &size, &type, name.data());
+
+        // Uniforms inside a uniform block have no location and can't be set with glUniform*.
+        int location = glGetUniformLocation(ID, name.c_str());
+        if (location < 0)
+            continue;
+
+        // Arrays are reported as "name[0]". Store the plain name.
+        std::string_view plain(name.data(), length);
+        if (plain.ends_with("[0]"))
+            plain.remove_suffix(3);
+
+        int index = findUniform(plain);
+        if (index < 0)
+        {
+            UniformSlot slot{};
+            slot.name = plain;
+            slot.hasValue = false;
+            slot.replay = nullptr;
+            uniforms.push_back(slot);
+            index = (int)uniforms.size() - 1;
+        }
+
+        UniformSlot &slot = uniforms[index];
+        if (slot.type != type)
+            slot.hasValue = false; // the shadowed value no longer fits
+        slot.location = location;
+        slot.type = type;
+        slot.count = size;
+    }
+
+    // Keep a sorted index so lookups are a binary search.
+    uniformsByName.resize(uniforms.size());
+    for (std::size_t i = 0; i < uniforms.size(); i++)
+        uniformsByName[i] = (int)i;
+    std::sort(uniformsByName.begin(), uniformsByName.end(), [this](int a, int b)
+              { return uniforms[a].name < uniforms[b].name; });
+}
+
+void Shader::replayUniforms(unsigned int replaced) const
+{
+    unsigned int current = glState().currentProgram();
+
+    glState().useProgram(ID);
+    for (const UniformSlot &slot : uniforms)
+    {
+        if (slot.hasValue && slot.location >= 0)
+            slot.replay(slot.location, slot.value);
+    }
+
+    // If the replaced program was bound, the new one takes its place.
+    if (current != replaced)
+        glState().useProgram(current);
+}
+
+int Shader::findUniform(std::string_view name) const
+{
+    auto it = std::lower_bound(uniformsByName.begin(), uniformsByName.end(), name, [this](int index, std::string_view key)
+                               { return uniforms[index].name < key; });
+    if (it == uniformsByName.end() || uniforms[*it].name != name)
+        return -1;
+    return *it;
+}
+
+bool Shader::accepts(GLenum type, bool)
+{
+    return type == GL_BOOL;
+}
+
+bool Shader::accepts(GLenum type, int)
+{
+    switch (type)
+    {
+    case GL_INT:
+    case GL_BOOL:
+    case GL_SAMPLER_1D:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_3D:
+    case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_2D_SHADOW:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool Shader::accepts(GLenum type, float)
+{
+    return type == GL_FLOAT;
+}
+
+bool Shader::accepts(GLenum type, const glm::vec2 &)
+{
+    return type == GL_FLOAT_VEC2;
+}
+
+bool Shader::accepts(GLenum type, const glm::vec3 &)
+{
+    return type == GL_FLOAT_VEC3;
+}
+
+bool Shader::accepts(GLenum type, const glm::vec4 &)
+{
+    return type == GL_FLOAT_VEC4;
+}
+
+bool Shader::accepts(GLenum type, const glm::mat4 &)
+{
+    return type == GL_FLOAT_MAT4;
+}
+
+void Shader::upload(int location, bool value)
+{
+    glUniform1i(location, (int)value);
+}
+
+void Shader::upload(int location, int value)
+{
+    glUniform1i(location, value);
+}
+
+void Shader::upload(int location, float value)
+{
+    glUniform1f(location, value);
+}
+
+void Shader::upload(int location, const glm::vec2 &value)
+{
+    glUniform2fv(location, 1, glm::value_ptr(value));
+}
+
+void Shader::upload(int location, const glm::vec3 &value)
+{
+    glUniform3fv(location, 1, glm::value_ptr(value));
+}
+
+void Shader::upload(int location, const glm::vec4 &value)
+{
+    glUniform4fv(location, 1, glm::value_ptr(value));
+}
+
+void Shader::upload(int location, const glm::mat4 &value)
+{
+    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
 }
 
 void Shader::use()
 {
-    glUseProgram(ID);
+    glState().useProgram(ID);
 }
 
-void Shader::setBool(const std::string& name, bool value) const
+void Shader::setBool(std::string_view name, bool value)
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    uniform<bool>(name).set(value);
 }
 
-void Shader::setInt(const std::string& name, int value) const
+void Shader::setInt(std::string_view name, int value)
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    uniform<int>(name).set(value);
 }
 
-void Shader::setFloat(const std::string& name, float value) const
+void Shader::setFloat(std::string_view name, float value)
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    uniform<float>(name).set(value);
 }
 
 void Shader::destroy()
 {
-    glDeleteProgram(ID);
+    glState().deleteProgram(ID);
+    ID = 0;
 }
 
@@ -1,5 +1,10 @@
 #version 330 core
 
+// Tints the textures by the interpolated vertex color.
+#pragma variant VERTEX_COLOR
+// Samples the instance's layer of a texture array instead.
+#pragma variant TEXTURE_ARRAY
+
 out vec4 FragColor;
 
 in vec3 ourColor;
@@ -8,7 +13,31 @@ in vec2 TexCoord;
 uniform sampler2D texture1;
 uniform sampler2D texture2;
 
+// Where each texture's image lies when both samplers read one atlas: xy is the
+// offset and zw the scale of its region. The default is the whole texture.
+uniform vec4 region1 = vec4(0.0f, 0.0f, 1.0f, 1.0f);
+uniform vec4 region2 = vec4(0.0f, 0.0f, 1.0f, 1.0f);
+
+#ifdef TEXTURE_ARRAY
+uniform sampler2DArray layers;
+flat in float Layer;
+#endif
+
+layout (std140) uniform Frame
+{
+    float time;
+    float textureMix;
+};
+
 void main()
 {
-    FragColor = mix(texture(texture1, TexCoord), texture(texture2, TexCoord), 0.2);
+#ifdef TEXTURE_ARRAY
+    FragColor = texture(layers, vec3(TexCoord, Layer));
+#else
+    FragColor = mix(texture(texture1, region1.xy + TexCoord * region1.zw),
+                    texture(texture2, region2.xy + TexCoord * region2.zw), textureMix);
+#endif
+#ifdef VERTEX_COLOR
+    FragColor *= vec4(ourColor, 1.0f);
+#endif
 }
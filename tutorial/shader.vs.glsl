@@ -1,17 +1,37 @@
 #version 330 core
 
+// One small quad per instance, offset and textured from a texture array layer
+// by a per-instance attribute (see TextureArrayPool).
+#pragma variant TEXTURE_ARRAY
+
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor;
 layout (location = 2) in vec2 aTexCoord;
 
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+};
+
 uniform mat4 transform;
 
+#ifdef TEXTURE_ARRAY
+layout (location = 3) in vec3 aInstance; // xy offset, z layer
+flat out float Layer;
+#endif
+
 out vec3 ourColor;
 out vec2 TexCoord;
 
 void main()
 {
-    gl_Position = transform * vec4(aPos, 1.0f);
+#ifdef TEXTURE_ARRAY
+    gl_Position = projection * view * (transform * vec4(aPos, 1.0f) + vec4(aInstance.xy, 0.0f, 0.0f));
+    Layer = aInstance.z;
+#else
+    gl_Position = projection * view * transform * vec4(aPos, 1.0f);
+#endif
     ourColor = aColor;
     TexCoord = aTexCoord;
 }
@@ -0,0 +1,201 @@
+#include "shader_pipeline.hpp"
+#include "shader_source.hpp"
+#include "gl_state.hpp"
+
+#include <iostream>
+
+namespace
+{
+    void printCompileLog(unsigned int shader, const char *stage, const std::string &path)
+    {
+        int success = 0;
+        char infoLog[512];
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            glGetShaderInfoLog(shader, 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER::" << stage << "_SHADER_COMPILATION_FAILED " << path << "\n"
+                      << infoLog << std::endl;
+        }
+    }
+}
+
+// * ShaderPipeline
+
+void ShaderPipeline::activate(const Shader &stage)
+{
+    if (activeProgram == stage.getID())
+        return;
+    activeProgram = stage.getID();
+    glActiveShaderProgram(pipeline, activeProgram);
+}
+
+void ShaderPipeline::use()
+{
+    if (program)
+    {
+        program->use();
+        return;
+    }
+
+    // A program in use would override the pipeline.
+    glState().useProgram(0);
+    glState().bindProgramPipeline(pipeline);
+}
+
+void ShaderPipeline::setInt(std::string_view name, int value)
+{
+    uniform<int>(name).set(value);
+}
+
+// * ShaderPipelines
+
+ShaderPipelines::ShaderPipelines(ProgramCache *cache, bool allowSeparate)
+    : cache(cache), separateStages(allowSeparate && GLAD_GL_ARB_separate_shader_objects)
+{
+}
+
+void ShaderPipelines::linkStages(const std::string &vertexPath, const std::string &fragmentPath)
+{
+    struct Pending
+    {
+        GLenum type;
+        const std::string *path;
+        Shader *target;
+        std::uint64_t cacheKey;
+        unsigned int shader;
+        unsigned int program;
+    };
+    Pending pending[2] = {
+        {GL_VERTEX_SHADER, &vertexPath, nullptr, 0, 0, 0},
+        {GL_FRAGMENT_SHADER, &fragmentPath, nullptr, 0, 0, 0},
+    };
+
+    // * 1. Restore or compile the stages that don't exist yet...
+    for (Pending &stage : pending)
+    {
+        std::unique_ptr<Shader> &target = stages[*stage.path];
+        if (target)
+            continue;
+        target = std::make_unique<Shader>();
+        stage.target = target.get();
+
+        const ShaderSource &source = shaderSources().load(stage.path->c_str());
+        if (!source.valid)
+            continue; // already reported by the source cache
+
+        if (cache != nullptr && cache->enabled())
+        {
+            stage.cacheKey = cache->stageKey(stage.type, source.hash);
+            unsigned int program = cache->load(stage.cacheKey, true);
+            if (program != 0)
+            {
+                stage.target->adopt(program);
+                continue;
+            }
+        }
+
+        stage.shader = glCreateShader(stage.type);
+        source.upload(stage.shader);
+        glCompileShader(stage.shader);
+    }
+
+    // * 2. ...link each one on its own...
+    for (Pending &stage : pending)
+    {
+        if (stage.shader == 0)
+            continue;
+
+        stage.program = glCreateProgram();
+        glProgramParameteri(stage.program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+        if (cache != nullptr)
+            cache->markRetrievable(stage.program);
+        glAttachShader(stage.program, stage.shader);
+        glLinkProgram(stage.program);
+        glDetachShader(stage.program, stage.shader);
+        stageLinks++;
+    }
+
+    // * 3. ...and only then check the results
+    for (Pending &stage : pending)
+    {
+        if (stage.shader == 0)
+            continue;
+
+        int success = 0;
+        glGetProgramiv(stage.program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            char infoLog[512];
+            printCompileLog(stage.shader, stage.type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT", *stage.path);
+            glGetProgramInfoLog(stage.program, 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER::SHADER_PROGRAM_LINKING_FAILED " << *stage.path << "\n"
+                      << infoLog << std::endl;
+            glDeleteProgram(stage.program);
+            stage.target->buildFailed = true;
+        }
+        else
+        {
+            if (cache != nullptr)
+                cache->store(stage.cacheKey, stage.program);
+            stage.target->adopt(stage.program);
+        }
+        glDeleteShader(stage.shader);
+    }
+}
+
+ShaderPipeline &ShaderPipelines::get(const char *vertexPath, const char *fragmentPath)
+{
+    std::string vertex = normalizeShaderPath(vertexPath);
+    std::string fragment = normalizeShaderPath(fragmentPath);
+
+    std::unique_ptr<ShaderPipeline> &pipeline = pipelines[vertex + "\n" + fragment];
+    if (pipeline)
+        return *pipeline;
+    pipeline = std::make_unique<ShaderPipeline>();
+
+    if (!separateStages)
+    {
+        pipeline->program = std::make_unique<Shader>(vertex.c_str(), fragment.c_str(), cache);
+        programLinks++;
+        return *pipeline;
+    }
+
+    linkStages(vertex, fragment);
+    pipeline->vertexStage = stages.at(vertex).get();
+    pipeline->fragmentStage = stages.at(fragment).get();
+    if (!pipeline->vertexStage->ready() || !pipeline->fragmentStage->ready())
+        return *pipeline;
+
+    // Combining the stages is all that's left; no link.
+    glGenProgramPipelines(1, &pipeline->pipeline);
+    glUseProgramStages(pipeline->pipeline, GL_VERTEX_SHADER_BIT, pipeline->vertexStage->getID());
+    glUseProgramStages(pipeline->pipeline, GL_FRAGMENT_SHADER_BIT, pipeline->fragmentStage->getID());
+    return *pipeline;
+}
+
+void ShaderPipelines::printStats() const
+{
+    std::cout << "Shader pipelines: " << pipelines.size() << " combinations, ";
+    if (separateStages)
+        std::cout << stageLinks << " separable stage links" << std::endl;
+    else
+        std::cout << programLinks << " program links (no ARB_separate_shader_objects)" << std::endl;
+}
+
+void ShaderPipelines::destroy()
+{
+    for (auto &entry : pipelines)
+    {
+        ShaderPipeline &pipeline = *entry.second;
+        if (pipeline.pipeline != 0)
+            glState().deleteProgramPipelines(1, &pipeline.pipeline);
+        if (pipeline.program)
+            pipeline.program->destroy();
+    }
+    pipelines.clear();
+
+    for (auto &entry : stages)
+        entry.second->destroy();
+    stages.clear();
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "shader.hpp"
+#include "program_cache.hpp"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+class ShaderPipeline;
+
+// A uniform of a ShaderPipeline. With separate stages a name can be declared by
+// both stage programs; set() writes every copy.
+template <typename T>
+class PipelineUniform
+{
+private:
+    ShaderPipeline *pipeline = nullptr;
+    Uniform<T> vertex;   // the only handle used by a monolithic program
+    Uniform<T> fragment;
+
+    friend class ShaderPipeline;
+
+public:
+    PipelineUniform() = default;
+
+    // The pipeline must be bound (pipeline.use()) when calling set().
+    void set(const T &value) const;
+
+    bool valid() const
+    {
+        return vertex.valid() || fragment.valid();
+    }
+};
+
+// One vertex/fragment combination. Either a program pipeline made of two
+// separable stage programs, or a plain linked program when the driver lacks
+// ARB_separate_shader_objects. Either way it is used the same.
+class ShaderPipeline
+{
+private:
+    // Separate path
+    unsigned int pipeline = 0;
+    Shader *vertexStage = nullptr;
+    Shader *fragmentStage = nullptr;
+    unsigned int activeProgram = 0;
+
+    // Fallback path
+    std::unique_ptr<Shader> program;
+
+    // Direct glUniform* at the stage that owns the uniform.
+    void activate(const Shader &stage);
+
+    template <typename T>
+    friend class PipelineUniform;
+    friend class ShaderPipelines;
+
+public:
+    void use();
+
+    // Resolve a uniform by name. Call this once, outside the render loop.
+    template <typename T>
+    PipelineUniform<T> uniform(std::string_view name);
+
+    // Convenience setter, see Shader::setInt.
+    void setInt(std::string_view name, int value);
+
+    bool ready() const
+    {
+        if (program)
+            return program->ready();
+        return pipeline != 0 && vertexStage->ready() && fragmentStage->ready();
+    }
+};
+
+// Builds ShaderPipelines for any combination of vertex and fragment shader files.
+//
+// With ARB_separate_shader_objects every stage is compiled and linked once, as a
+// separable program, and each combination is just a program pipeline object that
+// points at two of them. N vertex and M fragment shaders cost N + M links instead
+// of up to N x M. Without the extension (or with allowSeparate = false) every
+// combination is linked into a normal program. Either way programs go through
+// the ProgramCache if given; separable stages are cached one per stage.
+//
+// Pipelines that share a stage share its program, and with it its uniform values.
+// Separable stages match their interfaces by name (or location) like a linked
+// program does. The GL spec (section 7.4.1, "Shader Interface Matching") makes a
+// separable stage redeclare the gl_PerVertex block before using gl_Position and
+// the other built-ins in it; many drivers only enforce this from #version 410.
+// Built stages and pipelines are not reloaded when their files change.
+class ShaderPipelines
+{
+private:
+    ProgramCache *cache;
+    bool separateStages;
+
+    std::unordered_map<std::string, std::unique_ptr<Shader>> stages;          // by path
+    std::unordered_map<std::string, std::unique_ptr<ShaderPipeline>> pipelines; // by "vertex\nfragment" paths
+    unsigned int stageLinks = 0;
+    unsigned int programLinks = 0;
+
+    void linkStages(const std::string &vertexPath, const std::string &fragmentPath);
+
+public:
+    // Needs a current GL context.
+    explicit ShaderPipelines(ProgramCache *cache = nullptr, bool allowSeparate = true);
+
+    // The pipeline for a combination, built now if it hasn't been yet. It stays
+    // at the same address until destroy(). Not ready() if building failed.
+    ShaderPipeline &get(const char *vertexPath, const char *fragmentPath);
+
+    bool separate() const
+    {
+        return separateStages;
+    }
+
+    void printStats() const;
+
+    void destroy();
+};
+
+template <typename T>
+void PipelineUniform<T>::set(const T &value) const
+{
+    if (vertex.valid())
+    {
+        if (pipeline->vertexStage != nullptr)
+            pipeline->activate(*pipeline->vertexStage);
+        vertex.set(value);
+    }
+    if (fragment.valid())
+    {
+        pipeline->activate(*pipeline->fragmentStage);
+        fragment.set(value);
+    }
+}
+
+template <typename T>
+PipelineUniform<T> ShaderPipeline::uniform(std::string_view name)
+{
+    PipelineUniform<T> handle;
+    handle.pipeline = this;
+    if (program)
+    {
+        handle.vertex = program->uniform<T>(name);
+        return handle;
+    }
+
+    handle.vertex = vertexStage->uniform<T>(name);
+    handle.fragment = fragmentStage->uniform<T>(name);
+    return handle;
+}
@@ -0,0 +1,274 @@
+#include "shader_reloader.hpp"
+
+#include "shader_source.hpp"
+
+#include <iostream>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+ShaderReloader::ShaderReloader(std::chrono::milliseconds debounce)
+    : debounce(debounce), running(true)
+{
+#ifdef __linux__
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0)
+        std::cerr << "ERROR::SHADER_RELOADER::INOTIFY_INIT_FAILED" << std::endl;
+#endif
+
+    watcher = std::thread(&ShaderReloader::watchLoop, this);
+}
+
+ShaderReloader::~ShaderReloader()
+{
+    running = false;
+    if (watcher.joinable())
+        watcher.join();
+
+#ifdef __linux__
+    if (inotifyFd >= 0)
+        close(inotifyFd);
+#endif
+}
+
+void ShaderReloader::watch(Shader &shader, const char *vertexPath, const char *fragmentPath)
+{
+    Program program{&shader, normalizeShaderPath(vertexPath), normalizeShaderPath(fragmentPath)};
+
+    // Stages are compiled lazily, the first time a program using them has to be relinked.
+    stages.try_emplace(program.vertexPath, Stage{GL_VERTEX_SHADER, 0});
+    stages.try_emplace(program.fragmentPath, Stage{GL_FRAGMENT_SHADER, 0});
+
+    // Watch the files themselves and everything they #include.
+    for (const std::string &path : {program.vertexPath, program.fragmentPath})
+    {
+        for (const std::string &dependency : shaderSources().load(path.c_str()).dependencies)
+            watchFile(dependency);
+    }
+    programs.push_back(std::move(program));
+}
+
+void ShaderReloader::watchFile(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::error_code error;
+    files[path] = std::filesystem::last_write_time(path, error);
+
+#ifdef __linux__
+    // Watch the directory rather than the file: editors often save by writing a
+    // new file and renaming it over the old one, which ends a watch on the file.
+    std::string directory = std::filesystem::path(path).parent_path().string();
+    if (directory.empty())
+        directory = ".";
+    for (const auto &watched : watchedDirectories)
+    {
+        if (watched.second == directory)
+            return;
+    }
+
+    if (inotifyFd >= 0)
+    {
+        int wd = inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (wd < 0)
+            std::cerr << "ERROR::SHADER_RELOADER::CANNOT_WATCH " << directory << std::endl;
+        else
+            watchedDirectories[wd] = directory;
+    }
+#endif
+}
+
+void ShaderReloader::watchLoop()
+{
+#ifdef __linux__
+    if (inotifyFd >= 0)
+    {
+        alignas(inotify_event) char buffer[4096];
+        while (running)
+        {
+            pollfd pfd{inotifyFd, POLLIN, 0};
+            if (poll(&pfd, 1, 100) <= 0)
+                continue;
+
+            ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+            if (length <= 0)
+                continue;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            for (char *p = buffer; p < buffer + length;)
+            {
+                const inotify_event *event = (const inotify_event *)p;
+                p += sizeof(inotify_event) + event->len;
+
+                auto directory = watchedDirectories.find(event->wd);
+                if (event->len == 0 || directory == watchedDirectories.end())
+                    continue;
+
+                std::string path = (std::filesystem::path(directory->second) / event->name).string();
+                if (files.count(path))
+                    changed[path] = Clock::now();
+            }
+        }
+        return;
+    }
+#endif
+
+    // No inotify: compare modification times a few times per second.
+    while (running)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &file : files)
+        {
+            std::error_code error;
+            std::filesystem::file_time_type time = std::filesystem::last_write_time(file.first, error);
+            if (!error && time != file.second)
+            {
+                file.second = time;
+                changed[file.first] = Clock::now();
+            }
+        }
+    }
+}
+
+bool ShaderReloader::recompile(const std::string &path)
+{
+    Stage &stage = stages.at(path);
+
+    const ShaderSource &source = shaderSources().load(path.c_str());
+    if (!source.valid)
+        return false;
+
+    // The edit may have added #includes.
+    for (const std::string &dependency : source.dependencies)
+        watchFile(dependency);
+
+    unsigned int object = glCreateShader(stage.type);
+    source.upload(object);
+    glCompileShader(object);
+
+    int success = 0;
+    char infoLog[512];
+    glGetShaderiv(object, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(object, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::" << (stage.type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT")
+                  << "_SHADER_COMPILATION_FAILED " << path << "\n"
+                  << infoLog << std::endl;
+        glDeleteShader(object);
+        return false;
+    }
+
+    if (stage.object != 0)
+        glDeleteShader(stage.object);
+    stage.object = object;
+    return true;
+}
+
+unsigned int ShaderReloader::stage(const std::string &path, GLenum type)
+{
+    Stage &stage = stages.at(path);
+    if (stage.object == 0)
+        recompile(path);
+    return stage.type == type ? stage.object : 0;
+}
+
+unsigned int ShaderReloader::update()
+{
+    // Take the files that have been quiet for long enough.
+    std::vector<std::string> settled;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Clock::time_point now = Clock::now();
+        for (auto it = changed.begin(); it != changed.end();)
+        {
+            if (now - it->second >= debounce)
+            {
+                settled.push_back(it->first);
+                it = changed.erase(it);
+            }
+            else
+            {
+                it++;
+            }
+        }
+    }
+
+    if (settled.empty())
+        return 0;
+
+    // * 1. Recompile only the stages that changed, directly or through an #include
+    std::unordered_set<std::string> affected;
+    for (const std::string &path : settled)
+    {
+        for (const std::string &dependent : shaderSources().invalidate(path.c_str()))
+            affected.insert(dependent);
+        affected.insert(path);
+    }
+
+    std::unordered_set<std::string> rebuilt;
+    for (const std::string &path : affected)
+    {
+        if (stages.count(path) && recompile(path))
+            rebuilt.insert(path);
+    }
+
+    // * 2. Relink only the programs that use them
+    unsigned int swapped = 0;
+    for (Program &program : programs)
+    {
+        // Still compiling elsewhere. A failed Shader is rebuilt: the edit may be the fix.
+        if (!program.shader->ready() && !program.shader->failed())
+            continue;
+        if (!rebuilt.count(program.vertexPath) && !rebuilt.count(program.fragmentPath))
+            continue;
+
+        unsigned int vertexShader = stage(program.vertexPath, GL_VERTEX_SHADER);
+        unsigned int fragmentShader = stage(program.fragmentPath, GL_FRAGMENT_SHADER);
+        if (vertexShader == 0 || fragmentShader == 0)
+            continue;
+
+        unsigned int id = glCreateProgram();
+        glAttachShader(id, vertexShader);
+        glAttachShader(id, fragmentShader);
+        glLinkProgram(id);
+        glDetachShader(id, vertexShader);
+        glDetachShader(id, fragmentShader);
+
+        int success = 0;
+        char infoLog[512];
+        glGetProgramiv(id, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glGetProgramInfoLog(id, 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER::SHADER_PROGRAM_LINKING_FAILED\n"
+                      << infoLog << std::endl;
+            glDeleteProgram(id);
+            continue;
+        }
+
+        // * 3. Swap the new program in
+        program.shader->adopt(id);
+        swapped++;
+    }
+
+    if (swapped > 0)
+        std::cout << "Reloaded " << swapped << " shader program(s)." << std::endl;
+    return swapped;
+}
+
+void ShaderReloader::destroy()
+{
+    for (auto &entry : stages)
+    {
+        if (entry.second.object != 0)
+            glDeleteShader(entry.second.object);
+        entry.second.object = 0;
+    }
+}
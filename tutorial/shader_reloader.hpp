@@ -0,0 +1,82 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "shader.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Recompiles shaders when their .glsl files change on disk.
+//
+// A background thread watches the directories of every registered file and
+// everything it #includes (inotify on Linux, modification times elsewhere).
+// update() runs on the GL thread at a frame boundary: once a file has been
+// quiet for the debounce interval, only the stages that use it are recompiled
+// and only the programs using those are relinked. The new program replaces the old one inside the Shader in one
+// step, with all shadowed uniform values carried over. If a stage fails to
+// compile or link, the error is printed and the old program keeps running.
+// A Shader whose first build failed gets its program here once the files are fixed.
+// Only Shaders passed to watch() are reloaded; ShaderVariants and ShaderPipelines
+// built from the same files keep their programs until the app restarts.
+class ShaderReloader
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Program
+    {
+        Shader *shader;
+        std::string vertexPath;
+        std::string fragmentPath;
+    };
+
+    // Last good compiled object of one file, shared by every program using it.
+    struct Stage
+    {
+        GLenum type;
+        unsigned int object;
+    };
+
+    std::chrono::milliseconds debounce;
+    std::vector<Program> programs;
+    std::unordered_map<std::string, Stage> stages;
+
+    // Shared with the watcher thread.
+    std::mutex mutex;
+    std::unordered_map<std::string, std::filesystem::file_time_type> files;
+    std::unordered_map<std::string, Clock::time_point> changed;
+    std::unordered_map<int, std::string> watchedDirectories;
+    std::atomic<bool> running;
+    std::thread watcher;
+    int inotifyFd = -1;
+
+    void watchFile(const std::string &path);
+    void watchLoop();
+
+    // Returns the compiled stage for path, compiling it if needed. 0 on failure.
+    unsigned int stage(const std::string &path, GLenum type);
+    bool recompile(const std::string &path);
+
+public:
+    explicit ShaderReloader(std::chrono::milliseconds debounce = std::chrono::milliseconds(150));
+    ~ShaderReloader();
+
+    ShaderReloader(const ShaderReloader &) = delete;
+    ShaderReloader &operator=(const ShaderReloader &) = delete;
+
+    // Reload shader whenever either file changes. shader must outlive the reloader.
+    void watch(Shader &shader, const char *vertexPath, const char *fragmentPath);
+
+    // Call once per frame on the GL thread, before drawing. Returns the number of programs swapped.
+    unsigned int update();
+
+    // Delete the cached stage objects. Call before the GL context goes away.
+    void destroy();
+};
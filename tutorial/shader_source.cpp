@@ -0,0 +1,192 @@
+#include "shader_source.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+// * ShaderSource
+
+std::string ShaderSource::text() const
+{
+    std::string result;
+    for (std::size_t i = 0; i < strings.size(); i++)
+        result.append(strings[i], (std::size_t)lengths[i]);
+    return result;
+}
+
+ShaderSource ShaderSource::fromMemory(const char *text, std::size_t size, std::uint64_t hash)
+{
+    ShaderSource source;
+    source.strings.push_back(text);
+    source.lengths.push_back((GLint)size);
+    source.hash = hash;
+    source.valid = true;
+    return source;
+}
+
+// * ShaderSourceCache
+
+std::string normalizeShaderPath(const char *path)
+{
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+    return error ? std::string(path) : canonical.string();
+}
+
+ShaderSourceCache &shaderSources()
+{
+    static ShaderSourceCache cache;
+    return cache;
+}
+
+const ShaderSource &ShaderSourceCache::load(const char *path)
+{
+    std::vector<std::string> stack;
+    return load(normalizeShaderPath(path), stack);
+}
+
+const ShaderSource &ShaderSourceCache::load(const std::string &path, std::vector<std::string> &stack)
+{
+    static const ShaderSource INVALID;
+
+    auto cached = expansions.find(path);
+    if (cached != expansions.end())
+        return cached->second;
+
+    // References into an unordered_map stay valid while nested includes are inserted.
+    ShaderSource &source = expansions[path];
+    if (!expand(path, source, stack))
+    {
+        expansions.erase(path);
+        return INVALID;
+    }
+    return source;
+}
+
+bool ShaderSourceCache::expand(const std::string &path, ShaderSource &out, std::vector<std::string> &stack)
+{
+    // Unmapped again on return; only out.expanded is kept.
+    MappedFile file(path);
+    if (!file.valid())
+    {
+        std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ " << path << std::endl;
+        return false;
+    }
+
+    std::string_view text = file.view();
+    std::filesystem::path directory = std::filesystem::path(path).parent_path();
+
+    stack.push_back(path);
+    out.dependencies.push_back(path);
+    out.expanded.reserve(text.size());
+
+    std::size_t chunkStart = 0;
+    std::size_t lineStart = 0;
+    int line = 1;
+    bool ok = true;
+    while (lineStart < text.size())
+    {
+        std::size_t lineEnd = text.find('\n', lineStart);
+        std::size_t next = lineEnd == std::string_view::npos ? text.size() : lineEnd + 1;
+        std::string_view current = text.substr(lineStart, next - lineStart);
+
+        std::size_t directive = current.find_first_not_of(" \t");
+        if (directive != std::string_view::npos && current.substr(directive).starts_with("#include"))
+        {
+            std::size_t open = current.find('"', directive);
+            std::size_t close = open == std::string_view::npos ? open : current.find('"', open + 1);
+            if (close == std::string_view::npos)
+            {
+                std::cerr << "ERROR::SHADER::MALFORMED_INCLUDE " << path << ":" << line << std::endl;
+                ok = false;
+                break;
+            }
+
+            std::string name(current.substr(open + 1, close - open - 1));
+            std::string includePath = normalizeShaderPath((directory / name).string().c_str());
+
+            // Everything before the directive goes in as is.
+            out.expanded.append(text.substr(chunkStart, lineStart - chunkStart));
+            chunkStart = next;
+
+            if (std::find(stack.begin(), stack.end(), includePath) != stack.end())
+            {
+                std::cerr << "ERROR::SHADER::INCLUDE_CYCLE " << path << " includes " << includePath << std::endl;
+                ok = false;
+                break;
+            }
+
+            if (std::find(out.dependencies.begin(), out.dependencies.end(), includePath) == out.dependencies.end())
+            {
+                const ShaderSource &included = load(includePath, stack);
+                if (!included.valid)
+                {
+                    ok = false;
+                    break;
+                }
+
+                out.expanded.append(included.expanded);
+                for (const std::string &dependency : included.dependencies)
+                {
+                    if (std::find(out.dependencies.begin(), out.dependencies.end(), dependency) == out.dependencies.end())
+                        out.dependencies.push_back(dependency);
+                }
+            }
+
+            // Keep compiler messages pointing at the right line of this file.
+            out.expanded.append("\n#line " + std::to_string(line + 1) + "\n");
+        }
+
+        lineStart = next;
+        line++;
+    }
+
+    stack.pop_back();
+    if (!ok)
+        return false;
+
+    out.expanded.append(text.substr(chunkStart));
+
+    // out stays where it is in the cache, so the pointer does too.
+    out.strings.assign(1, out.expanded.data());
+    out.lengths.assign(1, (GLint)out.expanded.size());
+    out.hash = fnv1a(out.expanded);
+    out.valid = true;
+    return true;
+}
+
+std::vector<std::string> ShaderSourceCache::dependents(const char *path) const
+{
+    std::string key = normalizeShaderPath(path);
+
+    std::vector<std::string> result;
+    for (const auto &expansion : expansions)
+    {
+        const std::vector<std::string> &dependencies = expansion.second.dependencies;
+        if (expansion.first != key && std::find(dependencies.begin(), dependencies.end(), key) != dependencies.end())
+            result.push_back(expansion.first);
+    }
+    return result;
+}
+
+std::vector<std::string> ShaderSourceCache::invalidate(const char *path)
+{
+    std::string key = normalizeShaderPath(path);
+
+    std::vector<std::string> result;
+    for (auto it = expansions.begin(); it != expansions.end();)
+    {
+        const std::vector<std::string> &dependencies = it->second.dependencies;
+        if (std::find(dependencies.begin(), dependencies.end(), key) != dependencies.end())
+        {
+            result.push_back(it->first);
+            it = expansions.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "mapped_file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// One shader stage with every #include expanded, as a list of length-delimited
+// strings handed to glShaderSource as is.
+struct ShaderSource
+{
+    std::vector<const char *> strings;
+    std::vector<GLint> lengths;
+
+    // The expanded text of a source loaded from files, which strings points
+    // into. Empty for fromMemory().
+    std::string expanded;
+
+    // Hash of the expanded text (FNV-1a), for keying caches.
+    std::uint64_t hash = 0;
+
+    // Every file read to build this source, starting with the file itself.
+    std::vector<std::string> dependencies;
+
+    bool valid = false;
+
+    void upload(unsigned int shader) const
+    {
+        glShaderSource(shader, (GLsizei)strings.size(), strings.data(), lengths.data());
+    }
+
+    // Contiguous copy of the expanded text.
+    std::string text() const;
+
+    // A single piece of already expanded text that outlives the ShaderSource.
+    static ShaderSource fromMemory(const char *text, std::size_t size, std::uint64_t hash);
+};
+
+// Reads shader files and expands #include "file" directives (resolved relative
+// to the including file). Each file is read and expanded once; later loads
+// return the cached expansion. A file that is already part of an expansion is
+// not pasted again; the exception is a nested include's own (cached) expansion,
+// so files shared that way still need #ifndef guards.
+//
+// Each file is mapped only while it is expanded, straight into the expansion's
+// own buffer. Nothing keeps a view into the file, so an editor that truncates
+// and rewrites it in place can't change or fault a cached expansion. A file
+// that changes on disk has to be invalidate()d before it is read again.
+class ShaderSourceCache
+{
+private:
+    std::unordered_map<std::string, ShaderSource> expansions;
+
+    const ShaderSource &load(const std::string &path, std::vector<std::string> &stack);
+    bool expand(const std::string &path, ShaderSource &out, std::vector<std::string> &stack);
+
+public:
+    const ShaderSource &load(const char *path);
+
+    // Files that include path (directly or not) and are currently cached.
+    std::vector<std::string> dependents(const char *path) const;
+
+    // Forget path and every expansion that includes it. Returns the invalidated
+    // expansions, i.e. the files that have to be loaded again.
+    std::vector<std::string> invalidate(const char *path);
+};
+
+// Paths are compared in this form everywhere (cache keys, watchers).
+std::string normalizeShaderPath(const char *path);
+
+ShaderSourceCache &shaderSources();
@@ -0,0 +1,318 @@
+#include "shader_variants.hpp"
+#include "shader_source.hpp"
+#include "hash.hpp"
+
+#include <iostream>
+
+namespace
+{
+    // Calls f(line, lineNumber) for every line of text, stopping when f returns false.
+    template <typename F>
+    void forEachLine(std::string_view text, F f)
+    {
+        std::size_t lineStart = 0;
+        int line = 1;
+        while (lineStart < text.size())
+        {
+            std::size_t lineEnd = text.find('\n', lineStart);
+            std::size_t next = lineEnd == std::string_view::npos ? text.size() : lineEnd + 1;
+            if (!f(text.substr(lineStart, next - lineStart), line))
+                return;
+            lineStart = next;
+            line++;
+        }
+    }
+
+    // True if line is the given directive. rest receives what follows the name.
+    bool isDirective(std::string_view line, std::string_view name, std::string_view *rest = nullptr)
+    {
+        std::size_t start = line.find_first_not_of(" \t");
+        if (start == std::string_view::npos || !line.substr(start).starts_with(name))
+            return false;
+
+        std::string_view after = line.substr(start + name.size());
+        if (!after.empty() && after.find_first_of(" \t\r\n") != 0)
+            return false; // a longer word that starts with name
+        if (rest != nullptr)
+            *rest = after;
+        return true;
+    }
+}
+
+ShaderVariants::ShaderVariants(const char *vertexPath, const char *fragmentPath, ProgramCache *cache)
+    : vertex{GL_VERTEX_SHADER, normalizeShaderPath(vertexPath), nullptr, 0},
+      fragment{GL_FRAGMENT_SHADER, normalizeShaderPath(fragmentPath), nullptr, 0},
+      cache(cache)
+{
+    declareKeywords(vertex);
+    declareKeywords(fragment);
+}
+
+ShaderVariants::ShaderVariants(const EmbeddedShader &vertexShader, const EmbeddedShader &fragmentShader, ProgramCache *cache)
+    : vertex{GL_VERTEX_SHADER, vertexShader.path, &vertexShader, 0},
+      fragment{GL_FRAGMENT_SHADER, fragmentShader.path, &fragmentShader, 0},
+      cache(cache)
+{
+    declareKeywords(vertex);
+    declareKeywords(fragment);
+}
+
+void ShaderVariants::declareKeywords(Stage &stage)
+{
+    std::string text = baseText(stage);
+    forEachLine(text, [&](std::string_view line, int)
+                {
+        std::string_view pragma, names;
+        if (!isDirective(line, "#pragma", &pragma) || !isDirective(pragma, "variant", &names))
+            return true;
+
+        while (true)
+        {
+            std::size_t begin = names.find_first_not_of(" \t\r\n");
+            if (begin == std::string_view::npos)
+                break;
+            std::size_t end = names.find_first_of(" \t\r\n", begin);
+            std::string name(names.substr(begin, end == std::string_view::npos ? names.size() - begin : end - begin));
+            names = end == std::string_view::npos ? std::string_view() : names.substr(end);
+
+            std::uint32_t bit = keyword(name);
+            if (bit == 0)
+            {
+                if (keywords.size() == MAX_KEYWORDS)
+                {
+                    std::cerr << "ERROR::SHADER_VARIANTS::TOO_MANY_KEYWORDS " << stage.path << " " << name << std::endl;
+                    continue;
+                }
+                keywords.push_back(name);
+                bit = 1u << (keywords.size() - 1);
+            }
+            stage.keywords |= bit;
+        }
+        return true; });
+}
+
+std::string ShaderVariants::baseText(const Stage &stage) const
+{
+    if (stage.embedded != nullptr)
+        return std::string(stage.embedded->source, stage.embedded->size);
+
+    const ShaderSource &source = shaderSources().load(stage.path.c_str());
+    if (!source.valid)
+        return std::string();
+    return source.text();
+}
+
+std::string ShaderVariants::variantText(const Stage &stage, std::uint32_t mask) const
+{
+    std::string text = baseText(stage);
+
+    std::string defines;
+    for (std::size_t i = 0; i < keywords.size(); i++)
+    {
+        if (stage.keywords & mask & (1u << i))
+            defines += "#define " + keywords[i] + "\n";
+    }
+    if (defines.empty())
+        return text; // same text (and hash) as the base source
+
+    // The defines go right after #version, which has to stay the first statement.
+    std::size_t insertAt = 0;
+    int nextLine = 1;
+    std::size_t offset = 0;
+    forEachLine(text, [&](std::string_view line, int number)
+                {
+        offset += line.size();
+        if (!isDirective(line, "#version"))
+            return true;
+        insertAt = offset;
+        nextLine = number + 1;
+        return false; });
+
+    if (insertAt > 0 && text[insertAt - 1] != '\n')
+        defines.insert(0, "\n");
+    defines += "#line " + std::to_string(nextLine) + "\n";
+    text.insert(insertAt, defines);
+    return text;
+}
+
+unsigned int ShaderVariants::compileStage(const Stage &stage, const std::string &text, std::uint64_t hash)
+{
+    std::uint64_t key = fnv1a(std::string_view((const char *)&stage.type, sizeof(stage.type)), hash);
+    auto found = stages.find(key);
+    if (found != stages.end())
+    {
+        stagesShared++;
+        return found->second;
+    }
+
+    const char *string = text.c_str();
+    GLint length = (GLint)text.size();
+    unsigned int shader = glCreateShader(stage.type);
+    glShaderSource(shader, 1, &string, &length);
+    glCompileShader(shader);
+
+    stages.emplace(key, shader);
+    stagesCompiled++;
+    return shader;
+}
+
+bool ShaderVariants::checkStage(unsigned int shader, const Stage &stage, std::uint32_t mask)
+{
+    // A stage shared by several failed variants is reported and dropped once.
+    auto found = stages.begin();
+    while (found != stages.end() && found->second != shader)
+        found++;
+    if (found == stages.end())
+        return false;
+
+    int success = 0;
+    char infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (success)
+        return true;
+
+    glGetShaderInfoLog(shader, 512, NULL, infoLog);
+    std::cout << "ERROR::SHADER::" << (stage.type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT")
+              << "_SHADER_COMPILATION_FAILED " << stage.path << " (variant 0x" << std::hex << mask << std::dec << ")\n"
+              << infoLog << std::endl;
+
+    // Don't hand the broken object to the next variant with the same source.
+    stages.erase(found);
+    glDeleteShader(shader);
+    return false;
+}
+
+std::uint32_t ShaderVariants::keyword(std::string_view name) const
+{
+    for (std::size_t i = 0; i < keywords.size(); i++)
+    {
+        if (keywords[i] == name)
+            return 1u << i;
+    }
+    return 0;
+}
+
+std::uint32_t ShaderVariants::mask(std::initializer_list<std::string_view> names) const
+{
+    std::uint32_t result = 0;
+    for (std::string_view name : names)
+    {
+        std::uint32_t bit = keyword(name);
+        if (bit == 0)
+            std::cerr << "ERROR::SHADER_VARIANTS::UNKNOWN_KEYWORD " << name << std::endl;
+        result |= bit;
+    }
+    return result;
+}
+
+Shader &ShaderVariants::get(std::uint32_t mask)
+{
+    mask &= vertex.keywords | fragment.keywords;
+
+    auto found = variants.find(mask);
+    if (found != variants.end())
+        return *found->second;
+
+    precompile({mask});
+    return *variants.at(mask);
+}
+
+void ShaderVariants::precompile(const std::vector<std::uint32_t> &masks)
+{
+    std::vector<std::pair<std::uint32_t, Build>> builds;
+
+    // * 1. Restore cached programs and issue every compile that isn't shared
+    for (std::uint32_t mask : masks)
+    {
+        mask &= vertex.keywords | fragment.keywords;
+        // A variant that failed before is tried again, in the same Shader.
+        std::unique_ptr<Shader> &target = variants[mask];
+        if (target && !target->failed())
+            continue;
+        if (!target)
+            target = std::make_unique<Shader>();
+
+        std::string vertexText = variantText(vertex, mask);
+        std::string fragmentText = variantText(fragment, mask);
+        if (vertexText.empty() || fragmentText.empty())
+        {
+            target->buildFailed = true; // already reported by the source cache
+            continue;
+        }
+
+        std::uint64_t vertexHash = fnv1a(vertexText);
+        std::uint64_t fragmentHash = fnv1a(fragmentText);
+
+        Build build{target.get(), 0, 0, 0, 0};
+        if (cache != nullptr && cache->enabled())
+        {
+            build.cacheKey = cache->key(vertexHash, fragmentHash);
+            build.program = cache->load(build.cacheKey);
+        }
+        if (build.program == 0)
+        {
+            build.vertexShader = compileStage(vertex, vertexText, vertexHash);
+            build.fragmentShader = compileStage(fragment, fragmentText, fragmentHash);
+        }
+        builds.emplace_back(mask, build);
+    }
+
+    // * 2. Issue every link
+    for (auto &[mask, build] : builds)
+    {
+        if (build.program != 0)
+            continue;
+
+        build.program = glCreateProgram();
+        if (cache != nullptr)
+            cache->markRetrievable(build.program);
+        glAttachShader(build.program, build.vertexShader);
+        glAttachShader(build.program, build.fragmentShader);
+        glLinkProgram(build.program);
+        glDetachShader(build.program, build.vertexShader);
+        glDetachShader(build.program, build.fragmentShader);
+    }
+
+    // * 3. Only now wait for the results
+    for (auto &[mask, build] : builds)
+    {
+        bool fromSource = build.vertexShader != 0;
+        int success = 1;
+        if (fromSource)
+            glGetProgramiv(build.program, GL_LINK_STATUS, &success);
+
+        if (!success)
+        {
+            char infoLog[512];
+            checkStage(build.vertexShader, vertex, mask);
+            checkStage(build.fragmentShader, fragment, mask);
+            glGetProgramInfoLog(build.program, 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER::SHADER_PROGRAM_LINKING_FAILED (variant 0x" << std::hex << mask << std::dec << ")\n"
+                      << infoLog << std::endl;
+            glDeleteProgram(build.program);
+            build.target->buildFailed = true;
+            continue;
+        }
+
+        if (fromSource && cache != nullptr)
+            cache->store(build.cacheKey, build.program);
+        build.target->adopt(build.program);
+    }
+}
+
+void ShaderVariants::printStats() const
+{
+    std::cout << "Shader variants: " << variants.size() << " built, " << stagesCompiled << " stages compiled, "
+              << stagesShared << " shared" << std::endl;
+}
+
+void ShaderVariants::destroy()
+{
+    for (auto &variant : variants)
+        variant.second->destroy();
+    variants.clear();
+
+    for (auto &stage : stages)
+        glDeleteShader(stage.second);
+    stages.clear();
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "shader.hpp"
+#include "program_cache.hpp"
+#include "embedded_shader.hpp"
+
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Variants of one vertex/fragment pair that differ only in which feature
+// keywords are #defined. The sources declare their keywords with
+//
+//     #pragma variant TEXTURED VERTEX_COLOR
+//
+// which the GL compiler ignores, so the base files still compile on their own.
+// A variant is a bitmask of enabled keywords, bit i being the i-th keyword
+// declared (vertex stage first). Use mask() to build one from names.
+//
+// Each stage only gets the #defines for keywords it declares itself, so variants
+// that differ in a fragment-only keyword share the same vertex source. Compiled
+// stages are deduplicated by the hash of that final source, and linked programs
+// go through the ProgramCache like any other Shader.
+//
+// A variant is compiled the first time get() asks for it. precompile() builds
+// the variants a scene declares up front, with every compile and link issued
+// before any status is queried. The ShaderReloader doesn't know about variants:
+// once built, a variant keeps its program when the source files change.
+class ShaderVariants
+{
+private:
+    static constexpr int MAX_KEYWORDS = 32;
+
+    struct Stage
+    {
+        GLenum type;
+        std::string path;
+        const EmbeddedShader *embedded;
+        std::uint32_t keywords; // the keywords this stage declares
+    };
+
+    struct Build
+    {
+        Shader *target;
+        unsigned int vertexShader;
+        unsigned int fragmentShader;
+        std::uint64_t cacheKey;
+        unsigned int program;
+    };
+
+    Stage vertex;
+    Stage fragment;
+    ProgramCache *cache;
+
+    std::vector<std::string> keywords;
+    std::unordered_map<std::uint32_t, std::unique_ptr<Shader>> variants;
+
+    // Compiled stage objects by source hash (mixed with the stage type).
+    std::unordered_map<std::uint64_t, unsigned int> stages;
+    unsigned int stagesCompiled = 0;
+    unsigned int stagesShared = 0;
+
+    void declareKeywords(Stage &stage);
+    std::string baseText(const Stage &stage) const;
+    std::string variantText(const Stage &stage, std::uint32_t mask) const;
+    unsigned int compileStage(const Stage &stage, const std::string &text, std::uint64_t hash);
+    // Prints the log of a stage that failed to compile and drops it from stages.
+    bool checkStage(unsigned int shader, const Stage &stage, std::uint32_t mask);
+
+public:
+    ShaderVariants(const char *vertexPath, const char *fragmentPath, ProgramCache *cache = nullptr);
+    ShaderVariants(const EmbeddedShader &vertex, const EmbeddedShader &fragment, ProgramCache *cache = nullptr);
+
+    // Bit of a declared keyword, or 0 if the sources don't declare it.
+    std::uint32_t keyword(std::string_view name) const;
+    std::uint32_t mask(std::initializer_list<std::string_view> names) const;
+
+    // The program for a variant, compiled now if it hasn't been yet. The Shader
+    // stays at the same address, so Uniform handles to it remain valid. It is
+    // not ready() but failed() if compiling or linking failed.
+    Shader &get(std::uint32_t mask);
+
+    // Compile every listed variant that isn't built yet, as one batch. Variants
+    // that failed are compiled again.
+    void precompile(const std::vector<std::uint32_t> &masks);
+
+    const std::vector<std::string> &declaredKeywords() const
+    {
+        return keywords;
+    }
+
+    void printStats() const;
+
+    void destroy();
+};
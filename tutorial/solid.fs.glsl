@@ -0,0 +1,13 @@
+#version 330 core
+
+// The quad in its vertex colors only. Shares shader.vs.glsl with shader.fs.glsl
+// through a ShaderPipeline, so that vertex stage is linked once for both.
+
+out vec4 FragColor;
+
+in vec3 ourColor;
+
+void main()
+{
+    FragColor = vec4(ourColor, 1.0f);
+}
@@ -0,0 +1,78 @@
+// Atlas packing: rectangles land inside the bin without overlapping, in the
+// order they were given, and the bin is cropped to what they use.
+
+#include "atlas_packer.hpp"
+#include "check.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    bool overlap(const AtlasRect &a, const AtlasRect &b)
+    {
+        return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+    }
+
+    // Every rect inside the bin, at its requested size, apart from all others.
+    bool validPacking(const std::vector<AtlasRect> &sizes, const std::vector<AtlasRect> &placed, int binWidth, int binHeight)
+    {
+        if (placed.size() != sizes.size())
+            return false;
+        for (std::size_t i = 0; i < placed.size(); i++)
+        {
+            const AtlasRect &rect = placed[i];
+            if (rect.width != sizes[i].width || rect.height != sizes[i].height)
+                return false;
+            if (rect.x < 0 || rect.y < 0 || rect.x + rect.width > binWidth || rect.y + rect.height > binHeight)
+                return false;
+            for (std::size_t j = 0; j < i; j++)
+            {
+                if (overlap(rect, placed[j]))
+                    return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main()
+{
+    // * An exact fit: four quarters fill the bin, and a fifth rect fits nowhere
+    MaxRectsPacker packer(64, 64);
+    AtlasRect placed[4];
+    for (AtlasRect &rect : placed)
+        CHECK(packer.insert(32, 32, rect));
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < i; j++)
+            CHECK(!overlap(placed[i], placed[j]));
+    }
+    AtlasRect extra;
+    CHECK(!packer.insert(1, 1, extra));
+    CHECK(!MaxRectsPacker(16, 16).insert(17, 4, extra));
+
+    // * Mixed sizes
+    std::vector<AtlasRect> sizes = {{0, 0, 100, 20}, {0, 0, 7, 90}, {0, 0, 64, 64}, {0, 0, 33, 31},
+                                    {0, 0, 1, 1},    {0, 0, 50, 50}, {0, 0, 12, 128}, {0, 0, 20, 19}};
+    int binWidth = 0, binHeight = 0;
+    std::vector<AtlasRect> packed;
+    CHECK(packRects(sizes, 1024, binWidth, binHeight, packed));
+    CHECK(validPacking(sizes, packed, binWidth, binHeight));
+
+    // About 12k texels; no more than a 256x256 bin is needed for them.
+    CHECK(binWidth <= 256 && binHeight <= 256);
+    int usedWidth = 0, usedHeight = 0;
+    for (const AtlasRect &rect : packed)
+    {
+        usedWidth = std::max(usedWidth, rect.x + rect.width);
+        usedHeight = std::max(usedHeight, rect.y + rect.height);
+    }
+    CHECK(binWidth == usedWidth && binHeight == usedHeight); // cropped
+
+    // * Too large for maxSize
+    CHECK(!packRects({{0, 0, 300, 10}}, 256, binWidth, binHeight, packed));
+    CHECK(!packRects({{0, 0, 200, 200}, {0, 0, 200, 200}}, 256, binWidth, binHeight, packed));
+
+    return testResult();
+}
@@ -0,0 +1,96 @@
+// .ltex validation: BakedTexture::open accepts what writeBakedTexture writes
+// and rejects truncated files and level tables that aren't a mip chain.
+
+#include <glad/glad.h>
+
+#include "baked_texture.hpp"
+#include "check.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+    const std::string path = (std::filesystem::temp_directory_path() / "baked_texture_test.ltex").string();
+
+    BakedImageLevel level(int width, int height)
+    {
+        return BakedImageLevel{width, height, std::vector<unsigned char>((std::size_t)width * height * 4, 0x80)};
+    }
+
+    bool writeAndOpen(const std::vector<BakedImageLevel> &levels)
+    {
+        writeBakedTexture(path, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4, levels);
+        BakedTexture baked;
+        return baked.open(path);
+    }
+
+    std::vector<char> readFile()
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    bool writeRawAndOpen(const std::vector<char> &bytes)
+    {
+        {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(bytes.data(), (std::streamsize)bytes.size());
+        }
+        BakedTexture baked;
+        return baked.open(path);
+    }
+}
+
+int main()
+{
+    // * Full and partial chains, odd sizes rounding down
+    CHECK(writeAndOpen({level(1, 1)}));
+    CHECK(writeAndOpen({level(8, 4), level(4, 2), level(2, 1), level(1, 1)}));
+    CHECK(writeAndOpen({level(5, 3), level(2, 1), level(1, 1)}));
+    CHECK(writeAndOpen({level(64, 64)}));
+
+    BakedTexture opened;
+    writeBakedTexture(path, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4, {level(4, 2), level(2, 1)});
+    CHECK(opened.open(path));
+    CHECK(opened.info().width == 4 && opened.info().height == 2 && opened.info().levels == 2);
+    CHECK(opened.level(1).width == 2 && opened.level(1).height == 1 && opened.level(1).size == 8);
+
+    // * More levels than the dimensions allow
+    CHECK(!writeAndOpen({level(2, 2), level(1, 1), level(1, 1)}));
+
+    // * Levels that don't halve
+    CHECK(!writeAndOpen({level(4, 4), level(3, 2)}));
+    CHECK(!writeAndOpen({level(4, 4), level(2, 2), level(2, 2)}));
+    CHECK(!writeAndOpen({level(4, 4), level(1, 1)}));
+
+    // * Damaged files
+    writeBakedTexture(path, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4, {level(8, 8), level(4, 4)});
+    std::vector<char> good = readFile();
+    CHECK(writeRawAndOpen(good));
+
+    std::vector<char> truncated(good.begin(), good.end() - 1);
+    CHECK(!writeRawAndOpen(truncated));
+    CHECK(!writeRawAndOpen(std::vector<char>(good.begin(), good.begin() + 20)));
+    CHECK(!writeRawAndOpen({}));
+
+    std::vector<char> badMagic = good;
+    badMagic[0] = 'X';
+    CHECK(!writeRawAndOpen(badMagic));
+
+    std::vector<char> badVersion = good;
+    std::uint32_t version = BAKED_TEXTURE_VERSION + 1;
+    std::memcpy(badVersion.data() + offsetof(BakedTextureHeader, version), &version, sizeof(version));
+    CHECK(!writeRawAndOpen(badVersion));
+
+    std::vector<char> badLevelCount = good;
+    std::uint32_t levels = 5;
+    std::memcpy(badLevelCount.data() + offsetof(BakedTextureHeader, levels), &levels, sizeof(levels));
+    CHECK(!writeRawAndOpen(badLevelCount));
+
+    std::filesystem::remove(path);
+    return testResult();
+}
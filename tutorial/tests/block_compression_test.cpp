@@ -0,0 +1,114 @@
+// BC1/3/4/5 round trips: compressing and decompressing a smooth image keeps a
+// minimum PSNR at every quality, High is never worse than Fast, flat blocks
+// come back exactly, and a thread pool changes nothing.
+
+#include "block_compression.hpp"
+#include "check.hpp"
+#include "thread_pool.hpp"
+
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    const BlockFormat formats[] = {BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC4, BlockFormat::BC5};
+    const CompressionQuality qualities[] = {CompressionQuality::Fast, CompressionQuality::Normal, CompressionQuality::High};
+
+    // Gradients in every channel, different directions so the channels don't correlate.
+    std::vector<unsigned char> gradient(int width, int height)
+    {
+        std::vector<unsigned char> rgba((std::size_t)width * height * 4);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                unsigned char *pixel = &rgba[((std::size_t)y * width + x) * 4];
+                pixel[0] = (unsigned char)(x * 255 / (width - 1));
+                pixel[1] = (unsigned char)(y * 255 / (height - 1));
+                pixel[2] = (unsigned char)((x + y) * 255 / (width + height - 2));
+                pixel[3] = (unsigned char)(255 - x * 255 / (width - 1));
+            }
+        }
+        return rgba;
+    }
+
+    // PSNR in dB of the decoded channels against the source; 99 if they match.
+    double roundTripPsnr(const std::vector<unsigned char> &rgba, int width, int height, BlockFormat format,
+                       CompressionQuality quality, ThreadPool *pool = nullptr)
+    {
+        std::vector<unsigned char> blocks(compressedSize(format, width, height));
+        compressImage(rgba.data(), width, height, 4, format, quality, blocks.data(), pool);
+
+        int channels = blockFormatChannels(format);
+        std::vector<unsigned char> decoded((std::size_t)width * height * channels);
+        decompressImage(blocks.data(), width, height, format, decoded.data());
+
+        // BC1 has no alpha; BC4 and BC5 keep the first one and two channels.
+        int compared = format == BlockFormat::BC1 ? 3 : channels;
+        double squared = 0.0;
+        for (std::size_t i = 0; i < (std::size_t)width * height; i++)
+        {
+            for (int c = 0; c < compared; c++)
+            {
+                double error = (double)decoded[i * channels + c] - (double)rgba[i * 4 + c];
+                squared += error * error;
+            }
+        }
+        if (squared == 0.0)
+            return 99.0;
+        double mse = squared / ((double)width * height * compared);
+        return 10.0 * std::log10(255.0 * 255.0 / mse);
+    }
+}
+
+int main()
+{
+    // * Sizes
+    CHECK(compressedSize(BlockFormat::BC1, 4, 4) == 8);
+    CHECK(compressedSize(BlockFormat::BC3, 4, 4) == 16);
+    CHECK(compressedSize(BlockFormat::BC1, 5, 5) == 4 * 8);
+    CHECK(compressedSize(BlockFormat::BC5, 1, 9) == 3 * 16);
+
+    // * Smooth content stays close, at every quality
+    // Three independent gradients don't lie on one line in color space, which
+    // is all BC1 can store per block, hence the lower bound for it and BC3.
+    std::vector<unsigned char> image = gradient(32, 32);
+    for (BlockFormat format : formats)
+    {
+        double minimum = format == BlockFormat::BC1 || format == BlockFormat::BC3 ? 30.0 : 45.0;
+        for (CompressionQuality quality : qualities)
+            CHECK(roundTripPsnr(image, 32, 32, format, quality) >= minimum);
+        CHECK(roundTripPsnr(image, 32, 32, format, CompressionQuality::High) >=
+              roundTripPsnr(image, 32, 32, format, CompressionQuality::Fast));
+    }
+
+    // * Flat blocks are exact where the endpoint precision allows
+    // 255, 0 and 132 survive the 5:6:5 endpoints of BC1 and BC3.
+    std::vector<unsigned char> flat(16 * 4);
+    for (std::size_t i = 0; i < flat.size(); i += 4)
+    {
+        flat[i] = 255;
+        flat[i + 1] = 0;
+        flat[i + 2] = 132;
+        flat[i + 3] = 77;
+    }
+    for (BlockFormat format : formats)
+    {
+        for (CompressionQuality quality : qualities)
+            CHECK(roundTripPsnr(flat, 4, 4, format, quality) == 99.0);
+    }
+
+    // * Partial edge blocks, on one thread and on several
+    // Steeper gradients than above: 255 over 13 and 7 pixels.
+    std::vector<unsigned char> odd = gradient(13, 7);
+    ThreadPool pool(2);
+    for (BlockFormat format : formats)
+    {
+        double minimum = format == BlockFormat::BC1 || format == BlockFormat::BC3 ? 20.0 : 35.0;
+        double psnr = roundTripPsnr(odd, 13, 7, format, CompressionQuality::Normal);
+        CHECK(psnr >= minimum);
+        CHECK(roundTripPsnr(odd, 13, 7, format, CompressionQuality::Normal, &pool) == psnr);
+    }
+
+    return testResult();
+}
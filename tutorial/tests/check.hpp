@@ -0,0 +1,26 @@
+#pragma once
+
+#include <iostream>
+
+// Assertion for the test executables. A failed check is reported and the test
+// goes on, so one run shows every failure; main returns testResult().
+inline int &checkFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                         \
+    do                                                                                           \
+    {                                                                                            \
+        if (!(condition))                                                                        \
+        {                                                                                        \
+            std::cerr << "FAILED " << __FILE__ << ":" << __LINE__ << ": " #condition << std::endl; \
+            checkFailures()++;                                                                   \
+        }                                                                                        \
+    } while (false)
+
+inline int testResult()
+{
+    return checkFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+// CPU mip generation: chain length and level sizes, flat images staying flat
+// with every filter, sRGB-aware averaging, alpha coverage and resizeImage.
+
+#include "check.hpp"
+#include "mipmap.hpp"
+#include "thread_pool.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+    const MipFilter filters[] = {MipFilter::Box, MipFilter::Kaiser, MipFilter::Lanczos, MipFilter::Mitchell};
+
+    std::vector<unsigned char> filled(int width, int height, std::vector<unsigned char> pixel)
+    {
+        std::vector<unsigned char> pixels;
+        for (int i = 0; i < width * height; i++)
+            pixels.insert(pixels.end(), pixel.begin(), pixel.end());
+        return pixels;
+    }
+
+    bool allEqual(const std::vector<unsigned char> &pixels, const std::vector<unsigned char> &pixel, int tolerance = 0)
+    {
+        for (std::size_t i = 0; i < pixels.size(); i++)
+        {
+            if (std::abs((int)pixels[i] - (int)pixel[i % pixel.size()]) > tolerance)
+                return false;
+        }
+        return true;
+    }
+
+    // Share of texels whose alpha passes the cutoff.
+    float coverage(const std::vector<unsigned char> &pixels, float cutoff)
+    {
+        std::size_t passed = 0;
+        for (std::size_t i = 3; i < pixels.size(); i += 4)
+            passed += pixels[i] / 255.0f >= cutoff;
+        return (float)passed / (float)(pixels.size() / 4);
+    }
+}
+
+int main()
+{
+    // * Chain length and level sizes
+    CHECK(mipLevelCount(1, 1) == 1);
+    CHECK(mipLevelCount(256, 256) == 9);
+    CHECK(mipLevelCount(5, 3) == 3);
+    CHECK(mipLevelCount(1, 64) == 7);
+
+    std::vector<unsigned char> grey = filled(5, 3, {90, 90, 90, 255});
+    std::vector<MipLevel> levels = generateMips(grey.data(), 5, 3, 4, MipOptions());
+    CHECK(levels.size() == 2);
+    CHECK(levels[0].width == 2 && levels[0].height == 1);
+    CHECK(levels[1].width == 1 && levels[1].height == 1);
+
+    // * A flat image stays flat, with every filter and channel count
+    for (MipFilter filter : filters)
+    {
+        for (int channels = 1; channels <= 4; channels++)
+        {
+            std::vector<unsigned char> pixel = {200, 17, 99, 128};
+            pixel.resize(channels);
+            std::vector<unsigned char> image = filled(16, 8, pixel);
+
+            MipOptions options;
+            options.filter = filter;
+            ThreadPool pool(2);
+            std::vector<MipLevel> mips = generateMips(image.data(), 16, 8, channels, options, &pool);
+            CHECK(mips.size() == 4);
+            for (const MipLevel &mip : mips)
+                CHECK(allEqual(mip.pixels, pixel, 1));
+        }
+    }
+
+    // * Black and white average to mid grey in linear light, not in sRGB values
+    std::vector<unsigned char> checker(4 * 4 * 3);
+    for (int i = 0; i < 16; i++)
+    {
+        unsigned char value = (i % 4 + i / 4) % 2 ? 255 : 0;
+        checker[i * 3] = checker[i * 3 + 1] = checker[i * 3 + 2] = value;
+    }
+    MipOptions box;
+    box.filter = MipFilter::Box;
+    box.srgb = false;
+    std::vector<MipLevel> linear = generateMips(checker.data(), 4, 4, 3, box);
+    CHECK(allEqual(linear[0].pixels, {128, 128, 128}, 1));
+    box.srgb = true;
+    std::vector<MipLevel> srgb = generateMips(checker.data(), 4, 4, 3, box);
+    CHECK(allEqual(srgb[0].pixels, {188, 188, 188}, 1)); // 0.5 encoded
+
+    // * Alpha coverage is kept with a cutoff
+    // A thin diagonal line blurs out of the alpha test without one. The small
+    // levels have too few texels to match the share, so only 16x16 and 8x8 count.
+    std::vector<unsigned char> line = filled(32, 32, {255, 255, 255, 0});
+    for (int i = 0; i < 32; i++)
+        line[(i * 32 + i) * 4 + 3] = 255;
+    float base = coverage(line, 0.5f);
+    MipOptions cutout;
+    std::vector<MipLevel> faded = generateMips(line.data(), 32, 32, 4, cutout);
+    cutout.alphaCutoff = 0.5f;
+    std::vector<MipLevel> kept = generateMips(line.data(), 32, 32, 4, cutout);
+    for (std::size_t level = 0; level < 2; level++)
+    {
+        CHECK(coverage(faded[level].pixels, 0.5f) < base / 2.0f);
+        CHECK(std::fabs(coverage(kept[level].pixels, 0.5f) - base) <= 0.04f);
+    }
+
+    // * Resizing matches the source's average and lands on the target size
+    std::vector<unsigned char> flat = filled(37, 23, {10, 240, 60});
+    std::vector<unsigned char> resized(9 * 5 * 3);
+    ThreadPool pool(2);
+    resizeImage(flat.data(), 37, 23, 3, resized.data(), 9, 5, MipOptions(), &pool);
+    CHECK(allEqual(resized, {10, 240, 60}, 1));
+
+    return testResult();
+}
@@ -0,0 +1,105 @@
+// SIMD and scalar pixel conversion agree: every kernel gives the same bytes
+// with the best path this CPU has as with setSimdLevelLimit(Scalar), on counts
+// that leave a tail for each vector width.
+
+#include "check.hpp"
+#include "cpu_features.hpp"
+#include "pixel_convert.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <vector>
+
+namespace
+{
+    constexpr std::size_t COUNTS[] = {1, 7, 33, 1001};
+
+    std::vector<unsigned char> randomBytes(std::size_t size)
+    {
+        static std::mt19937 random(1234);
+        std::vector<unsigned char> bytes(size);
+        for (unsigned char &byte : bytes)
+            byte = (unsigned char)random();
+        return bytes;
+    }
+
+    // Runs `kernel` on a copy of `input` on the best path and on the scalar one.
+    bool pathsAgree(const std::vector<unsigned char> &input, std::size_t outputSize,
+                    const std::function<void(const unsigned char *, unsigned char *)> &kernel)
+    {
+        const SimdLevel best = simdLevel();
+        std::vector<unsigned char> results[2];
+        for (int scalar = 0; scalar < 2; scalar++)
+        {
+            setSimdLevelLimit(scalar ? SimdLevel::Scalar : best);
+            std::vector<unsigned char> source = input;
+            results[scalar].assign(std::max(outputSize, input.size()), 0);
+            std::copy(source.begin(), source.end(), results[scalar].begin());
+            kernel(source.data(), results[scalar].data());
+            results[scalar].resize(outputSize);
+        }
+        setSimdLevelLimit(best);
+        return results[0] == results[1];
+    }
+}
+
+int main()
+{
+    std::cout << "Comparing " << simdLevelName(simdLevel()) << " with the scalar path" << std::endl;
+
+    for (std::size_t count : COUNTS)
+    {
+        std::vector<unsigned char> rgb = randomBytes(count * 3);
+        std::vector<unsigned char> rgba = randomBytes(count * 4);
+        std::vector<unsigned char> greyAlpha = randomBytes(count * 2);
+
+        CHECK(pathsAgree(rgb, count * 4, [&](const unsigned char *source, unsigned char *target)
+                         { expandRgbToRgba(source, count, target); }));
+        CHECK(pathsAgree(rgba, count * 4, [&](const unsigned char *source, unsigned char *target)
+                         { swizzleRgba(source, count, {2, 1, 0, 3}, target); }));
+        CHECK(pathsAgree(rgba, count * 4, [&](const unsigned char *, unsigned char *pixels)
+                         { swizzleRgba(pixels, count, {3, 3, 0, 1}, pixels); })); // in place
+
+        for (bool srgb : {false, true})
+        {
+            CHECK(pathsAgree(rgba, count * 4, [&](const unsigned char *, unsigned char *pixels)
+                             { premultiplyAlpha(pixels, count, 4, srgb); }));
+            CHECK(pathsAgree(greyAlpha, count * 2, [&](const unsigned char *, unsigned char *pixels)
+                             { premultiplyAlpha(pixels, count, 2, srgb); }));
+        }
+
+        for (TransferFunction transfer : {TransferFunction::SrgbToLinear, TransferFunction::LinearToSrgb})
+        {
+            CHECK(pathsAgree(rgba, count * 4, [&](const unsigned char *, unsigned char *pixels)
+                             { applyTransfer(pixels, count, 4, transfer); }));
+        }
+        CHECK(pathsAgree(rgba, count * 2, [&](const unsigned char *source, unsigned char *target)
+                         { reduceToMask(source, count, 4, target); }));
+        CHECK(pathsAgree(rgb, count * 2, [&](const unsigned char *source, unsigned char *target)
+                         { packPixels(source, count, PixelPacking::RGB565, target); }));
+        CHECK(pathsAgree(rgba, count * 2, [&](const unsigned char *source, unsigned char *target)
+                         { packPixels(source, count, PixelPacking::RGBA4444, target); }));
+    }
+
+    // * The whole row pipeline, on one thread and on several
+    const int width = 67, height = 19;
+    std::vector<unsigned char> image = randomBytes((std::size_t)width * height * 3);
+    PixelConversion conversion;
+    conversion.flipVertically = true;
+    conversion.expandToRgba = true;
+    conversion.premultiplyAlpha = true;
+    conversion.srgb = true;
+    std::size_t converted = (std::size_t)width * height * convertedPixelBytes(3, conversion);
+    CHECK(convertedChannels(3, conversion) == 4);
+
+    ThreadPool pool(2);
+    for (ThreadPool *threads : {(ThreadPool *)nullptr, &pool})
+    {
+        CHECK(pathsAgree(image, converted, [&](const unsigned char *source, unsigned char *target)
+                         { convertPixels(source, width, height, 3, conversion, target, threads); }));
+    }
+
+    return testResult();
+}
@@ -0,0 +1,77 @@
+// Streaming budget math: the level a screen size asks for, and which levels
+// are given up when the wanted ones don't fit the video memory budget.
+
+#include "check.hpp"
+#include "texture_streamer.hpp"
+
+#include <vector>
+
+namespace
+{
+    // RGBA8 level sizes of a square texture, level 0 first.
+    std::vector<std::size_t> chain(int size)
+    {
+        std::vector<std::size_t> bytes;
+        for (; size >= 1; size /= 2)
+            bytes.push_back((std::size_t)size * size * 4);
+        return bytes;
+    }
+
+    std::size_t total(const std::vector<StreamingTarget> &targets)
+    {
+        std::size_t sum = 0;
+        for (const StreamingTarget &target : targets)
+        {
+            for (int level = target.target; level < target.levels; level++)
+                sum += target.levelBytes[level];
+        }
+        return sum;
+    }
+}
+
+int main()
+{
+    // * Wanted level: one texel per pixel, never past the tail
+    // A 1024 texture has its 64 texel tail at level 4.
+    CHECK(wantedStreamingLevel(1024.0f, 1024.0f, 4) == 0);
+    CHECK(wantedStreamingLevel(1024.0f, 4096.0f, 4) == 0);
+    CHECK(wantedStreamingLevel(1024.0f, 512.0f, 4) == 1);
+    CHECK(wantedStreamingLevel(1024.0f, 511.0f, 4) == 1);
+    CHECK(wantedStreamingLevel(1024.0f, 100.0f, 4) == 3);
+    CHECK(wantedStreamingLevel(1024.0f, 10.0f, 4) == 4);
+    CHECK(wantedStreamingLevel(1024.0f, 0.0f, 4) == 4); // not drawn
+    CHECK(wantedStreamingLevel(48.0f, 200.0f, 0) == 0); // all tail
+
+    std::vector<std::size_t> large = chain(1024); // 11 levels, level 0 is 4 MiB
+    std::vector<std::size_t> small = chain(256);  // 9 levels, level 0 is 256 KiB
+
+    // * Within budget nothing changes
+    std::vector<StreamingTarget> targets = {{large.data(), 11, 4, 0}, {small.data(), 9, 2, 0}};
+    fitStreamingBudget(targets.data(), targets.size(), 64 * 1024 * 1024);
+    CHECK(targets[0].target == 0 && targets[1].target == 0);
+
+    // * Over budget the largest level goes first
+    // Everything is about 5.67 MiB; 4 MiB of budget costs the 1024 texture its level 0.
+    targets = {{large.data(), 11, 4, 0}, {small.data(), 9, 2, 0}};
+    fitStreamingBudget(targets.data(), targets.size(), 4 * 1024 * 1024);
+    CHECK(targets[0].target == 1 && targets[1].target == 0);
+    CHECK(total(targets) <= 4 * 1024 * 1024);
+
+    // Tighter: the 512 level of the large one (1 MiB) goes before the small one's 256 KiB.
+    targets = {{large.data(), 11, 4, 0}, {small.data(), 9, 2, 0}};
+    fitStreamingBudget(targets.data(), targets.size(), 1024 * 1024);
+    CHECK(targets[0].target == 2);
+    CHECK(total(targets) <= 1024 * 1024);
+
+    // * Tails always stay, even past the budget
+    targets = {{large.data(), 11, 4, 0}, {small.data(), 9, 2, 1}};
+    fitStreamingBudget(targets.data(), targets.size(), 0);
+    CHECK(targets[0].target == 4 && targets[1].target == 2);
+
+    // * A target already at its tail is left alone
+    targets = {{large.data(), 11, 4, 4}};
+    fitStreamingBudget(targets.data(), targets.size(), 1);
+    CHECK(targets[0].target == 4);
+
+    return testResult();
+}
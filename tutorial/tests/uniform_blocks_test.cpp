@@ -0,0 +1,78 @@
+// std140 offsets: the C++ mirrors of the uniform blocks put every member where
+// the GLSL std140 rules do, and std140::valid catches the usual mistakes.
+
+#include "check.hpp"
+#include "uniform_blocks.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+
+namespace
+{
+    // vec3 rounds up to 16 bytes, a float may follow it in the same slot.
+    struct alignas(16) Packed
+    {
+        float a;
+        float pad[3];
+        glm::vec3 b;
+        float c;
+        glm::mat4 d;
+    };
+    constexpr std140::Member PACKED[] = {
+        STD140_MEMBER(Packed, a),
+        STD140_MEMBER(Packed, b),
+        STD140_MEMBER(Packed, c),
+        STD140_MEMBER(Packed, d),
+    };
+
+    // A vec3 right after a float, as plain C++ lays it out: std140 wants it at 16.
+    struct Unpadded
+    {
+        float a;
+        glm::vec3 b;
+    };
+    constexpr std140::Member UNPADDED[] = {
+        STD140_MEMBER(Unpadded, a),
+        STD140_MEMBER(Unpadded, b),
+    };
+
+    // A vec2 at offset 4: std140 aligns it to 8.
+    constexpr std140::Member MISALIGNED_VEC2[] = {
+        {"a", 0, 4, 4},
+        {"b", 4, 8, 8},
+    };
+}
+
+// * The blocks the shaders declare
+static_assert(offsetof(FrameBlock, time) == 0);
+static_assert(offsetof(FrameBlock, textureMix) == 4);
+static_assert(sizeof(FrameBlock) == 16);
+static_assert(offsetof(CameraBlock, view) == 0);
+static_assert(offsetof(CameraBlock, projection) == 64);
+static_assert(sizeof(CameraBlock) == 128);
+static_assert(std140::valid(UniformBlockTraits<FrameBlock>::MEMBERS));
+static_assert(std140::valid(UniformBlockTraits<CameraBlock>::MEMBERS));
+
+// * The rules themselves
+static_assert(std140::valid(PACKED));
+static_assert(offsetof(Packed, b) == 16 && offsetof(Packed, c) == 28 && offsetof(Packed, d) == 32);
+static_assert(!std140::valid(UNPADDED));
+static_assert(!std140::valid(MISALIGNED_VEC2));
+
+int main()
+{
+    // The layouts handed to Shader for binding and verifying programs.
+    CHECK(std::size(UNIFORM_BLOCK_LAYOUTS) == 2);
+    const UniformBlockLayout &frame = UNIFORM_BLOCK_LAYOUTS[0];
+    CHECK(std::strcmp(frame.name, "Frame") == 0);
+    CHECK(frame.binding == FRAME_BLOCK_BINDING && frame.size == 16 && frame.memberCount == 2);
+    CHECK(std::strcmp(frame.members[1].name, "textureMix") == 0 && frame.members[1].offset == 4);
+
+    const UniformBlockLayout &camera = UNIFORM_BLOCK_LAYOUTS[1];
+    CHECK(std::strcmp(camera.name, "Camera") == 0);
+    CHECK(camera.binding == CAMERA_BLOCK_BINDING && camera.size == 128 && camera.memberCount == 2);
+    CHECK(camera.members[1].offset == 64 && camera.members[1].size == 64);
+
+    return testResult();
+}
@@ -0,0 +1,151 @@
+#include "texture_array.hpp"
+#include "baked_texture.hpp"
+#include "block_compression.hpp"
+#include "gl_state.hpp"
+#include "gpu_memory.hpp"
+
+#include <iostream>
+#include <string>
+
+TextureArrayPool::TextureArrayPool(SamplerCache &samplers, const SamplerState &sampler, unsigned int layersPerArray)
+    : sampler(samplers.get(sampler)), layersPerArray(layersPerArray), textureStorage(GLAD_GL_ARB_texture_storage),
+      s3tc(GLAD_GL_EXT_texture_compression_s3tc)
+{
+}
+
+TextureArrayPool::Array &TextureArrayPool::create(int width, int height, int levels, GLenum internalFormat, GLenum format, GLenum type, int channels)
+{
+    Array &array = arrays.emplace_back(Array{0, width, height, levels, internalFormat, format, type, channels, 0, {}});
+    glGenTextures(1, &array.name);
+    glState().bindTexture(GL_TEXTURE_2D_ARRAY, array.name);
+    gpuMemory().label(GL_TEXTURE, array.name,
+                      "texture array " + std::to_string(width) + "x" + std::to_string(height) + "x" + std::to_string(layersPerArray));
+    if (channels <= 2)
+    {
+        GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, channels == 2 ? GL_GREEN : GL_ONE};
+        glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+
+    // Every layer is allocated up front; the images are copied in as they come.
+    if (textureStorage)
+    {
+        gpuMemory().texStorage3D(array.name, GL_TEXTURE_2D_ARRAY, levels, internalFormat, width, height, (int)layersPerArray);
+        return array;
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    BlockFormat blockFormat;
+    bool compressed = format == 0 && blockFormatFromGLEnum(internalFormat, blockFormat);
+    for (int level = 0, w = width, h = height; level < levels; level++, w = w > 1 ? w / 2 : 1, h = h > 1 ? h / 2 : 1)
+    {
+        if (compressed)
+            gpuMemory().compressedTexImage3D(array.name, GL_TEXTURE_2D_ARRAY, level, internalFormat, w, h, (int)layersPerArray,
+                                             (GLsizei)(compressedSize(blockFormat, w, h) * layersPerArray), nullptr);
+        else
+            gpuMemory().texImage3D(array.name, GL_TEXTURE_2D_ARRAY, level, internalFormat, w, h, (int)layersPerArray, format, type, nullptr);
+    }
+    return array;
+}
+
+TextureLayer TextureArrayPool::add(const char *path)
+{
+    BakedTexture baked;
+    if (!baked.open(path))
+        return TextureLayer();
+
+    // * 1. Work out how the layer is stored
+    const BakedTextureHeader &info = baked.info();
+    GLenum internalFormat = info.internalFormat;
+    GLenum format = info.format;
+    GLenum type = info.type;
+
+    BlockFormat blockFormat;
+    bool unpack = false;
+    if (baked.compressed())
+    {
+        if (!blockFormatFromGLEnum(info.internalFormat, blockFormat))
+        {
+            std::cerr << "ERROR::TEXTURE_ARRAY::UNKNOWN_COMPRESSED_FORMAT " << path << std::endl;
+            return TextureLayer();
+        }
+        // Decompress rather than fail, as the loader does.
+        unpack = !s3tc && (blockFormat == BlockFormat::BC1 || blockFormat == BlockFormat::BC3);
+        if (unpack)
+        {
+            internalFormat = GL_RGBA8;
+            format = GL_RGBA;
+            type = GL_UNSIGNED_BYTE;
+        }
+    }
+
+    // * 2. Find a free layer in an array of its kind, or start a new array
+    TextureLayer layer;
+    for (unsigned int index = 0; index < arrays.size() && !layer.valid(); index++)
+    {
+        Array &array = arrays[index];
+        if (array.width != (int)info.width || array.height != (int)info.height || array.levels != (int)info.levels ||
+            array.internalFormat != internalFormat || array.format != format || array.type != type || array.channels != (int)info.channels)
+            continue;
+        if (!array.freeLayers.empty())
+        {
+            layer = {index, array.freeLayers.back()};
+            array.freeLayers.pop_back();
+        }
+        else if (array.used < layersPerArray)
+        {
+            layer = {index, array.used++};
+        }
+    }
+    if (!layer.valid())
+    {
+        create((int)info.width, (int)info.height, (int)info.levels, internalFormat, format, type, (int)info.channels).used = 1;
+        layer = {(unsigned int)arrays.size() - 1, 0};
+    }
+
+    // * 3. Copy every level in, straight from the mapping
+    glState().bindTexture(GL_TEXTURE_2D_ARRAY, arrays[layer.array].name);
+    glState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    std::vector<unsigned char> pixels;
+    for (unsigned int level = 0; level < info.levels; level++)
+    {
+        const BakedLevel &data = baked.level(level);
+        if (unpack)
+        {
+            pixels.resize((std::size_t)data.width * data.height * 4);
+            decompressImage(baked.levelData(level), (int)data.width, (int)data.height, blockFormat, pixels.data());
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, 0, 0, (GLint)layer.layer, (GLsizei)data.width, (GLsizei)data.height, 1,
+                            format, type, pixels.data());
+        }
+        else if (baked.compressed())
+        {
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, 0, 0, (GLint)layer.layer, (GLsizei)data.width,
+                                      (GLsizei)data.height, 1, internalFormat, (GLsizei)data.size, baked.levelData(level));
+        }
+        else
+        {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, 0, 0, (GLint)layer.layer, (GLsizei)data.width, (GLsizei)data.height, 1,
+                            format, type, baked.levelData(level));
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    return layer;
+}
+
+void TextureArrayPool::remove(TextureLayer layer)
+{
+    arrays[layer.array].freeLayers.push_back(layer.layer);
+}
+
+void TextureArrayPool::bind(unsigned int unit, unsigned int array) const
+{
+    glState().bindTextureUnit(unit, GL_TEXTURE_2D_ARRAY, arrays[array].name);
+    glState().bindSampler(unit, sampler);
+}
+
+void TextureArrayPool::destroy()
+{
+    for (Array &array : arrays)
+        glState().deleteTextures(1, &array.name);
+    arrays.clear();
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "sampler_cache.hpp"
+
+#include <cstddef>
+#include <vector>
+
+// Handle to one layer of a TextureArrayPool. Cheap to copy.
+struct TextureLayer
+{
+    static constexpr unsigned int INVALID = 0xFFFFFFFF;
+    unsigned int array = INVALID; // index into the pool's arrays
+    unsigned int layer = 0;
+
+    bool valid() const
+    {
+        return array != INVALID;
+    }
+};
+
+// Puts baked textures (.ltex) of the same size, format and level count into
+// layers of shared GL_TEXTURE_2D_ARRAY textures. Quads that sample layers of
+// one array need one bind between them and can be drawn in one instanced
+// call, each instance picking its layer from an attribute (see the
+// TEXTURE_ARRAY variant of shader.vs.glsl).
+//
+// Arrays hold a fixed number of layers; once one is full the next image of
+// its kind starts another. Removed layers are reused, arrays are never shrunk.
+// Files load synchronously on the GL thread.
+class TextureArrayPool
+{
+private:
+    struct Array
+    {
+        unsigned int name;
+        int width;
+        int height;
+        int levels;
+        GLenum internalFormat;
+        GLenum format; // 0 if compressed
+        GLenum type;
+        int channels; // of the source, for the grey swizzle
+        unsigned int used; // layers handed out so far, free ones included
+        std::vector<unsigned int> freeLayers;
+    };
+
+    std::vector<Array> arrays;
+    unsigned int sampler;
+    unsigned int layersPerArray;
+    bool textureStorage;
+    bool s3tc;
+
+    Array &create(int width, int height, int levels, GLenum internalFormat, GLenum format, GLenum type, int channels);
+
+public:
+    // Needs a current GL context. The sampler object comes from `samplers`.
+    TextureArrayPool(SamplerCache &samplers, const SamplerState &sampler = SamplerState(), unsigned int layersPerArray = 64);
+
+    TextureArrayPool(const TextureArrayPool &) = delete;
+    TextureArrayPool &operator=(const TextureArrayPool &) = delete;
+
+    // Prints the reason and returns an invalid handle if the file can't be used.
+    TextureLayer add(const char *path);
+    // The handle (and any copy of it) must not be used afterwards.
+    void remove(TextureLayer layer);
+
+    // Binds the array (and the pool's sampler object) to the unit.
+    void bind(unsigned int unit, unsigned int array) const;
+
+    unsigned int glName(unsigned int array) const
+    {
+        return arrays[array].name;
+    }
+
+    std::size_t arrayCount() const
+    {
+        return arrays.size();
+    }
+
+    void destroy();
+};
@@ -0,0 +1,57 @@
+#include "texture_atlas.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool TextureAtlas::load(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cerr << "ERROR::ATLAS::FILE_NOT_SUCCESSFULLY_READ " << path << std::endl;
+        return false;
+    }
+
+    // "atlas WIDTH HEIGHT", then "NAME X Y WIDTH HEIGHT" per image, in texels of level 0.
+    regions.clear();
+    width = 0;
+    height = 0;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        std::istringstream fields(line);
+        std::string name;
+        if (!(fields >> name) || name[0] == '#')
+            continue;
+
+        bool valid;
+        int x = 0, y = 0, w = 0, h = 0;
+        if (name == "atlas")
+            valid = fields >> width >> height && width > 0 && height > 0;
+        else
+            valid = width > 0 && fields >> x >> y >> w >> h;
+        if (!valid)
+        {
+            std::cerr << "ERROR::ATLAS::MALFORMED_LINE " << path << ":" << lineNumber << std::endl;
+            return false;
+        }
+        if (name == "atlas")
+            continue;
+
+        AtlasRegion &region = regions[name];
+        region.offset[0] = (float)x / width;
+        region.offset[1] = (float)y / height;
+        region.scale[0] = (float)w / width;
+        region.scale[1] = (float)h / height;
+    }
+    return true;
+}
+
+const AtlasRegion *TextureAtlas::find(const std::string &name) const
+{
+    auto found = regions.find(name);
+    return found != regions.end() ? &found->second : nullptr;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+// Where one source image lies in an atlas: uv' = offset + uv * scale maps the
+// image's own texture coordinates into the atlas.
+struct AtlasRegion
+{
+    float offset[2] = {0.0f, 0.0f};
+    float scale[2] = {1.0f, 1.0f};
+
+    void remap(float &u, float &v) const
+    {
+        u = offset[0] + u * scale[0];
+        v = offset[1] + v * scale[1];
+    }
+};
+
+// The UV table written next to an atlas by `texture_baker --atlas=NAME`
+// (NAME.atlas, with the texture in NAME.ltex). Quads that remap their UVs
+// through it draw from one texture, so they need one bind and can share a
+// draw call. The atlas only has the mip levels its gutters keep apart, and
+// UVs outside [0, 1] don't wrap within a region.
+class TextureAtlas
+{
+private:
+    std::unordered_map<std::string, AtlasRegion> regions;
+    int width = 0;
+    int height = 0;
+
+public:
+    // Prints the reason and returns false if the table can't be read.
+    bool load(const std::string &path);
+
+    // nullptr if the atlas has no image of that name (the source file's stem).
+    const AtlasRegion *find(const std::string &name) const;
+
+    std::size_t size() const
+    {
+        return regions.size();
+    }
+};
@@ -0,0 +1,178 @@
+#include "texture_cache.hpp"
+
+#include <filesystem>
+#include <iostream>
+#include <utility>
+
+// * TextureRef
+
+TextureRef::TextureRef(const TextureRef &other)
+    : cache(other.cache), entry(other.entry)
+{
+    if (cache != nullptr)
+        cache->addRef(entry);
+}
+
+TextureRef::TextureRef(TextureRef &&other) noexcept
+    : cache(std::exchange(other.cache, nullptr)), entry(other.entry)
+{
+}
+
+TextureRef &TextureRef::operator=(TextureRef other) noexcept
+{
+    std::swap(cache, other.cache);
+    std::swap(entry, other.entry);
+    return *this;
+}
+
+TextureRef::~TextureRef()
+{
+    reset();
+}
+
+void TextureRef::reset()
+{
+    if (cache != nullptr)
+        cache->releaseRef(entry);
+    cache = nullptr;
+}
+
+// * TextureCache
+
+TextureCache::TextureCache(TextureLoader &loader, std::size_t budgetBytes)
+    : loader(loader), budgetBytes(budgetBytes)
+{
+}
+
+TextureRef TextureCache::acquire(const char *path, const TextureOptions &options)
+{
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(std::filesystem::absolute(path, error), error);
+    std::string key = (error ? std::string(path) : canonical.string()) + "|" +
+                      std::to_string(SamplerStateHash()(options.sampler)) + "," + std::to_string((int)options.usage) + "," +
+                      std::to_string(options.mipmaps) + "," + std::to_string(options.cpuMipmaps) + "," +
+                      std::to_string((int)options.mipOptions.filter) + "," +
+                      std::to_string(options.mipOptions.srgb) + "," + std::to_string(options.mipOptions.alphaCutoff) + "," +
+                      std::to_string(options.flipVertically) + "," + std::to_string(options.premultiplyAlpha) + "," +
+                      std::to_string(options.limits.maxDimension) + "," + std::to_string(options.limits.maxBytes) + "," +
+                      std::to_string((int)options.downscaleFilter);
+
+    TextureRef ref;
+    ref.cache = this;
+
+    auto found = byKey.find(key);
+    if (found != byKey.end())
+    {
+        counters.hits++;
+        ref.entry = found->second;
+        addRef(ref.entry);
+        return ref;
+    }
+
+    counters.misses++;
+    Entry entry{key, loader.load(path, options), 0, unused.end()};
+    if (!freeEntries.empty())
+    {
+        ref.entry = freeEntries.back();
+        freeEntries.pop_back();
+        entries[ref.entry] = std::move(entry);
+    }
+    else
+    {
+        ref.entry = (unsigned int)entries.size();
+        entries.push_back(std::move(entry));
+    }
+    byKey.emplace(std::move(key), ref.entry);
+    addRef(ref.entry);
+    return ref;
+}
+
+void TextureCache::addRef(unsigned int index)
+{
+    Entry &entry = entries[index];
+    if (entry.refs++ == 0 && entry.unusedPosition != unused.end())
+    {
+        unused.erase(entry.unusedPosition);
+        entry.unusedPosition = unused.end();
+    }
+}
+
+void TextureCache::releaseRef(unsigned int index)
+{
+    if (index >= entries.size() || !entries[index].texture.valid())
+        return; // destroy()ed
+
+    Entry &entry = entries[index];
+    if (--entry.refs == 0)
+        entry.unusedPosition = unused.insert(unused.end(), index);
+}
+
+void TextureCache::evict(unsigned int index)
+{
+    Entry &entry = entries[index];
+    unused.erase(entry.unusedPosition);
+    byKey.erase(entry.key);
+    loader.release(entry.texture);
+
+    entry = Entry{};
+    entry.unusedPosition = unused.end();
+    freeEntries.push_back(index);
+    counters.evictions++;
+}
+
+void TextureCache::update()
+{
+    // Evicting a texture that shares its upload frees nothing, so keep going until under budget.
+    while (loader.residentBytes() > budgetBytes && !unused.empty())
+        evict(unused.front());
+}
+
+unsigned int TextureCache::glName(const TextureRef &ref) const
+{
+    if (!ref.valid())
+        return loader.glName(Texture());
+    return loader.glName(entries[ref.entry].texture);
+}
+
+void TextureCache::bind(unsigned int unit, const TextureRef &ref) const
+{
+    loader.bind(unit, ref.valid() ? entries[ref.entry].texture : Texture());
+}
+
+TextureLoader::State TextureCache::state(const TextureRef &ref) const
+{
+    return loader.state(entries[ref.entry].texture);
+}
+
+TextureCache::Stats TextureCache::stats() const
+{
+    Stats result = counters;
+    result.deduplicated = loader.deduplicatedUploads();
+    result.downscaled = loader.downscaledImages();
+    return result;
+}
+
+void TextureCache::printStats() const
+{
+    Stats current = stats();
+    // Both are estimates, so the saving can come out negative; keep it signed.
+    long long savedBytes = (long long)loader.naiveBytes() - (long long)loader.residentBytes();
+    std::cout << "Texture cache: " << current.hits << " hits, " << current.misses << " misses, " << current.evictions
+              << " evictions, " << current.deduplicated << " shared by content, " << current.downscaled << " downscaled, "
+              << loader.residentBytes() / 1024
+              << " of " << budgetBytes / 1024 << " KiB resident, " << savedBytes / 1024
+              << " KiB saved by formats" << std::endl;
+}
+
+void TextureCache::destroy()
+{
+    for (Entry &entry : entries)
+    {
+        if (entry.texture.valid())
+            loader.release(entry.texture);
+    }
+    entries.clear();
+    freeEntries.clear();
+    byKey.clear();
+    unused.clear();
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "texture_loader.hpp"
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class TextureCache;
+
+// Shared reference to a texture of a TextureCache. Copies share the texture;
+// once the last one is gone it stays cached but may be evicted.
+class TextureRef
+{
+private:
+    TextureCache *cache = nullptr;
+    unsigned int entry = 0;
+
+    friend class TextureCache;
+
+public:
+    TextureRef() = default;
+    TextureRef(const TextureRef &other);
+    TextureRef(TextureRef &&other) noexcept;
+    TextureRef &operator=(TextureRef other) noexcept;
+    ~TextureRef();
+
+    void reset();
+
+    bool valid() const
+    {
+        return cache != nullptr;
+    }
+};
+
+// Hands out shared textures so that nothing is decoded or uploaded twice.
+//
+// Textures are keyed by canonical path and options: acquiring a file that is
+// cached (referenced or not) is a hit and costs nothing. Different files with
+// identical content are caught after decoding by the loader, which lets them
+// share one texture object instead of uploading it again.
+//
+// Textures nobody references are kept around in case they are needed again.
+// update() evicts them, least recently released first, while the loader's
+// resident textures exceed the video memory budget.
+class TextureCache
+{
+public:
+    struct Stats
+    {
+        unsigned int hits = 0;
+        unsigned int misses = 0;
+        unsigned int evictions = 0;
+        unsigned int deduplicated = 0; // uploads shared by content (from the loader)
+        unsigned int downscaled = 0; // images shrunk to their limits (from the loader)
+    };
+
+private:
+    struct Entry
+    {
+        std::string key;
+        Texture texture;
+        unsigned int refs;
+        std::list<unsigned int>::iterator unusedPosition;
+    };
+
+    TextureLoader &loader;
+    std::size_t budgetBytes;
+
+    std::vector<Entry> entries;
+    std::vector<unsigned int> freeEntries;
+    std::unordered_map<std::string, unsigned int> byKey;
+    std::list<unsigned int> unused; // unreferenced entries, least recently released first
+    Stats counters;
+
+    void addRef(unsigned int entry);
+    void releaseRef(unsigned int entry);
+    void evict(unsigned int entry);
+
+    friend class TextureRef;
+
+public:
+    TextureCache(TextureLoader &loader, std::size_t budgetBytes);
+
+    TextureRef acquire(const char *path, const TextureOptions &options = TextureOptions());
+
+    // Evict unreferenced textures while over budget. Call once per frame, after the loader's update().
+    void update();
+
+    unsigned int glName(const TextureRef &ref) const;
+    void bind(unsigned int unit, const TextureRef &ref) const;
+    TextureLoader::State state(const TextureRef &ref) const;
+
+    std::size_t budget() const
+    {
+        return budgetBytes;
+    }
+
+    void setBudget(std::size_t bytes)
+    {
+        budgetBytes = bytes;
+    }
+
+    Stats stats() const;
+    void printStats() const;
+
+    // Release every cached texture. References that are still alive become no-ops.
+    void destroy();
+};
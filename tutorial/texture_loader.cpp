@@ -0,0 +1,709 @@
+#include "texture_loader.hpp"
+#include "block_compression.hpp"
+#include "gl_state.hpp"
+#include "gpu_memory.hpp"
+#include "mapped_file.hpp"
+#include "parallel_decode.hpp"
+#include "pixel_convert.hpp"
+#include "hash.hpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <iostream>
+
+namespace
+{
+    GLenum pixelFormat(int channels)
+    {
+        switch (channels)
+        {
+        case 1:
+            return GL_RED;
+        case 2:
+            return GL_RG;
+        case 3:
+            return GL_RGB;
+        default:
+            return GL_RGBA;
+        }
+    }
+
+    GLint internalFormat(int channels)
+    {
+        switch (channels)
+        {
+        case 1:
+            return GL_R8;
+        case 2:
+            return GL_RG8;
+        case 3:
+            return GL_RGB8;
+        default:
+            return GL_RGBA8;
+        }
+    }
+
+    // How a decoded image (and its mips) is stored and uploaded.
+    struct PixelLayout
+    {
+        GLenum internalFormat;
+        GLenum format;
+        GLenum type;
+        int bytes; // per pixel, as uploaded
+    };
+
+    PixelLayout pixelLayout(int channels, TextureUsage usage, bool lowMemory)
+    {
+        GLenum format = pixelFormat(channels);
+        if (lowMemory && usage != TextureUsage::Mask && channels == 3)
+            return {GL_RGB565, format, GL_UNSIGNED_SHORT_5_6_5, 2};
+        if (lowMemory && usage != TextureUsage::Mask && channels == 4)
+            return {GL_RGBA4, format, GL_UNSIGNED_SHORT_4_4_4_4, 2};
+        // There are no core sRGB formats with fewer than 3 channels.
+        if (usage == TextureUsage::Color && channels == 3)
+            return {GL_SRGB8, format, GL_UNSIGNED_BYTE, 3};
+        if (usage == TextureUsage::Color && channels == 4)
+            return {GL_SRGB8_ALPHA8, format, GL_UNSIGNED_BYTE, 4};
+        return {(GLenum)internalFormat(channels), format, GL_UNSIGNED_BYTE, channels};
+    }
+
+    // The tighter of two limits, where 0 means none.
+    TextureLimits tighterLimits(const TextureLimits &a, const TextureLimits &b)
+    {
+        auto tighter = [](auto x, auto y)
+        {
+            return x == 0 ? y : y == 0 ? x : std::min(x, y);
+        };
+        return {tighter(a.maxDimension, b.maxDimension), tighter(a.maxBytes, b.maxBytes)};
+    }
+
+    // Shrink the size until it fits the limits, keeping the aspect ratio.
+    void fitToLimits(int &width, int &height, GLenum internalFormat, bool mipmaps, const TextureLimits &limits)
+    {
+        double scale = 1.0;
+        if (limits.maxDimension > 0)
+            scale = std::min(scale, (double)limits.maxDimension / std::max(width, height));
+        if (limits.maxBytes > 0)
+            scale = std::min(scale, std::sqrt((double)limits.maxBytes / TextureLoader::textureBytes(internalFormat, width, height, mipmaps)));
+        if (scale >= 1.0)
+            return;
+
+        // Rounding down keeps most sizes within the byte limit; the loop catches the rest.
+        int fittedWidth, fittedHeight;
+        do
+        {
+            fittedWidth = std::max(1, (int)(width * scale));
+            fittedHeight = std::max(1, (int)(height * scale));
+            scale *= 0.99;
+        } while (limits.maxBytes > 0 && TextureLoader::textureBytes(internalFormat, fittedWidth, fittedHeight, mipmaps) > limits.maxBytes &&
+                 (fittedWidth > 1 || fittedHeight > 1));
+        width = fittedWidth;
+        height = fittedHeight;
+    }
+
+    // Where the downscaled image of a file goes in the cache. Named after
+    // everything its pixels depend on, so a changed file or setting misses.
+    std::string downscaleCachePath(const std::string &directory, const std::string &file, const TextureOptions &options,
+                                   const TextureLimits &limits, bool lowMemory)
+    {
+        std::error_code error;
+        std::uintmax_t size = std::filesystem::file_size(file, error);
+        if (error)
+            return {};
+        auto modified = std::filesystem::last_write_time(file, error).time_since_epoch().count();
+        if (error)
+            return {};
+        std::filesystem::path canonical = std::filesystem::weakly_canonical(std::filesystem::absolute(file, error), error);
+
+        std::string key = (error ? file : canonical.string()) + "|" + std::to_string(size) + "," + std::to_string(modified) + "|" +
+                          std::to_string((int)options.usage) + "," + std::to_string(options.mipmaps) + "," +
+                          std::to_string(options.cpuMipmaps) + "," + std::to_string((int)options.mipOptions.filter) + "," +
+                          std::to_string(options.mipOptions.srgb) + "," + std::to_string(options.mipOptions.alphaCutoff) + "," +
+                          std::to_string(options.flipVertically) + "," + std::to_string(options.premultiplyAlpha) + "," +
+                          std::to_string((int)options.downscaleFilter) + "," + std::to_string(limits.maxDimension) + "," +
+                          std::to_string(limits.maxBytes) + "," + std::to_string(lowMemory);
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)fnv1a(key));
+        return (std::filesystem::path(directory) / (name + std::string(BAKED_TEXTURE_EXTENSION))).string();
+    }
+
+    // The largest GL_UNPACK_ALIGNMENT rows of this many bytes satisfy.
+    int unpackAlignment(std::size_t rowBytes)
+    {
+        for (int alignment = 8; alignment > 1; alignment /= 2)
+        {
+            if (rowBytes % (std::size_t)alignment == 0)
+                return alignment;
+        }
+        return 1;
+    }
+}
+
+TextureLoader::TextureLoader(std::chrono::microseconds budget, unsigned int threadCount)
+    : budget(budget), s3tc(GLAD_GL_EXT_texture_compression_s3tc), textureStorage(GLAD_GL_ARB_texture_storage), workers(std::make_unique<ThreadPool>(threadCount))
+{
+    // Mid grey, so missing textures are obvious without being loud.
+    const unsigned char grey[4] = {128, 128, 128, 255};
+    glGenTextures(1, &placeholder);
+    glState().bindTexture(GL_TEXTURE_2D, placeholder);
+    gpuMemory().texImage2D(placeholder, GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    gpuMemory().label(GL_TEXTURE, placeholder, "texture placeholder");
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenBuffers((GLsizei)pixelBuffers.size(), pixelBuffers.data());
+}
+
+TextureLoader::~TextureLoader()
+{
+    // Nothing can be decoded after this, so everything undelivered can be freed.
+    workers.reset();
+    for (const Decoded &image : decoded)
+        stbi_image_free(image.pixels);
+    for (const Decoded &image : uploads)
+        stbi_image_free(image.pixels);
+}
+
+std::size_t TextureLoader::textureBytes(GLenum internalFormat, int width, int height, bool mipmaps)
+{
+    std::size_t bytes = textureImageBytes(internalFormat, width, height);
+    // A full mip chain adds a third.
+    return mipmaps ? bytes + bytes / 3 : bytes;
+}
+
+void TextureLoader::setDownscaleCache(const std::string &directory)
+{
+    std::error_code error;
+    if (!directory.empty() && !std::filesystem::create_directories(directory, error) && error)
+        std::cerr << "ERROR::TEXTURE::CANNOT_CREATE_CACHE " << directory << " (" << error.message() << ")" << std::endl;
+    downscaleCacheDirectory = directory;
+}
+
+Texture TextureLoader::load(const char *path, const TextureOptions &options)
+{
+    Texture texture;
+    Slot slot{path, options, State::Loading, 0, samplers.get(options.sampler), 0, 0, 0, 0, false};
+    if (!freeSlots.empty())
+    {
+        texture.index = freeSlots.back();
+        freeSlots.pop_back();
+        slots[texture.index] = std::move(slot);
+    }
+    else
+    {
+        texture.index = (unsigned int)slots.size();
+        slots.push_back(std::move(slot));
+    }
+    loading++;
+
+    workers->submit([this, index = texture.index, file = std::string(path), options, lowMemory = lowMemoryMode,
+                     limits = tighterLimits(options.limits, loaderLimits), cacheDirectory = downscaleCacheDirectory]
+                    {
+        Decoded image{index, nullptr, nullptr, {}, {}, 0, 0, 0, 0, nullptr, lowMemory, false};
+        std::uint64_t contentHash = 0;
+
+        // An earlier load may have shrunk this image to the same limits already.
+        bool bakedFile = file.ends_with(BAKED_TEXTURE_EXTENSION);
+        std::string cacheFile;
+        if (!bakedFile && !cacheDirectory.empty() && (limits.maxDimension > 0 || limits.maxBytes > 0))
+            cacheFile = downscaleCachePath(cacheDirectory, file, options, limits, lowMemory);
+        std::error_code error;
+        bool cached = !cacheFile.empty() && std::filesystem::exists(cacheFile, error);
+
+        if (bakedFile || cached)
+        {
+            // Decoded and hashed at bake time. Fault the pages in here, so the
+            // upload on the GL thread doesn't wait for the disk.
+            auto baked = std::make_shared<BakedTexture>();
+            if (baked->open(bakedFile ? file : cacheFile))
+            {
+                baked->touch();
+                const BakedTextureHeader &info = baked->info();
+                image.width = (int)info.width;
+                image.height = (int)info.height;
+                image.channels = (int)info.channels;
+                contentHash = info.contentHash;
+
+                BlockFormat blockFormat;
+                if (baked->compressed() && !blockFormatFromGLEnum(info.internalFormat, blockFormat))
+                {
+                    image.failure = "unknown compressed format";
+                }
+                else if (baked->compressed() && !s3tc && (blockFormat == BlockFormat::BC1 || blockFormat == BlockFormat::BC3))
+                {
+                    // Decompress here rather than fail; it costs memory, not the look.
+                    unsigned int levels = options.mipmaps ? info.levels : 1;
+                    for (unsigned int level = 0; level < levels; level++)
+                    {
+                        const BakedLevel &data = baked->level(level);
+                        BakedImageLevel &target = image.unpacked.emplace_back();
+                        target.width = (int)data.width;
+                        target.height = (int)data.height;
+                        target.pixels.resize((std::size_t)data.width * data.height * blockFormatChannels(blockFormat));
+                        decompressImage(baked->levelData(level), target.width, target.height, blockFormat, target.pixels.data());
+                    }
+                }
+                if (image.failure == nullptr)
+                    image.baked = std::move(baked);
+                image.downscaled = cached;
+            }
+            else if (cached)
+            {
+                cached = false; // written by another version, say; decode again
+            }
+            else
+            {
+                image.failure = "not a valid baked texture";
+            }
+        }
+
+        if (!bakedFile && !cached)
+        {
+            // Flipped with the other conversions below, in the same pass. Large
+            // images are split over the other workers too, like the mips below.
+            stbi_set_flip_vertically_on_load_thread(0);
+
+            MappedFile encoded(file);
+            std::string_view bytes = encoded.view();
+            if (encoded.valid())
+                image.pixels = decodeImage((const unsigned char *)bytes.data(), bytes.size(), &image.width, &image.height, &image.channels,
+                                           workers.get());
+            if (image.pixels == nullptr)
+            {
+                image.failure = encoded.valid() ? stbi_failure_reason() : "can't open file";
+            }
+            else
+            {
+                // * 1. Everything up to the downscaling and mips in one pass over the
+                // rows. Packing comes after filtering, so they work from the full
+                // precision; without either it joins the pass too.
+                bool cpuMips = options.mipmaps && options.cpuMipmaps;
+                PixelConversion conversion;
+                conversion.flipVertically = options.flipVertically;
+                conversion.reduceToMask = options.usage == TextureUsage::Mask;
+                conversion.premultiplyAlpha = options.premultiplyAlpha;
+                conversion.srgb = options.usage == TextureUsage::Color;
+
+                int channels = convertedChannels(image.channels, conversion);
+                PixelLayout layout = pixelLayout(channels, options.usage, lowMemory);
+                PixelPacking packing = PixelPacking::None;
+                if (layout.type != GL_UNSIGNED_BYTE)
+                    packing = channels == 3 ? PixelPacking::RGB565 : PixelPacking::RGBA4444;
+                int targetWidth = image.width, targetHeight = image.height;
+                fitToLimits(targetWidth, targetHeight, layout.internalFormat, options.mipmaps, limits);
+                bool downscale = targetWidth != image.width || targetHeight != image.height;
+                if (!cpuMips && !downscale)
+                    conversion.packing = packing;
+
+                std::size_t count = (std::size_t)image.width * image.height;
+                std::size_t pixelBytes = (std::size_t)convertedPixelBytes(image.channels, conversion);
+                if (!conversion.identity())
+                {
+                    // Rows can only be converted in place if they keep their size.
+                    // Freed with stbi_image_free like stb's own buffers.
+                    unsigned char *target = image.pixels;
+                    if (pixelBytes != (std::size_t)image.channels)
+                        target = (unsigned char *)std::malloc(count * pixelBytes);
+                    if (target != nullptr)
+                        convertPixels(image.pixels, image.width, image.height, image.channels, conversion, target, workers.get());
+                    if (target != image.pixels)
+                    {
+                        stbi_image_free(image.pixels);
+                        image.pixels = target;
+                    }
+                }
+                image.channels = channels;
+
+                // * 2. Downscaling, from the converted pixels, so premultiplied alpha
+                // is filtered as such. Rows are spread over the other workers too;
+                // this one takes part, so it can't deadlock. Only color is sRGB-encoded.
+                if (downscale && image.pixels != nullptr)
+                {
+                    MipOptions resizeOptions;
+                    resizeOptions.filter = options.downscaleFilter;
+                    resizeOptions.srgb = options.usage == TextureUsage::Color;
+                    unsigned char *shrunk = (unsigned char *)std::malloc((std::size_t)targetWidth * targetHeight * channels);
+                    if (shrunk != nullptr)
+                        resizeImage(image.pixels, image.width, image.height, channels, shrunk, targetWidth, targetHeight, resizeOptions,
+                                    workers.get());
+                    stbi_image_free(image.pixels);
+                    image.pixels = shrunk;
+                    image.width = targetWidth;
+                    image.height = targetHeight;
+                    image.downscaled = true;
+                    count = (std::size_t)targetWidth * targetHeight;
+                }
+                if (image.pixels == nullptr)
+                    image.failure = "out of memory";
+                else
+                    contentHash = fnv1a(std::string_view((const char *)image.pixels, count * pixelBytes));
+
+                // * 3. Mips, spread like the downscaling.
+                MipOptions mipOptions = options.mipOptions;
+                mipOptions.srgb = mipOptions.srgb && options.usage == TextureUsage::Color;
+                if (cpuMips && image.pixels != nullptr)
+                    image.mips = generateMips(image.pixels, image.width, image.height, image.channels, mipOptions, workers.get());
+
+                // * 4. Packing of the level and its mips, in place: 2 bytes per pixel
+                // never overtake the 3 or 4 they are read from.
+                if ((cpuMips || downscale) && image.pixels != nullptr && packing != PixelPacking::None)
+                {
+                    packPixels(image.pixels, count, packing, image.pixels);
+                    for (MipLevel &mip : image.mips)
+                    {
+                        packPixels(mip.pixels.data(), (std::size_t)mip.width * mip.height, packing, mip.pixels.data());
+                        mip.pixels.resize((std::size_t)mip.width * mip.height * 2);
+                    }
+                }
+
+                // * 5. The result for the next load, in its final format.
+                if (downscale && !cacheFile.empty() && image.pixels != nullptr)
+                {
+                    std::vector<BakedImageLevel> levels;
+                    levels.push_back({image.width, image.height, std::vector<unsigned char>(image.pixels, image.pixels + count * layout.bytes)});
+                    for (const MipLevel &mip : image.mips)
+                        levels.push_back({mip.width, mip.height, mip.pixels});
+                    writeBakedTexture(cacheFile, layout.internalFormat, layout.format, layout.type, image.channels, levels);
+                }
+            }
+        }
+
+        // Identical pixels only share a texture object if its levels match too.
+        // Sampling isn't part of the texture, so it doesn't count.
+        int alphaCutoff;
+        std::memcpy(&alphaCutoff, &options.mipOptions.alphaCutoff, sizeof(alphaCutoff));
+        int header[10] = {image.width, image.height, image.channels, options.mipmaps, options.cpuMipmaps,
+                          (int)options.mipOptions.filter, options.mipOptions.srgb, alphaCutoff, (int)options.usage, lowMemory};
+        image.hash = fnv1a(std::string_view((const char *)header, sizeof(header)), contentHash);
+
+        {
+            std::lock_guard<std::mutex> lock(decodedMutex);
+            decoded.push_back(std::move(image));
+        }
+        decodedReady.notify_one(); });
+
+    return texture;
+}
+
+void TextureLoader::collect()
+{
+    std::lock_guard<std::mutex> lock(decodedMutex);
+    uploads.insert(uploads.end(), std::make_move_iterator(decoded.begin()), std::make_move_iterator(decoded.end()));
+    decoded.clear();
+}
+
+void TextureLoader::upload(const Decoded &image)
+{
+    Slot &slot = slots[image.index];
+    loading--;
+
+    if (slot.released)
+    {
+        stbi_image_free(image.pixels);
+        freeSlot(image.index);
+        return;
+    }
+
+    if (image.pixels == nullptr && image.baked == nullptr)
+    {
+        std::cerr << "ERROR::TEXTURE::STBI_DATA_EMPTY " << slot.path << " (" << (image.failure ? image.failure : "unknown") << ")" << std::endl;
+        slot.state = State::Failed;
+        return;
+    }
+
+    slot.width = image.width;
+    slot.height = image.height;
+    slot.channels = image.channels;
+    slot.contentHash = image.hash;
+    slot.state = State::Resident;
+    if (image.downscaled)
+        downscaled++;
+
+    // * 1. Share the texture object of an identical image
+    auto existing = uploaded.find(image.hash);
+    if (existing != uploaded.end())
+    {
+        existing->second.users++;
+        slot.name = existing->second.name;
+        deduplicated++;
+        stbi_image_free(image.pixels);
+        return;
+    }
+
+    if (image.baked != nullptr)
+    {
+        uploadBaked(slot, *image.baked, image.unpacked);
+        return;
+    }
+
+    PixelLayout layout = pixelLayout(image.channels, slot.options.usage, image.lowMemory);
+    std::size_t rowBytes = (std::size_t)image.width * layout.bytes;
+    std::size_t size = rowBytes * image.height;
+
+    // * 2. Copy into a pixel buffer. glTexImage2D then returns right away and the
+    // driver moves the data while the GPU works on something else. The buffer is
+    // orphaned first, so an upload still in flight from it is never waited for.
+    unsigned int pixelBuffer = pixelBuffers[nextPixelBuffer];
+    nextPixelBuffer = (nextPixelBuffer + 1) % pixelBuffers.size();
+
+    glState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+    gpuMemory().bufferData(pixelBuffer, GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)size, NULL, GL_STREAM_DRAW);
+    void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+    const void *source = nullptr; // offset into the pixel buffer
+    if (mapped != nullptr)
+    {
+        std::memcpy(mapped, image.pixels, size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    else
+    {
+        // Couldn't map; upload from client memory instead.
+        glState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        source = image.pixels;
+    }
+
+    // * 3. Create the texture from it
+    int levels = 1;
+    if (!image.mips.empty())
+        levels += (int)image.mips.size();
+    else if (slot.options.mipmaps)
+        levels = mipLevelCount(image.width, image.height);
+    allocate(slot, layout.internalFormat, levels, image.width, image.height);
+
+    // Grey images read as grey (and grey + alpha as such) instead of red.
+    if (image.channels <= 2)
+    {
+        GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, image.channels == 2 ? GL_GREEN : GL_ONE};
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+
+    // Rows are tightly packed, so only some widths meet the default alignment of 4.
+    int alignment = unpackAlignment(rowBytes);
+    if (alignment != 4)
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    setLevel(slot, 0, layout.internalFormat, image.width, image.height, layout.format, layout.type, source);
+    if (alignment != 4)
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if (!image.mips.empty())
+    {
+        // A third of level 0 at most; uploaded from client memory.
+        glState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (std::size_t level = 0; level < image.mips.size(); level++)
+        {
+            const MipLevel &mip = image.mips[level];
+            setLevel(slot, (int)level + 1, layout.internalFormat, mip.width, mip.height, layout.format, layout.type, mip.pixels.data());
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+    else if (levels > 1)
+    {
+        gpuMemory().generateMipmap(slot.name, GL_TEXTURE_2D, layout.internalFormat, image.width, image.height);
+    }
+
+    glState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    stbi_image_free(image.pixels);
+
+    std::size_t bytes = textureBytes(layout.internalFormat, image.width, image.height, slot.options.mipmaps);
+    std::size_t naiveBytes = textureBytes(GL_RGBA8, image.width, image.height, slot.options.mipmaps);
+    uploaded.emplace(image.hash, Upload{slot.name, 1, bytes, naiveBytes});
+    bytesResident += bytes;
+    bytesNaive += naiveBytes;
+}
+
+void TextureLoader::uploadBaked(Slot &slot, const BakedTexture &baked, const std::vector<BakedImageLevel> &unpacked)
+{
+    const BakedTextureHeader &info = baked.info();
+    unsigned int levels = slot.options.mipmaps ? info.levels : 1;
+    GLenum storedFormat = unpacked.empty() ? info.internalFormat : internalFormat(info.channels);
+    // Only level 0 in the file (a downscale cache entry without CPU mips, say):
+    // the driver makes the rest, as for a decoded image.
+    bool generateMipmaps = slot.options.mipmaps && info.levels == 1 && !baked.compressed() && mipLevelCount((int)info.width, (int)info.height) > 1;
+    allocate(slot, storedFormat, generateMipmaps ? mipLevelCount((int)info.width, (int)info.height) : (int)levels, (int)info.width,
+             (int)info.height);
+
+    if (info.channels <= 2)
+    {
+        GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, info.channels == 2 ? GL_GREEN : GL_ONE};
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+
+    // Straight from the mapping; the small levels' rows aren't 4-byte aligned.
+    std::size_t bytes = 0;
+    std::size_t naiveBytes = 0;
+    glState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (unsigned int level = 0; level < levels; level++)
+    {
+        const BakedLevel &data = baked.level(level);
+        naiveBytes += textureImageBytes(GL_RGBA8, (int)data.width, (int)data.height);
+        if (!unpacked.empty())
+        {
+            const BakedImageLevel &image = unpacked[level];
+            setLevel(slot, (int)level, storedFormat, image.width, image.height, pixelFormat(info.channels), GL_UNSIGNED_BYTE, image.pixels.data());
+            bytes += image.pixels.size();
+        }
+        else if (baked.compressed())
+        {
+            setCompressedLevel(slot, (int)level, storedFormat, (int)data.width, (int)data.height, data.size, baked.levelData(level));
+            bytes += data.size;
+        }
+        else
+        {
+            setLevel(slot, (int)level, storedFormat, (int)data.width, (int)data.height, info.format, info.type, baked.levelData(level));
+            bytes += data.size;
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if (generateMipmaps)
+    {
+        gpuMemory().generateMipmap(slot.name, GL_TEXTURE_2D, storedFormat, (int)info.width, (int)info.height);
+        // A full chain adds a third, as in textureBytes.
+        bytes += bytes / 3;
+        naiveBytes += naiveBytes / 3;
+    }
+
+    uploaded.emplace(slot.contentHash, Upload{slot.name, 1, bytes, naiveBytes});
+    bytesResident += bytes;
+    bytesNaive += naiveBytes;
+}
+
+void TextureLoader::allocate(Slot &slot, GLenum internalFormat, int levels, int width, int height)
+{
+    glGenTextures(1, &slot.name);
+    glState().bindTexture(GL_TEXTURE_2D, slot.name);
+    gpuMemory().label(GL_TEXTURE, slot.name, slot.path);
+    if (textureStorage)
+        gpuMemory().texStorage2D(slot.name, GL_TEXTURE_2D, levels, internalFormat, width, height);
+    else
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+}
+
+void TextureLoader::setLevel(const Slot &slot, int level, GLenum internalFormat, int width, int height, GLenum format, GLenum type,
+                             const void *pixels)
+{
+    if (textureStorage)
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format, type, pixels);
+    else
+        gpuMemory().texImage2D(slot.name, GL_TEXTURE_2D, level, internalFormat, width, height, format, type, pixels);
+}
+
+void TextureLoader::setCompressedLevel(const Slot &slot, int level, GLenum internalFormat, int width, int height, std::size_t size,
+                                       const void *blocks)
+{
+    if (textureStorage)
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, internalFormat, (GLsizei)size, blocks);
+    else
+        gpuMemory().compressedTexImage2D(slot.name, GL_TEXTURE_2D, level, internalFormat, width, height, (GLsizei)size, blocks);
+}
+
+void TextureLoader::freeSlot(unsigned int index)
+{
+    slots[index] = Slot{};
+    slots[index].state = State::Failed;
+    freeSlots.push_back(index);
+}
+
+void TextureLoader::release(Texture texture)
+{
+    Slot &slot = slots[texture.index];
+    if (slot.state == State::Loading)
+    {
+        // A worker still has it. upload() frees the slot when the image arrives.
+        slot.released = true;
+        return;
+    }
+
+    if (slot.state == State::Resident)
+    {
+        Upload &shared = uploaded.at(slot.contentHash);
+        if (--shared.users == 0)
+        {
+            glState().deleteTextures(1, &shared.name);
+            bytesResident -= shared.bytes;
+            bytesNaive -= shared.naiveBytes;
+            uploaded.erase(slot.contentHash);
+        }
+    }
+    freeSlot(texture.index);
+}
+
+unsigned int TextureLoader::update()
+{
+    collect();
+
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point start = Clock::now();
+
+    unsigned int uploaded = 0;
+    while (!uploads.empty())
+    {
+        if (uploaded > 0 && Clock::now() - start >= budget)
+            break;
+
+        upload(uploads.front());
+        uploads.pop_front();
+        uploaded++;
+    }
+    return uploaded;
+}
+
+void TextureLoader::finish()
+{
+    while (loading > 0)
+    {
+        {
+            std::unique_lock<std::mutex> lock(decodedMutex);
+            decodedReady.wait(lock, [this]
+                              { return !decoded.empty() || !uploads.empty(); });
+        }
+        collect();
+
+        while (!uploads.empty())
+        {
+            upload(uploads.front());
+            uploads.pop_front();
+        }
+    }
+}
+
+unsigned int TextureLoader::glName(Texture texture) const
+{
+    if (!texture.valid() || slots[texture.index].state != State::Resident)
+        return placeholder;
+    return slots[texture.index].name;
+}
+
+void TextureLoader::bind(unsigned int unit, Texture texture) const
+{
+    glState().bindTextureUnit(unit, GL_TEXTURE_2D, glName(texture));
+    glState().bindSampler(unit, texture.valid() ? slots[texture.index].sampler : 0);
+}
+
+void TextureLoader::destroy()
+{
+    for (auto &entry : uploaded)
+        glState().deleteTextures(1, &entry.second.name);
+    uploaded.clear();
+    bytesResident = 0;
+    bytesNaive = 0;
+
+    for (Slot &slot : slots)
+        slot.name = 0;
+    glState().deleteTextures(1, &placeholder);
+    samplers.destroy();
+    glState().deleteBuffers((int)pixelBuffers.size(), pixelBuffers.data());
+    placeholder = 0;
+}
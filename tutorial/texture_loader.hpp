@@ -0,0 +1,292 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "thread_pool.hpp"
+#include "baked_texture.hpp"
+#include "mipmap.hpp"
+#include "sampler_cache.hpp"
+
+#include <chrono>
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// What an image holds. Decides the internal format of decoded images; baked
+// textures keep the format they were baked with.
+enum class TextureUsage
+{
+    Color, // sRGB-encoded color: GL_SRGB8 or GL_SRGB8_ALPHA8, sampled as linear values
+    Mask,  // coverage and the like: GL_R8, or GL_RG8 with alpha. Color images are reduced to luminance
+    Data   // linear values such as normals: GL_R8 to GL_RGBA8, by channel count
+};
+
+// Upper bounds on the size of a decoded image on the GPU. 0 means no limit.
+struct TextureLimits
+{
+    int maxDimension = 0; // of width and height
+    std::size_t maxBytes = 0; // level 0 and its mips, in the internal format chosen (see TextureLoader::textureBytes)
+
+    bool operator==(const TextureLimits &) const = default;
+};
+
+struct TextureOptions
+{
+    TextureUsage usage = TextureUsage::Color;
+    // Bound as a sampler object next to the texture. Not part of the texture,
+    // so images that only differ in it share one texture object.
+    SamplerState sampler;
+    bool mipmaps = true;
+    // Build the mip chain on the worker with generateMips instead of with
+    // glGenerateMipmap, which filters sRGB color in the wrong space and differs
+    // between drivers. Baked textures bring their own chain. mipOptions.srgb
+    // only applies to TextureUsage::Color.
+    bool cpuMipmaps = false;
+    MipOptions mipOptions;
+    bool flipVertically = true; // GL expects the first row at the bottom
+    // Multiply color by alpha on the worker, for blending with GL_ONE,
+    // GL_ONE_MINUS_SRC_ALPHA. Color usage multiplies in linear light.
+    bool premultiplyAlpha = false;
+    // Images beyond these limits or the loader's (see setTextureLimits) are
+    // shrunk on the worker with this filter, keeping their aspect ratio.
+    TextureLimits limits;
+    MipFilter downscaleFilter = MipFilter::Mitchell;
+
+    bool operator==(const TextureOptions &) const = default;
+};
+
+// Handle to a texture of a TextureLoader. Cheap to copy.
+struct Texture
+{
+    static constexpr unsigned int INVALID = 0xFFFFFFFF;
+    unsigned int index = INVALID;
+
+    bool valid() const
+    {
+        return index != INVALID;
+    }
+};
+
+// Loads image files without blocking the GL thread.
+//
+// load() returns a handle right away and decodes the file on a worker thread.
+// update(), called once per frame on the GL thread, copies decoded images into
+// a pixel buffer object and uploads from there, so the copy into the texture
+// happens on the GPU's schedule. It stops after the frame budget is used up
+// (but always uploads at least one image, so loading can't stall).
+//
+// Until its image is resident a handle binds to a 1x1 grey placeholder.
+class TextureLoader
+{
+public:
+    enum class State
+    {
+        Loading,
+        Resident,
+        Failed
+    };
+
+private:
+    struct Slot
+    {
+        std::string path;
+        TextureOptions options;
+        State state;
+        unsigned int name;
+        unsigned int sampler;
+        int width;
+        int height;
+        int channels;
+        std::uint64_t contentHash;
+        bool released; // while still loading: drop the image when it arrives
+    };
+
+    // One texture object, possibly shared by several slots with the same content.
+    struct Upload
+    {
+        unsigned int name;
+        unsigned int users;
+        std::size_t bytes;
+        std::size_t naiveBytes; // as GL_RGBA8
+    };
+
+    // Handed from a worker to the GL thread.
+    struct Decoded
+    {
+        unsigned int index;
+        unsigned char *pixels; // from stbi_load, nullptr on failure
+        std::shared_ptr<BakedTexture> baked; // instead of pixels for .ltex files
+        std::vector<BakedImageLevel> unpacked; // baked levels in a compressed format the GPU can't sample
+        std::vector<MipLevel> mips; // the levels below pixels, with cpuMipmaps
+        int width;
+        int height;
+        int channels;
+        std::uint64_t hash; // of the pixels, dimensions and options
+        const char *failure;
+        bool lowMemory; // the mode when it was loaded; pixels are packed if it applies
+        bool downscaled; // shrunk to its limits, now or by an earlier load (from the cache)
+    };
+
+    static constexpr std::size_t PIXEL_BUFFER_COUNT = 4;
+
+    std::vector<Slot> slots;
+    std::vector<unsigned int> freeSlots;
+    std::unordered_map<std::uint64_t, Upload> uploaded; // by content hash
+    std::size_t bytesResident = 0;
+    std::size_t bytesNaive = 0;
+    unsigned int deduplicated = 0;
+    unsigned int downscaled = 0;
+    std::deque<Decoded> uploads; // decoded images waiting for the GL thread
+    unsigned int placeholder = 0;
+    std::array<unsigned int, PIXEL_BUFFER_COUNT> pixelBuffers{};
+    std::size_t nextPixelBuffer = 0;
+    std::chrono::microseconds budget;
+    std::size_t loading = 0;
+    bool s3tc; // RGTC is core, S3TC an extension
+    bool textureStorage;
+    bool lowMemoryMode = false;
+    TextureLimits loaderLimits;
+    std::string downscaleCacheDirectory;
+    SamplerCache samplers;
+
+    // Shared with the workers
+    std::mutex decodedMutex;
+    std::condition_variable decodedReady;
+    std::vector<Decoded> decoded;
+
+    // Declared last so the workers are joined first.
+    std::unique_ptr<ThreadPool> workers;
+
+    void collect();
+    void upload(const Decoded &image);
+    // Every level straight from the mapping; block-compressed ones with
+    // glCompressedTexImage2D, or from `unpacked` when the driver lacks S3TC.
+    void uploadBaked(Slot &slot, const BakedTexture &baked, const std::vector<BakedImageLevel> &unpacked);
+    // Create and bind the texture object of the slot, with room for `levels` levels.
+    // Immutable storage (glTexStorage2D) where the driver has it, else MAX_LEVEL
+    // says how many follow, so the driver never guesses whether the chain is complete.
+    void allocate(Slot &slot, GLenum internalFormat, int levels, int width, int height);
+    // Fill one level of the bound texture; only allocates it without texture storage.
+    void setLevel(const Slot &slot, int level, GLenum internalFormat, int width, int height, GLenum format, GLenum type, const void *pixels);
+    void setCompressedLevel(const Slot &slot, int level, GLenum internalFormat, int width, int height, std::size_t size, const void *blocks);
+    void freeSlot(unsigned int index);
+
+public:
+    // Needs a current GL context. threadCount 0 picks one per core, minus one.
+    explicit TextureLoader(std::chrono::microseconds budget = std::chrono::microseconds(2000), unsigned int threadCount = 0);
+    ~TextureLoader();
+
+    TextureLoader(const TextureLoader &) = delete;
+    TextureLoader &operator=(const TextureLoader &) = delete;
+
+    // On the worker a decoded image is flipped, reduced, premultiplied and packed
+    // in one pass over its rows (see PixelConversion), then shrunk to its limits
+    // (see resizeImage) and hashed. A large JPEG or PNG is decoded on all workers
+    // at once where its format allows (see decodeImage). It gets the smallest
+    // internal format that holds it for its usage; 1 and 2 channel images are
+    // swizzled to read as grey.
+    //
+    // Baked textures (.ltex, see tools/texture_baker) are mapped instead, with
+    // their orientation baked in: flipVertically, premultiplyAlpha and the limits
+    // don't apply. mipmaps = false uploads only level 0, and a file with only
+    // level 0 gets the rest from glGenerateMipmap.
+    Texture load(const char *path, const TextureOptions &options = TextureOptions());
+
+    // Give the texture up. The handle (and any copy of it) must not be used afterwards.
+    void release(Texture texture);
+
+    // Upload decoded images until the budget is used up. Returns how many were uploaded.
+    unsigned int update();
+
+    // Block until every texture loaded so far is resident (or failed).
+    void finish();
+
+    // The texture object to use right now: the placeholder until the image is resident.
+    unsigned int glName(Texture texture) const;
+    // Binds the texture and its sampler object to the unit.
+    void bind(unsigned int unit, Texture texture) const;
+
+    // The sampler objects behind TextureOptions::sampler, for binding another
+    // one to a unit without touching the texture.
+    SamplerCache &samplerCache()
+    {
+        return samplers;
+    }
+
+    State state(Texture texture) const
+    {
+        return slots[texture.index].state;
+    }
+
+    std::size_t pending() const
+    {
+        return loading;
+    }
+
+    // Estimated video memory used by all resident textures (each shared one counted once).
+    std::size_t residentBytes() const
+    {
+        return bytesResident;
+    }
+
+    // What the resident textures would take as GL_RGBA8 with the same levels.
+    // The difference to residentBytes() is what the chosen formats save.
+    std::size_t naiveBytes() const
+    {
+        return bytesNaive;
+    }
+
+    // Pack color and data images with 3 or 4 channels to GL_RGB565 or GL_RGBA4
+    // on the worker. Those have no sRGB forms, so shaders see them encoded.
+    // Applies to images loaded from now on.
+    void setLowMemory(bool enabled)
+    {
+        lowMemoryMode = enabled;
+    }
+
+    bool lowMemory() const
+    {
+        return lowMemoryMode;
+    }
+
+    // Images whose content and mip options matched a resident one and shared its
+    // texture object instead of being uploaded. It is deleted once all are released.
+    unsigned int deduplicatedUploads() const
+    {
+        return deduplicated;
+    }
+
+    // Limits for every image loaded from now on, on top of each one's own
+    // (the tighter one wins).
+    void setTextureLimits(const TextureLimits &limits)
+    {
+        loaderLimits = limits;
+    }
+
+    const TextureLimits &textureLimits() const
+    {
+        return loaderLimits;
+    }
+
+    // Keep downscaled images as .ltex files in `directory` (created if needed),
+    // named after the source file's path, size and modification time and the
+    // options and limits they were loaded with. Empty, the default, turns it off.
+    void setDownscaleCache(const std::string &directory);
+
+    // Images that were shrunk to their limits, counting those read from the cache.
+    unsigned int downscaledImages() const
+    {
+        return downscaled;
+    }
+
+    // Estimated size of a texture in video memory (see textureImageBytes).
+    static std::size_t textureBytes(GLenum internalFormat, int width, int height, bool mipmaps);
+
+    void destroy();
+};
@@ -0,0 +1,383 @@
+#include "texture_streamer.hpp"
+#include "block_compression.hpp"
+#include "gl_state.hpp"
+#include "gpu_memory.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <iterator>
+#include <limits>
+
+namespace
+{
+    // First level with both sides at most TAIL_SIZE; the last one if there is none.
+    int tailLevel(const BakedTexture &baked)
+    {
+        const BakedTextureHeader &info = baked.info();
+        for (unsigned int level = 0; level < info.levels; level++)
+        {
+            const BakedLevel &data = baked.level(level);
+            if ((int)data.width <= TextureStreamer::TAIL_SIZE && (int)data.height <= TextureStreamer::TAIL_SIZE)
+                return (int)level;
+        }
+        return (int)info.levels - 1;
+    }
+}
+
+TextureStreamer::TextureStreamer(SamplerCache &samplers, std::size_t budgetBytes, std::chrono::microseconds uploadBudget, unsigned int threadCount)
+    : samplers(samplers), budgetBytes(budgetBytes), uploadBudget(uploadBudget), s3tc(GLAD_GL_EXT_texture_compression_s3tc),
+      workers(std::make_unique<ThreadPool>(threadCount))
+{
+}
+
+bool TextureStreamer::needsUnpack(const BakedTexture &baked) const
+{
+    BlockFormat format;
+    return baked.compressed() && !s3tc && blockFormatFromGLEnum(baked.info().internalFormat, format) &&
+           (format == BlockFormat::BC1 || format == BlockFormat::BC3);
+}
+
+int wantedStreamingLevel(float texels, float screenSize, int tail)
+{
+    if (screenSize <= 0.0f)
+        return tail;
+
+    // Level n is 2^n times smaller than level 0; the first one no larger than
+    // the screen still has a texel per pixel.
+    int level = (int)std::floor(std::log2(texels / screenSize));
+    return std::clamp(level, 0, tail);
+}
+
+void fitStreamingBudget(StreamingTarget *targets, std::size_t count, std::size_t budgetBytes)
+{
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < count; i++)
+    {
+        for (int level = targets[i].target; level < targets[i].levels; level++)
+            total += targets[i].levelBytes[level];
+    }
+
+    while (total > budgetBytes)
+    {
+        StreamingTarget *largest = nullptr;
+        std::size_t largestBytes = 0;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            if (targets[i].target >= targets[i].tail)
+                continue;
+            std::size_t bytes = targets[i].levelBytes[targets[i].target];
+            if (bytes > largestBytes)
+            {
+                largest = &targets[i];
+                largestBytes = bytes;
+            }
+        }
+        if (largest == nullptr)
+            break; // only tails are left
+        largest->target++;
+        total -= largestBytes;
+    }
+}
+
+StreamedTexture TextureStreamer::add(const char *path, const SamplerState &sampler)
+{
+    StreamedTexture texture;
+    Entry entry{path, samplers.get(sampler), nullptr, 0, 0, 0, 0, 0, 0.0f, {}, 0, false, false, false, false};
+    if (!freeEntries.empty())
+    {
+        texture.index = freeEntries.back();
+        freeEntries.pop_back();
+        entries[texture.index] = std::move(entry);
+    }
+    else
+    {
+        texture.index = (unsigned int)entries.size();
+        entries.push_back(std::move(entry));
+    }
+
+    request(texture.index, -1, -1);
+    return texture;
+}
+
+void TextureStreamer::remove(StreamedTexture texture)
+{
+    Entry &entry = entries[texture.index];
+    if (entry.busy)
+        entry.removed = true;
+    else
+        freeEntry(texture.index);
+}
+
+void TextureStreamer::freeEntry(unsigned int index)
+{
+    Entry &entry = entries[index];
+    if (entry.name != 0)
+        glState().deleteTextures(1, &entry.name);
+    bytesResident -= entry.bytes;
+
+    entries[index] = Entry{};
+    entries[index].failed = true;
+    freeEntries.push_back(index);
+}
+
+void TextureStreamer::setScreenSize(StreamedTexture texture, float pixels)
+{
+    entries[texture.index].screenSize = pixels;
+}
+
+void TextureStreamer::request(unsigned int index, int first, int last)
+{
+    Entry &entry = entries[index];
+    entry.busy = true;
+
+    workers->submit([this, index, first, last, path = entry.path, baked = entry.baked]() mutable
+                    {
+        Streamed job{index, first, last, nullptr, {}};
+
+        if (baked == nullptr)
+        {
+            baked = std::make_shared<BakedTexture>();
+            BlockFormat format;
+            if (!baked->open(path))
+            {
+                job.first = -1;
+            }
+            else if (baked->compressed() && !blockFormatFromGLEnum(baked->info().internalFormat, format))
+            {
+                std::cerr << "ERROR::TEXTURE_STREAMER::UNKNOWN_COMPRESSED_FORMAT " << path << std::endl;
+                job.first = -1;
+            }
+            else
+            {
+                job.first = tailLevel(*baked);
+                job.last = (int)baked->info().levels - 1;
+                job.baked = baked;
+            }
+        }
+
+        // Fault the pages in here, so the upload doesn't wait for the disk.
+        for (int level = job.first; job.first >= 0 && level <= job.last; level++)
+        {
+            if (!needsUnpack(*baked))
+            {
+                baked->touch((unsigned int)level);
+                continue;
+            }
+
+            BlockFormat format;
+            blockFormatFromGLEnum(baked->info().internalFormat, format);
+            const BakedLevel &data = baked->level((unsigned int)level);
+            std::vector<unsigned char> &pixels = job.unpacked.emplace_back((std::size_t)data.width * data.height * 4);
+            decompressImage(baked->levelData((unsigned int)level), (int)data.width, (int)data.height, format, pixels.data());
+        }
+
+        std::lock_guard<std::mutex> lock(streamedMutex);
+        streamed.push_back(std::move(job)); });
+}
+
+void TextureStreamer::upload(const Streamed &job)
+{
+    Entry &entry = entries[job.index];
+    entry.busy = false;
+
+    if (entry.removed)
+    {
+        freeEntry(job.index);
+        return;
+    }
+    if (job.first < 0)
+    {
+        // The worker printed why.
+        entry.failed = true;
+        return;
+    }
+
+    // * 1. First arrival: create the texture for the tail
+    if (job.baked != nullptr)
+    {
+        const BakedTextureHeader &info = job.baked->info();
+        entry.baked = job.baked;
+        entry.levels = (int)info.levels;
+        entry.tail = job.first;
+        entry.resident = entry.levels;
+        entry.target = entry.tail;
+        entry.unpack = needsUnpack(*entry.baked);
+        for (int level = 0; level < entry.levels; level++)
+        {
+            const BakedLevel &data = entry.baked->level((unsigned int)level);
+            entry.levelBytes.push_back(entry.unpack ? (std::size_t)data.width * data.height * 4 : (std::size_t)data.size);
+        }
+
+        glGenTextures(1, &entry.name);
+        glState().bindTexture(GL_TEXTURE_2D, entry.name);
+        gpuMemory().label(GL_TEXTURE, entry.name, entry.path);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, entry.levels - 1);
+        if (info.channels <= 2)
+        {
+            GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, info.channels == 2 ? GL_GREEN : GL_ONE};
+            glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+        }
+    }
+
+    // A level is only worth uploading if it extends the resident range and is
+    // still wanted; the plan may have changed while it was read.
+    if (job.last != entry.resident - 1 || job.first < entry.target)
+        return;
+
+    // * 2. Upload, coarse to fine, straight from the mapping
+    const BakedTexture &baked = *entry.baked;
+    const BakedTextureHeader &info = baked.info();
+    glState().bindTexture(GL_TEXTURE_2D, entry.name);
+    glState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int level = job.last; level >= job.first; level--)
+    {
+        const BakedLevel &data = baked.level((unsigned int)level);
+        if (entry.unpack)
+        {
+            gpuMemory().texImage2D(entry.name, GL_TEXTURE_2D, level, GL_RGBA8, (int)data.width, (int)data.height, GL_RGBA,
+                                   GL_UNSIGNED_BYTE, job.unpacked[(std::size_t)(level - job.first)].data());
+        }
+        else if (baked.compressed())
+        {
+            gpuMemory().compressedTexImage2D(entry.name, GL_TEXTURE_2D, level, info.internalFormat, (int)data.width, (int)data.height,
+                                             (GLsizei)data.size, baked.levelData((unsigned int)level));
+        }
+        else
+        {
+            gpuMemory().texImage2D(entry.name, GL_TEXTURE_2D, level, info.internalFormat, (int)data.width, (int)data.height,
+                                   info.format, info.type, baked.levelData((unsigned int)level));
+        }
+        entry.bytes += entry.levelBytes[level];
+        bytesResident += entry.levelBytes[level];
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // * 3. Let the sampler see them
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, job.first);
+    entry.resident = job.first;
+    counters.levelsStreamed += (unsigned int)(job.last - job.first + 1);
+}
+
+void TextureStreamer::drop(Entry &entry, int level)
+{
+    // Move the base first, so the texture stays complete: levels outside
+    // BASE_LEVEL..MAX_LEVEL don't count, and a 0x0 image frees the level.
+    glState().bindTexture(GL_TEXTURE_2D, entry.name);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+    GLenum internalFormat = entry.unpack ? GL_RGBA8 : entry.baked->info().internalFormat;
+    for (int finer = entry.resident; finer < level; finer++)
+    {
+        if (entry.baked->compressed() && !entry.unpack)
+            gpuMemory().compressedTexImage2D(entry.name, GL_TEXTURE_2D, finer, internalFormat, 0, 0, 0, nullptr);
+        else
+            gpuMemory().texImage2D(entry.name, GL_TEXTURE_2D, finer, internalFormat, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        entry.bytes -= entry.levelBytes[finer];
+        bytesResident -= entry.levelBytes[finer];
+        counters.levelsDropped++;
+    }
+    entry.resident = level;
+}
+
+void TextureStreamer::plan()
+{
+    // * 1. The level each texture's screen size asks for
+    planned.clear();
+    for (Entry &entry : entries)
+    {
+        if (entry.baked == nullptr || entry.failed || entry.removed)
+            continue;
+        const BakedTextureHeader &info = entry.baked->info();
+        float texels = (float)std::max(info.width, info.height);
+        planned.push_back({entry.levelBytes.data(), entry.levels, entry.tail, wantedStreamingLevel(texels, entry.screenSize, entry.tail)});
+    }
+
+    // * 2. Over budget: give up the finest level that frees the most, until it fits
+    fitStreamingBudget(planned.data(), planned.size(), budgetBytes);
+
+    std::size_t next = 0;
+    for (Entry &entry : entries)
+    {
+        if (entry.baked == nullptr || entry.failed || entry.removed)
+            continue;
+        entry.target = planned[next++].target;
+    }
+}
+
+void TextureStreamer::update()
+{
+    plan();
+
+    // * 1. Drop first, so there is room for what streams in
+    for (Entry &entry : entries)
+        if (entry.name != 0 && entry.resident < entry.target)
+            drop(entry, entry.target);
+
+    // * 2. Upload what the workers have read, within the time budget
+    {
+        std::lock_guard<std::mutex> lock(streamedMutex);
+        uploads.insert(uploads.end(), std::make_move_iterator(streamed.begin()), std::make_move_iterator(streamed.end()));
+        streamed.clear();
+    }
+
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point start = Clock::now();
+    for (unsigned int uploaded = 0; !uploads.empty(); uploaded++)
+    {
+        if (uploaded > 0 && Clock::now() - start >= uploadBudget)
+            break;
+        upload(uploads.front());
+        uploads.pop_front();
+    }
+
+    // * 3. Read the next finer level of every texture that wants one
+    for (unsigned int index = 0; index < entries.size(); index++)
+    {
+        Entry &entry = entries[index];
+        if (entry.name != 0 && !entry.busy && entry.target < entry.resident)
+            request(index, entry.resident - 1, entry.resident - 1);
+    }
+}
+
+void TextureStreamer::bind(unsigned int unit, StreamedTexture texture) const
+{
+    const Entry *entry = texture.valid() ? &entries[texture.index] : nullptr;
+    glState().bindTextureUnit(unit, GL_TEXTURE_2D, entry != nullptr ? entry->name : 0);
+    glState().bindSampler(unit, entry != nullptr ? entry->sampler : 0);
+}
+
+int TextureStreamer::residentLevel(StreamedTexture texture) const
+{
+    const Entry &entry = entries[texture.index];
+    return entry.name != 0 && entry.resident < entry.levels ? entry.resident : -1;
+}
+
+void TextureStreamer::destroy()
+{
+    for (Entry &entry : entries)
+    {
+        if (entry.name != 0)
+            glState().deleteTextures(1, &entry.name);
+        entry.name = 0;
+        entry.bytes = 0;
+    }
+    bytesResident = 0;
+}
+
+float screenExtent(const glm::mat4 &clipFromObject, glm::vec2 min, glm::vec2 max, int viewportWidth, int viewportHeight)
+{
+    const glm::vec2 corners[4] = {min, {max.x, min.y}, {min.x, max.y}, max};
+    glm::vec2 low(std::numeric_limits<float>::max());
+    glm::vec2 high(-std::numeric_limits<float>::max());
+    for (const glm::vec2 &corner : corners)
+    {
+        glm::vec4 clip = clipFromObject * glm::vec4(corner, 0.0f, 1.0f);
+        if (clip.w <= 1e-4f)
+            return std::numeric_limits<float>::max();
+        glm::vec2 pixels = glm::vec2(clip) / clip.w * 0.5f * glm::vec2((float)viewportWidth, (float)viewportHeight);
+        low = glm::min(low, pixels);
+        high = glm::max(high, pixels);
+    }
+    return std::max(high.x - low.x, high.y - low.y);
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "baked_texture.hpp"
+#include "sampler_cache.hpp"
+#include "thread_pool.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Handle to a texture of a TextureStreamer. Cheap to copy.
+struct StreamedTexture
+{
+    static constexpr unsigned int INVALID = 0xFFFFFFFF;
+    unsigned int index = INVALID;
+
+    bool valid() const
+    {
+        return index != INVALID;
+    }
+};
+
+// The budget planning of TextureStreamer::update(), apart from GL.
+//
+// The level of a texture with `texels` on its larger side whose size matches
+// `screenSize` pixels, so it still has a texel per pixel, but never coarser
+// than `tail`. A screen size of 0 (not drawn) asks for the tail.
+int wantedStreamingLevel(float texels, float screenSize, int tail);
+
+// One texture as the planning sees it.
+struct StreamingTarget
+{
+    const std::size_t *levelBytes; // `levels` of them
+    int levels;
+    int tail;
+    int target; // the wanted level on the way in, the one that fits on the way out
+};
+
+// While the levels from each target on add up to more than budgetBytes, give
+// up the finest target level that frees the most. Tails always stay.
+void fitStreamingBudget(StreamingTarget *targets, std::size_t count, std::size_t budgetBytes);
+
+// Keeps only the mip levels of baked textures (.ltex) that are worth their
+// memory resident, within a video memory budget.
+//
+// A texture starts with its tail: the levels of at most TAIL_SIZE texels,
+// which stay resident until it is removed. Each frame the application reports
+// how large each texture appears on screen; update() turns that into the
+// finest level worth having, and if all of them together would exceed the
+// budget, gives up detail where that frees the most memory. Finer levels are
+// then read from the mapping on a worker thread, one level at a time, and
+// uploaded within a per-frame time budget. Levels that are no longer wanted
+// are dropped right away.
+//
+// GL_TEXTURE_BASE_LEVEL always points at the finest resident level, so the
+// sampler never reads a missing one. Streamed textures can't use immutable
+// storage, since that would keep every level allocated.
+class TextureStreamer
+{
+public:
+    static constexpr int TAIL_SIZE = 64;
+
+    struct Stats
+    {
+        unsigned int levelsStreamed = 0;
+        unsigned int levelsDropped = 0;
+    };
+
+private:
+    struct Entry
+    {
+        std::string path;
+        unsigned int sampler;
+        std::shared_ptr<BakedTexture> baked; // nullptr until opened
+        unsigned int name;
+        int levels;
+        int tail;     // first level of the tail
+        int resident; // finest resident level; `levels` while nothing is
+        int target;   // finest level wanted within the budget
+        float screenSize;
+        std::vector<std::size_t> levelBytes; // of each level in video memory, once opened
+        std::size_t bytes;
+        bool unpack;  // BC1/BC3 levels decompressed, for drivers without S3TC
+        bool busy;    // a worker has a job for it
+        bool removed; // while busy: free it when the job returns
+        bool failed;
+    };
+
+    // Handed from a worker to the GL thread: levels `first` to `last` can be uploaded.
+    struct Streamed
+    {
+        unsigned int index;
+        int first;
+        int last;
+        std::shared_ptr<BakedTexture> baked; // when the file was opened by this job
+        std::vector<std::vector<unsigned char>> unpacked; // first to last, if decompressed
+    };
+
+    std::vector<Entry> entries;
+    std::vector<unsigned int> freeEntries;
+    SamplerCache &samplers;
+    std::size_t budgetBytes;
+    std::size_t bytesResident = 0;
+    std::chrono::microseconds uploadBudget;
+    std::deque<Streamed> uploads;
+    std::vector<StreamingTarget> planned; // reused by plan() every frame
+    Stats counters;
+    bool s3tc;
+
+    // Shared with the workers
+    std::mutex streamedMutex;
+    std::vector<Streamed> streamed;
+
+    // Declared last so the workers are joined first.
+    std::unique_ptr<ThreadPool> workers;
+
+    // Blocks the GPU can't sample are decompressed on the worker.
+    bool needsUnpack(const BakedTexture &baked) const;
+    void plan();
+    // Have a worker read levels first to last; -1 opens the file and reads the tail.
+    void request(unsigned int index, int first, int last);
+    void upload(const Streamed &job);
+    void drop(Entry &entry, int level);
+    void freeEntry(unsigned int index);
+
+public:
+    // Needs a current GL context. The sampler objects come from `samplers`.
+    TextureStreamer(SamplerCache &samplers, std::size_t budgetBytes,
+                    std::chrono::microseconds uploadBudget = std::chrono::microseconds(1000), unsigned int threadCount = 1);
+
+    TextureStreamer(const TextureStreamer &) = delete;
+    TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+    // Start streaming a .ltex file. Binds no texture until its tail is uploaded.
+    StreamedTexture add(const char *path, const SamplerState &sampler = SamplerState());
+    // The handle (and any copy of it) must not be used afterwards.
+    void remove(StreamedTexture texture);
+
+    // How many pixels the texture spans on screen along its larger side, at
+    // the closest point it is drawn. Kept until set again; report 0 when the
+    // texture isn't drawn, so it shrinks back to its tail.
+    void setScreenSize(StreamedTexture texture, float pixels);
+
+    // Plan the resident levels, drop what is over, upload what has been read
+    // and queue the next reads. Call once per frame on the GL thread.
+    void update();
+
+    void bind(unsigned int unit, StreamedTexture texture) const;
+
+    // Finest resident level (0 is full size), or -1 while nothing is resident.
+    int residentLevel(StreamedTexture texture) const;
+
+    std::size_t residentBytes() const
+    {
+        return bytesResident;
+    }
+
+    std::size_t budget() const
+    {
+        return budgetBytes;
+    }
+
+    void setBudget(std::size_t bytes)
+    {
+        budgetBytes = bytes;
+    }
+
+    Stats stats() const
+    {
+        return counters;
+    }
+
+    void destroy();
+};
+
+// Screen extent in pixels of a rectangle [min, max] in the object's xy plane:
+// the larger side of the bounding box of its projected corners. Corners behind
+// the camera count as very close.
+float screenExtent(const glm::mat4 &clipFromObject, glm::vec2 min, glm::vec2 max, int viewportWidth, int viewportHeight);
@@ -0,0 +1,106 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+    if (threadCount == 0)
+    {
+        unsigned int cores = std::thread::hardware_concurrency();
+        threadCount = cores > 1 ? cores - 1 : 1;
+    }
+
+    for (unsigned int i = 0; i < threadCount; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    wake.notify_all();
+
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wake.notify_one();
+}
+
+void ThreadPool::parallelFor(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)> &body)
+{
+    if (count == 0)
+        return;
+    if (grain == 0)
+        grain = 1;
+
+    // Helpers that start after the last chunk was taken find nothing to do, so
+    // the state they share with the caller has to outlive this call.
+    struct Batch
+    {
+        std::atomic<std::size_t> next{0};
+        std::size_t remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+    auto batch = std::make_shared<Batch>();
+    std::size_t chunks = (count + grain - 1) / grain;
+    batch->remaining = chunks;
+
+    auto run = [batch, count, grain, &body]
+    {
+        std::size_t finished = 0;
+        for (std::size_t begin; (begin = batch->next.fetch_add(grain)) < count;)
+        {
+            body(begin, std::min(begin + grain, count));
+            finished++;
+        }
+        if (finished == 0)
+            return;
+
+        std::lock_guard<std::mutex> lock(batch->mutex);
+        batch->remaining -= finished;
+        if (batch->remaining == 0)
+            batch->done.notify_all();
+    };
+
+    // `body` is only referenced while chunks are left, and the caller waits for those.
+    std::size_t helpers = std::min<std::size_t>(workers.size(), chunks - 1);
+    for (std::size_t i = 0; i < helpers; i++)
+        submit(run);
+    run();
+
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->done.wait(lock, [&batch]
+                     { return batch->remaining == 0; });
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]
+                      { return stopping || !jobs.empty(); });
+            if (stopping)
+                return;
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
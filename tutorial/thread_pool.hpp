@@ -0,0 +1,44 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that run submitted jobs in FIFO order. Jobs must
+// not touch GL; hand results back to the GL thread instead.
+class ThreadPool
+{
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void workerLoop();
+
+public:
+    // 0 picks one thread per core, minus one for the GL thread.
+    explicit ThreadPool(unsigned int threadCount = 0);
+    // Jobs that haven't started yet are dropped.
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> job);
+
+    // Run body(begin, end) over [0, count) in chunks of `grain` on the workers
+    // and the calling thread, and return once every chunk has finished. The
+    // caller takes chunks too, so this is safe to call from inside a job.
+    void parallelFor(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)> &body);
+
+    unsigned int size() const
+    {
+        return (unsigned int)workers.size();
+    }
+};
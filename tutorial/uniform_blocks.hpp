@@ -0,0 +1,53 @@
+#pragma once
+
+#include "uniform_buffer.hpp"
+
+// Uniform blocks shared by every shader. Each struct mirrors a
+// "layout (std140) uniform <NAME> { ... };" declaration in GLSL.
+
+enum UniformBlockBinding : unsigned int
+{
+    FRAME_BLOCK_BINDING = 0,
+    CAMERA_BLOCK_BINDING = 1,
+};
+
+// Changes at most once per frame.
+struct alignas(16) FrameBlock
+{
+    float time;
+    float textureMix;
+};
+
+template <>
+struct UniformBlockTraits<FrameBlock>
+{
+    static constexpr const char *NAME = "Frame";
+    static constexpr unsigned int BINDING = FRAME_BLOCK_BINDING;
+    static constexpr std140::Member MEMBERS[] = {
+        STD140_MEMBER(FrameBlock, time),
+        STD140_MEMBER(FrameBlock, textureMix),
+    };
+};
+
+// Changes when the camera moves.
+struct alignas(16) CameraBlock
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+};
+
+template <>
+struct UniformBlockTraits<CameraBlock>
+{
+    static constexpr const char *NAME = "Camera";
+    static constexpr unsigned int BINDING = CAMERA_BLOCK_BINDING;
+    static constexpr std140::Member MEMBERS[] = {
+        STD140_MEMBER(CameraBlock, view),
+        STD140_MEMBER(CameraBlock, projection),
+    };
+};
+
+inline constexpr UniformBlockLayout UNIFORM_BLOCK_LAYOUTS[] = {
+    uniformBlockLayout<FrameBlock>(),
+    uniformBlockLayout<CameraBlock>(),
+};
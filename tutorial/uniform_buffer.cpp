@@ -0,0 +1,58 @@
+#include "uniform_buffer.hpp"
+#include "uniform_blocks.hpp"
+
+#include <iostream>
+#include <string>
+
+void bindUniformBlocks(unsigned int program)
+{
+    int blockCount = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+
+    char name[256];
+    for (int block = 0; block < blockCount; block++)
+    {
+        glGetActiveUniformBlockName(program, (GLuint)block, sizeof(name), NULL, name);
+
+        const UniformBlockLayout *layout = nullptr;
+        for (const UniformBlockLayout &candidate : UNIFORM_BLOCK_LAYOUTS)
+        {
+            if (std::string(candidate.name) == name)
+                layout = &candidate;
+        }
+
+        if (layout == nullptr)
+        {
+            std::cout << "ERROR::SHADER::UNKNOWN_UNIFORM_BLOCK " << name << std::endl;
+            continue;
+        }
+
+        glUniformBlockBinding(program, (GLuint)block, layout->binding);
+
+        // * Check the linked layout against the C++ struct
+        int dataSize = 0;
+        glGetActiveUniformBlockiv(program, (GLuint)block, GL_UNIFORM_BLOCK_DATA_SIZE, &dataSize);
+        if ((std::size_t)dataSize > layout->size)
+        {
+            std::cout << "ERROR::SHADER::UNIFORM_BLOCK_SIZE_MISMATCH " << name << " is " << dataSize
+                      << " bytes in GLSL but " << layout->size << " in C++" << std::endl;
+        }
+
+        for (std::size_t i = 0; i < layout->memberCount; i++)
+        {
+            const std140::Member &member = layout->members[i];
+            GLuint index = GL_INVALID_INDEX;
+            glGetUniformIndices(program, 1, &member.name, &index);
+            if (index == GL_INVALID_INDEX)
+                continue; // not declared by this shader
+
+            int offset = 0;
+            glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_OFFSET, &offset);
+            if ((std::size_t)offset != member.offset)
+            {
+                std::cout << "ERROR::SHADER::UNIFORM_BLOCK_LAYOUT_MISMATCH " << name << "." << member.name
+                          << " is at offset " << offset << " in GLSL but " << member.offset << " in C++" << std::endl;
+            }
+        }
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.hpp"
+#include "gpu_memory.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+
+// std140 layout rules for the types used in uniform blocks.
+namespace std140
+{
+    template <typename T>
+    struct Type;
+
+    // clang-format off
+    template <> struct Type<float>        { static constexpr std::size_t align = 4,  size = 4; };
+    template <> struct Type<int>          { static constexpr std::size_t align = 4,  size = 4; };
+    template <> struct Type<unsigned int> { static constexpr std::size_t align = 4,  size = 4; };
+    template <> struct Type<glm::vec2>    { static constexpr std::size_t align = 8,  size = 8; };
+    template <> struct Type<glm::vec3>    { static constexpr std::size_t align = 16, size = 12; };
+    template <> struct Type<glm::vec4>    { static constexpr std::size_t align = 16, size = 16; };
+    template <> struct Type<glm::mat4>    { static constexpr std::size_t align = 16, size = 64; };
+    // clang-format on
+
+    struct Member
+    {
+        const char *name;
+        std::size_t offset;
+        std::size_t align;
+        std::size_t size;
+    };
+
+    // True if the members sit exactly where std140 would put them, in declaration order.
+    template <std::size_t N>
+    constexpr bool valid(const Member (&members)[N])
+    {
+        std::size_t next = 0;
+        for (std::size_t i = 0; i < N; i++)
+        {
+            std::size_t expected = (next + members[i].align - 1) / members[i].align * members[i].align;
+            if (members[i].offset != expected)
+                return false;
+            next = expected + members[i].size;
+        }
+        return true;
+    }
+}
+
+#define STD140_MEMBER(Block, member)                                 \
+    std140::Member                                                   \
+    {                                                                \
+        #member, offsetof(Block, member),                            \
+            std140::Type<decltype(Block::member)>::align,            \
+            std140::Type<decltype(Block::member)>::size              \
+    }
+
+// Specialize for every block struct with NAME (the GLSL block name), BINDING
+// (the binding point every Shader uses for it) and MEMBERS (STD140_MEMBER list).
+template <typename T>
+struct UniformBlockTraits;
+
+// Type-erased description of a block, used to bind and verify linked programs.
+struct UniformBlockLayout
+{
+    const char *name;
+    unsigned int binding;
+    std::size_t size;
+    const std140::Member *members;
+    std::size_t memberCount;
+};
+
+template <typename T>
+constexpr UniformBlockLayout uniformBlockLayout()
+{
+    using Traits = UniformBlockTraits<T>;
+    static_assert(std140::valid(Traits::MEMBERS), "C++ struct does not match the std140 layout");
+    static_assert(sizeof(T) % 16 == 0, "std140 blocks must be padded to a multiple of 16 bytes");
+    return {Traits::NAME, Traits::BINDING, sizeof(T), Traits::MEMBERS, std::size(Traits::MEMBERS)};
+}
+
+// Binds every known block the program declares to its fixed binding point and
+// checks the offsets the driver reports against the C++ struct.
+void bindUniformBlocks(unsigned int program);
+
+// One buffer for a block struct, bound to the block's binding point. Fill data
+// and call upload() once per frame; it does nothing if data hasn't changed.
+template <typename T>
+class UniformBlock
+{
+private:
+    unsigned int UBO = 0;
+    T uploaded{};
+    bool hasUploaded = false;
+
+public:
+    T data{};
+
+    // Needs a current GL context.
+    UniformBlock()
+    {
+        glGenBuffers(1, &UBO);
+        glState().bindBuffer(GL_UNIFORM_BUFFER, UBO);
+        gpuMemory().bufferData(UBO, GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_DYNAMIC_DRAW);
+        glState().bindBufferBase(GL_UNIFORM_BUFFER, UniformBlockTraits<T>::BINDING, UBO);
+    }
+
+    void upload()
+    {
+        if (hasUploaded && std::memcmp(&uploaded, &data, sizeof(T)) == 0)
+            return;
+
+        glState().bindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+        uploaded = data;
+        hasUploaded = true;
+    }
+
+    void destroy()
+    {
+        glState().deleteBuffers(1, &UBO);
+    }
+};